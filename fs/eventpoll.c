@@ -1846,7 +1846,7 @@ static int ep_poll(struct eventpoll *ep, struct epoll_event __user *events,
 
 		if (!eavail)
 			timed_out = !schedule_hrtimeout_range(to, slack,
-							      HRTIMER_MODE_ABS);
+					HRTIMER_MODE_ABS | HRTIMER_MODE_ALIGN);
 		__set_current_state(TASK_RUNNING);
 
 		/*
@@ -240,7 +240,8 @@ static int poll_schedule_timeout(struct poll_wqueues *pwq, int state,
 
 	set_current_state(state);
 	if (!pwq->triggered)
-		rc = schedule_hrtimeout_range(expires, slack, HRTIMER_MODE_ABS);
+		rc = schedule_hrtimeout_range(expires, slack,
+					      HRTIMER_MODE_ABS | HRTIMER_MODE_ALIGN);
 	__set_current_state(TASK_RUNNING);
 
 	/*
@@ -122,6 +122,10 @@ struct bpf_map_ops {
 
 	/* Misc helpers.*/
 	int (*map_redirect)(struct bpf_map *map, u32 ifindex, u64 flags);
+	void (*map_info_fill)(const struct bpf_map *map,
+			      struct bpf_map_info *info);
+	void (*map_show_fdinfo)(const struct bpf_map *map,
+				struct seq_file *m);
 
 	/* map_meta_equal must be implemented for maps that can be
 	 * used as an inner map.  It is a runtime check to ensure
@@ -385,6 +385,11 @@ struct bpf_subprog_info {
 	bool has_tail_call;
 	bool tail_call_reachable;
 	bool has_ld_abs;
+	/* for global functions and the main program: the cost of verifying
+	 * them, including the static functions they call
+	 */
+	u32 insn_processed;
+	u64 verification_time;
 };
 
 /* single container for all structs
@@ -442,6 +447,12 @@ struct bpf_verifier_env {
 	u32 peak_states;
 	/* longest register parentage chain walked for liveness marking */
 	u32 longest_mark_read_walk;
+	/* number of explored states compared against the current one */
+	u32 states_compared;
+	/* number of times an equivalent explored state pruned the search */
+	u32 states_pruned;
+	/* number of explored states dropped for missing too often */
+	u32 states_evicted;
 };
 
 __printf(2, 0) void bpf_verifier_vlog(struct bpf_verifier_log *log,
@@ -23,6 +23,7 @@ struct console_font;
 struct module;
 struct tty_struct;
 struct notifier_block;
+struct task_struct;
 
 enum con_scroll {
 	SM_UP,
@@ -151,6 +152,10 @@ struct console {
 	int	cflag;
 	void	*data;
 	struct	 console *next;
+	u64	seq;		/* next printk record to write */
+	unsigned long dropped;	/* records lost since the last write */
+	unsigned long max_lag;	/* highest backlog seen, in records */
+	struct task_struct *thread;	/* printer kthread, if any */
 };
 
 /*
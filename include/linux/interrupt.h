@@ -109,6 +109,11 @@ typedef irqreturn_t (*irq_handler_t)(int, void *);
  * @secondary:	pointer to secondary irqaction (force threading)
  * @thread_flags:	flags related to @thread
  * @thread_mask:	bitmask for keeping track of @thread activity
+ * @thread_budget:	maximum number of consecutive runs of @thread_fn
+ *			while it returns IRQ_MORE_WORK
+ * @thread_wakeups:	number of times @thread was woken up
+ * @thread_runs:	number of invocations of @thread_fn
+ * @thread_exhausted:	number of wakeups which used up @thread_budget
  * @dir:	pointer to the proc/irq/NN/name entry
  */
 struct irqaction {
@@ -123,6 +128,10 @@ struct irqaction {
 	unsigned int		flags;
 	unsigned long		thread_flags;
 	unsigned long		thread_mask;
+	unsigned int		thread_budget;
+	unsigned long		thread_wakeups;
+	unsigned long		thread_runs;
+	unsigned long		thread_exhausted;
 	const char		*name;
 	struct proc_dir_entry	*dir;
 } ____cacheline_internodealigned_in_smp;
@@ -245,6 +254,8 @@ extern void enable_irq(unsigned int irq);
 extern void enable_percpu_irq(unsigned int irq, unsigned int type);
 extern bool irq_percpu_is_enabled(unsigned int irq);
 extern void irq_wake_thread(unsigned int irq, void *dev_id);
+extern int irq_set_thread_budget(unsigned int irq, void *dev_id,
+				 unsigned int budget);
 
 extern void disable_nmi_nosync(unsigned int irq);
 extern void disable_percpu_nmi(unsigned int irq);
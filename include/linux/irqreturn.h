@@ -7,11 +7,14 @@
  * @IRQ_NONE		interrupt was not from this device or was not handled
  * @IRQ_HANDLED		interrupt was handled by this device
  * @IRQ_WAKE_THREAD	handler requests to wake the handler thread
+ * @IRQ_MORE_WORK	threaded handler handled the interrupt and has more
+ *			work pending, see irq_set_thread_budget()
  */
 enum irqreturn {
 	IRQ_NONE		= (0 << 0),
 	IRQ_HANDLED		= (1 << 0),
 	IRQ_WAKE_THREAD		= (1 << 1),
+	IRQ_MORE_WORK		= (1 << 2),
 };
 
 typedef enum irqreturn irqreturn_t;
@@ -0,0 +1,34 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Lightweight lock contention profiling, see kernel/locking/lock_contention.c
+ */
+#ifndef __LINUX_LOCK_CONTENTION_H
+#define __LINUX_LOCK_CONTENTION_H
+
+struct raw_spinlock;
+
+#ifdef CONFIG_LOCK_CONTENTION_PROFILE
+#include <linux/jump_label.h>
+
+DECLARE_STATIC_KEY_FALSE(lock_contention_key);
+
+static __always_inline bool lock_contention_profiling(void)
+{
+	return static_branch_unlikely(&lock_contention_key);
+}
+
+extern void lock_contention_spin_lock(struct raw_spinlock *lock);
+extern void lock_contention_spin_lock_flags(struct raw_spinlock *lock,
+					    unsigned long *flags);
+#else
+static __always_inline bool lock_contention_profiling(void)
+{
+	return false;
+}
+
+static inline void lock_contention_spin_lock(struct raw_spinlock *lock) { }
+static inline void lock_contention_spin_lock_flags(struct raw_spinlock *lock,
+						   unsigned long *flags) { }
+#endif
+
+#endif /* __LINUX_LOCK_CONTENTION_H */
@@ -611,6 +611,7 @@ struct swevent_hlist {
 #define PERF_ATTACH_CHILD	0x40
 
 struct perf_cgroup;
+struct perf_cgroup_share;
 struct perf_buffer;
 
 struct pmu_event_list {
@@ -774,6 +775,7 @@ struct perf_event {
 
 #ifdef CONFIG_CGROUP_PERF
 	struct perf_cgroup		*cgrp; /* cgroup event is attach to */
+	struct perf_cgroup_share	*cgrp_share; /* cgroups counted on behalf of */
 #endif
 
 #ifdef CONFIG_SECURITY
@@ -1061,6 +1061,12 @@ struct task_struct {
 	struct held_lock		held_locks[MAX_LOCK_DEPTH];
 #endif
 
+#ifdef CONFIG_LOCK_CONTENTION_PROFILE
+	/* Start of the current sleeping lock wait, see lock_contention.c */
+	u64				lock_contention_start;
+	unsigned int			lock_contention_flags;
+#endif
+
 #if defined(CONFIG_UBSAN) && !defined(CONFIG_UBSAN_TRAP)
 	unsigned int			in_ubsan;
 #endif
@@ -57,6 +57,7 @@
 #include <linux/stringify.h>
 #include <linux/bottom_half.h>
 #include <linux/lockdep.h>
+#include <linux/lock_contention.h>
 #include <asm/barrier.h>
 #include <asm/mmiowb.h>
 
@@ -180,7 +181,10 @@ do {									\
 static inline void do_raw_spin_lock(raw_spinlock_t *lock) __acquires(lock)
 {
 	__acquire(lock);
-	arch_spin_lock(&lock->raw_lock);
+	if (lock_contention_profiling())
+		lock_contention_spin_lock(lock);
+	else
+		arch_spin_lock(&lock->raw_lock);
 	mmiowb_spin_lock();
 }
 
@@ -192,7 +196,10 @@ static inline void
 do_raw_spin_lock_flags(raw_spinlock_t *lock, unsigned long *flags) __acquires(lock)
 {
 	__acquire(lock);
-	arch_spin_lock_flags(&lock->raw_lock, *flags);
+	if (lock_contention_profiling())
+		lock_contention_spin_lock_flags(lock, flags);
+	else
+		arch_spin_lock_flags(&lock->raw_lock, *flags);
 	mmiowb_spin_lock();
 }
 
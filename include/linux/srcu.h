@@ -64,6 +64,21 @@ unsigned long get_state_synchronize_srcu(struct srcu_struct *ssp);
 unsigned long start_poll_synchronize_srcu(struct srcu_struct *ssp);
 bool poll_state_synchronize_srcu(struct srcu_struct *ssp, unsigned long cookie);
 
+#ifndef CONFIG_TREE_SRCU
+/* Tiny SRCU readers never execute memory barriers in the first place. */
+static inline void srcu_check_read_flavor_lite(struct srcu_struct *ssp) { }
+
+static inline int __srcu_read_lock_lite(struct srcu_struct *ssp)
+{
+	return __srcu_read_lock(ssp);
+}
+
+static inline void __srcu_read_unlock_lite(struct srcu_struct *ssp, int idx)
+{
+	__srcu_read_unlock(ssp, idx);
+}
+#endif /* #ifndef CONFIG_TREE_SRCU */
+
 #ifdef CONFIG_DEBUG_LOCK_ALLOC
 
 /**
@@ -191,6 +206,51 @@ srcu_read_unlock_notrace(struct srcu_struct *ssp, int idx) __releases(ssp)
 	__srcu_read_unlock(ssp, idx);
 }
 
+/**
+ * srcu_read_lock_lite - register a new reader without memory barriers
+ * @ssp: srcu_struct in which to register the new reader.
+ *
+ * Enter an SRCU read-side critical section, but without the full memory
+ * barriers executed by srcu_read_lock().  Instead, once any CPU has used
+ * srcu_read_lock_lite() on @ssp, its grace periods wait for an RCU grace
+ * period at each point where they would otherwise rely on the readers'
+ * barriers.  This makes readers nearly as cheap as rcu_read_lock() at the
+ * price of slower SRCU grace periods, which suits read-mostly users.
+ *
+ * Because RCU grace periods ignore idle and offline CPUs, this must not
+ * be used where RCU is not watching, for example from the idle loop, from
+ * CPU-hotplug paths that run on offline CPUs, or from noinstr entry code.
+ * Each srcu_read_lock_lite() must be paired with srcu_read_unlock_lite(),
+ * but use of srcu_read_lock() and srcu_read_lock_lite() may be mixed on
+ * the same srcu_struct.
+ */
+static inline int srcu_read_lock_lite(struct srcu_struct *ssp) __acquires(ssp)
+{
+	int retval;
+
+	srcu_check_read_flavor_lite(ssp);
+	retval = __srcu_read_lock_lite(ssp);
+	rcu_lock_acquire(&(ssp)->dep_map);
+	return retval;
+}
+
+/**
+ * srcu_read_unlock_lite - unregister a reader registered without barriers
+ * @ssp: srcu_struct in which to unregister the old reader.
+ * @idx: return value from corresponding srcu_read_lock_lite().
+ *
+ * Exit an SRCU read-side critical section entered by srcu_read_lock_lite().
+ * Unlike srcu_read_unlock(), this does not imply a full memory barrier,
+ * so smp_mb__after_srcu_read_unlock() does not apply.
+ */
+static inline void srcu_read_unlock_lite(struct srcu_struct *ssp, int idx)
+	__releases(ssp)
+{
+	WARN_ON_ONCE(idx & ~0x1);
+	rcu_lock_release(&(ssp)->dep_map);
+	__srcu_read_unlock_lite(ssp, idx);
+}
+
 /**
  * smp_mb__after_srcu_read_unlock - ensure full ordering after srcu_read_unlock
  *
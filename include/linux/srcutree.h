@@ -25,6 +25,7 @@ struct srcu_data {
 	/* Read-side state. */
 	unsigned long srcu_lock_count[2];	/* Locks per CPU. */
 	unsigned long srcu_unlock_count[2];	/* Unlocks per CPU. */
+	int srcu_reader_flavor;			/* Reader types used. */
 
 	/* Update-side state. */
 	spinlock_t __private lock ____cacheline_internodealigned_in_smp;
@@ -138,4 +139,55 @@ void synchronize_srcu_expedited(struct srcu_struct *ssp);
 void srcu_barrier(struct srcu_struct *ssp);
 void srcu_torture_stats_print(struct srcu_struct *ssp, char *tt, char *tf);
 
+/* Values for ->srcu_reader_flavor. */
+#define SRCU_READ_FLAVOR_LITE	0x1	/* srcu_read_lock_lite(). */
+
+void __srcu_check_read_flavor(struct srcu_struct *ssp, int read_flavor);
+
+/*
+ * Record that this CPU has used srcu_read_lock_lite() on this srcu_struct,
+ * so that grace periods know to wait for an RCU grace period in place of
+ * the memory barriers that those readers omit.  Only the first use on a
+ * given CPU takes the out-of-line full-barrier path.
+ */
+static inline void srcu_check_read_flavor_lite(struct srcu_struct *ssp)
+{
+	struct srcu_data *sdp = raw_cpu_ptr(ssp->sda);
+
+	if (likely(READ_ONCE(sdp->srcu_reader_flavor) & SRCU_READ_FLAVOR_LITE))
+		return;
+	__srcu_check_read_flavor(ssp, SRCU_READ_FLAVOR_LITE);
+}
+
+/*
+ * Counts the new reader in the appropriate per-CPU element of the
+ * srcu_struct, but in an smp_mb()-free manner.  The synchronize_rcu()
+ * in the grace-period code stands in for the missing memory barriers,
+ * which requires that RCU be watching this CPU.  Returns an index that
+ * must be passed to the matching __srcu_read_unlock_lite().
+ */
+static inline int __srcu_read_lock_lite(struct srcu_struct *ssp)
+{
+	int idx;
+
+	RCU_LOCKDEP_WARN(!rcu_is_watching(), "RCU must be watching srcu_read_lock_lite().");
+	idx = READ_ONCE(ssp->srcu_idx) & 0x1;
+	this_cpu_inc(ssp->sda->srcu_lock_count[idx]); /* Y */
+	barrier(); /* Avoid leaking the critical section. */
+	return idx;
+}
+
+/*
+ * Removes the count for the old reader from the appropriate per-CPU
+ * element of the srcu_struct, again without memory barriers.  As with
+ * __srcu_read_unlock(), this may be a different CPU than the one whose
+ * counter was incremented by the corresponding __srcu_read_lock_lite().
+ */
+static inline void __srcu_read_unlock_lite(struct srcu_struct *ssp, int idx)
+{
+	barrier();  /* Avoid leaking the critical section. */
+	this_cpu_inc(ssp->sda->srcu_unlock_count[idx]);  /* Z */
+	RCU_LOCKDEP_WARN(!rcu_is_watching(), "RCU must be watching srcu_read_unlock_lite().");
+}
+
 #endif
@@ -409,7 +409,8 @@ struct perf_event_attr {
 				inherit_thread :  1, /* children only inherit if cloned with CLONE_THREAD */
 				remove_on_exec :  1, /* event is removed from task on exec */
 				sigtrap        :  1, /* send synchronous SIGTRAP on event */
-				__reserved_1   : 26;
+				compact_callchain :  1, /* dedup callchains, see PERF_RECORD_CALLCHAIN */
+				__reserved_1   : 25;
 
 	union {
 		__u32		wakeup_events;	  /* wakeup every n events */
@@ -490,6 +491,34 @@ struct perf_event_query_bpf {
 	__u32	ids[0];
 };
 
+/*
+ * Structure used by below PERF_EVENT_IOC_ATTACH_CGROUP command to
+ * count a per-cpu event on behalf of a set of cgroups. The counter
+ * stays programmed across cgroup switches; its value is read at each
+ * switch and attributed to the outgoing cgroup and its ancestors.
+ */
+struct perf_event_attach_cgroup {
+	/*
+	 * The below ids array length
+	 */
+	__u32	nr;
+	__u32	reserved;
+	/*
+	 * Cgroup ids, as reported by PERF_SAMPLE_CGROUP
+	 */
+	__u64	ids[0];
+};
+
+/*
+ * Structure used by below PERF_EVENT_IOC_READ_CGROUP command
+ * to read the share of an event attributed to one cgroup.
+ */
+struct perf_event_cgroup_read {
+	__u64	id;		/* cgroup id, set by the user */
+	__u64	count;		/* event count while the cgroup ran */
+	__u64	time;		/* time the cgroup ran, in ns */
+};
+
 /*
  * Ioctls that can be done on a perf event fd:
  */
@@ -505,6 +534,8 @@ struct perf_event_query_bpf {
 #define PERF_EVENT_IOC_PAUSE_OUTPUT		_IOW('$', 9, __u32)
 #define PERF_EVENT_IOC_QUERY_BPF		_IOWR('$', 10, struct perf_event_query_bpf *)
 #define PERF_EVENT_IOC_MODIFY_ATTRIBUTES	_IOW('$', 11, struct perf_event_attr *)
+#define PERF_EVENT_IOC_ATTACH_CGROUP		_IOW('$', 12, struct perf_event_attach_cgroup *)
+#define PERF_EVENT_IOC_READ_CGROUP		_IOWR('$', 13, struct perf_event_cgroup_read *)
 
 enum perf_event_ioc_flags {
 	PERF_IOC_FLAG_GROUP		= 1U << 0,
@@ -1141,6 +1172,24 @@ enum perf_event_type {
 	 */
 	PERF_RECORD_TEXT_POKE			= 20,
 
+	/*
+	 * Defines a callchain for events with attr.compact_callchain set.
+	 * Samples of such events whose callchain matches a recently emitted
+	 * definition carry the callchain { 2, PERF_CONTEXT_CALLCHAIN_ID,
+	 * chain_id } instead of the full list of ips. The definition is
+	 * always written to the buffer before the first sample referring
+	 * to it and carries the sample_id of that sample.
+	 *
+	 * struct {
+	 *	struct perf_event_header	header;
+	 *	u64				chain_id;
+	 *	u64				nr;
+	 *	u64				ips[nr];
+	 *	struct sample_id		sample_id;
+	 * };
+	 */
+	PERF_RECORD_CALLCHAIN			= 21,
+
 	PERF_RECORD_MAX,			/* non-ABI */
 };
 
@@ -1176,6 +1225,8 @@ enum perf_callchain_context {
 	PERF_CONTEXT_GUEST_KERNEL	= (__u64)-2176,
 	PERF_CONTEXT_GUEST_USER		= (__u64)-2560,
 
+	PERF_CONTEXT_CALLCHAIN_ID	= (__u64)-3072,
+
 	PERF_CONTEXT_MAX		= (__u64)-4095,
 };
 
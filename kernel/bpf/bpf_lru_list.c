@@ -13,6 +13,8 @@
 #define PERCPU_FREE_TARGET		(4)
 #define PERCPU_NR_SCANS			PERCPU_FREE_TARGET
 
+#define CLOCK_NR_SCANS			(64)
+
 /* Helpers to get the local list index */
 #define LOCAL_LIST_IDX(t)	((t) - BPF_LOCAL_LIST_T_OFFSET)
 #define LOCAL_FREE_LIST_IDX	LOCAL_LIST_IDX(BPF_LRU_LOCAL_LIST_T_FREE)
@@ -44,6 +46,16 @@ static bool bpf_lru_node_is_ref(const struct bpf_lru_node *node)
 	return node->ref;
 }
 
+/* Remove the node from the htab so that it can be reused */
+static bool bpf_lru_evict(struct bpf_lru *lru, struct bpf_lru_node *node)
+{
+	if (!lru->del_from_htab(lru->del_arg, node))
+		return false;
+
+	this_cpu_inc(*lru->nr_evictions);
+	return true;
+}
+
 static void bpf_lru_list_count_inc(struct bpf_lru_list *l,
 				   enum bpf_lru_list_type type)
 {
@@ -217,7 +229,7 @@ __bpf_lru_list_shrink_inactive(struct bpf_lru *lru,
 	list_for_each_entry_safe_reverse(node, tmp_node, inactive, list) {
 		if (bpf_lru_node_is_ref(node)) {
 			__bpf_lru_node_move(l, node, BPF_LRU_LIST_T_ACTIVE);
-		} else if (lru->del_from_htab(lru->del_arg, node)) {
+		} else if (bpf_lru_evict(lru, node)) {
 			__bpf_lru_node_move_to_free(l, node, free_list,
 						    tgt_free_type);
 			if (++nshrinked == tgt_nshrink)
@@ -276,7 +288,7 @@ static unsigned int __bpf_lru_list_shrink(struct bpf_lru *lru,
 
 	list_for_each_entry_safe_reverse(node, tmp_node, force_shrink_list,
 					 list) {
-		if (lru->del_from_htab(lru->del_arg, node)) {
+		if (bpf_lru_evict(lru, node)) {
 			__bpf_lru_node_move_to_free(l, node, free_list,
 						    tgt_free_type);
 			return 1;
@@ -382,7 +394,7 @@ __local_list_pop_pending(struct bpf_lru *lru, struct bpf_lru_locallist *loc_l)
 	list_for_each_entry_reverse(node, local_pending_list(loc_l),
 				    list) {
 		if ((!bpf_lru_node_is_ref(node) || force) &&
-		    lru->del_from_htab(lru->del_arg, node)) {
+		    bpf_lru_evict(lru, node)) {
 			list_del(&node->list);
 			return node;
 		}
@@ -491,9 +503,78 @@ static struct bpf_lru_node *bpf_common_lru_pop_free(struct bpf_lru *lru,
 	return node;
 }
 
+static struct bpf_lru_node *bpf_clock_lru_node(struct bpf_clock_lru *clru,
+					       u32 idx)
+{
+	return clru->elems + (u64)idx * clru->elem_size + clru->node_offset;
+}
+
+/* Advance this CPU's clock hand until a node can be evicted:
+ * 1. Free nodes are skipped, they are reachable through the free list.
+ * 2. If the node has the ref bit set, the ref bit is cleared and
+ *    the node gets one more round to be looked up again.
+ * 3. Otherwise the node is removed from the htab.
+ *
+ * After nr_scans nodes the ref bit is ignored, so the cost of an
+ * eviction is bounded even when every element is hot.
+ */
+static struct bpf_lru_node *bpf_clock_lru_sweep(struct bpf_lru *lru)
+{
+	struct bpf_clock_lru *clru = &lru->clock_lru;
+	struct bpf_lru_node *node = NULL;
+	u32 *hand = raw_cpu_ptr(clru->hand);
+	u32 idx = *hand;
+	u32 i;
+
+	for (i = 0; i < lru->nr_scans + clru->nr_elems; i++) {
+		node = bpf_clock_lru_node(clru, idx);
+		if (++idx == clru->nr_elems)
+			idx = 0;
+
+		if (READ_ONCE(node->type) == BPF_LRU_LIST_T_FREE)
+			continue;
+
+		if (i < lru->nr_scans && bpf_lru_node_is_ref(node)) {
+			WRITE_ONCE(node->ref, 0);
+			continue;
+		}
+
+		if (bpf_lru_evict(lru, node))
+			break;
+	}
+
+	*hand = idx;
+
+	return i < lru->nr_scans + clru->nr_elems ? node : NULL;
+}
+
+static struct bpf_lru_node *bpf_clock_lru_pop_free(struct bpf_lru *lru,
+						   u32 hash)
+{
+	struct pcpu_freelist_node *f;
+	struct bpf_lru_node *node;
+
+	f = pcpu_freelist_pop(&lru->clock_lru.freelist);
+	if (f)
+		node = container_of(f, struct bpf_lru_node, fnode);
+	else
+		node = bpf_clock_lru_sweep(lru);
+
+	if (node) {
+		*(u32 *)((void *)node + lru->hash_offset) = hash;
+		node->cpu = raw_smp_processor_id();
+		node->ref = 0;
+		WRITE_ONCE(node->type, BPF_LRU_LIST_T_ACTIVE);
+	}
+
+	return node;
+}
+
 struct bpf_lru_node *bpf_lru_pop_free(struct bpf_lru *lru, u32 hash)
 {
-	if (lru->percpu)
+	if (lru->clock)
+		return bpf_clock_lru_pop_free(lru, hash);
+	else if (lru->percpu)
 		return bpf_percpu_lru_pop_free(lru, hash);
 	else
 		return bpf_common_lru_pop_free(lru, hash);
@@ -548,9 +629,21 @@ static void bpf_percpu_lru_push_free(struct bpf_lru *lru,
 	raw_spin_unlock_irqrestore(&l->lock, flags);
 }
 
+static void bpf_clock_lru_push_free(struct bpf_lru *lru,
+				    struct bpf_lru_node *node)
+{
+	if (WARN_ON_ONCE(READ_ONCE(node->type) == BPF_LRU_LIST_T_FREE))
+		return;
+
+	WRITE_ONCE(node->type, BPF_LRU_LIST_T_FREE);
+	pcpu_freelist_push(&lru->clock_lru.freelist, &node->fnode);
+}
+
 void bpf_lru_push_free(struct bpf_lru *lru, struct bpf_lru_node *node)
 {
-	if (lru->percpu)
+	if (lru->clock)
+		bpf_clock_lru_push_free(lru, node);
+	else if (lru->percpu)
 		bpf_percpu_lru_push_free(lru, node);
 	else
 		bpf_common_lru_push_free(lru, node);
@@ -605,10 +698,47 @@ static void bpf_percpu_lru_populate(struct bpf_lru *lru, void *buf,
 	}
 }
 
+static void bpf_clock_lru_populate(struct bpf_lru *lru, void *buf,
+				   u32 node_offset, u32 elem_size,
+				   u32 nr_elems)
+{
+	struct bpf_clock_lru *clru = &lru->clock_lru;
+	u32 i, pcpu_entries;
+	int cpu;
+
+	clru->elems = buf;
+	clru->node_offset = node_offset;
+	clru->elem_size = elem_size;
+	clru->nr_elems = nr_elems;
+
+	for (i = 0; i < nr_elems; i++) {
+		struct bpf_lru_node *node = bpf_clock_lru_node(clru, i);
+
+		node->type = BPF_LRU_LIST_T_FREE;
+		node->ref = 0;
+	}
+
+	/* spread the hands so that CPUs start sweeping different nodes */
+	pcpu_entries = nr_elems / num_possible_cpus();
+	i = 0;
+	for_each_possible_cpu(cpu) {
+		*per_cpu_ptr(clru->hand, cpu) = i;
+		i += pcpu_entries;
+	}
+
+	pcpu_freelist_populate(&clru->freelist,
+			       buf + node_offset +
+			       offsetof(struct bpf_lru_node, fnode),
+			       elem_size, nr_elems);
+}
+
 void bpf_lru_populate(struct bpf_lru *lru, void *buf, u32 node_offset,
 		      u32 elem_size, u32 nr_elems)
 {
-	if (lru->percpu)
+	if (lru->clock)
+		bpf_clock_lru_populate(lru, buf, node_offset, elem_size,
+				       nr_elems);
+	else if (lru->percpu)
 		bpf_percpu_lru_populate(lru, buf, node_offset, elem_size,
 					nr_elems);
 	else
@@ -643,15 +773,32 @@ static void bpf_lru_list_init(struct bpf_lru_list *l)
 	raw_spin_lock_init(&l->lock);
 }
 
-int bpf_lru_init(struct bpf_lru *lru, bool percpu, u32 hash_offset,
+int bpf_lru_init(struct bpf_lru *lru, bool percpu, bool clock, u32 hash_offset,
 		 del_from_htab_func del_from_htab, void *del_arg)
 {
-	int cpu;
+	int cpu, err;
 
-	if (percpu) {
+	lru->nr_evictions = alloc_percpu(u64);
+	if (!lru->nr_evictions)
+		return -ENOMEM;
+
+	if (clock) {
+		struct bpf_clock_lru *clru = &lru->clock_lru;
+
+		clru->hand = alloc_percpu(u32);
+		if (!clru->hand)
+			goto free_evictions;
+
+		err = pcpu_freelist_init(&clru->freelist);
+		if (err) {
+			free_percpu(clru->hand);
+			goto free_evictions;
+		}
+		lru->nr_scans = CLOCK_NR_SCANS;
+	} else if (percpu) {
 		lru->percpu_lru = alloc_percpu(struct bpf_lru_list);
 		if (!lru->percpu_lru)
-			return -ENOMEM;
+			goto free_evictions;
 
 		for_each_possible_cpu(cpu) {
 			struct bpf_lru_list *l;
@@ -665,7 +812,7 @@ int bpf_lru_init(struct bpf_lru *lru, bool percpu, u32 hash_offset,
 
 		clru->local_list = alloc_percpu(struct bpf_lru_locallist);
 		if (!clru->local_list)
-			return -ENOMEM;
+			goto free_evictions;
 
 		for_each_possible_cpu(cpu) {
 			struct bpf_lru_locallist *loc_l;
@@ -679,17 +826,38 @@ int bpf_lru_init(struct bpf_lru *lru, bool percpu, u32 hash_offset,
 	}
 
 	lru->percpu = percpu;
+	lru->clock = clock;
 	lru->del_from_htab = del_from_htab;
 	lru->del_arg = del_arg;
 	lru->hash_offset = hash_offset;
 
 	return 0;
+
+free_evictions:
+	free_percpu(lru->nr_evictions);
+	return -ENOMEM;
 }
 
 void bpf_lru_destroy(struct bpf_lru *lru)
 {
-	if (lru->percpu)
+	if (lru->clock) {
+		pcpu_freelist_destroy(&lru->clock_lru.freelist);
+		free_percpu(lru->clock_lru.hand);
+	} else if (lru->percpu) {
 		free_percpu(lru->percpu_lru);
-	else
+	} else {
 		free_percpu(lru->common_lru.local_list);
+	}
+	free_percpu(lru->nr_evictions);
+}
+
+u64 bpf_lru_evictions(const struct bpf_lru *lru)
+{
+	u64 sum = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		sum += *per_cpu_ptr(lru->nr_evictions, cpu);
+
+	return sum;
 }
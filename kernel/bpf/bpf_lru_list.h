@@ -6,6 +6,7 @@
 
 #include <linux/list.h>
 #include <linux/spinlock_types.h>
+#include "percpu_freelist.h"
 
 #define NR_BPF_LRU_LIST_T	(3)
 #define NR_BPF_LRU_LIST_COUNT	(2)
@@ -21,7 +22,11 @@ enum bpf_lru_list_type {
 };
 
 struct bpf_lru_node {
-	struct list_head list;
+	union {
+		struct list_head list;
+		/* free list linkage of a CLOCK LRU */
+		struct pcpu_freelist_node fnode;
+	};
 	u16 cpu;
 	u8 type;
 	u8 ref;
@@ -47,18 +52,31 @@ struct bpf_common_lru {
 	struct bpf_lru_locallist __percpu *local_list;
 };
 
+struct bpf_clock_lru {
+	struct pcpu_freelist freelist;
+	/* Each CPU sweeps the elements with its own clock hand */
+	u32 __percpu *hand;
+	void *elems;
+	u32 node_offset;
+	u32 elem_size;
+	u32 nr_elems;
+};
+
 typedef bool (*del_from_htab_func)(void *arg, struct bpf_lru_node *node);
 
 struct bpf_lru {
 	union {
 		struct bpf_common_lru common_lru;
 		struct bpf_lru_list __percpu *percpu_lru;
+		struct bpf_clock_lru clock_lru;
 	};
 	del_from_htab_func del_from_htab;
 	void *del_arg;
+	u64 __percpu *nr_evictions;
 	unsigned int hash_offset;
 	unsigned int nr_scans;
 	bool percpu;
+	bool clock;
 };
 
 static inline void bpf_lru_node_set_ref(struct bpf_lru_node *node)
@@ -70,7 +88,7 @@ static inline void bpf_lru_node_set_ref(struct bpf_lru_node *node)
 		node->ref = 1;
 }
 
-int bpf_lru_init(struct bpf_lru *lru, bool percpu, u32 hash_offset,
+int bpf_lru_init(struct bpf_lru *lru, bool percpu, bool clock, u32 hash_offset,
 		 del_from_htab_func del_from_htab, void *delete_arg);
 void bpf_lru_populate(struct bpf_lru *lru, void *buf, u32 node_offset,
 		      u32 elem_size, u32 nr_elems);
@@ -78,5 +96,6 @@ void bpf_lru_destroy(struct bpf_lru *lru);
 struct bpf_lru_node *bpf_lru_pop_free(struct bpf_lru *lru, u32 hash);
 void bpf_lru_push_free(struct bpf_lru *lru, struct bpf_lru_node *node);
 void bpf_lru_promote(struct bpf_lru *lru, struct bpf_lru_node *node);
+u64 bpf_lru_evictions(const struct bpf_lru *lru);
 
 #endif
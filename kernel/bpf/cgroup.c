@@ -8,7 +8,10 @@
 #include <linux/kernel.h>
 #include <linux/atomic.h>
 #include <linux/cgroup.h>
+#include <linux/debugfs.h>
 #include <linux/filter.h>
+#include <linux/sched/clock.h>
+#include <linux/seq_file.h>
 #include <linux/slab.h>
 #include <linux/sysctl.h>
 #include <linux/string.h>
@@ -22,6 +25,122 @@
 DEFINE_STATIC_KEY_ARRAY_FALSE(cgroup_bpf_enabled_key, MAX_BPF_ATTACH_TYPE);
 EXPORT_SYMBOL(cgroup_bpf_enabled_key);
 
+/* All programs in cgroup effective arrays are registered with a shared
+ * dispatcher, so running a multi-attach hook turns into a series of direct
+ * calls instead of one retpolined indirect call per program. Programs that
+ * do not fit into the dispatcher keep being called indirectly.
+ */
+DEFINE_BPF_DISPATCHER(cgroup)
+
+#define BPF_PROG_RUN_CGROUP(prog, ctx) \
+	__BPF_PROG_RUN(prog, ctx, BPF_DISPATCHER_FUNC(cgroup))
+
+static void bpf_cgroup_dispatcher_update(struct bpf_prog_array *from,
+					 struct bpf_prog_array *to)
+{
+	struct bpf_prog_array_item *item;
+
+	/* Add the new programs first so the ones shared by both arrays never
+	 * drop out of the dispatcher image.
+	 */
+	if (to) {
+		for (item = to->items; item->prog; item++)
+			if (item->prog->jited)
+				bpf_dispatcher_change_prog(BPF_DISPATCHER_PTR(cgroup),
+							   NULL, item->prog);
+	}
+	if (from) {
+		for (item = from->items; item->prog; item++)
+			if (item->prog->jited)
+				bpf_dispatcher_change_prog(BPF_DISPATCHER_PTR(cgroup),
+							   item->prog, NULL);
+	}
+}
+
+struct bpf_cgroup_hook_stats {
+	u64 cnt;
+	u64 nsecs;
+};
+
+static DEFINE_PER_CPU(struct bpf_cgroup_hook_stats[MAX_BPF_ATTACH_TYPE],
+		      bpf_cgroup_hook_stats);
+
+static void bpf_cgroup_hook_account(enum bpf_attach_type type, u64 start)
+{
+	this_cpu_inc(bpf_cgroup_hook_stats[type].cnt);
+	this_cpu_add(bpf_cgroup_hook_stats[type].nsecs, sched_clock() - start);
+}
+
+#ifdef CONFIG_DEBUG_FS
+static int bpf_cgroup_hook_stats_show(struct seq_file *m, void *v)
+{
+	unsigned int type;
+	int cpu;
+
+	seq_puts(m, "type\tcnt\tnsecs\n");
+	for (type = 0; type < MAX_BPF_ATTACH_TYPE; type++) {
+		u64 cnt = 0, nsecs = 0;
+
+		for_each_possible_cpu(cpu) {
+			struct bpf_cgroup_hook_stats *st;
+
+			st = &per_cpu(bpf_cgroup_hook_stats, cpu)[type];
+			cnt += READ_ONCE(st->cnt);
+			nsecs += READ_ONCE(st->nsecs);
+		}
+		if (cnt)
+			seq_printf(m, "%u\t%llu\t%llu\n", type, cnt, nsecs);
+	}
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(bpf_cgroup_hook_stats);
+
+static int __init bpf_cgroup_hook_stats_init(void)
+{
+	debugfs_create_file("bpf_cgroup_hooks", 0400, NULL, NULL,
+			    &bpf_cgroup_hook_stats_fops);
+	return 0;
+}
+late_initcall(bpf_cgroup_hook_stats_init);
+#endif
+
+/* Run all effective programs of a hook. While BPF stats are enabled the
+ * time spent in the hook as a whole is accounted per attach type, which
+ * includes the array walk and cgroup storage setup on top of the per
+ * program run_time_ns.
+ */
+#define BPF_CGROUP_RUN_HOOK(type, expr)					\
+	({								\
+		u64 __start = 0;					\
+		int __ret;						\
+		if (static_branch_unlikely(&bpf_stats_enabled_key))	\
+			__start = sched_clock();			\
+		__ret = (expr);						\
+		if (__start)						\
+			bpf_cgroup_hook_account(type, __start);		\
+		__ret;							\
+	})
+
+static u32 bpf_cgroup_run_save_cb(const struct bpf_prog *prog,
+				  struct sk_buff *skb)
+{
+	u8 *cb_data = bpf_skb_cb(skb);
+	u8 cb_saved[BPF_SKB_CB_LEN];
+	u32 res;
+
+	if (unlikely(prog->cb_access)) {
+		memcpy(cb_saved, cb_data, sizeof(cb_saved));
+		memset(cb_data, 0, sizeof(cb_saved));
+	}
+
+	res = BPF_PROG_RUN_CGROUP(prog, skb);
+
+	if (unlikely(prog->cb_access))
+		memcpy(cb_data, cb_saved, sizeof(cb_saved));
+
+	return res;
+}
+
 void cgroup_bpf_offline(struct cgroup *cgrp)
 {
 	cgroup_get(cgrp);
@@ -133,6 +252,7 @@ static void cgroup_bpf_release(struct work_struct *work)
 		old_array = rcu_dereference_protected(
 				cgrp->bpf.effective[type],
 				lockdep_is_held(&cgroup_mutex));
+		bpf_cgroup_dispatcher_update(old_array, NULL);
 		bpf_prog_array_free(old_array);
 	}
 
@@ -272,8 +392,11 @@ static void activate_effective_progs(struct cgroup *cgrp,
 				     enum bpf_attach_type type,
 				     struct bpf_prog_array *old_array)
 {
+	struct bpf_prog_array *new_array = old_array;
+
 	old_array = rcu_replace_pointer(cgrp->bpf.effective[type], old_array,
 					lockdep_is_held(&cgroup_mutex));
+	bpf_cgroup_dispatcher_update(old_array, new_array);
 	/* free prog array after grace period, since __cgroup_bpf_run_*()
 	 * might be still walking the array
 	 */
@@ -526,6 +649,7 @@ static void replace_effective_prog(struct cgroup *cgrp,
 	struct bpf_prog_array_item *item;
 	struct cgroup_subsys_state *css;
 	struct bpf_prog_array *progs;
+	struct bpf_prog *old_prog;
 	struct bpf_prog_list *pl;
 	struct list_head *head;
 	struct cgroup *cg;
@@ -557,7 +681,14 @@ static void replace_effective_prog(struct cgroup *cgrp,
 				desc->bpf.effective[type],
 				lockdep_is_held(&cgroup_mutex));
 		item = &progs->items[pos];
+		old_prog = item->prog;
+		if (link->link.prog->jited)
+			bpf_dispatcher_change_prog(BPF_DISPATCHER_PTR(cgroup),
+						   NULL, link->link.prog);
 		WRITE_ONCE(item->prog, link->link.prog);
+		if (old_prog->jited)
+			bpf_dispatcher_change_prog(BPF_DISPATCHER_PTR(cgroup),
+						   old_prog, NULL);
 	}
 }
 
@@ -1009,11 +1140,14 @@ int __cgroup_bpf_run_filter_skb(struct sock *sk,
 	bpf_compute_and_save_data_end(skb, &saved_data_end);
 
 	if (type == BPF_CGROUP_INET_EGRESS) {
-		ret = BPF_PROG_CGROUP_INET_EGRESS_RUN_ARRAY(
-			cgrp->bpf.effective[type], skb, __bpf_prog_run_save_cb);
+		ret = BPF_CGROUP_RUN_HOOK(type,
+			BPF_PROG_CGROUP_INET_EGRESS_RUN_ARRAY(
+				cgrp->bpf.effective[type], skb,
+				bpf_cgroup_run_save_cb));
 	} else {
-		ret = BPF_PROG_RUN_ARRAY(cgrp->bpf.effective[type], skb,
-					  __bpf_prog_run_save_cb);
+		ret = BPF_CGROUP_RUN_HOOK(type,
+			BPF_PROG_RUN_ARRAY(cgrp->bpf.effective[type], skb,
+					   bpf_cgroup_run_save_cb));
 		ret = (ret == 1 ? 0 : -EPERM);
 	}
 	bpf_restore_data_end(skb, saved_data_end);
@@ -1043,7 +1177,9 @@ int __cgroup_bpf_run_filter_sk(struct sock *sk,
 	struct cgroup *cgrp = sock_cgroup_ptr(&sk->sk_cgrp_data);
 	int ret;
 
-	ret = BPF_PROG_RUN_ARRAY(cgrp->bpf.effective[type], sk, BPF_PROG_RUN);
+	ret = BPF_CGROUP_RUN_HOOK(type,
+		BPF_PROG_RUN_ARRAY(cgrp->bpf.effective[type], sk,
+				   BPF_PROG_RUN_CGROUP));
 	return ret == 1 ? 0 : -EPERM;
 }
 EXPORT_SYMBOL(__cgroup_bpf_run_filter_sk);
@@ -1090,8 +1226,9 @@ int __cgroup_bpf_run_filter_sock_addr(struct sock *sk,
 	}
 
 	cgrp = sock_cgroup_ptr(&sk->sk_cgrp_data);
-	ret = BPF_PROG_RUN_ARRAY_FLAGS(cgrp->bpf.effective[type], &ctx,
-				       BPF_PROG_RUN, flags);
+	ret = BPF_CGROUP_RUN_HOOK(type,
+		BPF_PROG_RUN_ARRAY_FLAGS(cgrp->bpf.effective[type], &ctx,
+					 BPF_PROG_RUN_CGROUP, flags));
 
 	return ret == 1 ? 0 : -EPERM;
 }
@@ -1120,8 +1257,9 @@ int __cgroup_bpf_run_filter_sock_ops(struct sock *sk,
 	struct cgroup *cgrp = sock_cgroup_ptr(&sk->sk_cgrp_data);
 	int ret;
 
-	ret = BPF_PROG_RUN_ARRAY(cgrp->bpf.effective[type], sock_ops,
-				 BPF_PROG_RUN);
+	ret = BPF_CGROUP_RUN_HOOK(type,
+		BPF_PROG_RUN_ARRAY(cgrp->bpf.effective[type], sock_ops,
+				   BPF_PROG_RUN_CGROUP));
 	return ret == 1 ? 0 : -EPERM;
 }
 EXPORT_SYMBOL(__cgroup_bpf_run_filter_sock_ops);
@@ -1139,8 +1277,9 @@ int __cgroup_bpf_check_dev_permission(short dev_type, u32 major, u32 minor,
 
 	rcu_read_lock();
 	cgrp = task_dfl_cgroup(current);
-	allow = BPF_PROG_RUN_ARRAY(cgrp->bpf.effective[type], &ctx,
-				   BPF_PROG_RUN);
+	allow = BPF_CGROUP_RUN_HOOK(type,
+		BPF_PROG_RUN_ARRAY(cgrp->bpf.effective[type], &ctx,
+				   BPF_PROG_RUN_CGROUP));
 	rcu_read_unlock();
 
 	return !allow;
@@ -1271,7 +1410,9 @@ int __cgroup_bpf_run_filter_sysctl(struct ctl_table_header *head,
 
 	rcu_read_lock();
 	cgrp = task_dfl_cgroup(current);
-	ret = BPF_PROG_RUN_ARRAY(cgrp->bpf.effective[type], &ctx, BPF_PROG_RUN);
+	ret = BPF_CGROUP_RUN_HOOK(type,
+		BPF_PROG_RUN_ARRAY(cgrp->bpf.effective[type], &ctx,
+				   BPF_PROG_RUN_CGROUP));
 	rcu_read_unlock();
 
 	kfree(ctx.cur_val);
@@ -1385,8 +1526,9 @@ int __cgroup_bpf_run_filter_setsockopt(struct sock *sk, int *level,
 	}
 
 	lock_sock(sk);
-	ret = BPF_PROG_RUN_ARRAY(cgrp->bpf.effective[BPF_CGROUP_SETSOCKOPT],
-				 &ctx, BPF_PROG_RUN);
+	ret = BPF_CGROUP_RUN_HOOK(BPF_CGROUP_SETSOCKOPT,
+		BPF_PROG_RUN_ARRAY(cgrp->bpf.effective[BPF_CGROUP_SETSOCKOPT],
+				   &ctx, BPF_PROG_RUN_CGROUP));
 	release_sock(sk);
 
 	if (!ret) {
@@ -1495,8 +1637,9 @@ int __cgroup_bpf_run_filter_getsockopt(struct sock *sk, int level,
 	}
 
 	lock_sock(sk);
-	ret = BPF_PROG_RUN_ARRAY(cgrp->bpf.effective[BPF_CGROUP_GETSOCKOPT],
-				 &ctx, BPF_PROG_RUN);
+	ret = BPF_CGROUP_RUN_HOOK(BPF_CGROUP_GETSOCKOPT,
+		BPF_PROG_RUN_ARRAY(cgrp->bpf.effective[BPF_CGROUP_GETSOCKOPT],
+				   &ctx, BPF_PROG_RUN_CGROUP));
 	release_sock(sk);
 
 	if (!ret) {
@@ -1556,8 +1699,9 @@ int __cgroup_bpf_run_filter_getsockopt_kern(struct sock *sk, int level,
 	 * be called if that data shouldn't be "exported".
 	 */
 
-	ret = BPF_PROG_RUN_ARRAY(cgrp->bpf.effective[BPF_CGROUP_GETSOCKOPT],
-				 &ctx, BPF_PROG_RUN);
+	ret = BPF_CGROUP_RUN_HOOK(BPF_CGROUP_GETSOCKOPT,
+		BPF_PROG_RUN_ARRAY(cgrp->bpf.effective[BPF_CGROUP_GETSOCKOPT],
+				   &ctx, BPF_PROG_RUN_CGROUP));
 	if (!ret)
 		return -EPERM;
 
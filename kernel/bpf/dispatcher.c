@@ -127,6 +127,11 @@ static void bpf_dispatcher_update(struct bpf_dispatcher *d, int prev_num_progs)
 		return;
 
 	d->image_off = noff;
+	/* The next update writes into the half we just switched away from;
+	 * make sure no caller is still executing it. Callers are expected to
+	 * run the dispatcher from within an RCU read-side section.
+	 */
+	synchronize_rcu();
 }
 
 void bpf_dispatcher_change_prog(struct bpf_dispatcher *d, struct bpf_prog *from,
@@ -6,6 +6,7 @@
  * Copyright (c) 2016 David Herrmann
  */
 
+#include <linux/bitops.h>
 #include <linux/bpf.h>
 #include <linux/btf.h>
 #include <linux/err.h>
@@ -15,19 +16,31 @@
 #include <net/ipv6.h>
 #include <uapi/linux/btf.h>
 
-/* Intermediate node */
-#define LPM_TREE_NODE_FLAG_IM BIT(0)
+/* Each trie level consumes one byte of the key */
+#define LPM_STRIDE		8
+#define LPM_FANOUT		(1 << LPM_STRIDE)
+#define LPM_MAP_WORDS		(LPM_FANOUT / 64)
 
-struct lpm_trie_node;
-
-struct lpm_trie_node {
-	struct rcu_head rcu;
-	struct lpm_trie_node __rcu	*child[2];
+/* A prefix stored in the trie, followed by its value */
+struct lpm_trie_leaf {
+	struct rcu_head			rcu;
 	u32				prefixlen;
-	u32				flags;
 	u8				data[];
 };
 
+struct lpm_trie_node {
+	struct rcu_head			rcu;
+	u16				nr_children;
+	u16				nr_prefixes;
+	u16				nr_runs;
+	u64				child_map[LPM_MAP_WORDS];
+	u64				run_map[LPM_MAP_WORDS];
+	/* nr_children child pointers, then nr_prefixes prefixes, then
+	 * nr_runs leaf pointers.
+	 */
+	void				*ptrs[];
+};
+
 struct lpm_trie {
 	struct bpf_map			map;
 	struct lpm_trie_node __rcu	*root;
@@ -40,231 +53,193 @@ struct lpm_trie {
 /* This trie implements a longest prefix match algorithm that can be used to
  * match IP addresses to a stored set of ranges.
  *
- * Data stored in @data of struct bpf_lpm_key and struct lpm_trie_node is
+ * Data stored in @data of struct bpf_lpm_key and struct lpm_trie_leaf is
  * interpreted as big endian, so data[0] stores the most significant byte.
  *
- * Match ranges are internally stored in instances of struct lpm_trie_node
- * which each contain their prefix length as well as two pointers that may
- * lead to more nodes containing more specific matches. Each node also stores
- * a value that is defined by and returned to userspace via the update_elem
- * and lookup functions.
- *
- * For instance, let's start with a trie that was created with a prefix length
- * of 32, so it can be used for IPv4 addresses, and one single element that
- * matches 192.168.0.0/16. The data array would hence contain
- * [0xc0, 0xa8, 0x00, 0x00] in big-endian notation. This documentation will
- * stick to IP-address notation for readability though.
- *
- * As the trie is empty initially, the new node (1) will be places as root
- * node, denoted as (R) in the example below. As there are no other node, both
- * child pointers are %NULL.
- *
- *              +----------------+
- *              |       (1)  (R) |
- *              | 192.168.0.0/16 |
- *              |    value: 1    |
- *              |   [0]    [1]   |
- *              +----------------+
- *
- * Next, let's add a new node (2) matching 192.168.0.0/24. As there is already
- * a node with the same data and a smaller prefix (ie, a less specific one),
- * node (2) will become a child of (1). In child index depends on the next bit
- * that is outside of what (1) matches, and that bit is 0, so (2) will be
- * child[0] of (1):
- *
- *              +----------------+
- *              |       (1)  (R) |
- *              | 192.168.0.0/16 |
- *              |    value: 1    |
- *              |   [0]    [1]   |
- *              +----------------+
- *                   |
- *    +----------------+
- *    |       (2)      |
- *    | 192.168.0.0/24 |
- *    |    value: 2    |
- *    |   [0]    [1]   |
- *    +----------------+
- *
- * The child[1] slot of (1) could be filled with another node which has bit #17
- * (the next bit after the ones that (1) matches on) set to 1. For instance,
- * 192.168.128.0/24:
+ * The trie is a multibit trie with a stride of LPM_STRIDE bits: a node at
+ * level n has up to 256 children, indexed by byte n of the key. A prefix of
+ * length L is stored in the node at level (L - 1) / 8 that is reached by
+ * the first bytes of the prefix, so every node stores prefixes that end
+ * within its own byte. A /0 prefix lives in the root node.
  *
- *              +----------------+
- *              |       (1)  (R) |
- *              | 192.168.0.0/16 |
- *              |    value: 1    |
- *              |   [0]    [1]   |
- *              +----------------+
- *                   |      |
- *    +----------------+  +------------------+
- *    |       (2)      |  |        (3)       |
- *    | 192.168.0.0/24 |  | 192.168.128.0/24 |
- *    |    value: 2    |  |     value: 3     |
- *    |   [0]    [1]   |  |    [0]    [1]    |
- *    +----------------+  +------------------+
+ * For instance, in a trie created with a prefix length of 32 and holding
+ * 192.168.0.0/16, 192.168.0.0/24, 192.168.1.0/24 and 192.168.128.0/17:
  *
- * Let's add another node (4) to the game for 192.168.1.0/24. In order to place
- * it, node (1) is looked at first, and because (4) of the semantics laid out
- * above (bit #17 is 0), it would normally be attached to (1) as child[0].
- * However, that slot is already allocated, so a new node is needed in between.
- * That node does not have a value attached to it and it will never be
- * returned to users as result of a lookup. It is only there to differentiate
- * the traversal further. It will get a prefix as wide as necessary to
- * distinguish its two children:
+ *   level 0   [192] -> level 1
+ *   level 1   [168] -> level 2               prefixes: 192.168.0.0/16
+ *   level 2   prefixes: 192.168.0.0/24, 192.168.1.0/24, 192.168.128.0/17
  *
- *                      +----------------+
- *                      |       (1)  (R) |
- *                      | 192.168.0.0/16 |
- *                      |    value: 1    |
- *                      |   [0]    [1]   |
- *                      +----------------+
- *                           |      |
- *            +----------------+  +------------------+
- *            |       (4)  (I) |  |        (3)       |
- *            | 192.168.0.0/23 |  | 192.168.128.0/24 |
- *            |    value: ---  |  |     value: 3     |
- *            |   [0]    [1]   |  |    [0]    [1]    |
- *            +----------------+  +------------------+
- *                 |      |
- *  +----------------+  +----------------+
- *  |       (2)      |  |       (5)      |
- *  | 192.168.0.0/24 |  | 192.168.1.0/24 |
- *  |    value: 2    |  |     value: 5   |
- *  |   [0]    [1]   |  |   [0]    [1]   |
- *  +----------------+  +----------------+
+ * To avoid walking the prefixes of a node on lookup, every node also keeps
+ * the best matching prefix for each of its 256 slots, expanded from the
+ * prefixes it stores. Consecutive slots sharing the same best match are
+ * collapsed into runs; @run_map has a bit set for every slot that starts a
+ * run. In the example above, level 2 has the runs [0] -> 192.168.0.0/24,
+ * [1] -> 192.168.1.0/24, [2] -> none and [128] -> 192.168.128.0/17.
  *
- * 192.168.1.1/32 would be a child of (5) etc.
+ * Children and runs are packed into @ptrs and located by counting the bits
+ * set in @child_map and @run_map below the slot, so a lookup costs one node
+ * visit per key byte: at most 4 for IPv4 and 16 for IPv6.
  *
- * An intermediate node will be turned into a 'real' node on demand. In the
- * example above, (4) would be re-used if 192.168.0.0/23 is added to the trie.
- *
- * A fully populated trie would have a height of 32 nodes, as the trie was
- * created with a prefix length of 32.
- *
- * The lookup starts at the root node. If the current node matches and if there
- * is a child that can be used to become more specific, the trie is traversed
- * downwards. The last node in the traversal that is a non-intermediate one is
- * returned.
+ * Nodes are never modified in place except for the child pointers, which
+ * are RCU-published. Any other change builds a new copy of the node that
+ * replaces the old one in its parent, and the old node is freed after a
+ * grace period. Lookups therefore never take the trie lock, which only
+ * serializes updaters against each other.
  */
 
-static inline int extract_bit(const u8 *data, size_t index)
+static inline bool lpm_map_test(const u64 *map, u32 slot)
 {
-	return !!(data[index / 8] & (1 << (7 - (index % 8))));
+	return map[slot / 64] & BIT_ULL(slot % 64);
 }
 
-/**
- * longest_prefix_match() - determine the longest prefix
- * @trie:	The trie to get internal sizes from
- * @node:	The node to operate on
- * @key:	The key to compare to @node
- *
- * Determine the longest prefix of @node that matches the bits in @key.
- */
-static size_t longest_prefix_match(const struct lpm_trie *trie,
-				   const struct lpm_trie_node *node,
-				   const struct bpf_lpm_trie_key *key)
+/* Number of bits set in @map below @slot */
+static inline u32 lpm_map_rank(const u64 *map, u32 slot)
 {
-	u32 limit = min(node->prefixlen, key->prefixlen);
-	u32 prefixlen = 0, i = 0;
+	u32 i, rank = hweight64(map[slot / 64] & (BIT_ULL(slot % 64) - 1));
 
-	BUILD_BUG_ON(offsetof(struct lpm_trie_node, data) % sizeof(u32));
-	BUILD_BUG_ON(offsetof(struct bpf_lpm_trie_key, data) % sizeof(u32));
+	for (i = 0; i < slot / 64; i++)
+		rank += hweight64(map[i]);
+	return rank;
+}
 
-#if defined(CONFIG_HAVE_EFFICIENT_UNALIGNED_ACCESS) && defined(CONFIG_64BIT)
+static inline struct lpm_trie_node __rcu **
+lpm_children(struct lpm_trie_node *node)
+{
+	return (struct lpm_trie_node __rcu **)node->ptrs;
+}
 
-	/* data_size >= 16 has very small probability.
-	 * We do not use a loop for optimal code generation.
-	 */
-	if (trie->data_size >= 8) {
-		u64 diff = be64_to_cpu(*(__be64 *)node->data ^
-				       *(__be64 *)key->data);
-
-		prefixlen = 64 - fls64(diff);
-		if (prefixlen >= limit)
-			return limit;
-		if (diff)
-			return prefixlen;
-		i = 8;
-	}
-#endif
-
-	while (trie->data_size >= i + 4) {
-		u32 diff = be32_to_cpu(*(__be32 *)&node->data[i] ^
-				       *(__be32 *)&key->data[i]);
-
-		prefixlen += 32 - fls(diff);
-		if (prefixlen >= limit)
-			return limit;
-		if (diff)
-			return prefixlen;
-		i += 4;
-	}
+static inline struct lpm_trie_leaf **lpm_prefixes(struct lpm_trie_node *node)
+{
+	return (struct lpm_trie_leaf **)(node->ptrs + node->nr_children);
+}
 
-	if (trie->data_size >= i + 2) {
-		u16 diff = be16_to_cpu(*(__be16 *)&node->data[i] ^
-				       *(__be16 *)&key->data[i]);
+static inline struct lpm_trie_leaf **lpm_runs(struct lpm_trie_node *node)
+{
+	return (struct lpm_trie_leaf **)(node->ptrs + node->nr_children +
+					 node->nr_prefixes);
+}
 
-		prefixlen += 16 - fls(diff);
-		if (prefixlen >= limit)
-			return limit;
-		if (diff)
-			return prefixlen;
-		i += 2;
-	}
+static struct lpm_trie_node __rcu **lpm_child_slot(struct lpm_trie_node *node,
+						   u32 slot)
+{
+	if (!lpm_map_test(node->child_map, slot))
+		return NULL;
+	return &lpm_children(node)[lpm_map_rank(node->child_map, slot)];
+}
+
+/* Best prefix stored in @node covering @slot */
+static struct lpm_trie_leaf *lpm_node_leaf(struct lpm_trie_node *node,
+					   u32 slot)
+{
+	u32 run;
+
+	if (!node->nr_runs)
+		return NULL;
+
+	/* Slot 0 always starts a run */
+	run = lpm_map_rank(node->run_map, slot) +
+	      lpm_map_test(node->run_map, slot) - 1;
+	return lpm_runs(node)[run];
+}
+
+static inline u32 lpm_level(u32 prefixlen)
+{
+	return prefixlen ? (prefixlen - 1) / LPM_STRIDE : 0;
+}
+
+/* Mask of the bits of the level's byte covered by a prefix */
+static inline u32 lpm_slot_mask(u32 prefixlen, u32 level)
+{
+	return (0xff00 >> (prefixlen - level * LPM_STRIDE)) & 0xff;
+}
+
+static inline u32 lpm_first_slot(u32 prefixlen, const u8 *data, u32 level)
+{
+	return data[level] & lpm_slot_mask(prefixlen, level);
+}
 
-	if (trie->data_size >= i + 1) {
-		prefixlen += 8 - fls(node->data[i] ^ key->data[i]);
+static inline bool lpm_leaf_covers(const struct lpm_trie_leaf *leaf,
+				   u32 level, u32 slot)
+{
+	u32 mask = lpm_slot_mask(leaf->prefixlen, level);
 
-		if (prefixlen >= limit)
-			return limit;
+	return (slot & mask) == (leaf->data[level] & mask);
+}
+
+/* Prefixes of a node are sorted longest first, so the first one covering
+ * a slot is the best match for it.
+ */
+static bool lpm_leaf_before(const struct lpm_trie_leaf *a,
+			    const struct lpm_trie_leaf *b, u32 level)
+{
+	if (a->prefixlen != b->prefixlen)
+		return a->prefixlen > b->prefixlen;
+	return lpm_first_slot(a->prefixlen, a->data, level) <
+	       lpm_first_slot(b->prefixlen, b->data, level);
+}
+
+static struct lpm_trie_leaf *lpm_node_best(struct lpm_trie_node *node,
+					   u32 level, u32 slot, u32 max_len)
+{
+	struct lpm_trie_leaf **prefixes = lpm_prefixes(node);
+	u32 i;
+
+	for (i = 0; i < node->nr_prefixes; i++) {
+		if (prefixes[i]->prefixlen <= max_len &&
+		    lpm_leaf_covers(prefixes[i], level, slot))
+			return prefixes[i];
 	}
+	return NULL;
+}
 
-	return prefixlen;
+static int lpm_node_find(struct lpm_trie_node *node, u32 level,
+			 u32 prefixlen, const u8 *data)
+{
+	struct lpm_trie_leaf **prefixes = lpm_prefixes(node);
+	u32 first = lpm_first_slot(prefixlen, data, level);
+	u32 i;
+
+	for (i = 0; i < node->nr_prefixes; i++) {
+		if (prefixes[i]->prefixlen == prefixlen &&
+		    lpm_first_slot(prefixlen, prefixes[i]->data, level) == first)
+			return i;
+	}
+	return -1;
 }
 
 /* Called from syscall or from eBPF program */
 static void *trie_lookup_elem(struct bpf_map *map, void *_key)
 {
 	struct lpm_trie *trie = container_of(map, struct lpm_trie, map);
-	struct lpm_trie_node *node, *found = NULL;
+	struct lpm_trie_leaf *leaf, *found = NULL;
 	struct bpf_lpm_trie_key *key = _key;
+	struct lpm_trie_node __rcu **slot;
+	struct lpm_trie_node *node;
+	u32 level;
 
 	/* Start walking the trie from the root node ... */
+	node = rcu_dereference(trie->root);
+	for (level = 0; node; level++) {
+		u32 byte = key->data[level];
 
-	for (node = rcu_dereference(trie->root); node;) {
-		unsigned int next_bit;
-		size_t matchlen;
-
-		/* Determine the longest prefix of @node that matches @key.
-		 * If it's the maximum possible prefix for this trie, we have
-		 * an exact match and can return it directly.
+		/* The expanded runs hold the longest prefix of this level.
+		 * Only lookups with a short prefix length have to look for
+		 * a shorter one in the node itself.
 		 */
-		matchlen = longest_prefix_match(trie, node, key);
-		if (matchlen == trie->max_prefixlen) {
-			found = node;
+		leaf = lpm_node_leaf(node, byte);
+		if (leaf && leaf->prefixlen > key->prefixlen)
+			leaf = lpm_node_best(node, level, byte, key->prefixlen);
+		if (leaf)
+			found = leaf;
+
+		/* Deeper levels only store longer prefixes */
+		if (key->prefixlen <= (level + 1) * LPM_STRIDE)
 			break;
-		}
 
-		/* If the number of bits that match is smaller than the prefix
-		 * length of @node, bail out and return the node we have seen
-		 * last in the traversal (ie, the parent).
-		 */
-		if (matchlen < node->prefixlen)
+		slot = lpm_child_slot(node, byte);
+		if (!slot)
 			break;
-
-		/* Consider this node as return candidate unless it is an
-		 * artificially added intermediate one.
-		 */
-		if (!(node->flags & LPM_TREE_NODE_FLAG_IM))
-			found = node;
-
-		/* If the node match is fully satisfied, let's see if we can
-		 * become more specific. Determine the next bit in the key and
-		 * traverse down.
-		 */
-		next_bit = extract_bit(key->data, node->prefixlen);
-		node = rcu_dereference(node->child[next_bit]);
+		node = rcu_dereference(*slot);
 	}
 
 	if (!found)
@@ -273,41 +248,187 @@ static void *trie_lookup_elem(struct bpf_map *map, void *_key)
 	return found->data + trie->data_size;
 }
 
-static struct lpm_trie_node *lpm_trie_node_alloc(const struct lpm_trie *trie,
+static struct lpm_trie_leaf *lpm_trie_leaf_alloc(const struct lpm_trie *trie,
+						 const struct bpf_lpm_trie_key *key,
 						 const void *value)
 {
+	struct lpm_trie_leaf *leaf;
+	size_t size = sizeof(struct lpm_trie_leaf) + trie->data_size +
+		      trie->map.value_size;
+
+	leaf = bpf_map_kmalloc_node(&trie->map, size, GFP_ATOMIC | __GFP_NOWARN,
+				    trie->map.numa_node);
+	if (!leaf)
+		return NULL;
+
+	leaf->prefixlen = key->prefixlen;
+	memcpy(leaf->data, key->data, trie->data_size);
+	memcpy(leaf->data + trie->data_size, value, trie->map.value_size);
+
+	return leaf;
+}
+
+struct lpm_node_edit {
+	int				child_slot;	/* -1 if unchanged */
+	struct lpm_trie_node		*child;		/* NULL to remove */
+	struct lpm_trie_leaf		*add;		/* add or replace */
+	struct lpm_trie_leaf		*del;
+};
+
+/**
+ * lpm_node_rebuild() - build a modified copy of a node
+ * @trie:	The trie the node belongs to
+ * @old:	The node to copy, or %NULL to build a new one
+ * @level:	The level of the node
+ * @edit:	The changes to apply
+ *
+ * Returns the new node, %NULL if it would be empty or an ERR_PTR() on
+ * allocation failure. Must be called with the trie lock held.
+ */
+static struct lpm_trie_node *lpm_node_rebuild(struct lpm_trie *trie,
+					      struct lpm_trie_node *old,
+					      u32 level,
+					      const struct lpm_node_edit *edit)
+{
+	u32 nr_children = 0, nr_prefixes = 0, max_runs = 0, i, n;
+	struct lpm_trie_leaf **prefixes, **runs, *leaf, *prev;
+	u64 child_map[LPM_MAP_WORDS] = {};
+	struct lpm_trie_node __rcu **children;
+	int slot, replace = -1, del = -1;
 	struct lpm_trie_node *node;
-	size_t size = sizeof(struct lpm_trie_node) + trie->data_size;
+	bool added = false;
+
+	if (old) {
+		memcpy(child_map, old->child_map, sizeof(child_map));
+		nr_prefixes = old->nr_prefixes;
+		if (edit->add)
+			replace = lpm_node_find(old, level,
+						edit->add->prefixlen,
+						edit->add->data);
+		for (i = 0; edit->del && i < old->nr_prefixes; i++) {
+			if (lpm_prefixes(old)[i] == edit->del)
+				del = i;
+		}
+	}
 
-	if (value)
-		size += trie->map.value_size;
+	if (edit->child_slot >= 0) {
+		if (edit->child)
+			child_map[edit->child_slot / 64] |=
+				BIT_ULL(edit->child_slot % 64);
+		else
+			child_map[edit->child_slot / 64] &=
+				~BIT_ULL(edit->child_slot % 64);
+	}
 
-	node = bpf_map_kmalloc_node(&trie->map, size, GFP_ATOMIC | __GFP_NOWARN,
+	for (i = 0; i < LPM_MAP_WORDS; i++)
+		nr_children += hweight64(child_map[i]);
+	if (edit->add && replace < 0)
+		nr_prefixes++;
+	if (del >= 0)
+		nr_prefixes--;
+
+	if (!nr_children && !nr_prefixes)
+		return NULL;
+
+	/* Every prefix adds at most two run boundaries */
+	if (nr_prefixes)
+		max_runs = min_t(u32, LPM_FANOUT, 2 * nr_prefixes + 1);
+
+	node = bpf_map_kmalloc_node(&trie->map,
+				    struct_size(node, ptrs, nr_children +
+						nr_prefixes + max_runs),
+				    GFP_ATOMIC | __GFP_NOWARN,
 				    trie->map.numa_node);
 	if (!node)
-		return NULL;
+		return ERR_PTR(-ENOMEM);
+
+	memcpy(node->child_map, child_map, sizeof(child_map));
+	memset(node->run_map, 0, sizeof(node->run_map));
+	node->nr_children = nr_children;
+	node->nr_prefixes = nr_prefixes;
+	node->nr_runs = 0;
+
+	children = lpm_children(node);
+	for (slot = 0, n = 0; slot < LPM_FANOUT; slot++) {
+		struct lpm_trie_node *child;
+
+		if (!lpm_map_test(child_map, slot))
+			continue;
+
+		if (slot == edit->child_slot)
+			child = edit->child;
+		else
+			child = rcu_dereference_protected(
+					*lpm_child_slot(old, slot),
+					lockdep_is_held(&trie->lock));
+		RCU_INIT_POINTER(children[n++], child);
+	}
 
-	node->flags = 0;
+	/* Merge the added prefix into the sorted prefixes of @old */
+	prefixes = lpm_prefixes(node);
+	for (i = 0, n = 0; old && i < old->nr_prefixes; i++) {
+		leaf = lpm_prefixes(old)[i];
 
-	if (value)
-		memcpy(node->data + trie->data_size, value,
-		       trie->map.value_size);
+		if (i == del)
+			continue;
+		if (i == replace) {
+			prefixes[n++] = edit->add;
+			continue;
+		}
+		if (edit->add && replace < 0 && !added &&
+		    lpm_leaf_before(edit->add, leaf, level)) {
+			prefixes[n++] = edit->add;
+			added = true;
+		}
+		prefixes[n++] = leaf;
+	}
+	if (edit->add && replace < 0 && !added)
+		prefixes[n++] = edit->add;
+
+	if (!nr_prefixes)
+		return node;
+
+	/* Expand the prefixes into runs of slots sharing the best match */
+	runs = lpm_runs(node);
+	for (slot = 0, prev = NULL; slot < LPM_FANOUT; slot++) {
+		leaf = lpm_node_best(node, level, slot, U32_MAX);
+		if (slot && leaf == prev)
+			continue;
+
+		node->run_map[slot / 64] |= BIT_ULL(slot % 64);
+		runs[node->nr_runs++] = leaf;
+		prev = leaf;
+	}
 
 	return node;
 }
 
+/* Free a chain of nodes built by trie_update_elem() but never published */
+static void lpm_node_free_chain(struct lpm_trie_node *node)
+{
+	struct lpm_trie_node *next;
+
+	while (node) {
+		next = node->nr_children ?
+		       rcu_dereference_raw(lpm_children(node)[0]) : NULL;
+		kfree(node);
+		node = next;
+	}
+}
+
 /* Called from syscall or from eBPF program */
 static int trie_update_elem(struct bpf_map *map,
 			    void *_key, void *value, u64 flags)
 {
 	struct lpm_trie *trie = container_of(map, struct lpm_trie, map);
-	struct lpm_trie_node *node, *im_node = NULL, *new_node = NULL;
-	struct lpm_trie_node __rcu **slot;
+	struct lpm_node_edit edit = { .child_slot = -1 };
+	struct lpm_trie_node *node, *new_node = NULL;
+	struct lpm_trie_leaf *leaf, *old_leaf = NULL;
+	struct lpm_trie_node __rcu **slot, **child;
 	struct bpf_lpm_trie_key *key = _key;
 	unsigned long irq_flags;
-	unsigned int next_bit;
-	size_t matchlen = 0;
-	int ret = 0;
+	u32 level, depth, l;
+	int idx = -1, ret = 0;
 
 	if (unlikely(flags > BPF_EXIST))
 		return -EINVAL;
@@ -315,210 +436,182 @@ static int trie_update_elem(struct bpf_map *map,
 	if (key->prefixlen > trie->max_prefixlen)
 		return -EINVAL;
 
-	spin_lock_irqsave(&trie->lock, irq_flags);
-
-	/* Allocate and fill a new node */
-
-	if (trie->n_entries == trie->map.max_entries) {
-		ret = -ENOSPC;
-		goto out;
-	}
-
-	new_node = lpm_trie_node_alloc(trie, value);
-	if (!new_node) {
-		ret = -ENOMEM;
-		goto out;
-	}
-
-	trie->n_entries++;
+	/* Allocate and fill the new leaf before taking the lock */
+	leaf = lpm_trie_leaf_alloc(trie, key, value);
+	if (!leaf)
+		return -ENOMEM;
 
-	new_node->prefixlen = key->prefixlen;
-	RCU_INIT_POINTER(new_node->child[0], NULL);
-	RCU_INIT_POINTER(new_node->child[1], NULL);
-	memcpy(new_node->data, key->data, trie->data_size);
+	spin_lock_irqsave(&trie->lock, irq_flags);
 
-	/* Now find a slot to attach the new node. To do that, walk the tree
-	 * from the root and match as many bits as possible for each node until
-	 * we either find an empty slot or a slot that needs to be replaced by
-	 * an intermediate node.
+	/* Walk down towards the level of the prefix for as long as the
+	 * nodes on the path exist.
 	 */
+	level = lpm_level(key->prefixlen);
 	slot = &trie->root;
-
-	while ((node = rcu_dereference_protected(*slot,
-					lockdep_is_held(&trie->lock)))) {
-		matchlen = longest_prefix_match(trie, node, key);
-
-		if (node->prefixlen != matchlen ||
-		    node->prefixlen == key->prefixlen ||
-		    node->prefixlen == trie->max_prefixlen)
+	node = rcu_dereference_protected(*slot, lockdep_is_held(&trie->lock));
+	for (depth = 0; node && depth < level; depth++) {
+		child = lpm_child_slot(node, key->data[depth]);
+		if (!child)
 			break;
 
-		next_bit = extract_bit(key->data, node->prefixlen);
-		slot = &node->child[next_bit];
+		slot = child;
+		node = rcu_dereference_protected(*slot,
+						 lockdep_is_held(&trie->lock));
 	}
 
-	/* If the slot is empty (a free child pointer or an empty root),
-	 * simply assign the @new_node to that slot and be done.
-	 */
-	if (!node) {
-		rcu_assign_pointer(*slot, new_node);
-		goto out;
-	}
-
-	/* If the slot we picked already exists, replace it with @new_node
-	 * which already has the correct data array set.
-	 */
-	if (node->prefixlen == matchlen) {
-		new_node->child[0] = node->child[0];
-		new_node->child[1] = node->child[1];
-
-		if (!(node->flags & LPM_TREE_NODE_FLAG_IM))
-			trie->n_entries--;
+	if (node && depth == level)
+		idx = lpm_node_find(node, level, key->prefixlen, key->data);
 
-		rcu_assign_pointer(*slot, new_node);
-		kfree_rcu(node, rcu);
-
-		goto out;
+	if (idx >= 0) {
+		if (flags == BPF_NOEXIST) {
+			ret = -EEXIST;
+			goto out;
+		}
+		old_leaf = lpm_prefixes(node)[idx];
+	} else {
+		if (flags == BPF_EXIST) {
+			ret = -ENOENT;
+			goto out;
+		}
+		if (trie->n_entries == trie->map.max_entries) {
+			ret = -ENOSPC;
+			goto out;
+		}
 	}
 
-	/* If the new node matches the prefix completely, it must be inserted
-	 * as an ancestor. Simply insert it between @node and *@slot.
+	/* Build the missing nodes bottom up, ending with a copy of the
+	 * deepest existing node on the path, which is swapped in as a whole.
 	 */
-	if (matchlen == key->prefixlen) {
-		next_bit = extract_bit(node->data, matchlen);
-		rcu_assign_pointer(new_node->child[next_bit], node);
-		rcu_assign_pointer(*slot, new_node);
-		goto out;
-	}
+	for (l = level;; l--) {
+		struct lpm_trie_node *tmp;
 
-	im_node = lpm_trie_node_alloc(trie, NULL);
-	if (!im_node) {
-		ret = -ENOMEM;
-		goto out;
-	}
+		if (l == level) {
+			edit.add = leaf;
+		} else {
+			edit.add = NULL;
+			edit.child_slot = key->data[l];
+			edit.child = new_node;
+		}
 
-	im_node->prefixlen = matchlen;
-	im_node->flags |= LPM_TREE_NODE_FLAG_IM;
-	memcpy(im_node->data, node->data, trie->data_size);
+		tmp = lpm_node_rebuild(trie, l == depth ? node : NULL, l, &edit);
+		if (IS_ERR(tmp)) {
+			lpm_node_free_chain(new_node);
+			ret = PTR_ERR(tmp);
+			goto out;
+		}
 
-	/* Now determine which child to install in which slot */
-	if (extract_bit(key->data, matchlen)) {
-		rcu_assign_pointer(im_node->child[0], node);
-		rcu_assign_pointer(im_node->child[1], new_node);
-	} else {
-		rcu_assign_pointer(im_node->child[0], new_node);
-		rcu_assign_pointer(im_node->child[1], node);
+		new_node = tmp;
+		if (l == depth)
+			break;
 	}
 
-	/* Finally, assign the intermediate node to the determined spot */
-	rcu_assign_pointer(*slot, im_node);
-
-out:
-	if (ret) {
-		if (new_node)
-			trie->n_entries--;
+	rcu_assign_pointer(*slot, new_node);
+	if (node)
+		kfree_rcu(node, rcu);
 
-		kfree(new_node);
-		kfree(im_node);
-	}
+	if (old_leaf)
+		kfree_rcu(old_leaf, rcu);
+	else
+		trie->n_entries++;
 
+out:
 	spin_unlock_irqrestore(&trie->lock, irq_flags);
 
+	if (ret)
+		kfree(leaf);
+
 	return ret;
 }
 
+struct lpm_path {
+	struct lpm_trie_node __rcu	**slot;
+	struct lpm_trie_node		*node;
+};
+
 /* Called from syscall or from eBPF program */
 static int trie_delete_elem(struct bpf_map *map, void *_key)
 {
 	struct lpm_trie *trie = container_of(map, struct lpm_trie, map);
+	struct lpm_trie_node *node, *new_node;
 	struct bpf_lpm_trie_key *key = _key;
-	struct lpm_trie_node __rcu **trim, **trim2;
-	struct lpm_trie_node *node, *parent;
+	struct lpm_trie_node __rcu **slot;
+	struct lpm_node_edit edit = {};
+	struct lpm_trie_leaf *leaf;
+	struct lpm_path *path;
 	unsigned long irq_flags;
-	unsigned int next_bit;
-	size_t matchlen = 0;
-	int ret = 0;
+	u32 level, depth;
+	int idx, ret = 0;
 
 	if (key->prefixlen > trie->max_prefixlen)
 		return -EINVAL;
 
+	level = lpm_level(key->prefixlen);
+	path = kmalloc_array(level + 1, sizeof(*path),
+			     GFP_ATOMIC | __GFP_NOWARN);
+	if (!path)
+		return -ENOMEM;
+
 	spin_lock_irqsave(&trie->lock, irq_flags);
 
-	/* Walk the tree looking for an exact key/length match and keeping
-	 * track of the path we traverse.  We will need to know the node
-	 * we wish to delete, and the slot that points to the node we want
-	 * to delete.  We may also need to know the nodes parent and the
-	 * slot that contains it.
+	/* Walk the trie down to the level of the prefix, keeping track of
+	 * the nodes and the slots referencing them. Nodes that become empty
+	 * are removed from their parent.
 	 */
-	trim = &trie->root;
-	trim2 = trim;
-	parent = NULL;
-	while ((node = rcu_dereference_protected(
-		       *trim, lockdep_is_held(&trie->lock)))) {
-		matchlen = longest_prefix_match(trie, node, key);
-
-		if (node->prefixlen != matchlen ||
-		    node->prefixlen == key->prefixlen)
+	slot = &trie->root;
+	for (depth = 0;; depth++) {
+		node = rcu_dereference_protected(*slot,
+						 lockdep_is_held(&trie->lock));
+		if (!node) {
+			ret = -ENOENT;
+			goto out;
+		}
+
+		path[depth].slot = slot;
+		path[depth].node = node;
+		if (depth == level)
 			break;
 
-		parent = node;
-		trim2 = trim;
-		next_bit = extract_bit(key->data, node->prefixlen);
-		trim = &node->child[next_bit];
+		slot = lpm_child_slot(node, key->data[depth]);
+		if (!slot) {
+			ret = -ENOENT;
+			goto out;
+		}
 	}
 
-	if (!node || node->prefixlen != key->prefixlen ||
-	    node->prefixlen != matchlen ||
-	    (node->flags & LPM_TREE_NODE_FLAG_IM)) {
+	idx = lpm_node_find(node, level, key->prefixlen, key->data);
+	if (idx < 0) {
 		ret = -ENOENT;
 		goto out;
 	}
 
-	trie->n_entries--;
+	leaf = lpm_prefixes(node)[idx];
+	edit.child_slot = -1;
+	edit.del = leaf;
+	for (;; depth--) {
+		new_node = lpm_node_rebuild(trie, path[depth].node, depth,
+					    &edit);
+		if (IS_ERR(new_node)) {
+			ret = PTR_ERR(new_node);
+			goto out;
+		}
+		if (new_node || !depth)
+			break;
 
-	/* If the node we are removing has two children, simply mark it
-	 * as intermediate and we are done.
-	 */
-	if (rcu_access_pointer(node->child[0]) &&
-	    rcu_access_pointer(node->child[1])) {
-		node->flags |= LPM_TREE_NODE_FLAG_IM;
-		goto out;
+		/* The node became empty, drop it from its parent */
+		edit.child_slot = key->data[depth - 1];
+		edit.del = NULL;
 	}
 
-	/* If the parent of the node we are about to delete is an intermediate
-	 * node, and the deleted node doesn't have any children, we can delete
-	 * the intermediate parent as well and promote its other child
-	 * up the tree.  Doing this maintains the invariant that all
-	 * intermediate nodes have exactly 2 children and that there are no
-	 * unnecessary intermediate nodes in the tree.
-	 */
-	if (parent && (parent->flags & LPM_TREE_NODE_FLAG_IM) &&
-	    !node->child[0] && !node->child[1]) {
-		if (node == rcu_access_pointer(parent->child[0]))
-			rcu_assign_pointer(
-				*trim2, rcu_access_pointer(parent->child[1]));
-		else
-			rcu_assign_pointer(
-				*trim2, rcu_access_pointer(parent->child[0]));
-		kfree_rcu(parent, rcu);
-		kfree_rcu(node, rcu);
-		goto out;
-	}
+	rcu_assign_pointer(*path[depth].slot, new_node);
+	for (; depth <= level; depth++)
+		kfree_rcu(path[depth].node, rcu);
+	kfree_rcu(leaf, rcu);
 
-	/* The node we are removing has either zero or one child. If there
-	 * is a child, move it into the removed node's slot then delete
-	 * the node.  Otherwise just clear the slot and delete the node.
-	 */
-	if (node->child[0])
-		rcu_assign_pointer(*trim, rcu_access_pointer(node->child[0]));
-	else if (node->child[1])
-		rcu_assign_pointer(*trim, rcu_access_pointer(node->child[1]));
-	else
-		RCU_INIT_POINTER(*trim, NULL);
-	kfree_rcu(node, rcu);
+	trie->n_entries--;
 
 out:
 	spin_unlock_irqrestore(&trie->lock, irq_flags);
+	kfree(path);
 
 	return ret;
 }
@@ -527,7 +620,7 @@ static int trie_delete_elem(struct bpf_map *map, void *_key)
 #define LPM_DATA_SIZE_MIN	1
 
 #define LPM_VAL_SIZE_MAX	(KMALLOC_MAX_SIZE - LPM_DATA_SIZE_MAX - \
-				 sizeof(struct lpm_trie_node))
+				 sizeof(struct lpm_trie_leaf))
 #define LPM_VAL_SIZE_MIN	1
 
 #define LPM_KEY_SIZE(X)		(sizeof(struct bpf_lpm_trie_key) + (X))
@@ -573,12 +666,13 @@ static struct bpf_map *trie_alloc(union bpf_attr *attr)
 static void trie_free(struct bpf_map *map)
 {
 	struct lpm_trie *trie = container_of(map, struct lpm_trie, map);
-	struct lpm_trie_node __rcu **slot;
+	struct lpm_trie_node __rcu **slot, **child;
 	struct lpm_trie_node *node;
+	u32 i;
 
 	/* Always start at the root and walk down to a node that has no
-	 * children. Then free that node, nullify its reference in the parent
-	 * and start over.
+	 * children left. Then free that node and its prefixes, nullify its
+	 * reference in the parent and start over.
 	 */
 
 	for (;;) {
@@ -589,16 +683,20 @@ static void trie_free(struct bpf_map *map)
 			if (!node)
 				goto out;
 
-			if (rcu_access_pointer(node->child[0])) {
-				slot = &node->child[0];
-				continue;
+			child = NULL;
+			for (i = 0; i < node->nr_children; i++) {
+				if (rcu_access_pointer(lpm_children(node)[i])) {
+					child = &lpm_children(node)[i];
+					break;
+				}
 			}
-
-			if (rcu_access_pointer(node->child[1])) {
-				slot = &node->child[1];
+			if (child) {
+				slot = child;
 				continue;
 			}
 
+			for (i = 0; i < node->nr_prefixes; i++)
+				kfree(lpm_prefixes(node)[i]);
 			kfree(node);
 			RCU_INIT_POINTER(*slot, NULL);
 			break;
@@ -609,75 +707,90 @@ static void trie_free(struct bpf_map *map)
 	kfree(trie);
 }
 
+/* First prefix in postorder of the subtree rooted at @node. Nodes without
+ * children always store at least one prefix.
+ */
+static struct lpm_trie_leaf *lpm_leftmost(struct lpm_trie_node *node)
+{
+	while (node->nr_children)
+		node = rcu_dereference(lpm_children(node)[0]);
+	return lpm_prefixes(node)[0];
+}
+
 static int trie_get_next_key(struct bpf_map *map, void *_key, void *_next_key)
 {
-	struct lpm_trie_node *node, *next_node = NULL, *parent, *search_root;
 	struct lpm_trie *trie = container_of(map, struct lpm_trie, map);
 	struct bpf_lpm_trie_key *key = _key, *next_key = _next_key;
 	struct lpm_trie_node **node_stack = NULL;
-	int err = 0, stack_ptr = -1;
-	unsigned int next_bit;
-	size_t matchlen;
+	struct lpm_trie_node *node, *parent, *root;
+	struct lpm_trie_leaf *next = NULL;
+	struct lpm_trie_node __rcu **slot;
+	u32 level, depth, i;
+	int idx, err = 0;
 
-	/* The get_next_key follows postorder. For the 4 node example in
-	 * the top of this file, the trie_get_next_key() returns the following
-	 * one after another:
+	/* The get_next_key follows postorder: the children of a node in
+	 * ascending slot order, then the prefixes of the node itself, longest
+	 * first. For the example at the top of this file, trie_get_next_key()
+	 * returns the following one after another:
 	 *   192.168.0.0/24
 	 *   192.168.1.0/24
-	 *   192.168.128.0/24
+	 *   192.168.128.0/17
 	 *   192.168.0.0/16
 	 *
 	 * The idea is to return more specific keys before less specific ones.
 	 */
 
 	/* Empty trie */
-	search_root = rcu_dereference(trie->root);
-	if (!search_root)
+	root = rcu_dereference(trie->root);
+	if (!root)
 		return -ENOENT;
 
 	/* For invalid key, find the leftmost node in the trie */
 	if (!key || key->prefixlen > trie->max_prefixlen)
 		goto find_leftmost;
 
-	node_stack = kmalloc_array(trie->max_prefixlen,
-				   sizeof(struct lpm_trie_node *),
+	level = lpm_level(key->prefixlen);
+	node_stack = kmalloc_array(level + 1, sizeof(struct lpm_trie_node *),
 				   GFP_ATOMIC | __GFP_NOWARN);
 	if (!node_stack)
 		return -ENOMEM;
 
-	/* Try to find the exact node for the given key */
-	for (node = search_root; node;) {
-		node_stack[++stack_ptr] = node;
-		matchlen = longest_prefix_match(trie, node, key);
-		if (node->prefixlen != matchlen ||
-		    node->prefixlen == key->prefixlen)
-			break;
-
-		next_bit = extract_bit(key->data, node->prefixlen);
-		node = rcu_dereference(node->child[next_bit]);
+	/* Try to find the exact prefix for the given key */
+	node = root;
+	for (depth = 0; depth < level; depth++) {
+		node_stack[depth] = node;
+		slot = lpm_child_slot(node, key->data[depth]);
+		if (!slot)
+			goto find_leftmost;
+		node = rcu_dereference(*slot);
 	}
-	if (!node || node->prefixlen != key->prefixlen ||
-	    (node->flags & LPM_TREE_NODE_FLAG_IM))
+	node_stack[level] = node;
+
+	idx = lpm_node_find(node, level, key->prefixlen, key->data);
+	if (idx < 0)
 		goto find_leftmost;
 
-	/* The node with the exactly-matching key has been found,
-	 * find the first node in postorder after the matched node.
+	/* The exactly-matching prefix has been found, find the first prefix
+	 * in postorder after it.
 	 */
-	node = node_stack[stack_ptr];
-	while (stack_ptr > 0) {
-		parent = node_stack[stack_ptr - 1];
-		if (rcu_dereference(parent->child[0]) == node) {
-			search_root = rcu_dereference(parent->child[1]);
-			if (search_root)
-				goto find_leftmost;
+	if (idx + 1 < node->nr_prefixes) {
+		next = lpm_prefixes(node)[idx + 1];
+		goto do_copy;
+	}
+
+	for (depth = level; depth > 0; depth--) {
+		parent = node_stack[depth - 1];
+		for (i = key->data[depth - 1] + 1; i < LPM_FANOUT; i++) {
+			slot = lpm_child_slot(parent, i);
+			if (slot) {
+				next = lpm_leftmost(rcu_dereference(*slot));
+				goto do_copy;
+			}
 		}
-		if (!(parent->flags & LPM_TREE_NODE_FLAG_IM)) {
-			next_node = parent;
+		if (parent->nr_prefixes) {
+			next = lpm_prefixes(parent)[0];
 			goto do_copy;
 		}
-
-		node = parent;
-		stack_ptr--;
 	}
 
 	/* did not find anything */
@@ -685,23 +798,11 @@ static int trie_get_next_key(struct bpf_map *map, void *_key, void *_next_key)
 	goto free_stack;
 
 find_leftmost:
-	/* Find the leftmost non-intermediate node, all intermediate nodes
-	 * have exact two children, so this function will never return NULL.
-	 */
-	for (node = search_root; node;) {
-		if (node->flags & LPM_TREE_NODE_FLAG_IM) {
-			node = rcu_dereference(node->child[0]);
-		} else {
-			next_node = node;
-			node = rcu_dereference(node->child[0]);
-			if (!node)
-				node = rcu_dereference(next_node->child[1]);
-		}
-	}
+	next = lpm_leftmost(root);
 do_copy:
-	next_key->prefixlen = next_node->prefixlen;
+	next_key->prefixlen = next->prefixlen;
 	memcpy((void *)next_key + offsetof(struct bpf_lpm_trie_key, data),
-	       next_node->data, trie->data_size);
+	       next->data, trie->data_size);
 free_stack:
 	kfree(node_stack);
 	return err;
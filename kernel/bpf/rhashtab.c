@@ -0,0 +1,811 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Resizable hash map
+ *
+ * BPF_MAP_TYPE_RHASH sizes its bucket array by the number of elements in
+ * the map rather than by max_entries, which only caps the element count.
+ * The table starts small, doubles when it is 75% full and shrinks again
+ * when it drops below 30%.
+ *
+ * Lookups are lockless and only need RCU. Buckets don't carry a separate
+ * spinlock: bit 0 of the bucket head doubles as the bucket lock, which
+ * writers take for the short section that links or unlinks an element.
+ * Element allocation and freeing happen outside of it.
+ *
+ * Resizing is incremental and runs from a workqueue, in the spirit of
+ * lib/rhashtable.c. The new table is published as ->future_tbl of the
+ * current one and chains are then moved over one element at a time.
+ * While that is in progress lookups and deletes visit both tables and
+ * inserts go to the newest one, so neither readers nor writers ever wait
+ * for a resize to complete.
+ */
+#include <linux/bpf.h>
+#include <linux/btf.h>
+#include <linux/bit_spinlock.h>
+#include <linux/filter.h>
+#include <linux/irq_work.h>
+#include <linux/jhash.h>
+#include <linux/random.h>
+#include <linux/workqueue.h>
+#include <uapi/linux/btf.h>
+
+#define RHTAB_CREATE_FLAG_MASK						\
+	(BPF_F_NO_PREALLOC | BPF_F_NUMA_NODE | BPF_F_ACCESS_MASK |	\
+	 BPF_F_ZERO_SEED)
+
+#define RHTAB_MIN_SIZE	16
+#define RHTAB_MAX_SIZE	(1U << 31)
+#define RHTAB_LOCK_BIT	0
+
+/* Bit 0 of ->first is the bucket lock. The remaining bits point at the
+ * first element of the chain, or are zero if the chain is empty.
+ *
+ * The ->next link of the last element in a chain holds the nulls marker
+ * of its bucket, i.e. the bucket address with bit 0 set. A lockless
+ * reader that ends up on a different marker followed an element that
+ * was moved to another chain and has to restart the walk.
+ */
+struct rhtab_bucket {
+	unsigned long first;
+};
+
+struct rhtab_table {
+	u32 size;	/* number of buckets, power of 2 */
+	struct rhtab_table __rcu *future_tbl;
+	struct rhtab_bucket buckets[];
+};
+
+struct bpf_rhtab {
+	struct bpf_map map;
+	struct rhtab_table __rcu *tbl;
+	atomic_t count;	/* number of elements in this hashtable */
+	u32 max_size;	/* upper bound for tbl->size */
+	u32 elem_size;	/* size of each element in bytes */
+	u32 hashrnd;
+	int __percpu *map_locked;
+	struct irq_work resize_irq_work;
+	struct work_struct resize_work;
+};
+
+/* each rhtab element is struct rhtab_elem + key + value */
+struct rhtab_elem {
+	unsigned long next;
+	struct rcu_head rcu;
+	u32 hash;
+	char key[] __aligned(8);
+};
+
+static inline unsigned long rhtab_nulls(const struct rhtab_bucket *b)
+{
+	return (unsigned long)b | 1UL;
+}
+
+static inline bool rhtab_is_nulls(unsigned long ptr)
+{
+	return ptr & 1UL;
+}
+
+static inline struct rhtab_bucket *rhtab_bucket(struct rhtab_table *tbl,
+						u32 hash)
+{
+	return &tbl->buckets[hash & (tbl->size - 1)];
+}
+
+static inline struct rhtab_elem *rhtab_first(const struct rhtab_bucket *b)
+{
+	return (struct rhtab_elem *)(READ_ONCE(b->first) &
+				     ~BIT(RHTAB_LOCK_BIT));
+}
+
+static inline struct rhtab_elem *rhtab_next(const struct rhtab_elem *l)
+{
+	unsigned long next = READ_ONCE(l->next);
+
+	return rhtab_is_nulls(next) ? NULL : (struct rhtab_elem *)next;
+}
+
+static inline void *rhtab_elem_value(const struct bpf_map *map,
+				     struct rhtab_elem *l)
+{
+	return l->key + round_up(map->key_size, 8);
+}
+
+static inline u32 rhtab_map_hash(const void *key, u32 key_len, u32 hashrnd)
+{
+	return jhash(key, key_len, hashrnd);
+}
+
+static inline bool rhtab_grow_above_75(const struct bpf_rhtab *rhtab,
+				       const struct rhtab_table *tbl)
+{
+	return atomic_read(&rhtab->count) > tbl->size / 4 * 3 &&
+	       tbl->size < rhtab->max_size;
+}
+
+static inline bool rhtab_shrink_below_30(const struct bpf_rhtab *rhtab,
+					 const struct rhtab_table *tbl)
+{
+	return atomic_read(&rhtab->count) < tbl->size / 10 * 3 &&
+	       tbl->size > RHTAB_MIN_SIZE;
+}
+
+/* Like htab_lock_bucket(), the per-CPU map_locked counter turns recursion
+ * from a BPF program that interrupted a bucket lock holder on the same
+ * CPU into -EBUSY instead of a deadlock.
+ */
+static inline int rhtab_lock_bucket(const struct bpf_rhtab *rhtab,
+				    struct rhtab_bucket *b,
+				    unsigned long *pflags)
+{
+	unsigned long flags;
+
+	migrate_disable();
+	if (unlikely(__this_cpu_inc_return(*rhtab->map_locked) != 1)) {
+		__this_cpu_dec(*rhtab->map_locked);
+		migrate_enable();
+		return -EBUSY;
+	}
+
+	local_irq_save(flags);
+	bit_spin_lock(RHTAB_LOCK_BIT, &b->first);
+	*pflags = flags;
+
+	return 0;
+}
+
+static inline void rhtab_unlock_bucket(const struct bpf_rhtab *rhtab,
+				       struct rhtab_bucket *b,
+				       unsigned long flags)
+{
+	bit_spin_unlock(RHTAB_LOCK_BIT, &b->first);
+	local_irq_restore(flags);
+	__this_cpu_dec(*rhtab->map_locked);
+	migrate_enable();
+}
+
+/* Store @val into @link, which is either the head of bucket @b or the
+ * ->next field of an element in its chain. Must be called with the
+ * bucket lock held; the lock bit is preserved for the head.
+ */
+static void rhtab_assign_link(struct rhtab_bucket *b, unsigned long *link,
+			      unsigned long val)
+{
+	if (link == &b->first) {
+		if (rhtab_is_nulls(val))
+			val = 0;
+		val |= BIT(RHTAB_LOCK_BIT);
+	}
+	smp_store_release(link, val);
+}
+
+/* add @l to the head of the chain, so that a concurrent search finds it
+ * before any element it replaces
+ */
+static void rhtab_link_elem(struct rhtab_bucket *b, struct rhtab_elem *l)
+{
+	struct rhtab_elem *first = rhtab_first(b);
+
+	WRITE_ONCE(l->next, first ? (unsigned long)first : rhtab_nulls(b));
+	rhtab_assign_link(b, &b->first, (unsigned long)l);
+}
+
+/* this lookup function can only be called with bucket lock taken */
+static struct rhtab_elem *lookup_elem_raw(struct rhtab_bucket *b, u32 hash,
+					  void *key, u32 key_size,
+					  unsigned long **pprev)
+{
+	unsigned long *link = &b->first;
+	struct rhtab_elem *l;
+
+	for (l = rhtab_first(b); l; l = rhtab_next(l)) {
+		if (l->hash == hash && !memcmp(l->key, key, key_size)) {
+			*pprev = link;
+			return l;
+		}
+		link = &l->next;
+	}
+
+	return NULL;
+}
+
+/* can be called without bucket lock. it will repeat the walk in the
+ * unlikely event that an element was moved into another chain while the
+ * list was being walked
+ */
+static struct rhtab_elem *lookup_nulls_elem_raw(struct rhtab_bucket *b,
+						u32 hash, void *key,
+						u32 key_size)
+{
+	unsigned long ptr;
+	struct rhtab_elem *l;
+
+again:
+	ptr = (unsigned long)rhtab_first(b);
+	if (!ptr)
+		return NULL;
+
+	while (!rhtab_is_nulls(ptr)) {
+		l = (struct rhtab_elem *)ptr;
+		if (l->hash == hash && !memcmp(l->key, key, key_size))
+			return l;
+		ptr = READ_ONCE(l->next);
+	}
+
+	if (unlikely(ptr != rhtab_nulls(b)))
+		goto again;
+
+	return NULL;
+}
+
+static struct rhtab_table *rhtab_alloc_table(struct bpf_rhtab *rhtab,
+					     u32 size)
+{
+	struct rhtab_table *tbl;
+
+	/* bpf_map_area_alloc() zero-fills, so all buckets start out empty */
+	tbl = bpf_map_area_alloc(struct_size(tbl, buckets, size),
+				 rhtab->map.numa_node);
+	if (!tbl)
+		return NULL;
+
+	tbl->size = size;
+	RCU_INIT_POINTER(tbl->future_tbl, NULL);
+	return tbl;
+}
+
+/* Move all elements of one bucket of @old_tbl into @new_tbl. Elements are
+ * taken off the tail of the chain, so the part of the chain that readers
+ * may still be walking stays intact. A reader that sits on the element
+ * being moved follows it into the new chain, sees a foreign nulls marker
+ * at its end and restarts.
+ */
+static void rhtab_rehash_chain(struct bpf_rhtab *rhtab,
+			       struct rhtab_table *old_tbl,
+			       struct rhtab_table *new_tbl, u32 idx)
+{
+	struct rhtab_bucket *old_b = &old_tbl->buckets[idx], *new_b;
+	struct rhtab_elem *l, *next;
+	unsigned long flags, *pprev;
+
+	/* The resize worker never runs nested in a bucket lock holder, so
+	 * map_locked can't be elevated on this CPU and there is no need to
+	 * handle -EBUSY here.
+	 */
+	migrate_disable();
+	__this_cpu_inc(*rhtab->map_locked);
+	local_irq_save(flags);
+	bit_spin_lock(RHTAB_LOCK_BIT, &old_b->first);
+
+	while ((l = rhtab_first(old_b))) {
+		pprev = &old_b->first;
+		while ((next = rhtab_next(l))) {
+			pprev = &l->next;
+			l = next;
+		}
+
+		new_b = rhtab_bucket(new_tbl, l->hash);
+		bit_spin_lock(RHTAB_LOCK_BIT, &new_b->first);
+		rhtab_link_elem(new_b, l);
+		bit_spin_unlock(RHTAB_LOCK_BIT, &new_b->first);
+
+		rhtab_assign_link(old_b, pprev, rhtab_nulls(old_b));
+	}
+
+	bit_spin_unlock(RHTAB_LOCK_BIT, &old_b->first);
+	local_irq_restore(flags);
+	__this_cpu_dec(*rhtab->map_locked);
+	migrate_enable();
+}
+
+static int rhtab_rehash(struct bpf_rhtab *rhtab, struct rhtab_table *old_tbl,
+			u32 size)
+{
+	struct rhtab_table *new_tbl;
+	u32 i;
+
+	new_tbl = rhtab_alloc_table(rhtab, size);
+	if (!new_tbl)
+		return -ENOMEM;
+
+	/* From here on inserts go into new_tbl, while lookups and deletes
+	 * visit both tables. Writers read ->future_tbl under the bucket
+	 * lock, so an element inserted into old_tbl is always seen by
+	 * rhtab_rehash_chain() below.
+	 */
+	rcu_assign_pointer(old_tbl->future_tbl, new_tbl);
+
+	for (i = 0; i < old_tbl->size; i++) {
+		rhtab_rehash_chain(rhtab, old_tbl, new_tbl, i);
+		cond_resched();
+	}
+
+	rcu_assign_pointer(rhtab->tbl, new_tbl);
+
+	/* wait for lookups and updates which may still be walking old_tbl */
+	synchronize_rcu();
+	bpf_map_area_free(old_tbl);
+
+	return 0;
+}
+
+static u32 rhtab_target_size(const struct bpf_rhtab *rhtab,
+			     const struct rhtab_table *tbl)
+{
+	u32 count = atomic_read(&rhtab->count);
+
+	if (rhtab_grow_above_75(rhtab, tbl))
+		return min(tbl->size * 2, rhtab->max_size);
+
+	/* shrink straight to a size that is at most 75% full */
+	if (rhtab_shrink_below_30(rhtab, tbl))
+		return max_t(u32, roundup_pow_of_two(count / 3 * 4 + 1),
+			     RHTAB_MIN_SIZE);
+
+	return tbl->size;
+}
+
+static void rhtab_resize_work(struct work_struct *work)
+{
+	struct bpf_rhtab *rhtab = container_of(work, struct bpf_rhtab,
+					       resize_work);
+	struct rhtab_table *tbl;
+	u32 size;
+
+	/* The work item is the only writer of rhtab->tbl. Keep going until
+	 * the table size matches the element count, as the map may keep
+	 * filling up while a rehash is in progress.
+	 */
+	tbl = rcu_dereference_protected(rhtab->tbl, 1);
+	size = rhtab_target_size(rhtab, tbl);
+	while (size != tbl->size) {
+		if (rhtab_rehash(rhtab, tbl, size))
+			break;
+		tbl = rcu_dereference_protected(rhtab->tbl, 1);
+		size = rhtab_target_size(rhtab, tbl);
+	}
+}
+
+/* BPF programs can update the map from contexts where queueing work is
+ * not safe, so bounce through irq_work first.
+ */
+static void rhtab_resize_irq_work(struct irq_work *work)
+{
+	struct bpf_rhtab *rhtab = container_of(work, struct bpf_rhtab,
+					       resize_irq_work);
+
+	queue_work(system_unbound_wq, &rhtab->resize_work);
+}
+
+/* Called from syscall */
+static int rhtab_map_alloc_check(union bpf_attr *attr)
+{
+	bool zero_seed = (attr->map_flags & BPF_F_ZERO_SEED);
+
+	if (zero_seed && !capable(CAP_SYS_ADMIN))
+		/* Guard against local DoS, and discourage production use. */
+		return -EPERM;
+
+	if (attr->map_flags & ~RHTAB_CREATE_FLAG_MASK ||
+	    !bpf_map_flags_access_ok(attr->map_flags))
+		return -EINVAL;
+
+	if (attr->max_entries == 0 || attr->key_size == 0 ||
+	    attr->value_size == 0)
+		return -EINVAL;
+
+	if (attr->max_entries > RHTAB_MAX_SIZE)
+		return -E2BIG;
+
+	if ((u64)attr->key_size + attr->value_size >= KMALLOC_MAX_SIZE -
+	   sizeof(struct rhtab_elem))
+		/* if key_size + value_size is bigger, the user space won't be
+		 * able to access the elements via bpf syscall. This check
+		 * also makes sure that the elem_size doesn't overflow and it's
+		 * kmalloc-able later in rhtab_map_update_elem()
+		 */
+		return -E2BIG;
+
+	return 0;
+}
+
+static struct bpf_map *rhtab_map_alloc(union bpf_attr *attr)
+{
+	struct bpf_rhtab *rhtab;
+	struct rhtab_table *tbl;
+	int err = -ENOMEM;
+
+	rhtab = kzalloc(sizeof(*rhtab), GFP_USER | __GFP_ACCOUNT);
+	if (!rhtab)
+		return ERR_PTR(-ENOMEM);
+
+	bpf_map_init_from_attr(&rhtab->map, attr);
+
+	/* hash table size must be power of 2 */
+	rhtab->max_size = roundup_pow_of_two(rhtab->map.max_entries);
+	rhtab->elem_size = sizeof(struct rhtab_elem) +
+			   round_up(rhtab->map.key_size, 8) +
+			   round_up(rhtab->map.value_size, 8);
+
+	rhtab->map_locked = bpf_map_alloc_percpu(&rhtab->map, sizeof(int),
+						 sizeof(int), GFP_USER);
+	if (!rhtab->map_locked)
+		goto free_rhtab;
+
+	tbl = rhtab_alloc_table(rhtab, min_t(u32, RHTAB_MIN_SIZE,
+					     rhtab->max_size));
+	if (!tbl)
+		goto free_map_locked;
+	RCU_INIT_POINTER(rhtab->tbl, tbl);
+
+	if (rhtab->map.map_flags & BPF_F_ZERO_SEED)
+		rhtab->hashrnd = 0;
+	else
+		rhtab->hashrnd = get_random_int();
+
+	init_irq_work(&rhtab->resize_irq_work, rhtab_resize_irq_work);
+	INIT_WORK(&rhtab->resize_work, rhtab_resize_work);
+
+	return &rhtab->map;
+
+free_map_locked:
+	free_percpu(rhtab->map_locked);
+free_rhtab:
+	kfree(rhtab);
+	return ERR_PTR(err);
+}
+
+/* Called from syscall or from eBPF program directly, so
+ * arguments have to match bpf_map_lookup_elem() exactly.
+ * The return value is adjusted by BPF instructions
+ * in rhtab_map_gen_lookup().
+ */
+static void *__rhtab_map_lookup_elem(struct bpf_map *map, void *key)
+{
+	struct bpf_rhtab *rhtab = container_of(map, struct bpf_rhtab, map);
+	struct rhtab_table *tbl;
+	struct rhtab_elem *l;
+	u32 hash, key_size;
+
+	WARN_ON_ONCE(!rcu_read_lock_held());
+
+	key_size = map->key_size;
+
+	hash = rhtab_map_hash(key, key_size, rhtab->hashrnd);
+
+	tbl = rcu_dereference(rhtab->tbl);
+	do {
+		l = lookup_nulls_elem_raw(rhtab_bucket(tbl, hash), hash, key,
+					  key_size);
+		if (l)
+			return l;
+
+		/* the element may have been moved to a table being resized
+		 * into while we were walking this one
+		 */
+		smp_rmb();
+		tbl = rcu_dereference(tbl->future_tbl);
+	} while (tbl);
+
+	return NULL;
+}
+
+static void *rhtab_map_lookup_elem(struct bpf_map *map, void *key)
+{
+	struct rhtab_elem *l = __rhtab_map_lookup_elem(map, key);
+
+	if (l)
+		return rhtab_elem_value(map, l);
+
+	return NULL;
+}
+
+/* inline bpf_map_lookup_elem() call, see htab_map_gen_lookup() */
+static int rhtab_map_gen_lookup(struct bpf_map *map, struct bpf_insn *insn_buf)
+{
+	struct bpf_insn *insn = insn_buf;
+	const int ret = BPF_REG_0;
+
+	BUILD_BUG_ON(!__same_type(&__rhtab_map_lookup_elem,
+		     (void *(*)(struct bpf_map *map, void *key))NULL));
+	*insn++ = BPF_EMIT_CALL(BPF_CAST_CALL(__rhtab_map_lookup_elem));
+	*insn++ = BPF_JMP_IMM(BPF_JEQ, ret, 0, 1);
+	*insn++ = BPF_ALU64_IMM(BPF_ADD, ret,
+				offsetof(struct rhtab_elem, key) +
+				round_up(map->key_size, 8));
+	return insn - insn_buf;
+}
+
+/* Called from syscall */
+static int rhtab_map_get_next_key(struct bpf_map *map, void *key,
+				  void *next_key)
+{
+	struct bpf_rhtab *rhtab = container_of(map, struct bpf_rhtab, map);
+	struct rhtab_elem *l = NULL, *next_l;
+	struct rhtab_table *tbl;
+	u32 hash, key_size;
+	u32 i = 0;
+
+	WARN_ON_ONCE(!rcu_read_lock_held());
+
+	key_size = map->key_size;
+
+	tbl = rcu_dereference(rhtab->tbl);
+	if (!key)
+		goto find_first_elem;
+
+	hash = rhtab_map_hash(key, key_size, rhtab->hashrnd);
+
+	/* lookup the key, remembering the table it was found in */
+	for (; tbl; tbl = rcu_dereference(tbl->future_tbl)) {
+		l = lookup_nulls_elem_raw(rhtab_bucket(tbl, hash), hash, key,
+					  key_size);
+		if (l)
+			break;
+		smp_rmb();
+	}
+
+	if (!l) {
+		tbl = rcu_dereference(rhtab->tbl);
+		goto find_first_elem;
+	}
+
+	/* key was found, get next key in the same bucket */
+	next_l = rhtab_next(l);
+	if (next_l) {
+		/* if next elem in this hash list is non-zero, just return it */
+		memcpy(next_key, next_l->key, key_size);
+		return 0;
+	}
+
+	/* no more elements in this hash list, go to the next bucket */
+	i = (hash & (tbl->size - 1)) + 1;
+
+find_first_elem:
+	/* iterate over buckets, continuing into a table being resized into */
+	for (; tbl; tbl = rcu_dereference(tbl->future_tbl), i = 0) {
+		for (; i < tbl->size; i++) {
+			/* pick first element in the bucket */
+			next_l = rhtab_first(&tbl->buckets[i]);
+			if (next_l) {
+				/* if it's not empty, just return it */
+				memcpy(next_key, next_l->key, key_size);
+				return 0;
+			}
+		}
+		smp_rmb();
+	}
+
+	/* iterated over all buckets and all elements */
+	return -ENOENT;
+}
+
+static void rhtab_elem_free_rcu(struct rcu_head *head)
+{
+	kfree(container_of(head, struct rhtab_elem, rcu));
+}
+
+static struct rhtab_elem *alloc_rhtab_elem(struct bpf_rhtab *rhtab,
+					   void *key, void *value, u32 hash)
+{
+	struct bpf_map *map = &rhtab->map;
+	struct rhtab_elem *l_new;
+
+	l_new = bpf_map_kmalloc_node(map, rhtab->elem_size,
+				     GFP_ATOMIC | __GFP_NOWARN,
+				     map->numa_node);
+	if (!l_new)
+		return NULL;
+
+	memcpy(l_new->key, key, map->key_size);
+	copy_map_value(map, rhtab_elem_value(map, l_new), value);
+	l_new->hash = hash;
+	return l_new;
+}
+
+static int check_flags(struct rhtab_elem *l_old, u64 map_flags)
+{
+	if (l_old && map_flags == BPF_NOEXIST)
+		/* elem already exists */
+		return -EEXIST;
+
+	if (!l_old && map_flags == BPF_EXIST)
+		/* elem doesn't exist, cannot update it */
+		return -ENOENT;
+
+	return 0;
+}
+
+/* Called from syscall or from eBPF program */
+static int rhtab_map_update_elem(struct bpf_map *map, void *key, void *value,
+				 u64 map_flags)
+{
+	struct bpf_rhtab *rhtab = container_of(map, struct bpf_rhtab, map);
+	struct rhtab_elem *l_new, *l_old;
+	struct rhtab_table *tbl, *future_tbl;
+	unsigned long flags, *pprev;
+	struct rhtab_bucket *b;
+	u32 key_size, hash;
+	int ret;
+
+	if (unlikely(map_flags > BPF_EXIST))
+		/* unknown flags */
+		return -EINVAL;
+
+	WARN_ON_ONCE(!rcu_read_lock_held());
+
+	key_size = map->key_size;
+
+	hash = rhtab_map_hash(key, key_size, rhtab->hashrnd);
+
+	/* Allocate before taking the bucket lock to keep the lock held
+	 * section down to a few pointer updates.
+	 */
+	l_new = alloc_rhtab_elem(rhtab, key, value, hash);
+	if (!l_new)
+		return -ENOMEM;
+
+	/* An existing element may still sit in a table that is being
+	 * resized, but new elements always go into the newest table.
+	 */
+	tbl = rcu_dereference(rhtab->tbl);
+	for (;;) {
+		b = rhtab_bucket(tbl, hash);
+		ret = rhtab_lock_bucket(rhtab, b, &flags);
+		if (ret)
+			goto free_new;
+
+		l_old = lookup_elem_raw(b, hash, key, key_size, &pprev);
+		future_tbl = rcu_dereference(tbl->future_tbl);
+		if (l_old || !future_tbl)
+			break;
+
+		rhtab_unlock_bucket(rhtab, b, flags);
+		tbl = future_tbl;
+	}
+
+	ret = check_flags(l_old, map_flags);
+	if (ret)
+		goto err;
+
+	if (l_old) {
+		WRITE_ONCE(l_new->next, READ_ONCE(l_old->next));
+		rhtab_assign_link(b, pprev, (unsigned long)l_new);
+	} else {
+		if (atomic_inc_return(&rhtab->count) > map->max_entries) {
+			atomic_dec(&rhtab->count);
+			ret = -E2BIG;
+			goto err;
+		}
+		rhtab_link_elem(b, l_new);
+	}
+
+	rhtab_unlock_bucket(rhtab, b, flags);
+
+	if (l_old)
+		call_rcu(&l_old->rcu, rhtab_elem_free_rcu);
+	else if (rhtab_grow_above_75(rhtab, tbl))
+		irq_work_queue(&rhtab->resize_irq_work);
+	return 0;
+
+err:
+	rhtab_unlock_bucket(rhtab, b, flags);
+free_new:
+	kfree(l_new);
+	return ret;
+}
+
+/* Called from syscall or from eBPF program */
+static int rhtab_map_delete_elem(struct bpf_map *map, void *key)
+{
+	struct bpf_rhtab *rhtab = container_of(map, struct bpf_rhtab, map);
+	struct rhtab_table *tbl, *future_tbl;
+	unsigned long flags, *pprev;
+	struct rhtab_bucket *b;
+	struct rhtab_elem *l;
+	u32 hash, key_size;
+	int ret;
+
+	WARN_ON_ONCE(!rcu_read_lock_held());
+
+	key_size = map->key_size;
+
+	hash = rhtab_map_hash(key, key_size, rhtab->hashrnd);
+
+	tbl = rcu_dereference(rhtab->tbl);
+	for (;;) {
+		b = rhtab_bucket(tbl, hash);
+		ret = rhtab_lock_bucket(rhtab, b, &flags);
+		if (ret)
+			return ret;
+
+		l = lookup_elem_raw(b, hash, key, key_size, &pprev);
+		future_tbl = rcu_dereference(tbl->future_tbl);
+		if (l || !future_tbl)
+			break;
+
+		rhtab_unlock_bucket(rhtab, b, flags);
+		tbl = future_tbl;
+	}
+
+	if (l)
+		rhtab_assign_link(b, pprev, READ_ONCE(l->next));
+
+	rhtab_unlock_bucket(rhtab, b, flags);
+
+	if (!l)
+		return -ENOENT;
+
+	atomic_dec(&rhtab->count);
+	call_rcu(&l->rcu, rhtab_elem_free_rcu);
+	if (rhtab_shrink_below_30(rhtab, tbl))
+		irq_work_queue(&rhtab->resize_irq_work);
+	return 0;
+}
+
+/* Called when map->refcnt goes to zero, either from workqueue or from syscall */
+static void rhtab_map_free(struct bpf_map *map)
+{
+	struct bpf_rhtab *rhtab = container_of(map, struct bpf_rhtab, map);
+	struct rhtab_elem *l, *next;
+	struct rhtab_table *tbl;
+	u32 i;
+
+	/* No more updates can come in, so once a pending resize has been
+	 * flushed there is a single table left.
+	 */
+	irq_work_sync(&rhtab->resize_irq_work);
+	cancel_work_sync(&rhtab->resize_work);
+
+	tbl = rcu_dereference_protected(rhtab->tbl, 1);
+	for (i = 0; i < tbl->size; i++) {
+		for (l = rhtab_first(&tbl->buckets[i]); l; l = next) {
+			next = rhtab_next(l);
+			kfree(l);
+		}
+		cond_resched();
+	}
+
+	bpf_map_area_free(tbl);
+	free_percpu(rhtab->map_locked);
+	kfree(rhtab);
+}
+
+static void rhtab_map_seq_show_elem(struct bpf_map *map, void *key,
+				    struct seq_file *m)
+{
+	void *value;
+
+	rcu_read_lock();
+
+	value = rhtab_map_lookup_elem(map, key);
+	if (!value) {
+		rcu_read_unlock();
+		return;
+	}
+
+	btf_type_seq_show(map->btf, map->btf_key_type_id, key, m);
+	seq_puts(m, ": ");
+	btf_type_seq_show(map->btf, map->btf_value_type_id, value, m);
+	seq_puts(m, "\n");
+
+	rcu_read_unlock();
+}
+
+static int rhtab_map_btf_id;
+const struct bpf_map_ops rhtab_map_ops = {
+	.map_meta_equal = bpf_map_meta_equal,
+	.map_alloc_check = rhtab_map_alloc_check,
+	.map_alloc = rhtab_map_alloc,
+	.map_free = rhtab_map_free,
+	.map_get_next_key = rhtab_map_get_next_key,
+	.map_lookup_elem = rhtab_map_lookup_elem,
+	.map_update_elem = rhtab_map_update_elem,
+	.map_delete_elem = rhtab_map_delete_elem,
+	.map_gen_lookup = rhtab_map_gen_lookup,
+	.map_seq_show_elem = rhtab_map_seq_show_elem,
+	.map_lookup_batch = generic_map_lookup_batch,
+	.map_update_batch = generic_map_update_batch,
+	.map_delete_batch = generic_map_delete_batch,
+	.map_btf_name = "bpf_rhtab",
+	.map_btf_id = &rhtab_map_btf_id,
+};
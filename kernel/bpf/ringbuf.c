@@ -8,9 +8,10 @@
 #include <linux/vmalloc.h>
 #include <linux/wait.h>
 #include <linux/poll.h>
+#include <linux/timer.h>
 #include <uapi/linux/btf.h>
 
-#define RINGBUF_CREATE_FLAG_MASK (BPF_F_NUMA_NODE)
+#define RINGBUF_CREATE_FLAG_MASK (BPF_F_NUMA_NODE | BPF_F_RB_ADAPTIVE_WAKEUP)
 
 /* non-mmap()'able part of bpf_ringbuf (everything up to consumer page) */
 #define RINGBUF_PGOFF \
@@ -29,13 +30,39 @@
 #define RINGBUF_MAX_DATA_SZ \
 	(((1ULL << 24) - RINGBUF_POS_PAGES - RINGBUF_PGOFF) * PAGE_SIZE)
 
+/* With BPF_F_RB_ADAPTIVE_WAKEUP, the consumer is woken up once a quarter of
+ * the ring buffer is filled, or 10ms after the first record it has not
+ * been woken up for.
+ */
+#define RINGBUF_WAKEUP_WM_SHIFT 2
+#define RINGBUF_WAKEUP_TIMEOUT_MS 10
+
+struct bpf_ringbuf_stats {
+	u64 dropped;
+	u64 contended;
+};
+
 struct bpf_ringbuf {
 	wait_queue_head_t waitq;
 	struct irq_work work;
 	u64 mask;
 	struct page **pages;
 	int nr_pages;
-	spinlock_t spinlock ____cacheline_aligned_in_smp;
+	bool adaptive_wakeup;
+	unsigned long wakeup_wm;
+	atomic_t timer_armed;
+	struct irq_work timer_work;
+	struct timer_list wakeup_timer;
+	struct bpf_ringbuf_stats __percpu *stats;
+	/* Producers reserve space by advancing pending_pos with cmpxchg(),
+	 * then publish their record by advancing producer_pos, in
+	 * reservation order.
+	 */
+	unsigned long pending_pos ____cacheline_aligned_in_smp;
+	/* With adaptive wakeup, bytes of committed (submitted or discarded)
+	 * records, which may complete out of reservation order.
+	 */
+	atomic_long_t committed_pos;
 	/* Consumer and producer counters are put into separate pages to allow
 	 * mapping consumer page as r/w, but restrict producer page to r/o.
 	 * This protects producer position from being modified by user-space
@@ -117,6 +144,8 @@ static struct bpf_ringbuf *bpf_ringbuf_area_alloc(size_t data_sz, int numa_node)
 	return NULL;
 }
 
+static void bpf_ringbuf_free(struct bpf_ringbuf *rb);
+
 static void bpf_ringbuf_notify(struct irq_work *work)
 {
 	struct bpf_ringbuf *rb = container_of(work, struct bpf_ringbuf, work);
@@ -124,7 +153,28 @@ static void bpf_ringbuf_notify(struct irq_work *work)
 	wake_up_all(&rb->waitq);
 }
 
-static struct bpf_ringbuf *bpf_ringbuf_alloc(size_t data_sz, int numa_node)
+static void bpf_ringbuf_arm_timer(struct irq_work *work)
+{
+	struct bpf_ringbuf *rb = container_of(work, struct bpf_ringbuf,
+					      timer_work);
+
+	mod_timer(&rb->wakeup_timer,
+		  jiffies + msecs_to_jiffies(RINGBUF_WAKEUP_TIMEOUT_MS));
+}
+
+static unsigned long ringbuf_avail_data_sz(struct bpf_ringbuf *rb);
+
+static void bpf_ringbuf_wakeup_timer(struct timer_list *t)
+{
+	struct bpf_ringbuf *rb = from_timer(rb, t, wakeup_timer);
+
+	atomic_set(&rb->timer_armed, 0);
+	if (ringbuf_avail_data_sz(rb))
+		wake_up_all(&rb->waitq);
+}
+
+static struct bpf_ringbuf *bpf_ringbuf_alloc(size_t data_sz, int numa_node,
+					     bool adaptive_wakeup)
 {
 	struct bpf_ringbuf *rb;
 
@@ -132,12 +182,24 @@ static struct bpf_ringbuf *bpf_ringbuf_alloc(size_t data_sz, int numa_node)
 	if (!rb)
 		return NULL;
 
-	spin_lock_init(&rb->spinlock);
+	rb->stats = alloc_percpu_gfp(struct bpf_ringbuf_stats,
+				     GFP_KERNEL_ACCOUNT);
+	if (!rb->stats) {
+		bpf_ringbuf_free(rb);
+		return NULL;
+	}
+
 	init_waitqueue_head(&rb->waitq);
 	init_irq_work(&rb->work, bpf_ringbuf_notify);
+	init_irq_work(&rb->timer_work, bpf_ringbuf_arm_timer);
+	timer_setup(&rb->wakeup_timer, bpf_ringbuf_wakeup_timer, 0);
 
 	rb->mask = data_sz - 1;
+	rb->adaptive_wakeup = adaptive_wakeup;
+	rb->wakeup_wm = data_sz >> RINGBUF_WAKEUP_WM_SHIFT;
 	rb->consumer_pos = 0;
+	rb->pending_pos = 0;
+	atomic_long_set(&rb->committed_pos, 0);
 	rb->producer_pos = 0;
 
 	return rb;
@@ -167,7 +229,8 @@ static struct bpf_map *ringbuf_map_alloc(union bpf_attr *attr)
 
 	bpf_map_init_from_attr(&rb_map->map, attr);
 
-	rb_map->rb = bpf_ringbuf_alloc(attr->max_entries, rb_map->map.numa_node);
+	rb_map->rb = bpf_ringbuf_alloc(attr->max_entries, rb_map->map.numa_node,
+				       attr->map_flags & BPF_F_RB_ADAPTIVE_WAKEUP);
 	if (!rb_map->rb) {
 		kfree(rb_map);
 		return ERR_PTR(-ENOMEM);
@@ -184,6 +247,7 @@ static void bpf_ringbuf_free(struct bpf_ringbuf *rb)
 	struct page **pages = rb->pages;
 	int i, nr_pages = rb->nr_pages;
 
+	free_percpu(rb->stats);
 	vunmap(rb);
 	for (i = 0; i < nr_pages; i++)
 		__free_page(pages[i]);
@@ -195,6 +259,9 @@ static void ringbuf_map_free(struct bpf_map *map)
 	struct bpf_ringbuf_map *rb_map;
 
 	rb_map = container_of(map, struct bpf_ringbuf_map, map);
+	irq_work_sync(&rb_map->rb->timer_work);
+	del_timer_sync(&rb_map->rb->wakeup_timer);
+	irq_work_sync(&rb_map->rb->work);
 	bpf_ringbuf_free(rb_map->rb);
 	kfree(rb_map);
 }
@@ -266,6 +333,36 @@ static __poll_t ringbuf_map_poll(struct bpf_map *map, struct file *filp,
 	return 0;
 }
 
+static void bpf_ringbuf_stats(struct bpf_ringbuf *rb,
+			      struct bpf_ringbuf_stats *stats)
+{
+	const struct bpf_ringbuf_stats *pcpu;
+	int cpu;
+
+	memset(stats, 0, sizeof(*stats));
+	for_each_possible_cpu(cpu) {
+		pcpu = per_cpu_ptr(rb->stats, cpu);
+		stats->dropped += READ_ONCE(pcpu->dropped);
+		stats->contended += READ_ONCE(pcpu->contended);
+	}
+}
+
+static void ringbuf_map_show_fdinfo(const struct bpf_map *map,
+				    struct seq_file *m)
+{
+	struct bpf_ringbuf_map *rb_map;
+	struct bpf_ringbuf_stats stats;
+
+	rb_map = container_of(map, struct bpf_ringbuf_map, map);
+	bpf_ringbuf_stats(rb_map->rb, &stats);
+
+	seq_printf(m,
+		   "rb_dropped:\t%llu\n"
+		   "rb_contended:\t%llu\n",
+		   stats.dropped,
+		   stats.contended);
+}
+
 static int ringbuf_map_btf_id;
 const struct bpf_map_ops ringbuf_map_ops = {
 	.map_meta_equal = bpf_map_meta_equal,
@@ -277,6 +374,7 @@ const struct bpf_map_ops ringbuf_map_ops = {
 	.map_update_elem = ringbuf_map_update_elem,
 	.map_delete_elem = ringbuf_map_delete_elem,
 	.map_get_next_key = ringbuf_map_get_next_key,
+	.map_show_fdinfo = ringbuf_map_show_fdinfo,
 	.map_btf_name = "bpf_ringbuf_map",
 	.map_btf_id = &ringbuf_map_btf_id,
 };
@@ -307,7 +405,7 @@ bpf_ringbuf_restore_from_rec(struct bpf_ringbuf_hdr *hdr)
 
 static void *__bpf_ringbuf_reserve(struct bpf_ringbuf *rb, u64 size)
 {
-	unsigned long cons_pos, prod_pos, new_prod_pos, flags;
+	unsigned long cons_pos, prod_pos, new_prod_pos, old_pos, flags;
 	u32 len, pg_off;
 	struct bpf_ringbuf_hdr *hdr;
 
@@ -317,22 +415,34 @@ static void *__bpf_ringbuf_reserve(struct bpf_ringbuf *rb, u64 size)
 	len = round_up(size + BPF_RINGBUF_HDR_SZ, 8);
 	cons_pos = smp_load_acquire(&rb->consumer_pos);
 
-	if (in_nmi()) {
-		if (!spin_trylock_irqsave(&rb->spinlock, flags))
-			return NULL;
-	} else {
-		spin_lock_irqsave(&rb->spinlock, flags);
-	}
-
-	prod_pos = rb->producer_pos;
-	new_prod_pos = prod_pos + len;
-
-	/* check for out of ringbuf space by ensuring producer position
-	 * doesn't advance more than (ringbuf_size - 1) ahead
+	/* A reserved record has to be published before any later one, so
+	 * don't let the producer get interrupted until it is.
 	 */
-	if (new_prod_pos - cons_pos > rb->mask) {
-		spin_unlock_irqrestore(&rb->spinlock, flags);
-		return NULL;
+	local_irq_save(flags);
+
+	prod_pos = READ_ONCE(rb->pending_pos);
+	for (;;) {
+		/* In NMI, the interrupted context might have reserved a record
+		 * it can only publish once we return, so don't queue behind
+		 * in-flight records.
+		 */
+		if (in_nmi() && prod_pos != READ_ONCE(rb->producer_pos))
+			goto drop;
+
+		new_prod_pos = prod_pos + len;
+
+		/* check for out of ringbuf space by ensuring producer position
+		 * doesn't advance more than (ringbuf_size - 1) ahead
+		 */
+		if (new_prod_pos - cons_pos > rb->mask)
+			goto drop;
+
+		old_pos = cmpxchg(&rb->pending_pos, prod_pos, new_prod_pos);
+		if (old_pos == prod_pos)
+			break;
+
+		this_cpu_inc(rb->stats->contended);
+		prod_pos = old_pos;
 	}
 
 	hdr = (void *)rb->data + (prod_pos & rb->mask);
@@ -340,12 +450,25 @@ static void *__bpf_ringbuf_reserve(struct bpf_ringbuf *rb, u64 size)
 	hdr->len = size | BPF_RINGBUF_BUSY_BIT;
 	hdr->pg_off = pg_off;
 
+	/* Wait for the producers that reserved before us to write their
+	 * headers. They run with interrupts disabled, so this is short.
+	 */
+	if (READ_ONCE(rb->producer_pos) != prod_pos) {
+		this_cpu_inc(rb->stats->contended);
+		smp_cond_load_acquire(&rb->producer_pos, VAL == prod_pos);
+	}
+
 	/* pairs with consumer's smp_load_acquire() */
 	smp_store_release(&rb->producer_pos, new_prod_pos);
 
-	spin_unlock_irqrestore(&rb->spinlock, flags);
+	local_irq_restore(flags);
 
 	return (void *)hdr + BPF_RINGBUF_HDR_SZ;
+
+drop:
+	this_cpu_inc(rb->stats->dropped);
+	local_irq_restore(flags);
+	return NULL;
 }
 
 BPF_CALL_3(bpf_ringbuf_reserve, struct bpf_map *, map, u64, size, u64, flags)
@@ -367,12 +490,33 @@ const struct bpf_func_proto bpf_ringbuf_reserve_proto = {
 	.arg3_type	= ARG_ANYTHING,
 };
 
+/* Wake up the consumer when this record makes the unconsumed committed data
+ * cross the watermark. Records which are reserved but not yet committed
+ * don't count. Otherwise make sure the consumer is woken up by the timer.
+ */
+static void bpf_ringbuf_adaptive_notify(struct bpf_ringbuf *rb,
+					unsigned long committed, u32 len)
+{
+	unsigned long cons_pos = smp_load_acquire(&rb->consumer_pos);
+	unsigned long avail;
+
+	/* the consumer might have caught up with records committed since */
+	avail = committed - cons_pos;
+	if ((long)avail < 0)
+		avail = 0;
+
+	if (avail >= rb->wakeup_wm && avail - len < rb->wakeup_wm)
+		irq_work_queue(&rb->work);
+	else if (!atomic_xchg(&rb->timer_armed, 1))
+		irq_work_queue(&rb->timer_work);
+}
+
 static void bpf_ringbuf_commit(void *sample, u64 flags, bool discard)
 {
-	unsigned long rec_pos, cons_pos;
+	unsigned long rec_pos, cons_pos, committed = 0;
 	struct bpf_ringbuf_hdr *hdr;
 	struct bpf_ringbuf *rb;
-	u32 new_len;
+	u32 new_len, len;
 
 	hdr = sample - BPF_RINGBUF_HDR_SZ;
 	rb = bpf_ringbuf_restore_from_rec(hdr);
@@ -383,6 +527,11 @@ static void bpf_ringbuf_commit(void *sample, u64 flags, bool discard)
 	/* update record header with correct final size prefix */
 	xchg(&hdr->len, new_len);
 
+	len = round_up((new_len & ~BPF_RINGBUF_DISCARD_BIT) +
+		       BPF_RINGBUF_HDR_SZ, 8);
+	if (rb->adaptive_wakeup)
+		committed = atomic_long_add_return(len, &rb->committed_pos);
+
 	/* if consumer caught up and is waiting for our record, notify about
 	 * new data availability
 	 */
@@ -391,7 +540,11 @@ static void bpf_ringbuf_commit(void *sample, u64 flags, bool discard)
 
 	if (flags & BPF_RB_FORCE_WAKEUP)
 		irq_work_queue(&rb->work);
-	else if (cons_pos == rec_pos && !(flags & BPF_RB_NO_WAKEUP))
+	else if (flags & BPF_RB_NO_WAKEUP)
+		return;
+	else if (rb->adaptive_wakeup)
+		bpf_ringbuf_adaptive_notify(rb, committed, len);
+	else if (cons_pos == rec_pos)
 		irq_work_queue(&rb->work);
 }
 
@@ -451,6 +604,7 @@ const struct bpf_func_proto bpf_ringbuf_output_proto = {
 
 BPF_CALL_2(bpf_ringbuf_query, struct bpf_map *, map, u64, flags)
 {
+	struct bpf_ringbuf_stats stats;
 	struct bpf_ringbuf *rb;
 
 	rb = container_of(map, struct bpf_ringbuf_map, map)->rb;
@@ -464,6 +618,12 @@ BPF_CALL_2(bpf_ringbuf_query, struct bpf_map *, map, u64, flags)
 		return smp_load_acquire(&rb->consumer_pos);
 	case BPF_RB_PROD_POS:
 		return smp_load_acquire(&rb->producer_pos);
+	case BPF_RB_DROPPED:
+		bpf_ringbuf_stats(rb, &stats);
+		return stats.dropped;
+	case BPF_RB_CONTENDED:
+		bpf_ringbuf_stats(rb, &stats);
+		return stats.contended;
 	default:
 		return 0;
 	}
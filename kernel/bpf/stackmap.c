@@ -10,6 +10,7 @@
 #include <linux/irq_work.h>
 #include <linux/btf_ids.h>
 #include <linux/buildid.h>
+#include <linux/random.h>
 #include "percpu_freelist.h"
 
 #define STACK_CREATE_FLAG_MASK					\
@@ -148,7 +149,7 @@ static void stack_map_get_build_id_offset(struct bpf_stack_build_id *id_offs,
 					  u64 *ips, u32 trace_nr, bool user)
 {
 	int i;
-	struct vm_area_struct *vma;
+	struct vm_area_struct *vma, *prev_vma = NULL;
 	bool irq_work_busy = false;
 	struct stack_map_irq_work *work = NULL;
 
@@ -191,13 +192,22 @@ static void stack_map_get_build_id_offset(struct bpf_stack_build_id *id_offs,
 
 	for (i = 0; i < trace_nr; i++) {
 		vma = find_vma(current->mm, ips[i]);
+		/* consecutive frames are often in the same object */
+		if (vma && vma == prev_vma) {
+			memcpy(id_offs[i].build_id, id_offs[i - 1].build_id,
+			       BUILD_ID_SIZE_MAX);
+			goto build_id_valid;
+		}
 		if (!vma || build_id_parse(vma, id_offs[i].build_id, NULL)) {
 			/* per entry fall back to ips */
 			id_offs[i].status = BPF_STACK_BUILD_ID_IP;
 			id_offs[i].ip = ips[i];
 			memset(id_offs[i].build_id, 0, BUILD_ID_SIZE_MAX);
+			prev_vma = NULL;
 			continue;
 		}
+		prev_vma = vma;
+build_id_valid:
 		id_offs[i].offset = (vma->vm_pgoff << PAGE_SHIFT) + ips[i]
 			- vma->vm_start;
 		id_offs[i].status = BPF_STACK_BUILD_ID_VALID;
@@ -249,6 +259,180 @@ get_callchain_entry_for_task(struct task_struct *task, u32 init_nr)
 #endif
 }
 
+/* BPF_MAP_TYPE_STACK_TRIE stores stacks as paths in a trie of frames rooted
+ * at the outermost caller, so stacks sharing callers share their nodes. The
+ * id of a stack is the index of the node of its innermost frame, and
+ * following the parent links from there yields the stack innermost frame
+ * first. max_entries bounds the number of frame nodes, not of stacks.
+ *
+ * Nodes are found through a hash table keyed by (parent, ip). Each node is
+ * referenced by its children and, if a stack ends there, by that stack.
+ * References only drop to zero with the node's bucket locked, which is
+ * where lookups take theirs, so a node is never revived once freed.
+ */
+#define STACK_TRIE_ROOT		U32_MAX
+#define STACK_TRIE_F_STACK	0
+
+struct stack_trie_node {
+	union {
+		struct pcpu_freelist_node fnode;
+		struct hlist_node hash_node;
+	};
+	u64 ip;
+	u32 parent;
+	atomic_t refcnt;
+	unsigned long flags;
+};
+
+struct stack_trie_bucket {
+	raw_spinlock_t lock;
+	struct hlist_head head;
+};
+
+struct bpf_stack_trie {
+	struct bpf_map map;
+	struct stack_trie_node *nodes;
+	struct pcpu_freelist freelist;
+	u32 n_buckets;
+	u32 hashrnd;
+	struct stack_trie_bucket buckets[];
+};
+
+static u32 stack_trie_node_id(const struct bpf_stack_trie *strie,
+			      const struct stack_trie_node *node)
+{
+	return node - strie->nodes;
+}
+
+static struct stack_trie_bucket *
+stack_trie_bucket(struct bpf_stack_trie *strie, u32 parent, u64 ip)
+{
+	u32 hash = jhash_3words(parent, (u32)ip, (u32)(ip >> 32),
+				strie->hashrnd);
+
+	return &strie->buckets[hash & (strie->n_buckets - 1)];
+}
+
+static int stack_trie_lock(struct stack_trie_bucket *b, unsigned long *pflags)
+{
+	unsigned long flags;
+
+	local_irq_save(flags);
+	if (in_nmi()) {
+		if (!raw_spin_trylock(&b->lock)) {
+			local_irq_restore(flags);
+			return -EBUSY;
+		}
+	} else {
+		raw_spin_lock(&b->lock);
+	}
+	*pflags = flags;
+	return 0;
+}
+
+static void stack_trie_unlock(struct stack_trie_bucket *b, unsigned long flags)
+{
+	raw_spin_unlock_irqrestore(&b->lock, flags);
+}
+
+static void stack_trie_put(struct bpf_stack_trie *strie,
+			   struct stack_trie_node *node)
+{
+	struct stack_trie_bucket *b;
+	unsigned long flags;
+	u32 parent;
+
+	while (node) {
+		if (atomic_add_unless(&node->refcnt, -1, 1))
+			return;
+
+		/* If the lock cannot be taken from NMI, the node stays
+		 * until the map is freed.
+		 */
+		b = stack_trie_bucket(strie, node->parent, node->ip);
+		if (stack_trie_lock(b, &flags))
+			return;
+		if (!atomic_dec_and_test(&node->refcnt)) {
+			stack_trie_unlock(b, flags);
+			return;
+		}
+		hlist_del(&node->hash_node);
+		stack_trie_unlock(b, flags);
+
+		parent = node->parent;
+		pcpu_freelist_push(&strie->freelist, &node->fnode);
+		node = parent == STACK_TRIE_ROOT ? NULL : &strie->nodes[parent];
+	}
+}
+
+static long stack_trie_get_stackid(struct bpf_map *map, u64 *ips,
+				   u32 trace_nr)
+{
+	struct bpf_stack_trie *strie = container_of(map, struct bpf_stack_trie,
+						    map);
+	struct stack_trie_node *node = NULL, *child, *spare = NULL;
+	u32 parent = STACK_TRIE_ROOT;
+	struct stack_trie_bucket *b;
+	unsigned long flags;
+	long ret;
+	int i;
+
+	for (i = trace_nr - 1; i >= 0; i--) {
+		/* don't call into the freelist with a bucket locked */
+		if (!spare)
+			spare = (struct stack_trie_node *)
+				pcpu_freelist_pop(&strie->freelist);
+
+		b = stack_trie_bucket(strie, parent, ips[i]);
+		ret = stack_trie_lock(b, &flags);
+		if (ret)
+			goto err;
+
+		hlist_for_each_entry(child, &b->head, hash_node) {
+			if (child->parent == parent && child->ip == ips[i])
+				break;
+		}
+
+		if (child) {
+			atomic_inc(&child->refcnt);
+			stack_trie_unlock(b, flags);
+			/* the child holds its own reference on @node */
+			if (node)
+				stack_trie_put(strie, node);
+		} else {
+			if (unlikely(!spare)) {
+				stack_trie_unlock(b, flags);
+				ret = -ENOMEM;
+				goto err;
+			}
+			child = spare;
+			spare = NULL;
+			child->ip = ips[i];
+			child->parent = parent;
+			child->flags = 0;
+			atomic_set(&child->refcnt, 1);
+			hlist_add_head(&child->hash_node, &b->head);
+			stack_trie_unlock(b, flags);
+			/* our reference on @node now belongs to @child */
+		}
+
+		node = child;
+		parent = stack_trie_node_id(strie, node);
+	}
+
+	/* keep our reference as the stack's, unless it already has one */
+	if (test_and_set_bit(STACK_TRIE_F_STACK, &node->flags))
+		stack_trie_put(strie, node);
+	ret = parent;
+	node = NULL;
+err:
+	if (node)
+		stack_trie_put(strie, node);
+	if (spare)
+		pcpu_freelist_push(&strie->freelist, &spare->fnode);
+	return ret;
+}
+
 static long __bpf_get_stackid(struct bpf_map *map,
 			      struct perf_callchain_entry *trace, u64 flags)
 {
@@ -275,6 +459,10 @@ static long __bpf_get_stackid(struct bpf_map *map,
 	trace_nr -= skip;
 	trace_len = trace_nr * sizeof(u64);
 	ips = trace->ip + skip + init_nr;
+
+	if (map->map_type == BPF_MAP_TYPE_STACK_TRIE)
+		return stack_trie_get_stackid(map, ips, trace_nr);
+
 	hash = jhash2((u32 *)ips, trace_len / sizeof(u32), 0);
 	id = hash & (smap->n_buckets - 1);
 	bucket = READ_ONCE(smap->buckets[id]);
@@ -612,6 +800,8 @@ static void *stack_map_lookup_elem(struct bpf_map *map, void *key)
 	return ERR_PTR(-EOPNOTSUPP);
 }
 
+static int stack_trie_copy(struct bpf_map *map, u32 id, void *value);
+
 /* Called from syscall */
 int bpf_stackmap_copy(struct bpf_map *map, void *key, void *value)
 {
@@ -619,6 +809,9 @@ int bpf_stackmap_copy(struct bpf_map *map, void *key, void *value)
 	struct stack_map_bucket *bucket, *old_bucket;
 	u32 id = *(u32 *)key, trace_len;
 
+	if (map->map_type == BPF_MAP_TYPE_STACK_TRIE)
+		return stack_trie_copy(map, id, value);
+
 	if (unlikely(id >= smap->n_buckets))
 		return -ENOENT;
 
@@ -715,6 +908,172 @@ const struct bpf_map_ops stack_trace_map_ops = {
 	.map_btf_id = &stack_trace_map_btf_id,
 };
 
+/* Called from syscall */
+static struct bpf_map *stack_trie_alloc(union bpf_attr *attr)
+{
+	u32 value_size = attr->value_size;
+	struct bpf_stack_trie *strie;
+	u64 cost, n_buckets;
+	int err, i;
+
+	if (!bpf_capable())
+		return ERR_PTR(-EPERM);
+
+	if (attr->map_flags & ~(STACK_CREATE_FLAG_MASK & ~BPF_F_STACK_BUILD_ID))
+		return ERR_PTR(-EINVAL);
+
+	/* check sanity of attributes */
+	if (attr->max_entries == 0 || attr->max_entries == STACK_TRIE_ROOT ||
+	    attr->key_size != 4 || value_size < 8 || value_size % 8 ||
+	    value_size / 8 > sysctl_perf_event_max_stack)
+		return ERR_PTR(-EINVAL);
+
+	n_buckets = roundup_pow_of_two(attr->max_entries);
+	if (!n_buckets)
+		return ERR_PTR(-E2BIG);
+
+	cost = sizeof(*strie) + n_buckets * sizeof(struct stack_trie_bucket);
+	strie = bpf_map_area_alloc(cost, bpf_map_attr_numa_node(attr));
+	if (!strie)
+		return ERR_PTR(-ENOMEM);
+
+	bpf_map_init_from_attr(&strie->map, attr);
+	strie->n_buckets = n_buckets;
+	strie->hashrnd = get_random_int();
+	for (i = 0; i < n_buckets; i++) {
+		raw_spin_lock_init(&strie->buckets[i].lock);
+		INIT_HLIST_HEAD(&strie->buckets[i].head);
+	}
+
+	err = get_callchain_buffers(sysctl_perf_event_max_stack);
+	if (err)
+		goto free_strie;
+
+	err = -ENOMEM;
+	strie->nodes = bpf_map_area_alloc(sizeof(struct stack_trie_node) *
+					  attr->max_entries,
+					  strie->map.numa_node);
+	if (!strie->nodes)
+		goto put_buffers;
+
+	err = pcpu_freelist_init(&strie->freelist);
+	if (err)
+		goto free_nodes;
+
+	pcpu_freelist_populate(&strie->freelist, strie->nodes,
+			       sizeof(struct stack_trie_node),
+			       attr->max_entries);
+	return &strie->map;
+
+free_nodes:
+	bpf_map_area_free(strie->nodes);
+put_buffers:
+	put_callchain_buffers();
+free_strie:
+	bpf_map_area_free(strie);
+	return ERR_PTR(err);
+}
+
+static int stack_trie_copy(struct bpf_map *map, u32 id, void *value)
+{
+	struct bpf_stack_trie *strie = container_of(map, struct bpf_stack_trie,
+						    map);
+	u32 n = 0, max_depth = map->value_size / sizeof(u64);
+	struct stack_trie_node *node;
+	u64 *ips = value;
+
+	if (unlikely(id >= map->max_entries))
+		return -ENOENT;
+
+	node = &strie->nodes[id];
+	if (!test_bit(STACK_TRIE_F_STACK, &node->flags))
+		return -ENOENT;
+
+	/* A stack deleted concurrently may be copied partially */
+	while (n < max_depth) {
+		ips[n++] = READ_ONCE(node->ip);
+		id = READ_ONCE(node->parent);
+		if (id >= map->max_entries)
+			break;
+		node = &strie->nodes[id];
+	}
+	memset(ips + n, 0, map->value_size - n * sizeof(u64));
+	return 0;
+}
+
+static int stack_trie_get_next_key(struct bpf_map *map, void *key,
+				   void *next_key)
+{
+	struct bpf_stack_trie *strie = container_of(map, struct bpf_stack_trie,
+						    map);
+	u32 id;
+
+	if (!key) {
+		id = 0;
+	} else {
+		id = *(u32 *)key;
+		if (id >= map->max_entries)
+			id = 0;
+		else
+			id++;
+	}
+
+	while (id < map->max_entries &&
+	       !test_bit(STACK_TRIE_F_STACK, &strie->nodes[id].flags))
+		id++;
+
+	if (id >= map->max_entries)
+		return -ENOENT;
+
+	*(u32 *)next_key = id;
+	return 0;
+}
+
+/* Called from syscall or from eBPF program */
+static int stack_trie_delete_elem(struct bpf_map *map, void *key)
+{
+	struct bpf_stack_trie *strie = container_of(map, struct bpf_stack_trie,
+						    map);
+	struct stack_trie_node *node;
+	u32 id = *(u32 *)key;
+
+	if (unlikely(id >= map->max_entries))
+		return -E2BIG;
+
+	node = &strie->nodes[id];
+	if (!test_and_clear_bit(STACK_TRIE_F_STACK, &node->flags))
+		return -ENOENT;
+
+	stack_trie_put(strie, node);
+	return 0;
+}
+
+/* Called when map->refcnt goes to zero, either from workqueue or from syscall */
+static void stack_trie_free(struct bpf_map *map)
+{
+	struct bpf_stack_trie *strie = container_of(map, struct bpf_stack_trie,
+						    map);
+
+	bpf_map_area_free(strie->nodes);
+	pcpu_freelist_destroy(&strie->freelist);
+	bpf_map_area_free(strie);
+	put_callchain_buffers();
+}
+
+static int stack_trie_map_btf_id;
+const struct bpf_map_ops stack_trie_map_ops = {
+	.map_meta_equal = bpf_map_meta_equal,
+	.map_alloc = stack_trie_alloc,
+	.map_free = stack_trie_free,
+	.map_get_next_key = stack_trie_get_next_key,
+	.map_lookup_elem = stack_map_lookup_elem,
+	.map_update_elem = stack_map_update_elem,
+	.map_delete_elem = stack_trie_delete_elem,
+	.map_check_btf = map_check_no_btf,
+	.map_btf_name = "bpf_stack_trie",
+	.map_btf_id = &stack_trie_map_btf_id,
+};
+
 static int __init stack_map_init(void)
 {
 	int cpu;
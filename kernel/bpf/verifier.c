@@ -5176,6 +5176,7 @@ static int check_map_func_compatibility(struct bpf_verifier_env *env,
 			goto error;
 		break;
 	case BPF_MAP_TYPE_STACK_TRACE:
+	case BPF_MAP_TYPE_STACK_TRIE:
 		if (func_id != BPF_FUNC_get_stackid)
 			goto error;
 		break;
@@ -5281,7 +5282,8 @@ static int check_map_func_compatibility(struct bpf_verifier_env *env,
 			goto error;
 		break;
 	case BPF_FUNC_get_stackid:
-		if (map->map_type != BPF_MAP_TYPE_STACK_TRACE)
+		if (map->map_type != BPF_MAP_TYPE_STACK_TRACE &&
+		    map->map_type != BPF_MAP_TYPE_STACK_TRIE)
 			goto error;
 		break;
 	case BPF_FUNC_current_task_under_cgroup:
@@ -10294,8 +10296,8 @@ static bool states_maybe_looping(struct bpf_verifier_state *old,
 
 static int is_state_visited(struct bpf_verifier_env *env, int insn_idx)
 {
+	struct bpf_verifier_state_list *sl, **pprev, **head;
 	struct bpf_verifier_state_list *new_sl;
-	struct bpf_verifier_state_list *sl, **pprev;
 	struct bpf_verifier_state *cur = env->cur_state, *new;
 	int i, j, err, states_cnt = 0;
 	bool add_new_state = env->test_state_freq ? true : false;
@@ -10319,7 +10321,7 @@ static int is_state_visited(struct bpf_verifier_env *env, int insn_idx)
 	    env->insn_processed - env->prev_insn_processed >= 8)
 		add_new_state = true;
 
-	pprev = explored_state(env, insn_idx);
+	head = pprev = explored_state(env, insn_idx);
 	sl = *pprev;
 
 	clean_live_states(env, insn_idx, cur);
@@ -10352,8 +10354,20 @@ static int is_state_visited(struct bpf_verifier_env *env, int insn_idx)
 				add_new_state = false;
 			goto miss;
 		}
+		env->states_compared++;
 		if (states_equal(env, &sl->state, cur)) {
 			sl->hit_cnt++;
+			env->states_pruned++;
+			/* Keep the states that prune most often at the front
+			 * of the list, so that later visits of this insn
+			 * find them after fewer comparisons.
+			 */
+			if (pprev != head &&
+			    sl->hit_cnt > (*head)->hit_cnt) {
+				*pprev = sl->next;
+				sl->next = *head;
+				*head = sl;
+			}
 			/* reached equivalent register/stack state,
 			 * prune the search.
 			 * Registers read by the continuation are read by us.
@@ -10396,6 +10410,7 @@ static int is_state_visited(struct bpf_verifier_env *env, int insn_idx)
 			 * speed up verification
 			 */
 			*pprev = sl->next;
+			env->states_evicted++;
 			if (sl->state.frame[0]->regs[0].live & REG_LIVE_DONE) {
 				u32 br = sl->state.branches;
 
@@ -11030,6 +11045,10 @@ static int check_pseudo_btf_id(struct bpf_verifier_env *env,
 
 static int check_map_prealloc(struct bpf_map *map)
 {
+	/* resizable hash maps always allocate elements at update time */
+	if (map->map_type == BPF_MAP_TYPE_RHASH)
+		return false;
+
 	return (map->map_type != BPF_MAP_TYPE_HASH &&
 		map->map_type != BPF_MAP_TYPE_PERCPU_HASH &&
 		map->map_type != BPF_MAP_TYPE_HASH_OF_MAPS) ||
@@ -12804,6 +12823,19 @@ static int do_check_common(struct bpf_verifier_env *env, int subprog)
 	return ret;
 }
 
+static int do_check_timed(struct bpf_verifier_env *env, int subprog)
+{
+	struct bpf_subprog_info *info = &env->subprog_info[subprog];
+	u32 insn_processed = env->insn_processed;
+	u64 start_time = ktime_get_ns();
+	int ret;
+
+	ret = do_check_common(env, subprog);
+	info->verification_time = ktime_get_ns() - start_time;
+	info->insn_processed = env->insn_processed - insn_processed;
+	return ret;
+}
+
 /* Verify all global functions in a BPF program one by one based on their BTF.
  * All global functions must pass verification. Otherwise the whole program is rejected.
  * Consider:
@@ -12834,7 +12866,7 @@ static int do_check_subprogs(struct bpf_verifier_env *env)
 			continue;
 		env->insn_idx = env->subprog_info[i].start;
 		WARN_ON_ONCE(env->insn_idx == 0);
-		ret = do_check_common(env, i);
+		ret = do_check_timed(env, i);
 		if (ret) {
 			return ret;
 		} else if (env->log.level & BPF_LOG_LEVEL) {
@@ -12851,7 +12883,7 @@ static int do_check_main(struct bpf_verifier_env *env)
 	int ret;
 
 	env->insn_idx = 0;
-	ret = do_check_common(env, 0);
+	ret = do_check_timed(env, 0);
 	if (!ret)
 		env->prog->aux->stack_depth = env->subprog_info[0].stack_depth;
 	return ret;
@@ -12863,7 +12895,7 @@ static void print_verification_stats(struct bpf_verifier_env *env)
 	int i;
 
 	if (env->log.level & BPF_LOG_STATS) {
-		verbose(env, "verification time %lld usec\n",
+		verbose(env, "verification time %llu usec\n",
 			div_u64(env->verification_time, 1000));
 		verbose(env, "stack depth ");
 		for (i = 0; i < env->subprog_cnt; i++) {
@@ -12874,6 +12906,18 @@ static void print_verification_stats(struct bpf_verifier_env *env)
 				verbose(env, "+");
 		}
 		verbose(env, "\n");
+		for (i = 0; i < env->subprog_cnt; i++) {
+			struct bpf_subprog_info *info = &env->subprog_info[i];
+
+			if (!info->insn_processed)
+				continue;
+			verbose(env, "func#%d processed %u insns in %llu usec\n",
+				i, info->insn_processed,
+				div_u64(info->verification_time, 1000));
+		}
+		verbose(env, "states compared %u pruned %u evicted %u\n",
+			env->states_compared, env->states_pruned,
+			env->states_evicted);
 	}
 	verbose(env, "processed %d insns (limit %d) max_states_per_insn %d "
 		"total_states %d peak_states %d mark_read %d\n",
@@ -847,6 +847,107 @@ static void perf_cgroup_switch(struct task_struct *task, int mode)
 	local_irq_restore(flags);
 }
 
+/*
+ * Shared-counter mode: a per-cpu event counts on behalf of a set of cgroups
+ * (PERF_EVENT_IOC_ATTACH_CGROUP). Unlike a cgroup event it is not scheduled
+ * out and back in on a cgroup switch, its count is read instead and the delta
+ * since the previous switch is added to the outgoing cgroup and to all of its
+ * ancestors which are in the set.
+ */
+struct perf_cgroup_node {
+	struct hlist_node		node;
+	u64				id;
+	u64				count;
+	u64				time;
+};
+
+struct perf_cgroup_share {
+	struct perf_event		*event;
+	struct list_head		entry;	/* on cgrp_share_list */
+	u64				count;	/* event count at last update */
+	u64				timestamp;
+	struct hlist_head		*hash;
+	unsigned int			hash_bits;
+	unsigned int			nr_nodes;
+	struct perf_cgroup_node		nodes[];
+};
+
+#define PERF_CGROUP_SHARE_MAX	4096
+
+/* Shared-counter events per cpu, protected by cgrp_share_lock. */
+static DEFINE_PER_CPU(struct list_head, cgrp_share_list);
+static DEFINE_PER_CPU(raw_spinlock_t, cgrp_share_lock);
+
+static struct perf_cgroup_node *
+perf_cgroup_share_find(struct perf_cgroup_share *share, u64 id)
+{
+	struct perf_cgroup_node *node;
+
+	hlist_for_each_entry(node, &share->hash[hash_64(id, share->hash_bits)], node) {
+		if (node->id == id)
+			return node;
+	}
+	return NULL;
+}
+
+/*
+ * Attribute what @share's event counted since the last update to @cgrp.
+ * Called on @share's cpu with interrupts disabled and cgrp_share_lock held.
+ */
+static void perf_cgroup_share_update(struct perf_cgroup_share *share,
+				     struct perf_cgroup *cgrp, u64 now)
+{
+	struct perf_event *event = share->event;
+	struct cgroup_subsys_state *css;
+	struct perf_cgroup_node *node;
+	u64 count, delta, time;
+
+	raw_spin_lock(&event->ctx->lock);
+	if (event->state == PERF_EVENT_STATE_ACTIVE &&
+	    event->oncpu == smp_processor_id())
+		event->pmu->read(event);
+	count = local64_read(&event->count);
+	raw_spin_unlock(&event->ctx->lock);
+
+	/* The count went backwards across PERF_EVENT_IOC_RESET. */
+	delta = count >= share->count ? count - share->count : count;
+	time = now - share->timestamp;
+	share->count = count;
+	share->timestamp = now;
+
+	if (!cgrp)
+		return;
+
+	for (css = &cgrp->css; css; css = css->parent) {
+		node = perf_cgroup_share_find(share, cgroup_id(css->cgroup));
+		if (node) {
+			node->count += delta;
+			node->time += time;
+		}
+	}
+}
+
+/*
+ * Called on a cgroup switch, with interrupts disabled, for the cgroup
+ * being switched out.
+ */
+static void perf_cgroup_share_switch(struct perf_cgroup *cgrp)
+{
+	struct perf_cgroup_share *share;
+	struct list_head *list;
+	u64 now;
+
+	list = this_cpu_ptr(&cgrp_share_list);
+	if (list_empty(list))
+		return;
+
+	now = perf_clock();
+	raw_spin_lock(this_cpu_ptr(&cgrp_share_lock));
+	list_for_each_entry(share, list, entry)
+		perf_cgroup_share_update(share, cgrp, now);
+	raw_spin_unlock(this_cpu_ptr(&cgrp_share_lock));
+}
+
 static inline void perf_cgroup_sched_out(struct task_struct *task,
 					 struct task_struct *next)
 {
@@ -867,8 +968,10 @@ static inline void perf_cgroup_sched_out(struct task_struct *task,
 	 * that we are switching to a different cgroup. Otherwise,
 	 * do no touch the cgroup events.
 	 */
-	if (cgrp1 != cgrp2)
+	if (cgrp1 != cgrp2) {
+		perf_cgroup_share_switch(cgrp1);
 		perf_cgroup_switch(task, PERF_CGROUP_SWOUT);
+	}
 
 	rcu_read_unlock();
 }
@@ -4768,6 +4871,44 @@ static void unaccount_freq_event(void)
 		atomic_dec(&nr_freq_events);
 }
 
+/*
+ * Enable the context switch hooks (perf_sched_events) for as long as the
+ * caller needs them.
+ */
+static void perf_sched_events_get(void)
+{
+	/*
+	 * We need the mutex here because static_branch_enable()
+	 * must complete *before* the perf_sched_count increment
+	 * becomes visible.
+	 */
+	if (atomic_inc_not_zero(&perf_sched_count))
+		return;
+
+	mutex_lock(&perf_sched_mutex);
+	if (!atomic_read(&perf_sched_count)) {
+		static_branch_enable(&perf_sched_events);
+		/*
+		 * Guarantee that all CPUs observe they key change and
+		 * call the perf scheduling hooks before proceeding to
+		 * install events that need them.
+		 */
+		synchronize_rcu();
+	}
+	/*
+	 * Now that we have waited for the sync_sched(), allow further
+	 * increments to by-pass the mutex.
+	 */
+	atomic_inc(&perf_sched_count);
+	mutex_unlock(&perf_sched_mutex);
+}
+
+static void perf_sched_events_put(void)
+{
+	if (!atomic_add_unless(&perf_sched_count, -1, 1))
+		schedule_delayed_work(&perf_sched_work, HZ);
+}
+
 static void unaccount_event(struct perf_event *event)
 {
 	bool dec = false;
@@ -4806,10 +4947,8 @@ static void unaccount_event(struct perf_event *event)
 	if (event->attr.text_poke)
 		atomic_dec(&nr_text_poke_events);
 
-	if (dec) {
-		if (!atomic_add_unless(&perf_sched_count, -1, 1))
-			schedule_delayed_work(&perf_sched_work, HZ);
-	}
+	if (dec)
+		perf_sched_events_put();
 
 	unaccount_event_cpu(event, event->cpu);
 
@@ -4824,6 +4963,199 @@ static void perf_sched_delayed(struct work_struct *work)
 	mutex_unlock(&perf_sched_mutex);
 }
 
+#ifdef CONFIG_CGROUP_PERF
+/*
+ * Runs on the event's cpu, or anywhere with interrupts disabled if that cpu
+ * is offline, in which case no cgroup switch can race with us.
+ */
+static int __perf_cgroup_share_attach(void *info)
+{
+	struct perf_cgroup_share *share = info;
+	int cpu = share->event->cpu;
+
+	raw_spin_lock(per_cpu_ptr(&cgrp_share_lock, cpu));
+	perf_cgroup_share_update(share, NULL, perf_clock());
+	list_add_tail(&share->entry, per_cpu_ptr(&cgrp_share_list, cpu));
+	raw_spin_unlock(per_cpu_ptr(&cgrp_share_lock, cpu));
+
+	return 0;
+}
+
+static int perf_event_attach_cgroup(struct perf_event *event,
+				    struct perf_event_attach_cgroup __user *uattach)
+{
+	struct perf_cgroup_share *share;
+	unsigned int i, nr, bits;
+	unsigned long flags;
+	int ret;
+
+	/* Only per-cpu counting events can be shared between cgroups. */
+	if (event->cpu < 0 || event->ctx->task || is_cgroup_event(event) ||
+	    is_sampling_event(event))
+		return -EINVAL;
+
+	if (event->cgrp_share)
+		return -EBUSY;
+
+	if (get_user(nr, &uattach->nr))
+		return -EFAULT;
+
+	if (!nr || nr > PERF_CGROUP_SHARE_MAX)
+		return -EINVAL;
+
+	share = kvzalloc_node(struct_size(share, nodes, nr), GFP_KERNEL,
+			      cpu_to_node(event->cpu));
+	if (!share)
+		return -ENOMEM;
+
+	/* Keep the chains short, the hash is walked on every cgroup switch. */
+	bits = order_base_2(nr) + 1;
+	share->hash = kvcalloc(1U << bits, sizeof(*share->hash), GFP_KERNEL);
+	if (!share->hash) {
+		ret = -ENOMEM;
+		goto err_free;
+	}
+	share->hash_bits = bits;
+	share->event = event;
+
+	for (i = 0; i < nr; i++) {
+		struct perf_cgroup_node *node = &share->nodes[i];
+
+		ret = -EFAULT;
+		if (get_user(node->id, &uattach->ids[i]))
+			goto err_free;
+
+		ret = -EINVAL;
+		if (perf_cgroup_share_find(share, node->id))
+			goto err_free;
+
+		hlist_add_head(&node->node, &share->hash[hash_64(node->id, bits)]);
+		share->nr_nodes++;
+	}
+
+	perf_sched_events_get();
+	atomic_inc(&per_cpu(perf_cgroup_events, event->cpu));
+
+	if (cpu_function_call(event->cpu, __perf_cgroup_share_attach, share)) {
+		local_irq_save(flags);
+		__perf_cgroup_share_attach(share);
+		local_irq_restore(flags);
+	}
+	event->cgrp_share = share;
+
+	return 0;
+
+err_free:
+	kvfree(share->hash);
+	kvfree(share);
+	return ret;
+}
+
+struct perf_cgroup_share_read {
+	struct perf_cgroup_share	*share;
+	struct perf_event_cgroup_read	*read;
+};
+
+static int __perf_cgroup_share_read(void *info)
+{
+	struct perf_cgroup_share_read *data = info;
+	struct perf_cgroup_share *share = data->share;
+	struct perf_cgroup_node *node;
+	int cpu = share->event->cpu;
+	int ret = 0;
+
+	raw_spin_lock(per_cpu_ptr(&cgrp_share_lock, cpu));
+	/* Fold in what the running cgroup counted so far. */
+	if (cpu == smp_processor_id()) {
+		rcu_read_lock();
+		perf_cgroup_share_update(share, perf_cgroup_from_task(current, NULL),
+					 perf_clock());
+		rcu_read_unlock();
+	}
+
+	node = perf_cgroup_share_find(share, data->read->id);
+	if (node) {
+		data->read->count = node->count;
+		data->read->time = node->time;
+	} else {
+		ret = -ENOENT;
+	}
+	raw_spin_unlock(per_cpu_ptr(&cgrp_share_lock, cpu));
+
+	return ret;
+}
+
+static int perf_event_read_cgroup(struct perf_event *event,
+				  struct perf_event_cgroup_read __user *uread)
+{
+	struct perf_event_cgroup_read read;
+	struct perf_cgroup_share_read data = {
+		.share	= event->cgrp_share,
+		.read	= &read,
+	};
+	unsigned long flags;
+	int ret;
+
+	if (!data.share)
+		return -EINVAL;
+
+	if (copy_from_user(&read, uread, sizeof(read)))
+		return -EFAULT;
+
+	ret = cpu_function_call(event->cpu, __perf_cgroup_share_read, &data);
+	if (ret == -ENXIO) {
+		local_irq_save(flags);
+		ret = __perf_cgroup_share_read(&data);
+		local_irq_restore(flags);
+	}
+	if (ret)
+		return ret;
+
+	if (copy_to_user(uread, &read, sizeof(read)))
+		return -EFAULT;
+
+	return 0;
+}
+
+static void perf_event_detach_cgroup_share(struct perf_event *event)
+{
+	struct perf_cgroup_share *share = event->cgrp_share;
+	raw_spinlock_t *lock;
+	unsigned long flags;
+
+	if (!share)
+		return;
+
+	lock = per_cpu_ptr(&cgrp_share_lock, event->cpu);
+	raw_spin_lock_irqsave(lock, flags);
+	list_del(&share->entry);
+	raw_spin_unlock_irqrestore(lock, flags);
+
+	atomic_dec(&per_cpu(perf_cgroup_events, event->cpu));
+	perf_sched_events_put();
+
+	event->cgrp_share = NULL;
+	kvfree(share->hash);
+	kvfree(share);
+}
+#else /* !CONFIG_CGROUP_PERF */
+static inline int perf_event_attach_cgroup(struct perf_event *event,
+					   struct perf_event_attach_cgroup __user *uattach)
+{
+	return -EINVAL;
+}
+
+static inline int perf_event_read_cgroup(struct perf_event *event,
+					 struct perf_event_cgroup_read __user *uread)
+{
+	return -EINVAL;
+}
+
+static inline void perf_event_detach_cgroup_share(struct perf_event *event)
+{
+}
+#endif /* CONFIG_CGROUP_PERF */
+
 /*
  * The following implement mutual exclusion of events on "exclusive" pmus
  * (PERF_PMU_CAP_EXCLUSIVE). Such pmus can only have one event scheduled
@@ -4936,6 +5268,8 @@ static void _free_event(struct perf_event *event)
 	if (is_cgroup_event(event))
 		perf_detach_cgroup(event);
 
+	perf_event_detach_cgroup_share(event);
+
 	if (!event->parent) {
 		if (event->attr.sample_type & PERF_SAMPLE_CALLCHAIN)
 			put_callchain_buffers();
@@ -5646,6 +5980,12 @@ static long _perf_ioctl(struct perf_event *event, unsigned int cmd, unsigned lon
 	case PERF_EVENT_IOC_QUERY_BPF:
 		return perf_event_query_prog_array(event, (void __user *)arg);
 
+	case PERF_EVENT_IOC_ATTACH_CGROUP:
+		return perf_event_attach_cgroup(event, (void __user *)arg);
+
+	case PERF_EVENT_IOC_READ_CGROUP:
+		return perf_event_read_cgroup(event, (void __user *)arg);
+
 	case PERF_EVENT_IOC_MODIFY_ATTRIBUTES: {
 		struct perf_event_attr new_attr;
 		int err = perf_copy_attr((struct perf_event_attr __user *)arg,
@@ -5695,6 +6035,8 @@ static long perf_compat_ioctl(struct file *file, unsigned int cmd,
 	case _IOC_NR(PERF_EVENT_IOC_ID):
 	case _IOC_NR(PERF_EVENT_IOC_QUERY_BPF):
 	case _IOC_NR(PERF_EVENT_IOC_MODIFY_ATTRIBUTES):
+	case _IOC_NR(PERF_EVENT_IOC_ATTACH_CGROUP):
+	case _IOC_NR(PERF_EVENT_IOC_READ_CGROUP):
 		/* Fix up pointer size (usually 4 -> 8 in 32-on-64-bit case */
 		if (_IOC_SIZE(cmd) == sizeof(compat_uptr_t)) {
 			cmd &= ~IOCSIZE_MASK;
@@ -5909,6 +6251,9 @@ static void ring_buffer_attach(struct perf_event *event,
 			event->rcu_pending = 0;
 		}
 
+		if (event->attr.compact_callchain)
+			rb_alloc_callchain_cache(rb);
+
 		spin_lock_irqsave(&rb->event_lock, flags);
 		list_add_rcu(&event->rb_entry, &rb->event_list);
 		spin_unlock_irqrestore(&rb->event_lock, flags);
@@ -7437,6 +7782,8 @@ __perf_event_output(struct perf_event *event,
 {
 	struct perf_output_handle handle;
 	struct perf_event_header header;
+	struct perf_callchain_entry *callchain;
+	u64 chain_ref[3], chain_id;
 	int err;
 
 	/* protect the callchain buffers */
@@ -7444,6 +7791,23 @@ __perf_event_output(struct perf_event *event,
 
 	perf_prepare_sample(&header, data, event, regs);
 
+	/*
+	 * Replace a callchain already defined in the buffer by its id;
+	 * see PERF_RECORD_CALLCHAIN. @data may be output again, so the
+	 * callchain is restored before returning.
+	 */
+	callchain = data->callchain;
+	if (event->attr.compact_callchain && data->callchain->nr > 2) {
+		chain_id = perf_output_callchain_id(event, data, output_begin);
+		if (chain_id) {
+			header.size -= (data->callchain->nr - 2) * sizeof(u64);
+			chain_ref[0] = 2;
+			chain_ref[1] = PERF_CONTEXT_CALLCHAIN_ID;
+			chain_ref[2] = chain_id;
+			data->callchain = (struct perf_callchain_entry *)chain_ref;
+		}
+	}
+
 	err = output_begin(&handle, data, event, header.size);
 	if (err)
 		goto exit;
@@ -7453,6 +7817,7 @@ __perf_event_output(struct perf_event *event,
 	perf_output_end(&handle);
 
 exit:
+	data->callchain = callchain;
 	rcu_read_unlock();
 	return err;
 }
@@ -11373,33 +11738,8 @@ static void account_event(struct perf_event *event)
 	if (event->attr.text_poke)
 		atomic_inc(&nr_text_poke_events);
 
-	if (inc) {
-		/*
-		 * We need the mutex here because static_branch_enable()
-		 * must complete *before* the perf_sched_count increment
-		 * becomes visible.
-		 */
-		if (atomic_inc_not_zero(&perf_sched_count))
-			goto enabled;
-
-		mutex_lock(&perf_sched_mutex);
-		if (!atomic_read(&perf_sched_count)) {
-			static_branch_enable(&perf_sched_events);
-			/*
-			 * Guarantee that all CPUs observe they key change and
-			 * call the perf scheduling hooks before proceeding to
-			 * install events that need them.
-			 */
-			synchronize_rcu();
-		}
-		/*
-		 * Now that we have waited for the sync_sched(), allow further
-		 * increments to by-pass the mutex.
-		 */
-		atomic_inc(&perf_sched_count);
-		mutex_unlock(&perf_sched_mutex);
-	}
-enabled:
+	if (inc)
+		perf_sched_events_get();
 
 	account_event_cpu(event, event->cpu);
 
@@ -11763,6 +12103,10 @@ static int perf_copy_attr(struct perf_event_attr __user *uattr,
 	if (attr->sigtrap && !attr->remove_on_exec)
 		return -EINVAL;
 
+	if (attr->compact_callchain &&
+	    !(attr->sample_type & PERF_SAMPLE_CALLCHAIN))
+		return -EINVAL;
+
 out:
 	return ret;
 
@@ -13160,6 +13504,8 @@ static void __init perf_event_init_all_cpus(void)
 
 #ifdef CONFIG_CGROUP_PERF
 		INIT_LIST_HEAD(&per_cpu(cgrp_cpuctx_list, cpu));
+		INIT_LIST_HEAD(&per_cpu(cgrp_share_list, cpu));
+		raw_spin_lock_init(&per_cpu(cgrp_share_lock, cpu));
 #endif
 		INIT_LIST_HEAD(&per_cpu(sched_cb_list, cpu));
 	}
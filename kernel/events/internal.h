@@ -54,6 +54,9 @@ struct perf_buffer {
 	void				**aux_pages;
 	void				*aux_priv;
 
+	/* callchains already defined in the buffer, see PERF_RECORD_CALLCHAIN */
+	struct perf_callchain_cache	*callchain_cache;
+
 	struct perf_event_mmap_page	*user_page;
 	void				*data_pages[];
 };
@@ -82,6 +85,13 @@ extern void perf_event_wakeup(struct perf_event *event);
 extern int rb_alloc_aux(struct perf_buffer *rb, struct perf_event *event,
 			pgoff_t pgoff, int nr_pages, long watermark, int flags);
 extern void rb_free_aux(struct perf_buffer *rb);
+extern void rb_alloc_callchain_cache(struct perf_buffer *rb);
+extern u64 perf_output_callchain_id(struct perf_event *event,
+				    struct perf_sample_data *data,
+				    int (*output_begin)(struct perf_output_handle *,
+							struct perf_sample_data *,
+							struct perf_event *,
+							unsigned int));
 extern struct perf_buffer *ring_buffer_get(struct perf_event *event);
 extern void ring_buffer_put(struct perf_buffer *rb);
 
@@ -14,6 +14,8 @@
 #include <linux/circ_buf.h>
 #include <linux/poll.h>
 #include <linux/nospec.h>
+#include <linux/random.h>
+#include <linux/siphash.h>
 
 #include "internal.h"
 
@@ -284,6 +286,133 @@ int perf_output_begin(struct perf_output_handle *handle,
 				   unlikely(is_write_backward(event)));
 }
 
+/*
+ * Callchain deduplication for events with attr.compact_callchain.
+ *
+ * Each buffer remembers the hash of the callchains it recently carried
+ * together with the id they were defined under. A sample whose callchain
+ * hits in that cache only stores the id; on a miss the callchain is first
+ * written out as a PERF_RECORD_CALLCHAIN definition.
+ *
+ * A definition is only reused while it is less than half a buffer behind
+ * the write head, so that in overwrite mode every sample in the newer half
+ * of the buffer still finds its definition when the buffer is read.
+ */
+#define PERF_CALLCHAIN_CACHE_BITS	8
+#define PERF_CALLCHAIN_CACHE_SIZE	(1 << PERF_CALLCHAIN_CACHE_BITS)
+
+struct perf_callchain_cache_entry {
+	u64			hash;
+	u64			id;
+	unsigned long		head;	/* rb->head after the definition */
+};
+
+struct perf_callchain_cache {
+	atomic_t				busy;
+	struct perf_callchain_cache_entry	entries[PERF_CALLCHAIN_CACHE_SIZE];
+};
+
+static atomic64_t perf_callchain_id;
+static siphash_key_t perf_callchain_key __read_mostly;
+
+void rb_alloc_callchain_cache(struct perf_buffer *rb)
+{
+	struct perf_callchain_cache *cache;
+
+	if (READ_ONCE(rb->callchain_cache))
+		return;
+
+	get_random_once(&perf_callchain_key, sizeof(perf_callchain_key));
+
+	/* Without a cache, callchains are simply output inline. */
+	cache = kzalloc(sizeof(*cache), GFP_KERNEL);
+	if (cache && cmpxchg(&rb->callchain_cache, NULL, cache))
+		kfree(cache);
+}
+
+static bool perf_callchain_entry_stale(struct perf_buffer *rb,
+				       struct perf_callchain_cache_entry *entry)
+{
+	long dist = local_read(&rb->head) - entry->head;
+
+	return abs(dist) >= perf_data_size(rb) / 2;
+}
+
+/*
+ * Return the id under which @data->callchain is defined in the buffer of
+ * @event, writing the definition first if needed, or 0 if the callchain
+ * has to be output inline.
+ */
+u64 perf_output_callchain_id(struct perf_event *event,
+			     struct perf_sample_data *data,
+			     int (*output_begin)(struct perf_output_handle *,
+						 struct perf_sample_data *,
+						 struct perf_event *,
+						 unsigned int))
+{
+	struct perf_callchain_entry *callchain = data->callchain;
+	struct perf_callchain_cache_entry *entry;
+	struct perf_callchain_cache *cache;
+	struct perf_output_handle handle;
+	struct perf_buffer *rb;
+	struct {
+		struct perf_event_header	header;
+		u64				chain_id;
+		u64				nr;
+	} chain_event;
+	u64 hash, id = 0;
+
+	if (event->parent)
+		event = event->parent;
+
+	rb = rcu_dereference(event->rb);
+	if (!rb)
+		return 0;
+
+	cache = READ_ONCE(rb->callchain_cache);
+	if (!cache)
+		return 0;
+
+	/* A nested writer (NMI) just outputs its callchain inline. */
+	if (atomic_cmpxchg_acquire(&cache->busy, 0, 1))
+		return 0;
+
+	hash = siphash(callchain, (callchain->nr + 1) * sizeof(u64),
+		       &perf_callchain_key);
+	entry = &cache->entries[hash & (PERF_CALLCHAIN_CACHE_SIZE - 1)];
+
+	if (entry->id && entry->hash == hash &&
+	    !perf_callchain_entry_stale(rb, entry)) {
+		id = entry->id;
+		goto unlock;
+	}
+
+	chain_event.header.type = PERF_RECORD_CALLCHAIN;
+	chain_event.header.misc = 0;
+	chain_event.header.size = sizeof(chain_event) +
+				  callchain->nr * sizeof(u64);
+	if (event->attr.sample_id_all)
+		chain_event.header.size += event->id_header_size;
+	chain_event.chain_id = atomic64_inc_return(&perf_callchain_id);
+	chain_event.nr = callchain->nr;
+
+	if (output_begin(&handle, data, event, chain_event.header.size))
+		goto unlock;
+
+	perf_output_put(&handle, chain_event);
+	__output_copy(&handle, callchain->ip, callchain->nr * sizeof(u64));
+	perf_event__output_id_sample(event, &handle, data);
+	perf_output_end(&handle);
+
+	entry->hash = hash;
+	entry->id = id = chain_event.chain_id;
+	entry->head = local_read(&rb->head);
+
+unlock:
+	atomic_set_release(&cache->busy, 0);
+	return id;
+}
+
 unsigned int perf_output_copy(struct perf_output_handle *handle,
 		      const void *buf, unsigned int len)
 {
@@ -855,6 +984,7 @@ void rb_free(struct perf_buffer *rb)
 	perf_mmap_free_page(rb->user_page);
 	for (i = 0; i < rb->nr_pages; i++)
 		perf_mmap_free_page(rb->data_pages[i]);
+	kfree(rb->callchain_cache);
 	kfree(rb);
 }
 
@@ -896,6 +1026,7 @@ static void rb_free_work(struct work_struct *work)
 		perf_mmap_unmark_page(base + (i * PAGE_SIZE));
 
 	vfree(base);
+	kfree(rb->callchain_cache);
 	kfree(rb);
 }
 
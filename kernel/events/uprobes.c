@@ -27,6 +27,8 @@
 #include <linux/task_work.h>
 #include <linux/shmem_fs.h>
 #include <linux/khugepaged.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include <linux/uprobes.h>
 
@@ -41,6 +43,9 @@ static struct rb_root uprobes_tree = RB_ROOT;
 #define no_uprobe_events()	RB_EMPTY_ROOT(&uprobes_tree)
 
 static DEFINE_SPINLOCK(uprobes_treelock);	/* serialize rbtree access */
+/* lets the breakpoint hit path look up uprobes_tree without the lock */
+static seqcount_spinlock_t uprobes_seqcount =
+	SEQCNT_SPINLOCK_ZERO(uprobes_seqcount, &uprobes_treelock);
 
 #define UPROBES_HASH_SZ	13
 /* serialize uprobe->pending_list */
@@ -55,6 +60,8 @@ DEFINE_STATIC_PERCPU_RWSEM(dup_mmap_sem);
 struct uprobe {
 	struct rb_node		rb_node;	/* node in the rb tree */
 	refcount_t		ref;
+	struct rcu_head		rcu;		/* freed after lockless lookups */
+	unsigned long __percpu	*nhits;		/* breakpoint hits */
 	struct rw_semaphore	register_rwsem;
 	struct rw_semaphore	consumer_rwsem;
 	struct list_head	pending_list;
@@ -598,6 +605,17 @@ static struct uprobe *get_uprobe(struct uprobe *uprobe)
 	return uprobe;
 }
 
+static void free_uprobe(struct uprobe *uprobe)
+{
+	free_percpu(uprobe->nhits);
+	kfree(uprobe);
+}
+
+static void free_uprobe_rcu(struct rcu_head *rcu)
+{
+	free_uprobe(container_of(rcu, struct uprobe, rcu));
+}
+
 static void put_uprobe(struct uprobe *uprobe)
 {
 	if (refcount_dec_and_test(&uprobe->ref)) {
@@ -609,7 +627,8 @@ static void put_uprobe(struct uprobe *uprobe)
 		mutex_lock(&delayed_uprobe_lock);
 		delayed_uprobe_remove(uprobe, NULL);
 		mutex_unlock(&delayed_uprobe_lock);
-		kfree(uprobe);
+		/* find_uprobe_rcu() may still be looking at it */
+		call_rcu(&uprobe->rcu, free_uprobe_rcu);
 	}
 }
 
@@ -681,16 +700,69 @@ static struct uprobe *find_uprobe(struct inode *inode, loff_t offset)
 	return uprobe;
 }
 
-static struct uprobe *__insert_uprobe(struct uprobe *uprobe)
+/*
+ * Find a uprobe corresponding to a given inode:offset without taking
+ * uprobes_treelock, for the breakpoint hit path.
+ *
+ * Tree updates bump uprobes_seqcount, so a lookup that missed because of
+ * a concurrent rotation is retried. A uprobe found with a zero refcount
+ * is being freed and is treated as gone.
+ */
+static struct uprobe *find_uprobe_rcu(struct inode *inode, loff_t offset)
 {
+	struct uprobe *uprobe;
 	struct rb_node *node;
+	unsigned int seq;
+	int cmp;
 
-	node = rb_find_add(&uprobe->rb_node, &uprobes_tree, __uprobe_cmp);
-	if (node)
-		return get_uprobe(__node_2_uprobe(node));
+	rcu_read_lock();
+	do {
+		seq = read_seqcount_begin(&uprobes_seqcount);
+		node = rcu_dereference_raw(uprobes_tree.rb_node);
+		while (node) {
+			uprobe = __node_2_uprobe(node);
+			cmp = uprobe_cmp(inode, offset, uprobe);
+			if (!cmp) {
+				if (refcount_inc_not_zero(&uprobe->ref)) {
+					rcu_read_unlock();
+					return uprobe;
+				}
+				break;
+			}
+			node = cmp < 0 ? rcu_dereference_raw(node->rb_left) :
+					 rcu_dereference_raw(node->rb_right);
+		}
+	} while (read_seqcount_retry(&uprobes_seqcount, seq));
+	rcu_read_unlock();
+
+	return NULL;
+}
+
+static struct uprobe *__insert_uprobe(struct uprobe *uprobe)
+{
+	struct rb_node **link = &uprobes_tree.rb_node;
+	struct rb_node *parent = NULL;
+	int cmp;
+
+	while (*link) {
+		parent = *link;
+		cmp = __uprobe_cmp(&uprobe->rb_node, parent);
+		if (cmp < 0)
+			link = &parent->rb_left;
+		else if (cmp > 0)
+			link = &parent->rb_right;
+		else
+			return get_uprobe(__node_2_uprobe(parent));
+	}
 
 	/* get access + creation ref */
 	refcount_set(&uprobe->ref, 2);
+
+	write_seqcount_begin(&uprobes_seqcount);
+	rb_link_node_rcu(&uprobe->rb_node, parent, link);
+	rb_insert_color(&uprobe->rb_node, &uprobes_tree);
+	write_seqcount_end(&uprobes_seqcount);
+
 	return NULL;
 }
 
@@ -732,6 +804,12 @@ static struct uprobe *alloc_uprobe(struct inode *inode, loff_t offset,
 	if (!uprobe)
 		return NULL;
 
+	uprobe->nhits = alloc_percpu(unsigned long);
+	if (!uprobe->nhits) {
+		kfree(uprobe);
+		return NULL;
+	}
+
 	uprobe->inode = inode;
 	uprobe->offset = offset;
 	uprobe->ref_ctr_offset = ref_ctr_offset;
@@ -745,10 +823,10 @@ static struct uprobe *alloc_uprobe(struct inode *inode, loff_t offset,
 		if (cur_uprobe->ref_ctr_offset != uprobe->ref_ctr_offset) {
 			ref_ctr_mismatch_warn(cur_uprobe, uprobe);
 			put_uprobe(cur_uprobe);
-			kfree(uprobe);
+			free_uprobe(uprobe);
 			return ERR_PTR(-EINVAL);
 		}
-		kfree(uprobe);
+		free_uprobe(uprobe);
 		uprobe = cur_uprobe;
 	}
 
@@ -941,7 +1019,9 @@ static void delete_uprobe(struct uprobe *uprobe)
 		return;
 
 	spin_lock(&uprobes_treelock);
+	write_seqcount_begin(&uprobes_seqcount);
 	rb_erase(&uprobe->rb_node, &uprobes_tree);
+	write_seqcount_end(&uprobes_seqcount);
 	spin_unlock(&uprobes_treelock);
 	RB_CLEAR_NODE(&uprobe->rb_node); /* for uprobe_is_active() */
 	put_uprobe(uprobe);
@@ -960,10 +1040,14 @@ static inline struct map_info *free_map_info(struct map_info *info)
 	return next;
 }
 
+/*
+ * Collect the mms mapping the file range [@start, @end], one map_info per
+ * vma. ->vaddr is where @start is (or would be) mapped by that vma.
+ */
 static struct map_info *
-build_map_info(struct address_space *mapping, loff_t offset, bool is_register)
+build_map_info(struct address_space *mapping, loff_t start, loff_t end,
+	       bool is_register)
 {
-	unsigned long pgoff = offset >> PAGE_SHIFT;
 	struct vm_area_struct *vma;
 	struct map_info *curr = NULL;
 	struct map_info *prev = NULL;
@@ -972,7 +1056,8 @@ build_map_info(struct address_space *mapping, loff_t offset, bool is_register)
 
  again:
 	i_mmap_lock_read(mapping);
-	vma_interval_tree_foreach(vma, &mapping->i_mmap, pgoff, pgoff) {
+	vma_interval_tree_foreach(vma, &mapping->i_mmap, start >> PAGE_SHIFT,
+				  end >> PAGE_SHIFT) {
 		if (!valid_vma(vma, is_register))
 			continue;
 
@@ -1000,7 +1085,7 @@ build_map_info(struct address_space *mapping, loff_t offset, bool is_register)
 		curr = info;
 
 		info->mm = vma->vm_mm;
-		info->vaddr = offset_to_vaddr(vma, offset);
+		info->vaddr = offset_to_vaddr(vma, start);
 	}
 	i_mmap_unlock_read(mapping);
 
@@ -1030,16 +1115,29 @@ build_map_info(struct address_space *mapping, loff_t offset, bool is_register)
 	return curr;
 }
 
+/*
+ * Install (@news != NULL) or remove the breakpoints of @cnt uprobes of the
+ * same inode in every mm that maps them, taking each mm's mmap_lock once
+ * for all of them. @news[i] is the new consumer of @uprobes[i].
+ */
 static int
-register_for_each_vma(struct uprobe *uprobe, struct uprobe_consumer *new)
+register_for_each_vma_batch(struct uprobe **uprobes,
+			    struct uprobe_consumer **news, int cnt)
 {
-	bool is_register = !!new;
+	struct inode *inode = uprobes[0]->inode;
+	bool is_register = !!news;
+	loff_t start, end;
 	struct map_info *info;
-	int err = 0;
+	int i, err = 0;
+
+	start = end = uprobes[0]->offset;
+	for (i = 1; i < cnt; i++) {
+		start = min(start, uprobes[i]->offset);
+		end = max(end, uprobes[i]->offset);
+	}
 
 	percpu_down_write(&dup_mmap_sem);
-	info = build_map_info(uprobe->inode->i_mapping,
-					uprobe->offset, is_register);
+	info = build_map_info(inode->i_mapping, start, end, is_register);
 	if (IS_ERR(info)) {
 		err = PTR_ERR(info);
 		goto out;
@@ -1047,33 +1145,39 @@ register_for_each_vma(struct uprobe *uprobe, struct uprobe_consumer *new)
 
 	while (info) {
 		struct mm_struct *mm = info->mm;
-		struct vm_area_struct *vma;
 
 		if (err && is_register)
 			goto free;
 
 		mmap_write_lock(mm);
-		vma = find_vma(mm, info->vaddr);
-		if (!vma || !valid_vma(vma, is_register) ||
-		    file_inode(vma->vm_file) != uprobe->inode)
-			goto unlock;
-
-		if (vma->vm_start > info->vaddr ||
-		    vaddr_to_offset(vma, info->vaddr) != uprobe->offset)
-			goto unlock;
-
-		if (is_register) {
-			/* consult only the "caller", new consumer. */
-			if (consumer_filter(new,
-					UPROBE_FILTER_REGISTER, mm))
-				err = install_breakpoint(uprobe, mm, vma, info->vaddr);
-		} else if (test_bit(MMF_HAS_UPROBES, &mm->flags)) {
-			if (!filter_chain(uprobe,
-					UPROBE_FILTER_UNREGISTER, mm))
-				err |= remove_breakpoint(uprobe, mm, info->vaddr);
+		for (i = 0; i < cnt; i++) {
+			struct uprobe *uprobe = uprobes[i];
+			unsigned long vaddr;
+			struct vm_area_struct *vma;
+
+			vaddr = info->vaddr + (uprobe->offset - start);
+			vma = find_vma(mm, vaddr);
+			if (!vma || !valid_vma(vma, is_register) ||
+			    file_inode(vma->vm_file) != inode)
+				continue;
+
+			if (vma->vm_start > vaddr ||
+			    vaddr_to_offset(vma, vaddr) != uprobe->offset)
+				continue;
+
+			if (is_register) {
+				/* consult only the "caller", new consumer. */
+				if (consumer_filter(news[i],
+						UPROBE_FILTER_REGISTER, mm))
+					err = install_breakpoint(uprobe, mm, vma, vaddr);
+				if (err)
+					break;
+			} else if (test_bit(MMF_HAS_UPROBES, &mm->flags)) {
+				if (!filter_chain(uprobe,
+						UPROBE_FILTER_UNREGISTER, mm))
+					err |= remove_breakpoint(uprobe, mm, vaddr);
+			}
 		}
-
- unlock:
 		mmap_write_unlock(mm);
  free:
 		mmput(mm);
@@ -1084,6 +1188,12 @@ register_for_each_vma(struct uprobe *uprobe, struct uprobe_consumer *new)
 	return err;
 }
 
+static int
+register_for_each_vma(struct uprobe *uprobe, struct uprobe_consumer *new)
+{
+	return register_for_each_vma_batch(&uprobe, new ? &new : NULL, 1);
+}
+
 static void
 __uprobe_unregister(struct uprobe *uprobe, struct uprobe_consumer *uc)
 {
@@ -1137,12 +1247,9 @@ EXPORT_SYMBOL_GPL(uprobe_unregister);
  * Return errno if it cannot successully install probes
  * else return 0 (success)
  */
-static int __uprobe_register(struct inode *inode, loff_t offset,
-			     loff_t ref_ctr_offset, struct uprobe_consumer *uc)
+static int uprobe_validate(struct inode *inode, loff_t offset,
+			   loff_t ref_ctr_offset, struct uprobe_consumer *uc)
 {
-	struct uprobe *uprobe;
-	int ret;
-
 	/* Uprobe must have at least one set consumer */
 	if (!uc->handler && !uc->ret_handler)
 		return -EINVAL;
@@ -1163,6 +1270,19 @@ static int __uprobe_register(struct inode *inode, loff_t offset,
 	if (!IS_ALIGNED(ref_ctr_offset, sizeof(short)))
 		return -EINVAL;
 
+	return 0;
+}
+
+static int __uprobe_register(struct inode *inode, loff_t offset,
+			     loff_t ref_ctr_offset, struct uprobe_consumer *uc)
+{
+	struct uprobe *uprobe;
+	int ret;
+
+	ret = uprobe_validate(inode, offset, ref_ctr_offset, uc);
+	if (ret)
+		return ret;
+
  retry:
 	uprobe = alloc_uprobe(inode, offset, ref_ctr_offset);
 	if (!uprobe)
@@ -1204,6 +1324,178 @@ int uprobe_register_refctr(struct inode *inode, loff_t offset,
 }
 EXPORT_SYMBOL_GPL(uprobe_register_refctr);
 
+static void __uprobe_unregister_batch(struct uprobe **uprobes,
+				      struct uprobe_batch_entry *entries,
+				      int cnt)
+{
+	int i, err;
+
+	for (i = 0; i < cnt; i++) {
+		down_write(&uprobes[i]->register_rwsem);
+		WARN_ON(!consumer_del(uprobes[i], entries[i].uc));
+		up_write(&uprobes[i]->register_rwsem);
+	}
+
+	/*
+	 * If a breakpoint could not be removed from some mm, the uprobes are
+	 * kept in the tree. A leftover breakpoint then still finds its
+	 * uprobe on a hit, which only single-steps the original instruction
+	 * as there are no consumers, and a later registration at the same
+	 * offset reuses the uprobe.
+	 */
+	err = register_for_each_vma_batch(uprobes, NULL, cnt);
+
+	for (i = 0; i < cnt; i++) {
+		down_write(&uprobes[i]->register_rwsem);
+		if (!uprobes[i]->consumers && !err &&
+		    uprobe_is_active(uprobes[i]))
+			delete_uprobe(uprobes[i]);
+		up_write(&uprobes[i]->register_rwsem);
+	}
+}
+
+/*
+ * uprobe_register_batch - register @cnt probes in the same file
+ * @inode: the file in which the probes have to be placed.
+ * @entries: offset, ref_ctr_offset and consumer of each probe.
+ * @cnt: number of entries.
+ *
+ * Equivalent to calling uprobe_register_refctr() for each entry, but the
+ * breakpoints are installed with a single walk over the mms mapping
+ * @inode, instead of one walk per probe. Either all probes get registered
+ * or none.
+ */
+int uprobe_register_batch(struct inode *inode,
+			  struct uprobe_batch_entry *entries, int cnt)
+{
+	struct uprobe_consumer **ucs;
+	struct uprobe **uprobes;
+	int i, ret;
+
+	if (cnt <= 0)
+		return -EINVAL;
+
+	for (i = 0; i < cnt; i++) {
+		ret = uprobe_validate(inode, entries[i].offset,
+				      entries[i].ref_ctr_offset, entries[i].uc);
+		if (ret)
+			return ret;
+	}
+
+	uprobes = kvcalloc(cnt, sizeof(*uprobes), GFP_KERNEL);
+	ucs = kvcalloc(cnt, sizeof(*ucs), GFP_KERNEL);
+	if (!uprobes || !ucs) {
+		ret = -ENOMEM;
+		goto free;
+	}
+
+	for (i = 0; i < cnt; i++) {
+		struct uprobe *uprobe;
+ retry:
+		uprobe = alloc_uprobe(inode, entries[i].offset,
+				      entries[i].ref_ctr_offset);
+		if (IS_ERR_OR_NULL(uprobe)) {
+			ret = uprobe ? PTR_ERR(uprobe) : -ENOMEM;
+			goto unregister;
+		}
+
+		/* We can race with uprobe_unregister()->delete_uprobe(). */
+		down_write(&uprobe->register_rwsem);
+		if (unlikely(!uprobe_is_active(uprobe))) {
+			up_write(&uprobe->register_rwsem);
+			put_uprobe(uprobe);
+			goto retry;
+		}
+		consumer_add(uprobe, entries[i].uc);
+		up_write(&uprobe->register_rwsem);
+
+		uprobes[i] = uprobe;
+		ucs[i] = entries[i].uc;
+	}
+
+	ret = register_for_each_vma_batch(uprobes, ucs, cnt);
+
+ unregister:
+	if (ret && i)
+		__uprobe_unregister_batch(uprobes, entries, i);
+	while (i--)
+		put_uprobe(uprobes[i]);
+ free:
+	kvfree(ucs);
+	kvfree(uprobes);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(uprobe_register_batch);
+
+/*
+ * uprobe_unregister_batch - unregister probes registered by
+ * uprobe_register_batch().
+ * @inode: the file in which the probes have to be removed.
+ * @entries: the entries passed to uprobe_register_batch().
+ * @cnt: number of entries.
+ */
+void uprobe_unregister_batch(struct inode *inode,
+			     struct uprobe_batch_entry *entries, int cnt)
+{
+	struct uprobe **uprobes;
+	bool found;
+	int i;
+
+	uprobes = kvcalloc(cnt, sizeof(*uprobes), GFP_KERNEL);
+	if (!uprobes)
+		goto slow;
+
+	for (i = 0; i < cnt; i++) {
+		uprobes[i] = find_uprobe(inode, entries[i].offset);
+		if (!uprobes[i])
+			break;
+	}
+
+	found = i == cnt;
+	if (found)
+		__uprobe_unregister_batch(uprobes, entries, cnt);
+	while (i--)
+		put_uprobe(uprobes[i]);
+	kvfree(uprobes);
+	if (found)
+		return;
+ slow:
+	/* Unregistering can't fail, fall back to one probe at a time. */
+	for (i = 0; i < cnt; i++)
+		uprobe_unregister(inode, entries[i].offset, entries[i].uc);
+}
+EXPORT_SYMBOL_GPL(uprobe_unregister_batch);
+
+/*
+ * uprobe_nhits - number of times the breakpoint at @inode:@offset was hit.
+ */
+static unsigned long __uprobe_nhits(struct uprobe *uprobe)
+{
+	unsigned long nhits = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		nhits += *per_cpu_ptr(uprobe->nhits, cpu);
+
+	return nhits;
+}
+
+unsigned long uprobe_nhits(struct inode *inode, loff_t offset)
+{
+	struct uprobe *uprobe;
+	unsigned long nhits;
+
+	uprobe = find_uprobe(inode, offset);
+	if (!uprobe)
+		return 0;
+
+	nhits = __uprobe_nhits(uprobe);
+	put_uprobe(uprobe);
+
+	return nhits;
+}
+EXPORT_SYMBOL_GPL(uprobe_nhits);
+
 /*
  * uprobe_apply - unregister an already registered probe.
  * @inode: the file in which the probe has to be removed.
@@ -2052,7 +2344,7 @@ static struct uprobe *find_active_uprobe(unsigned long bp_vaddr, int *is_swbp)
 			struct inode *inode = file_inode(vma->vm_file);
 			loff_t offset = vaddr_to_offset(vma, bp_vaddr);
 
-			uprobe = find_uprobe(inode, offset);
+			uprobe = find_uprobe_rcu(inode, offset);
 		}
 
 		if (!uprobe)
@@ -2239,6 +2531,7 @@ static void handle_swbp(struct pt_regs *regs)
 	if (arch_uprobe_ignore(&uprobe->arch, regs))
 		goto out;
 
+	this_cpu_inc(*uprobe->nhits);
 	handler_chain(uprobe, regs);
 
 	if (arch_uprobe_skip_sstep(&uprobe->arch, regs))
@@ -2342,6 +2635,39 @@ int uprobe_post_sstep_notifier(struct pt_regs *regs)
 	return 1;
 }
 
+#ifdef CONFIG_DEBUG_FS
+/* <sb id> <inode> <offset> <hits> for every registered uprobe */
+static int uprobe_hits_show(struct seq_file *m, void *v)
+{
+	struct uprobe *uprobe;
+	struct rb_node *n;
+
+	spin_lock(&uprobes_treelock);
+	for (n = rb_first(&uprobes_tree); n; n = rb_next(n)) {
+		uprobe = __node_2_uprobe(n);
+		seq_printf(m, "%s %lu 0x%llx %lu\n", uprobe->inode->i_sb->s_id,
+			   uprobe->inode->i_ino,
+			   (unsigned long long)uprobe->offset,
+			   __uprobe_nhits(uprobe));
+	}
+	spin_unlock(&uprobes_treelock);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(uprobe_hits);
+
+static int __init uprobes_debugfs_init(void)
+{
+	struct dentry *dir;
+
+	dir = debugfs_create_dir("uprobes", NULL);
+	debugfs_create_file("hits", 0400, dir, NULL, &uprobe_hits_fops);
+
+	return 0;
+}
+late_initcall(uprobes_debugfs_init);
+#endif /* CONFIG_DEBUG_FS */
+
 static struct notifier_block uprobe_exception_nb = {
 	.notifier_call		= arch_uprobe_exception_notify,
 	.priority		= INT_MAX-1,	/* notified after kprobes, kgdb */
@@ -2070,6 +2070,9 @@ static __latent_entropy struct task_struct *copy_process(
 #ifdef CONFIG_LOCKDEP
 	lockdep_init_task(p);
 #endif
+#ifdef CONFIG_LOCK_CONTENTION_PROFILE
+	p->lock_contention_start = 0;
+#endif
 
 #ifdef CONFIG_DEBUG_MUTEXES
 	p->blocked_on = NULL; /* not blocked yet */
@@ -481,6 +481,10 @@ void handle_nested_irq(unsigned int irq)
 	for_each_action_of_desc(desc, action)
 		action_ret |= action->thread_fn(action->irq, action->dev_id);
 
+	/* Nested handlers are not polled, more work pending means handled */
+	if (action_ret & IRQ_MORE_WORK)
+		action_ret = (action_ret & ~IRQ_MORE_WORK) | IRQ_HANDLED;
+
 	if (!noirqdebug)
 		note_interrupt(desc, action_ret);
 
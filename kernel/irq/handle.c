@@ -160,6 +160,11 @@ irqreturn_t __handle_irq_event_percpu(struct irq_desc *desc, unsigned int *flags
 			      irq, action->handler))
 			local_irq_disable();
 
+		/* Only threaded handlers can be polled */
+		if (WARN_ONCE(res & IRQ_MORE_WORK, "irq %u handler %pS returned IRQ_MORE_WORK\n",
+			      irq, action->handler))
+			res = (res & ~IRQ_MORE_WORK) | IRQ_HANDLED;
+
 		switch (res) {
 		case IRQ_WAKE_THREAD:
 			/*
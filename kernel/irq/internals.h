@@ -37,6 +37,9 @@ enum {
 	IRQTF_FORCED_THREAD,
 };
 
+/* Default polling budget of threaded handlers, see irq_set_thread_budget() */
+#define IRQ_THREAD_BUDGET	16
+
 /*
  * Bit masks for desc->core_internal_state__do_not_mess_with_it
  *
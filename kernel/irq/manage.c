@@ -1159,15 +1159,44 @@ irq_forced_thread_fn(struct irq_desc *desc, struct irqaction *action)
  * Interrupts explicitly requested as threaded interrupts want to be
  * preemptible - many of them need to sleep and wait for slow busses to
  * complete.
+ *
+ * A handler returning IRQ_MORE_WORK is polled again right away, without
+ * unmasking the interrupt line, up to action->thread_budget times. Then
+ * the thread sleeps for a tick before it polls again.
  */
 static irqreturn_t irq_thread_fn(struct irq_desc *desc,
 		struct irqaction *action)
 {
+	unsigned int runs = 0, budget = READ_ONCE(action->thread_budget);
 	irqreturn_t ret;
 
-	ret = action->thread_fn(action->irq, action->dev_id);
-	if (ret == IRQ_HANDLED)
-		atomic_inc(&desc->threads_handled);
+	action->thread_wakeups++;
+	for (;;) {
+		ret = action->thread_fn(action->irq, action->dev_id);
+		action->thread_runs++;
+		if (ret & (IRQ_HANDLED | IRQ_MORE_WORK))
+			atomic_inc(&desc->threads_handled);
+
+		if (!(ret & IRQ_MORE_WORK))
+			break;
+
+		if (++runs >= budget) {
+			/*
+			 * Budget used up. Requeue the thread, which keeps a
+			 * oneshot line masked, and sleep for a tick. The
+			 * thread runs with a realtime priority, so yielding
+			 * the CPU would not let lower priority tasks run.
+			 * The threads_active reference is dropped by
+			 * irq_thread().
+			 */
+			action->thread_exhausted++;
+			if (!test_and_set_bit(IRQTF_RUNTHREAD, &action->thread_flags))
+				atomic_inc(&desc->threads_active);
+			schedule_timeout_interruptible(1);
+			break;
+		}
+		cond_resched();
+	}
 
 	irq_finalize_oneshot(desc, action);
 	return ret;
@@ -1289,6 +1318,47 @@ void irq_wake_thread(unsigned int irq, void *dev_id)
 }
 EXPORT_SYMBOL_GPL(irq_wake_thread);
 
+/**
+ *	irq_set_thread_budget - set the polling budget of a threaded handler
+ *	@irq:		Interrupt line
+ *	@dev_id:	Device identity of the handler
+ *	@budget:	Maximum number of consecutive runs of the handler
+ *
+ *	A threaded handler can process a batch of events per run and
+ *	return IRQ_MORE_WORK when events are left. It is then run again
+ *	without the interrupt line being unmasked, up to @budget times per
+ *	wakeup, after which the thread sleeps for a tick before it polls
+ *	again, so it does not starve the lower priority tasks. High rate
+ *	interrupts thus turn into polling bursts instead of one wakeup per
+ *	event.
+ *
+ *	Nested threaded handlers are not polled, see handle_nested_irq().
+ */
+int irq_set_thread_budget(unsigned int irq, void *dev_id, unsigned int budget)
+{
+	struct irq_desc *desc = irq_to_desc(irq);
+	struct irqaction *action;
+	unsigned long flags;
+	int ret = -EINVAL;
+
+	if (!desc || !budget || irq_settings_is_per_cpu_devid(desc))
+		return -EINVAL;
+
+	raw_spin_lock_irqsave(&desc->lock, flags);
+	for_each_action_of_desc(desc, action) {
+		if (action->dev_id == dev_id) {
+			if (action->thread) {
+				WRITE_ONCE(action->thread_budget, budget);
+				ret = 0;
+			}
+			break;
+		}
+	}
+	raw_spin_unlock_irqrestore(&desc->lock, flags);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(irq_set_thread_budget);
+
 static int irq_setup_forced_threading(struct irqaction *new)
 {
 	if (!force_irqthreads)
@@ -1402,6 +1472,7 @@ setup_irq_thread(struct irqaction *new, unsigned int irq, bool secondary)
 	 * references an already freed task_struct.
 	 */
 	new->thread = get_task_struct(t);
+	new->thread_budget = IRQ_THREAD_BUDGET;
 	/*
 	 * Tell the thread to set its affinity. This is
 	 * important for shared interrupt handlers as we do
@@ -295,6 +295,32 @@ static int irq_spurious_proc_show(struct seq_file *m, void *v)
 	return 0;
 }
 
+static void irq_thread_proc_show_one(struct seq_file *m,
+				     struct irqaction *action)
+{
+	if (!action->thread)
+		return;
+	seq_printf(m, "%s budget %u wakeups %lu runs %lu exhausted %lu\n",
+		   action->name, action->thread_budget, action->thread_wakeups,
+		   action->thread_runs, action->thread_exhausted);
+}
+
+static int irq_threads_proc_show(struct seq_file *m, void *v)
+{
+	struct irq_desc *desc = irq_to_desc((long) m->private);
+	struct irqaction *action;
+	unsigned long flags;
+
+	raw_spin_lock_irqsave(&desc->lock, flags);
+	for_each_action_of_desc(desc, action) {
+		irq_thread_proc_show_one(m, action);
+		if (action->secondary)
+			irq_thread_proc_show_one(m, action->secondary);
+	}
+	raw_spin_unlock_irqrestore(&desc->lock, flags);
+	return 0;
+}
+
 #define MAX_NAMELEN 128
 
 static int name_unique(unsigned int irq, struct irqaction *new_action)
@@ -386,6 +412,9 @@ void register_irq_proc(unsigned int irq, struct irq_desc *desc)
 	proc_create_single_data("spurious", 0444, desc->dir,
 			irq_spurious_proc_show, (void *)(long)irq);
 
+	proc_create_single_data("threads", 0444, desc->dir,
+			irq_threads_proc_show, (void *)(long)irq);
+
 out_unlock:
 	mutex_unlock(&register_lock);
 }
@@ -407,6 +436,7 @@ void unregister_irq_proc(unsigned int irq, struct irq_desc *desc)
 # endif
 #endif
 	remove_proc_entry("spurious", desc->dir);
+	remove_proc_entry("threads", desc->dir);
 
 	sprintf(name, "%u", irq);
 	remove_proc_entry(name, root_irq_dir);
@@ -0,0 +1,460 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Lightweight lock contention profiling
+ *
+ * lock_stat needs full lockdep, which is too expensive to leave enabled on
+ * production machines. This instead only hooks the slowpaths: the
+ * contention_begin/contention_end tracepoints of the sleeping locks (mutex,
+ * rwsem, percpu-rwsem, rt_mutex and semaphore) and the spinlock acquire
+ * when its trylock fails. Nothing is added to the uncontended paths but a
+ * static branch for spinlocks.
+ *
+ * Without lockdep there is no lock class, so wait times are aggregated per
+ * call site and lock type: the first return address on the stack past the
+ * lock functions (the lock and scheduler text sections). The statistics are
+ * kept in per-CPU hash tables that are only merged when /proc/lock_contention
+ * is read.
+ *
+ * Writing '1' to /proc/lock_contention clears the statistics and starts
+ * profiling, writing '0' stops it. The statistics stay readable until the
+ * next start.
+ */
+#include <linux/kernel.h>
+#include <linux/lock_contention.h>
+#include <linux/mutex.h>
+#include <linux/percpu.h>
+#include <linux/proc_fs.h>
+#include <linux/sched.h>
+#include <linux/sched/clock.h>
+#include <linux/sched/debug.h>
+#include <linux/seq_file.h>
+#include <linux/sort.h>
+#include <linux/spinlock.h>
+#include <linux/stacktrace.h>
+#include <linux/uaccess.h>
+#include <linux/vmalloc.h>
+#include <linux/hash.h>
+#include <linux/math64.h>
+
+#include <trace/events/lock.h>
+
+#define LC_HASH_BITS		8
+#define LC_HASH_SIZE		(1UL << LC_HASH_BITS)
+#define LC_STACK_DEPTH		16
+
+struct lock_contention_stat {
+	unsigned long		ip;	/* call site, 0 if the slot is free */
+	unsigned int		flags;	/* LCB_F_* of the first wait */
+	unsigned long		count;
+	u64			total;	/* wait time, ns */
+	u64			max;
+};
+
+struct lock_contention_table {
+	struct lock_contention_stat	stats[LC_HASH_SIZE];
+	unsigned long			dropped;
+};
+
+DEFINE_STATIC_KEY_FALSE(lock_contention_key);
+EXPORT_SYMBOL(lock_contention_key);
+
+static struct lock_contention_table __percpu *lc_tables;
+static DEFINE_MUTEX(lc_mutex);	/* serializes enable/disable */
+static bool lc_enabled;
+
+/* Waits that started before the profiler was (re)enabled are ignored. */
+static u64 lc_epoch;
+
+/*
+ * The stack seen from here starts with the profiler itself and, for the
+ * sleeping locks, the tracepoint iterator; then come the lock functions,
+ * which all live in the lock or scheduler text sections (the spinlock hooks
+ * below are __lockfunc for that reason); the first entry past them is the
+ * call site. Returns 0 if it is not within LC_STACK_DEPTH.
+ */
+static unsigned long lock_contention_caller(void)
+{
+	unsigned long entries[LC_STACK_DEPTH];
+	unsigned int i, nr;
+
+	nr = stack_trace_save(entries, ARRAY_SIZE(entries), 0);
+	for (i = 0; i < nr && !in_sched_functions(entries[i]); i++)
+		;
+	for (; i < nr && in_sched_functions(entries[i]); i++)
+		;
+
+	return i < nr ? entries[i] : 0;
+}
+
+static void lock_contention_account(unsigned int lcb_flags, u64 start)
+{
+	struct lock_contention_table *table;
+	struct lock_contention_stat *stat = NULL;
+	unsigned long ip, flags, h, i;
+	u64 delta;
+
+	if (unlikely(in_nmi()))
+		return;
+
+	delta = local_clock() - start;
+	ip = lock_contention_caller();
+	h = hash_long(ip ^ lcb_flags, LC_HASH_BITS);
+
+	local_irq_save(flags);
+	table = this_cpu_ptr(lc_tables);
+	for (i = 0; ip && i < LC_HASH_SIZE; i++) {
+		struct lock_contention_stat *slot;
+
+		slot = &table->stats[(h + i) & (LC_HASH_SIZE - 1)];
+		if (!slot->ip) {
+			slot->ip = ip;
+			slot->flags = lcb_flags;
+		}
+		if (slot->ip == ip && slot->flags == lcb_flags) {
+			stat = slot;
+			break;
+		}
+	}
+
+	if (stat) {
+		stat->count++;
+		stat->total += delta;
+		if (delta > stat->max)
+			stat->max = delta;
+	} else {
+		table->dropped++;
+	}
+	local_irq_restore(flags);
+}
+
+void __lockfunc lock_contention_spin_lock(struct raw_spinlock *lock)
+{
+	u64 start;
+
+	if (arch_spin_trylock(&lock->raw_lock))
+		return;
+
+	start = local_clock();
+	arch_spin_lock(&lock->raw_lock);
+	lock_contention_account(LCB_F_SPIN, start);
+}
+EXPORT_SYMBOL(lock_contention_spin_lock);
+
+void __lockfunc lock_contention_spin_lock_flags(struct raw_spinlock *lock,
+						unsigned long *flags)
+{
+	u64 start;
+
+	if (arch_spin_trylock(&lock->raw_lock))
+		return;
+
+	start = local_clock();
+	arch_spin_lock_flags(&lock->raw_lock, *flags);
+	lock_contention_account(LCB_F_SPIN, start);
+}
+EXPORT_SYMBOL(lock_contention_spin_lock_flags);
+
+/*
+ * A sleeping lock may report contention_begin more than once for a single
+ * wait, when it goes from spinning to sleeping; the wait is timed from the
+ * first one. The spinning bit is dropped so that a lock type has a single
+ * entry per call site.
+ */
+static void lc_contention_begin(void *data, void *lock, unsigned int flags)
+{
+	struct task_struct *curr = current;
+
+	if (curr->lock_contention_start > READ_ONCE(lc_epoch))
+		return;
+
+	curr->lock_contention_flags = flags & ~LCB_F_SPIN;
+	curr->lock_contention_start = local_clock();
+}
+
+static void lc_contention_end(void *data, void *lock, int ret)
+{
+	struct task_struct *curr = current;
+	u64 start = curr->lock_contention_start;
+
+	curr->lock_contention_start = 0;
+	if (start > READ_ONCE(lc_epoch))
+		lock_contention_account(curr->lock_contention_flags, start);
+}
+
+static int lock_contention_enable(void)
+{
+	int cpu, ret;
+
+	if (lc_enabled)
+		return 0;
+
+	if (!lc_tables) {
+		lc_tables = alloc_percpu(struct lock_contention_table);
+		if (!lc_tables)
+			return -ENOMEM;
+	}
+
+	for_each_possible_cpu(cpu)
+		memset(per_cpu_ptr(lc_tables, cpu), 0,
+		       sizeof(struct lock_contention_table));
+
+	WRITE_ONCE(lc_epoch, local_clock());
+
+	ret = register_trace_contention_begin(lc_contention_begin, NULL);
+	if (ret)
+		return ret;
+	ret = register_trace_contention_end(lc_contention_end, NULL);
+	if (ret) {
+		unregister_trace_contention_begin(lc_contention_begin, NULL);
+		tracepoint_synchronize_unregister();
+		return ret;
+	}
+
+	static_branch_enable(&lock_contention_key);
+	lc_enabled = true;
+	return 0;
+}
+
+static void lock_contention_disable(void)
+{
+	if (!lc_enabled)
+		return;
+
+	static_branch_disable(&lock_contention_key);
+	unregister_trace_contention_end(lc_contention_end, NULL);
+	unregister_trace_contention_begin(lc_contention_begin, NULL);
+
+	/*
+	 * Wait for spinners that saw the key enabled and for running probes,
+	 * both are in preempt-disabled regions; after this the tables are
+	 * stable and can be cleared by the next enable.
+	 */
+	tracepoint_synchronize_unregister();
+	lc_enabled = false;
+}
+
+struct lock_contention_seq {
+	struct lock_contention_stat	*stats;
+	unsigned long			nr;
+	unsigned long			dropped;
+	bool				enabled;
+};
+
+static int lc_cmp_site(const void *a, const void *b)
+{
+	const struct lock_contention_stat *sa = a, *sb = b;
+
+	if (sa->ip != sb->ip)
+		return sa->ip < sb->ip ? -1 : 1;
+	if (sa->flags != sb->flags)
+		return sa->flags < sb->flags ? -1 : 1;
+	return 0;
+}
+
+static int lc_cmp_total(const void *a, const void *b)
+{
+	const struct lock_contention_stat *sa = a, *sb = b;
+
+	if (sa->total != sb->total)
+		return sa->total > sb->total ? -1 : 1;
+	return 0;
+}
+
+/*
+ * Merge the per-CPU tables: collect all used slots, sort them by call site
+ * to fold duplicates, then sort by total wait time.
+ */
+static int lock_contention_snapshot(struct lock_contention_seq *data)
+{
+	struct lock_contention_stat *stats, *out;
+	unsigned long i, nr = 0;
+	int cpu;
+
+	data->enabled = lc_enabled;
+	if (!lc_tables)
+		return 0;
+
+	stats = vmalloc(array_size(num_possible_cpus() * LC_HASH_SIZE,
+				   sizeof(*stats)));
+	if (!stats)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		struct lock_contention_table *table = per_cpu_ptr(lc_tables, cpu);
+
+		data->dropped += READ_ONCE(table->dropped);
+		for (i = 0; i < LC_HASH_SIZE; i++) {
+			struct lock_contention_stat *stat = &table->stats[i];
+
+			if (!READ_ONCE(stat->ip) || !READ_ONCE(stat->count))
+				continue;
+			stats[nr].ip = stat->ip;
+			stats[nr].flags = stat->flags;
+			stats[nr].count = READ_ONCE(stat->count);
+			stats[nr].total = READ_ONCE(stat->total);
+			stats[nr].max = READ_ONCE(stat->max);
+			nr++;
+		}
+	}
+
+	sort(stats, nr, sizeof(*stats), lc_cmp_site, NULL);
+	for (i = 0, out = stats; i < nr; i++) {
+		if (out != stats && !lc_cmp_site(out - 1, &stats[i])) {
+			out[-1].count += stats[i].count;
+			out[-1].total += stats[i].total;
+			out[-1].max = max(out[-1].max, stats[i].max);
+			continue;
+		}
+		*out++ = stats[i];
+	}
+	nr = out - stats;
+	sort(stats, nr, sizeof(*stats), lc_cmp_total, NULL);
+
+	data->stats = stats;
+	data->nr = nr;
+	return 0;
+}
+
+static const char *lc_type_name(unsigned int flags)
+{
+	if (flags & LCB_F_MUTEX)
+		return "mutex";
+	if (flags & LCB_F_RT)
+		return "rt_mutex";
+	if (flags & LCB_F_PERCPU)
+		return flags & LCB_F_WRITE ? "percpu-rwsem:W" : "percpu-rwsem:R";
+	if (flags & LCB_F_WRITE)
+		return "rwsem:W";
+	if (flags & LCB_F_READ)
+		return "rwsem:R";
+	if (flags & LCB_F_SPIN)
+		return "spinlock";
+	return "semaphore";
+}
+
+static void *lc_start(struct seq_file *m, loff_t *pos)
+{
+	struct lock_contention_seq *data = m->private;
+
+	if (*pos == 0)
+		return SEQ_START_TOKEN;
+	if (*pos > data->nr)
+		return NULL;
+
+	return data->stats + (*pos - 1);
+}
+
+static void *lc_next(struct seq_file *m, void *v, loff_t *pos)
+{
+	(*pos)++;
+	return lc_start(m, pos);
+}
+
+static void lc_stop(struct seq_file *m, void *v)
+{
+}
+
+static int lc_show(struct seq_file *m, void *v)
+{
+	struct lock_contention_seq *data = m->private;
+	struct lock_contention_stat *stat = v;
+
+	if (v == SEQ_START_TOKEN) {
+		seq_printf(m, "lock_contention version 0.1, %s, %lu dropped\n",
+			   data->enabled ? "enabled" : "disabled",
+			   data->dropped);
+		seq_printf(m, "%14s %16s %14s %14s %-15s %s\n",
+			   "contentions", "wait-total(ns)", "wait-avg(ns)",
+			   "wait-max(ns)", "type", "caller");
+		return 0;
+	}
+
+	seq_printf(m, "%14lu %16llu %14llu %14llu %-15s %pS\n",
+		   stat->count, stat->total,
+		   div64_u64(stat->total, stat->count), stat->max,
+		   lc_type_name(stat->flags), (void *)stat->ip);
+	return 0;
+}
+
+static const struct seq_operations lock_contention_ops = {
+	.start	= lc_start,
+	.next	= lc_next,
+	.stop	= lc_stop,
+	.show	= lc_show,
+};
+
+static int lock_contention_open(struct inode *inode, struct file *file)
+{
+	struct lock_contention_seq *data;
+	int res;
+
+	data = kzalloc(sizeof(*data), GFP_KERNEL);
+	if (!data)
+		return -ENOMEM;
+
+	mutex_lock(&lc_mutex);
+	res = lock_contention_snapshot(data);
+	mutex_unlock(&lc_mutex);
+	if (res)
+		goto err;
+
+	res = seq_open(file, &lock_contention_ops);
+	if (res)
+		goto err;
+
+	((struct seq_file *)file->private_data)->private = data;
+	return 0;
+err:
+	vfree(data->stats);
+	kfree(data);
+	return res;
+}
+
+static ssize_t lock_contention_write(struct file *file, const char __user *buf,
+				     size_t count, loff_t *ppos)
+{
+	int ret = 0;
+	char c;
+
+	if (!count)
+		return 0;
+	if (get_user(c, buf))
+		return -EFAULT;
+
+	mutex_lock(&lc_mutex);
+	if (c == '1')
+		ret = lock_contention_enable();
+	else if (c == '0')
+		lock_contention_disable();
+	else
+		ret = -EINVAL;
+	mutex_unlock(&lc_mutex);
+
+	return ret ? ret : count;
+}
+
+static int lock_contention_release(struct inode *inode, struct file *file)
+{
+	struct seq_file *seq = file->private_data;
+	struct lock_contention_seq *data = seq->private;
+
+	vfree(data->stats);
+	kfree(data);
+	return seq_release(inode, file);
+}
+
+static const struct proc_ops lock_contention_proc_ops = {
+	.proc_open	= lock_contention_open,
+	.proc_write	= lock_contention_write,
+	.proc_read	= seq_read,
+	.proc_lseek	= seq_lseek,
+	.proc_release	= lock_contention_release,
+};
+
+static int __init lock_contention_proc_init(void)
+{
+	proc_create("lock_contention", S_IRUSR | S_IWUSR, NULL,
+		    &lock_contention_proc_ops);
+	return 0;
+}
+__initcall(lock_contention_proc_init);
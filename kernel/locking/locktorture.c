@@ -29,6 +29,7 @@
 #include <linux/slab.h>
 #include <linux/torture.h>
 #include <linux/reboot.h>
+#include <linux/math64.h>
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Paul E. McKenney <paulmck@linux.ibm.com>");
@@ -48,6 +49,8 @@ torture_param(int, stat_interval, 60,
 torture_param(int, stutter, 5, "Number of jiffies to run/halt test, 0=disable");
 torture_param(int, verbose, 1,
 	     "Enable verbose debugging printk()s");
+torture_param(int, bench, 0,
+	     "Throughput mode: cache lines written per critical section, 0=disable");
 
 static char *torture_type = "spin_lock";
 module_param(torture_type, charp, 0444);
@@ -67,6 +70,19 @@ struct lock_stress_stats {
 	long n_lock_acquired;
 };
 
+/*
+ * Data protected by the lock in throughput mode.  Each writer critical
+ * section dirties the first "bench" lines, so that the cost of moving the
+ * protected data between CPUs is part of what gets measured.
+ */
+#define LOCK_BENCH_MAX_LINES	64
+
+struct lock_bench_line {
+	unsigned long val;
+} ____cacheline_aligned_in_smp;
+
+static struct lock_bench_line lock_bench_data[LOCK_BENCH_MAX_LINES];
+
 /* Forward reference. */
 static void lock_torture_cleanup(void);
 
@@ -97,6 +113,7 @@ struct lock_torture_cxt {
 	struct lock_torture_ops *cur_ops;
 	struct lock_stress_stats *lwsa; /* writer statistics */
 	struct lock_stress_stats *lrsa; /* reader statistics */
+	unsigned long bench_start; /* jiffies at start of throughput run */
 };
 static struct lock_torture_cxt cxt = { 0, 0, false, false,
 				       ATOMIC_INIT(0),
@@ -660,6 +677,19 @@ static struct lock_torture_ops percpu_rwsem_lock_ops = {
 	.name		= "percpu_rwsem_lock"
 };
 
+/*
+ * Throughput-mode critical section: a fixed amount of work on the
+ * protected data instead of the randomized write_delay() of the torture
+ * mode, so that runs on different lock implementations are comparable.
+ */
+static void lock_torture_bench_cs(void)
+{
+	int i;
+
+	for (i = 0; i < bench; i++)
+		WRITE_ONCE(lock_bench_data[i].val, lock_bench_data[i].val + 1);
+}
+
 /*
  * Lock torture writer kthread.  Repeatedly acquires and releases
  * the lock, checking for duplicate acquisitions.
@@ -686,7 +716,10 @@ static int lock_torture_writer(void *arg)
 			lwsp->n_lock_fail++; /* rare, but... */
 
 		lwsp->n_lock_acquired++;
-		cxt.cur_ops->write_delay(&rand);
+		if (bench)
+			lock_torture_bench_cs();
+		else
+			cxt.cur_ops->write_delay(&rand);
 		lock_is_write_held = false;
 		WRITE_ONCE(last_lock_release, jiffies);
 		cxt.cur_ops->writeunlock(tid);
@@ -759,6 +792,12 @@ static void __torture_print_stats(char *page,
 			sum, max, min,
 			!onoff_interval && max / 2 > min ? "???" : "",
 			fail, fail ? "!!!" : "");
+	if (write && bench) {
+		unsigned long delta = jiffies - cxt.bench_start;
+
+		page += sprintf(page, "Throughput: %llu acquisitions/s\n",
+				delta ? div64_u64((u64)sum * HZ, delta) : 0ULL);
+	}
 	if (fail)
 		atomic_inc(&cxt.n_lock_torture_errors);
 }
@@ -828,11 +867,11 @@ lock_torture_print_module_parms(struct lock_torture_ops *cur_ops,
 				const char *tag)
 {
 	pr_alert("%s" TORTURE_FLAG
-		 "--- %s%s: nwriters_stress=%d nreaders_stress=%d stat_interval=%d verbose=%d shuffle_interval=%d stutter=%d shutdown_secs=%d onoff_interval=%d onoff_holdoff=%d\n",
+		 "--- %s%s: nwriters_stress=%d nreaders_stress=%d stat_interval=%d verbose=%d shuffle_interval=%d stutter=%d shutdown_secs=%d onoff_interval=%d onoff_holdoff=%d bench=%d\n",
 		 torture_type, tag, cxt.debug_lock ? " [debug]": "",
 		 cxt.nrealwriters_stress, cxt.nrealreaders_stress, stat_interval,
 		 verbose, shuffle_interval, stutter, shutdown_secs,
-		 onoff_interval, onoff_holdoff);
+		 onoff_interval, onoff_holdoff, bench);
 }
 
 static void lock_torture_cleanup(void)
@@ -939,6 +978,13 @@ static int __init lock_torture_init(void)
 		goto unwind;
 	}
 
+	if (bench < 0 || bench > LOCK_BENCH_MAX_LINES) {
+		pr_alert("lock-torture: bench must be between 0 and %d\n",
+			 LOCK_BENCH_MAX_LINES);
+		firsterr = -EINVAL;
+		goto unwind;
+	}
+
 	if (nwriters_stress >= 0)
 		cxt.nrealwriters_stress = nwriters_stress;
 	else
@@ -1016,6 +1062,7 @@ static int __init lock_torture_init(void)
 	}
 
 	lock_torture_print_module_parms(cxt.cur_ops, "Start of test");
+	cxt.bench_start = jiffies;
 
 	/* Prepare torture context. */
 	if (onoff_interval > 0) {
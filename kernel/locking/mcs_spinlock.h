@@ -45,6 +45,15 @@ do {									\
 	smp_store_release((l), 1)
 #endif
 
+#ifndef arch_mcs_lock_handoff
+/*
+ * As arch_mcs_spin_unlock_contended(), but hands over @val instead of 1;
+ * the NUMA-aware qspinlock slowpath passes its secondary queue that way.
+ */
+#define arch_mcs_lock_handoff(l, val)					\
+	smp_store_release((l), (val))
+#endif
+
 /*
  * Note: the smp_load_acquire/smp_store_release pair is not
  * sufficient to form a full memory barrier across
@@ -19,6 +19,7 @@
 #include <linux/sched/wake_q.h>
 #include <linux/sched/debug.h>
 #include <linux/timer.h>
+#include <trace/events/lock.h>
 
 #include "rtmutex_common.h"
 
@@ -1216,6 +1217,8 @@ static int __sched rt_mutex_slowlock(struct rt_mutex *lock, int state,
 		return 0;
 	}
 
+	trace_contention_begin(lock, LCB_F_RT);
+
 	set_current_state(state);
 
 	/* Setup the timer, when timeout != NULL */
@@ -1242,6 +1245,8 @@ static int __sched rt_mutex_slowlock(struct rt_mutex *lock, int state,
 
 	raw_spin_unlock_irqrestore(&lock->wait_lock, flags);
 
+	trace_contention_end(lock, ret);
+
 	/* Remove pending timer: */
 	if (unlikely(timeout))
 		hrtimer_cancel(&timeout->timer);
@@ -27,6 +27,8 @@
 #include <linux/export.h>
 #include <linux/rwsem.h>
 #include <linux/atomic.h>
+#include <linux/moduleparam.h>
+#include <trace/events/lock.h>
 
 #include "lock_events.h"
 
@@ -351,11 +353,26 @@ enum writer_wait_state {
 };
 
 /*
- * The typical HZ value is either 250 or 1000. So set the minimum waiting
- * time to at least 4ms or 1 jiffy (if it is higher than 4ms) in the wait
- * queue before initiating the handoff protocol.
+ * The typical HZ value is either 250 or 1000. So set the default minimum
+ * waiting time to at least 4ms or 1 jiffy (if it is higher than 4ms) in the
+ * wait queue before initiating the handoff protocol.
+ *
+ * Readers and writers have separate thresholds, so that either side can be
+ * made to force the handoff sooner (lower latency) or later (more lock
+ * stealing, higher throughput).
  */
-#define RWSEM_WAIT_TIMEOUT	DIV_ROUND_UP(HZ, 250)
+static unsigned int reader_handoff_ms = 4;
+module_param(reader_handoff_ms, uint, 0644);
+MODULE_PARM_DESC(reader_handoff_ms, "Reader wait time before lock handoff (ms)");
+
+static unsigned int writer_handoff_ms = 4;
+module_param(writer_handoff_ms, uint, 0644);
+MODULE_PARM_DESC(writer_handoff_ms, "Writer wait time before lock handoff (ms)");
+
+static inline unsigned long rwsem_wait_timeout(unsigned int *handoff_ms)
+{
+	return jiffies + max(1UL, msecs_to_jiffies(READ_ONCE(*handoff_ms)));
+}
 
 /*
  * Magic number to batch-wakeup waiting readers, even when writers are
@@ -595,6 +612,30 @@ static inline bool rwsem_try_write_lock_unqueued(struct rw_semaphore *sem)
 	return false;
 }
 
+/*
+ * Try to acquire read lock before the reader is put on wait queue.
+ * Lock acquisition isn't allowed if the rwsem is locked or a writer handoff
+ * is ongoing.
+ */
+static inline bool rwsem_try_read_lock_unqueued(struct rw_semaphore *sem)
+{
+	long count = atomic_long_read(&sem->count);
+
+	if (count & (RWSEM_WRITER_MASK | RWSEM_FLAG_HANDOFF))
+		return false;
+
+	count = atomic_long_fetch_add_acquire(RWSEM_READER_BIAS, &sem->count);
+	if (!(count & (RWSEM_WRITER_MASK | RWSEM_FLAG_HANDOFF))) {
+		rwsem_set_reader_owned(sem);
+		lockevent_inc(rwsem_opt_rlock);
+		return true;
+	}
+
+	/* Back out the change */
+	atomic_long_add(-RWSEM_READER_BIAS, &sem->count);
+	return false;
+}
+
 static inline bool owner_on_cpu(struct task_struct *owner)
 {
 	/*
@@ -733,7 +774,7 @@ static inline u64 rwsem_rspin_threshold(struct rw_semaphore *sem)
 	return sched_clock() + delta;
 }
 
-static bool rwsem_optimistic_spin(struct rw_semaphore *sem)
+static bool rwsem_optimistic_spin(struct rw_semaphore *sem, bool wlock)
 {
 	bool taken = false;
 	int prev_owner_state = OWNER_NULL;
@@ -750,7 +791,9 @@ static bool rwsem_optimistic_spin(struct rw_semaphore *sem)
 	 * Optimistically spin on the owner field and attempt to acquire the
 	 * lock whenever the owner changes. Spinning will be stopped when:
 	 *  1) the owning writer isn't running; or
-	 *  2) readers own the lock and spinning time has exceeded limit.
+	 *  2) readers own the lock and spinning time has exceeded limit; or
+	 *  3) readers own the lock and we are a reader that failed to join
+	 *     them, i.e. a writer handoff is pending.
 	 */
 	for (;;) {
 		enum owner_state owner_state;
@@ -762,11 +805,19 @@ static bool rwsem_optimistic_spin(struct rw_semaphore *sem)
 		/*
 		 * Try to acquire the lock
 		 */
-		taken = rwsem_try_write_lock_unqueued(sem);
+		taken = wlock ? rwsem_try_write_lock_unqueued(sem)
+			      : rwsem_try_read_lock_unqueued(sem);
 
 		if (taken)
 			break;
 
+		/*
+		 * A reader only spins on a running writer; there is nothing
+		 * to gain from waiting on other readers.
+		 */
+		if (!wlock && owner_state == OWNER_READER)
+			break;
+
 		/*
 		 * Time-based reader-owned rwsem optimistic spinning
 		 */
@@ -864,19 +915,45 @@ static inline void clear_nonspinnable(struct rw_semaphore *sem)
 		atomic_long_andnot(RWSEM_NONSPINNABLE, &sem->owner);
 }
 
+static bool reader_spin = true;
+module_param(reader_spin, bool, 0644);
+MODULE_PARM_DESC(reader_spin, "Let readers spin on a running writer owner");
+
+/*
+ * Readers only spin while the lock is owned by a writer that is running;
+ * a pending handoff means a waiter has to go first.
+ */
+static inline bool rwsem_reader_can_spin(struct rw_semaphore *sem, long count)
+{
+	if (!READ_ONCE(reader_spin))
+		return false;
+
+	if ((count & (RWSEM_WRITER_LOCKED | RWSEM_FLAG_HANDOFF)) !=
+	    RWSEM_WRITER_LOCKED)
+		return false;
+
+	return rwsem_can_spin_on_owner(sem);
+}
+
 #else
 static inline bool rwsem_can_spin_on_owner(struct rw_semaphore *sem)
 {
 	return false;
 }
 
-static inline bool rwsem_optimistic_spin(struct rw_semaphore *sem)
+static inline bool rwsem_optimistic_spin(struct rw_semaphore *sem,
+					 bool wlock)
 {
 	return false;
 }
 
 static inline void clear_nonspinnable(struct rw_semaphore *sem) { }
 
+static inline bool rwsem_reader_can_spin(struct rw_semaphore *sem, long count)
+{
+	return false;
+}
+
 static inline int
 rwsem_spin_on_owner(struct rw_semaphore *sem)
 {
@@ -928,10 +1005,42 @@ rwsem_down_read_slowpath(struct rw_semaphore *sem, long count, int state)
 		return sem;
 	}
 
+	/*
+	 * Reader optimistic spinning: the lock is held by a writer that is
+	 * still running, so it is likely to be released soon. Spinning here
+	 * avoids a sleep/wakeup round trip per writer critical section.
+	 */
+	if (rwsem_reader_can_spin(sem, count)) {
+		/*
+		 * Undo read bias from down_read() and do optimistic spinning.
+		 */
+		atomic_long_add(-RWSEM_READER_BIAS, &sem->count);
+		adjustment = 0;
+
+		trace_contention_begin(sem, LCB_F_SPIN | LCB_F_READ);
+		if (rwsem_optimistic_spin(sem, false)) {
+			/* rwsem_optimistic_spin() implies ACQUIRE on success */
+			trace_contention_end(sem, 0);
+			/*
+			 * Wake up other readers in the wait list if the front
+			 * waiter is a reader.
+			 */
+			if (atomic_long_read(&sem->count) & RWSEM_FLAG_WAITERS) {
+				raw_spin_lock_irq(&sem->wait_lock);
+				if (!list_empty(&sem->wait_list))
+					rwsem_mark_wake(sem, RWSEM_WAKE_READ_OWNED,
+							&wake_q);
+				raw_spin_unlock_irq(&sem->wait_lock);
+				wake_up_q(&wake_q);
+			}
+			return sem;
+		}
+	}
+
 queue:
 	waiter.task = current;
 	waiter.type = RWSEM_WAITING_FOR_READ;
-	waiter.timeout = jiffies + RWSEM_WAIT_TIMEOUT;
+	waiter.timeout = rwsem_wait_timeout(&reader_handoff_ms);
 
 	raw_spin_lock_irq(&sem->wait_lock);
 	if (list_empty(&sem->wait_list)) {
@@ -940,8 +1049,9 @@ rwsem_down_read_slowpath(struct rw_semaphore *sem, long count, int state)
 		 * by a writer or has the handoff bit set, this reader can
 		 * exit the slowpath and return immediately as its
 		 * RWSEM_READER_BIAS has already been set in the count.
+		 * That is not the case after optimistic spinning failed.
 		 */
-		if (!(atomic_long_read(&sem->count) &
+		if (adjustment && !(atomic_long_read(&sem->count) &
 		     (RWSEM_WRITER_MASK | RWSEM_FLAG_HANDOFF))) {
 			/* Provide lock ACQUIRE */
 			smp_acquire__after_ctrl_dep();
@@ -974,6 +1084,8 @@ rwsem_down_read_slowpath(struct rw_semaphore *sem, long count, int state)
 	raw_spin_unlock_irq(&sem->wait_lock);
 	wake_up_q(&wake_q);
 
+	trace_contention_begin(sem, LCB_F_READ);
+
 	/* wait to be given the lock */
 	for (;;) {
 		set_current_state(state);
@@ -995,6 +1107,7 @@ rwsem_down_read_slowpath(struct rw_semaphore *sem, long count, int state)
 
 	__set_current_state(TASK_RUNNING);
 	lockevent_inc(rwsem_rlock);
+	trace_contention_end(sem, 0);
 	return sem;
 
 out_nolock:
@@ -1006,6 +1119,7 @@ rwsem_down_read_slowpath(struct rw_semaphore *sem, long count, int state)
 	raw_spin_unlock_irq(&sem->wait_lock);
 	__set_current_state(TASK_RUNNING);
 	lockevent_inc(rwsem_rlock_fail);
+	trace_contention_end(sem, -EINTR);
 	return ERR_PTR(-EINTR);
 }
 
@@ -1022,9 +1136,13 @@ rwsem_down_write_slowpath(struct rw_semaphore *sem, int state)
 	DEFINE_WAKE_Q(wake_q);
 
 	/* do optimistic spinning and steal lock if possible */
-	if (rwsem_can_spin_on_owner(sem) && rwsem_optimistic_spin(sem)) {
-		/* rwsem_optimistic_spin() implies ACQUIRE on success */
-		return sem;
+	if (rwsem_can_spin_on_owner(sem)) {
+		trace_contention_begin(sem, LCB_F_SPIN | LCB_F_WRITE);
+		if (rwsem_optimistic_spin(sem, true)) {
+			/* rwsem_optimistic_spin() implies ACQUIRE on success */
+			trace_contention_end(sem, 0);
+			return sem;
+		}
 	}
 
 	/*
@@ -1033,7 +1151,7 @@ rwsem_down_write_slowpath(struct rw_semaphore *sem, int state)
 	 */
 	waiter.task = current;
 	waiter.type = RWSEM_WAITING_FOR_WRITE;
-	waiter.timeout = jiffies + RWSEM_WAIT_TIMEOUT;
+	waiter.timeout = rwsem_wait_timeout(&writer_handoff_ms);
 
 	raw_spin_lock_irq(&sem->wait_lock);
 
@@ -1076,6 +1194,8 @@ rwsem_down_write_slowpath(struct rw_semaphore *sem, int state)
 	}
 
 wait:
+	trace_contention_begin(sem, LCB_F_WRITE);
+
 	/* wait until we successfully acquire the lock */
 	set_current_state(state);
 	for (;;) {
@@ -1139,6 +1259,7 @@ rwsem_down_write_slowpath(struct rw_semaphore *sem, int state)
 	list_del(&waiter.list);
 	raw_spin_unlock_irq(&sem->wait_lock);
 	lockevent_inc(rwsem_wlock);
+	trace_contention_end(sem, 0);
 
 	return ret;
 
@@ -1157,6 +1278,7 @@ rwsem_down_write_slowpath(struct rw_semaphore *sem, int state)
 	raw_spin_unlock_irq(&sem->wait_lock);
 	wake_up_q(&wake_q);
 	lockevent_inc(rwsem_wlock_fail);
+	trace_contention_end(sem, -EINTR);
 
 	return ERR_PTR(-EINTR);
 }
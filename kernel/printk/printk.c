@@ -42,6 +42,8 @@
 #include <linux/rculist.h>
 #include <linux/poll.h>
 #include <linux/irq_work.h>
+#include <linux/kthread.h>
+#include <linux/debugfs.h>
 #include <linux/ctype.h>
 #include <linux/uio.h>
 #include <linux/sched/clock.h>
@@ -211,9 +213,6 @@ int devkmsg_sysctl_set_loglvl(struct ctl_table *table, int write,
 	return 0;
 }
 
-/* Number of registered extended console drivers. */
-static int nr_ext_console_drivers;
-
 /*
  * Helper macros to handle lockdep when locking/unlocking console_sem. We use
  * macros instead of functions so that _RET_IP_ contains useful information.
@@ -267,9 +266,25 @@ static void __up_console_sem(unsigned long ip)
 static int console_locked, console_suspended;
 
 /*
- * If exclusive_console is non-NULL then only this console is to be printed to.
+ * Set once the per-console printer kthreads have been started. While this
+ * is false, or whenever printk_direct_required() says so, records are
+ * written to the consoles from the context calling console_unlock().
+ */
+static bool printk_kthreads_available;
+
+/* Printer kthreads wait here for new records. */
+static DECLARE_WAIT_QUEUE_HEAD(printk_printer_wait);
+
+/*
+ * Panic, oops and shutdown output must not depend on the scheduler getting
+ * around to running the printer kthreads, so print directly in those cases.
  */
-static struct console *exclusive_console;
+static inline bool printk_direct_required(void)
+{
+	return !printk_kthreads_available || oops_in_progress ||
+	       atomic_read(&panic_cpu) != PANIC_CPU_INVALID ||
+	       system_state > SYSTEM_RUNNING;
+}
 
 /*
  *	Array of consoles built from command line options (console=)
@@ -366,11 +381,11 @@ static u64 syslog_seq;
 static size_t syslog_partial;
 static bool syslog_time;
 
-/* All 3 protected by @console_sem. */
-/* the next printk record to write to the console */
-static u64 console_seq;
-static u64 exclusive_console_stop_seq;
-static unsigned long console_dropped;
+/*
+ * One past the newest stored record. Only used to report how far behind
+ * the consoles are, so racing writers may leave it briefly stale.
+ */
+static atomic_long_t printk_next_stored_seq;
 
 struct latched_seq {
 	seqcount_latch_t	latch;
@@ -397,6 +412,9 @@ static struct latched_seq clear_seq = {
 /* the maximum size of a formatted record (i.e. with prefix added per line) */
 #define CONSOLE_LOG_MAX		1024
 
+/* the maximum size of the "messages dropped" console notice */
+#define DROPPED_TEXT_MAX	64
+
 /* the maximum size allowed to be reserved for a record */
 #define LOG_LINE_MAX		(CONSOLE_LOG_MAX - PREFIX_MAX)
 
@@ -1897,47 +1915,37 @@ static int console_trylock_spinning(void)
 }
 
 /*
- * Call the console drivers, asking them to write out
- * log_buf[start] to log_buf[end - 1].
+ * Call a console driver, asking it to write out a formatted record. A
+ * notice about records lost since the previous write to this console is
+ * emitted first, unless @dropped_text is NULL (extended consoles).
  * The console_lock must be held.
  */
-static void call_console_drivers(const char *ext_text, size_t ext_len,
-				 const char *text, size_t len)
+static void call_console_driver(struct console *con, const char *text,
+				size_t len, char *dropped_text)
 {
-	static char dropped_text[64];
-	size_t dropped_len = 0;
-	struct console *con;
-
-	trace_console_rcuidle(text, len);
+	size_t dropped_len;
 
-	if (!console_drivers)
-		return;
-
-	if (console_dropped) {
-		dropped_len = snprintf(dropped_text, sizeof(dropped_text),
+	if (con->dropped && dropped_text) {
+		dropped_len = snprintf(dropped_text, DROPPED_TEXT_MAX,
 				       "** %lu printk messages dropped **\n",
-				       console_dropped);
-		console_dropped = 0;
+				       con->dropped);
+		con->dropped = 0;
+		con->write(con, dropped_text, dropped_len);
 	}
 
-	for_each_console(con) {
-		if (exclusive_console && con != exclusive_console)
-			continue;
-		if (!(con->flags & CON_ENABLED))
-			continue;
-		if (!con->write)
-			continue;
-		if (!cpu_online(smp_processor_id()) &&
-		    !(con->flags & CON_ANYTIME))
-			continue;
-		if (con->flags & CON_EXTENDED)
-			con->write(con, ext_text, ext_len);
-		else {
-			if (dropped_len)
-				con->write(con, dropped_text, dropped_len);
-			con->write(con, text, len);
-		}
-	}
+	con->write(con, text, len);
+}
+
+/*
+ * Track the backlog of @con, in records, at the time @seq is about to be
+ * written to it.
+ */
+static void console_update_lag(struct console *con, u64 seq)
+{
+	long lag = atomic_long_read(&printk_next_stored_seq) - (unsigned long)seq;
+
+	if (lag > 0 && (unsigned long)lag > con->max_lag)
+		con->max_lag = lag;
 }
 
 int printk_delay_msec __read_mostly;
@@ -2028,6 +2036,8 @@ static u16 printk_sprint(char *text, u16 size, int facility, enum log_flags *lfl
 		}
 	}
 
+	trace_console_rcuidle(text, text_len);
+
 	return text_len;
 }
 
@@ -2124,6 +2134,8 @@ int vprintk_store(int facility, int level,
 	if (dev_info)
 		memcpy(&r.info->dev_info, dev_info, sizeof(r.info->dev_info));
 
+	atomic_long_set(&printk_next_stored_seq, r.info->seq + 1);
+
 	/* A message without a trailing newline can be continued. */
 	if (!(lflags & LOG_NEWLINE))
 		prb_commit(&e);
@@ -2157,8 +2169,12 @@ asmlinkage int vprintk_emit(int facility, int level,
 	printed_len = vprintk_store(facility, level, dev_info, fmt, args);
 	printk_safe_exit_irqrestore(flags);
 
-	/* If called from the scheduler, we can not call up(). */
-	if (!in_sched) {
+	/*
+	 * If called from the scheduler, we can not call up(). Otherwise
+	 * only print from this context when the printer kthreads can not
+	 * be relied upon; wake_up_klogd() below kicks them.
+	 */
+	if (!in_sched && printk_direct_required()) {
 		/*
 		 * Disable preemption to avoid being preempted while holding
 		 * console_sem which would prevent anyone from printing to
@@ -2223,15 +2239,14 @@ EXPORT_SYMBOL(printk);
 #else /* CONFIG_PRINTK */
 
 #define CONSOLE_LOG_MAX		0
+#define DROPPED_TEXT_MAX	0
 #define printk_time		false
 
 #define prb_read_valid(rb, seq, r)	false
 #define prb_first_valid_seq(rb)		0
+#define prb_next_seq(rb)		0
 
 static u64 syslog_seq;
-static u64 console_seq;
-static u64 exclusive_console_stop_seq;
-static unsigned long console_dropped;
 
 static size_t record_print_text(const struct printk_record *r,
 				bool syslog, bool time)
@@ -2248,8 +2263,9 @@ static ssize_t msg_print_ext_body(char *buf, size_t size,
 				  struct dev_printk_info *dev_info) { return 0; }
 static void console_lock_spinning_enable(void) { }
 static int console_lock_spinning_disable_and_check(void) { return 0; }
-static void call_console_drivers(const char *ext_text, size_t ext_len,
-				 const char *text, size_t len) {}
+static void call_console_driver(struct console *con, const char *text,
+				size_t len, char *dropped_text) {}
+static void console_update_lag(struct console *con, u64 seq) { }
 static bool suppress_message_printing(int level) { return false; }
 
 #endif /* CONFIG_PRINTK */
@@ -2426,6 +2442,7 @@ void resume_console(void)
 	down_console_sem();
 	console_suspended = 0;
 	console_unlock();
+	wake_up_klogd();
 }
 
 /**
@@ -2496,31 +2513,173 @@ int is_console_locked(void)
 EXPORT_SYMBOL(is_console_locked);
 
 /*
- * Check if we have any console that is capable of printing while cpu is
- * booting or shutting down. Requires console_sem.
+ * Check if the given console is currently capable and allowed to print
+ * records. Requires console_sem.
+ *
+ * Console drivers may assume that per-cpu resources have been allocated. So
+ * unless they're explicitly marked as being able to cope (CON_ANYTIME) don't
+ * call them until this CPU is officially up.
  */
-static int have_callable_console(void)
+static inline bool console_is_usable(struct console *con)
 {
-	struct console *con;
+	if (!(con->flags & CON_ENABLED))
+		return false;
 
-	for_each_console(con)
-		if ((con->flags & CON_ENABLED) &&
-				(con->flags & CON_ANYTIME))
-			return 1;
+	if (!con->write)
+		return false;
 
-	return 0;
+	if (!cpu_online(raw_smp_processor_id()) &&
+	    !(con->flags & CON_ANYTIME))
+		return false;
+
+	return true;
 }
 
+/* Buffers for formatting console output, protected by console_sem. */
+static char console_text[CONSOLE_LOG_MAX];
+static char console_ext_text[CONSOLE_EXT_LOG_MAX];
+static char console_dropped_text[DROPPED_TEXT_MAX];
+
 /*
- * Can we actually use the console at this time on this cpu?
+ * Print one record for the given console. The record printed is whatever
+ * record is the next available record for the given console.
  *
- * Console drivers may assume that per-cpu resources have been allocated. So
- * unless they're explicitly marked as being able to cope (CON_ANYTIME) don't
- * call them until this CPU is officially up.
+ * If @handover is not NULL, the console_lock may be handed over to a
+ * spinning waiter while the record is printed. In that case *@handover is
+ * set to true and the caller no longer owns the console_lock.
+ *
+ * Returns false if there was no record to print for @con.
+ *
+ * Requires the console_lock.
+ */
+static bool console_emit_next_record(struct console *con, bool *handover)
+{
+	struct printk_info info;
+	struct printk_record r;
+	unsigned long flags;
+	char *write_text;
+	char *dropped_text = NULL;
+	size_t len;
+
+	prb_rec_init_rd(&r, &info, console_text, sizeof(console_text));
+
+	if (handover)
+		*handover = false;
+
+	printk_safe_enter_irqsave(flags);
+skip:
+	if (!prb_read_valid(prb, con->seq, &r)) {
+		printk_safe_exit_irqrestore(flags);
+		return false;
+	}
+
+	if (con->seq != r.info->seq) {
+		con->dropped += r.info->seq - con->seq;
+		con->seq = r.info->seq;
+	}
+
+	/* Skip record that has level above the console loglevel. */
+	if (suppress_message_printing(r.info->level)) {
+		con->seq++;
+		goto skip;
+	}
+
+	console_update_lag(con, con->seq);
+
+	/*
+	 * Extended consoles get the /dev/kmsg format and no notice about
+	 * dropped records.
+	 */
+	if (con->flags & CON_EXTENDED) {
+		write_text = console_ext_text;
+		len = info_print_ext_header(console_ext_text,
+					    sizeof(console_ext_text), r.info);
+		len += msg_print_ext_body(console_ext_text + len,
+					  sizeof(console_ext_text) - len,
+					  &r.text_buf[0], r.info->text_len,
+					  &r.info->dev_info);
+	} else {
+		write_text = console_text;
+		dropped_text = console_dropped_text;
+		len = record_print_text(&r,
+				console_msg_format & MSG_FORMAT_SYSLOG,
+				printk_time);
+	}
+	con->seq++;
+
+	/*
+	 * While actively printing out messages, if another printk()
+	 * were to occur on another CPU, it may wait for this one to
+	 * finish. This task can not be preempted if there is a
+	 * waiter waiting to take over.
+	 */
+	if (handover)
+		console_lock_spinning_enable();
+
+	stop_critical_timings();	/* don't trace print latency */
+	call_console_driver(con, write_text, len, dropped_text);
+	start_critical_timings();
+
+	if (handover)
+		*handover = console_lock_spinning_disable_and_check();
+
+	printk_safe_exit_irqrestore(flags);
+
+	return true;
+}
+
+/*
+ * Print out all remaining records to all consoles that are not serviced by
+ * a printer kthread.
+ *
+ * @next_seq is set to the highest sequence number of all of those consoles.
+ * If *@handover is set on return, the console_lock was handed over to a
+ * spinning waiter and must not be released by the caller.
+ *
+ * Returns true if there was at least one usable console to print to.
+ *
+ * Requires the console_lock.
  */
-static inline int can_use_console(void)
+static bool console_flush_all(bool do_cond_resched, u64 *next_seq, bool *handover)
 {
-	return cpu_online(raw_smp_processor_id()) || have_callable_console();
+	bool direct = printk_direct_required();
+	bool any_usable = false;
+	bool any_progress;
+	struct console *con;
+
+	*next_seq = 0;
+	*handover = false;
+
+	do {
+		any_progress = false;
+
+		for_each_console(con) {
+			bool progress;
+
+			if (con->thread && !direct)
+				continue;
+			if (!console_is_usable(con))
+				continue;
+			any_usable = true;
+
+			progress = console_emit_next_record(con, handover);
+			if (*handover)
+				return true;
+
+			/* Track the highest seq flushed. */
+			if (con->seq > *next_seq)
+				*next_seq = con->seq;
+
+			if (!progress)
+				continue;
+			any_progress = true;
+
+			if (do_cond_resched)
+				cond_resched();
+		}
+	} while (any_progress);
+
+	return any_usable;
 }
 
 /**
@@ -2530,29 +2689,24 @@ static inline int can_use_console(void)
  * and the console driver list.
  *
  * While the console_lock was held, console output may have been buffered
- * by printk().  If this is the case, console_unlock(); emits
- * the output prior to releasing the lock.
- *
- * If there is output waiting, we wake /dev/kmsg and syslog() users.
+ * by printk().  If this is the case, console_unlock(); emits the output
+ * to the consoles that are not serviced by a printer kthread, or to all
+ * consoles if printk_direct_required(), prior to releasing the lock.
  *
  * console_unlock(); may be called from any context.
  */
 void console_unlock(void)
 {
-	static char ext_text[CONSOLE_EXT_LOG_MAX];
-	static char text[CONSOLE_LOG_MAX];
 	unsigned long flags;
 	bool do_cond_resched, retry;
-	struct printk_info info;
-	struct printk_record r;
+	bool flushed, handover;
+	u64 next_seq;
 
 	if (console_suspended) {
 		up_console_sem();
 		return;
 	}
 
-	prb_rec_init_rd(&r, &info, text, sizeof(text));
-
 	/*
 	 * Console drivers are called with interrupts disabled, so
 	 * @console_may_schedule should be cleared before; however, we may
@@ -2571,100 +2725,26 @@ void console_unlock(void)
 again:
 	console_may_schedule = 0;
 
-	/*
-	 * We released the console_sem lock, so we need to recheck if
-	 * cpu is online and (if not) is there at least one CON_ANYTIME
-	 * console.
-	 */
-	if (!can_use_console()) {
-		console_locked = 0;
-		up_console_sem();
+	flushed = console_flush_all(do_cond_resched, &next_seq, &handover);
+	if (handover)
 		return;
-	}
-
-	for (;;) {
-		size_t ext_len = 0;
-		size_t len;
-
-		printk_safe_enter_irqsave(flags);
-skip:
-		if (!prb_read_valid(prb, console_seq, &r))
-			break;
-
-		if (console_seq != r.info->seq) {
-			console_dropped += r.info->seq - console_seq;
-			console_seq = r.info->seq;
-		}
-
-		if (suppress_message_printing(r.info->level)) {
-			/*
-			 * Skip record we have buffered and already printed
-			 * directly to the console when we received it, and
-			 * record that has level above the console loglevel.
-			 */
-			console_seq++;
-			goto skip;
-		}
-
-		/* Output to all consoles once old messages replayed. */
-		if (unlikely(exclusive_console &&
-			     console_seq >= exclusive_console_stop_seq)) {
-			exclusive_console = NULL;
-		}
-
-		/*
-		 * Handle extended console text first because later
-		 * record_print_text() will modify the record buffer in-place.
-		 */
-		if (nr_ext_console_drivers) {
-			ext_len = info_print_ext_header(ext_text,
-						sizeof(ext_text),
-						r.info);
-			ext_len += msg_print_ext_body(ext_text + ext_len,
-						sizeof(ext_text) - ext_len,
-						&r.text_buf[0],
-						r.info->text_len,
-						&r.info->dev_info);
-		}
-		len = record_print_text(&r,
-				console_msg_format & MSG_FORMAT_SYSLOG,
-				printk_time);
-		console_seq++;
-
-		/*
-		 * While actively printing out messages, if another printk()
-		 * were to occur on another CPU, it may wait for this one to
-		 * finish. This task can not be preempted if there is a
-		 * waiter waiting to take over.
-		 */
-		console_lock_spinning_enable();
-
-		stop_critical_timings();	/* don't trace print latency */
-		call_console_drivers(ext_text, ext_len, text, len);
-		start_critical_timings();
-
-		if (console_lock_spinning_disable_and_check()) {
-			printk_safe_exit_irqrestore(flags);
-			return;
-		}
-
-		printk_safe_exit_irqrestore(flags);
-
-		if (do_cond_resched)
-			cond_resched();
-	}
 
 	console_locked = 0;
 
 	up_console_sem();
 
+	/* Nothing to recheck if no console is printed to from here. */
+	if (!flushed)
+		return;
+
 	/*
 	 * Someone could have filled up the buffer again, so re-check if there's
 	 * something to flush. In case we cannot trylock the console_sem again,
 	 * there's a new owner and the console_unlock() from them will do the
 	 * flush, no worries.
 	 */
-	retry = prb_read_valid(prb, console_seq, NULL);
+	printk_safe_enter_irqsave(flags);
+	retry = prb_read_valid(prb, next_seq, NULL);
 	printk_safe_exit_irqrestore(flags);
 
 	if (retry && console_trylock())
@@ -2729,11 +2809,16 @@ void console_flush_on_panic(enum con_flush_mode mode)
 	console_may_schedule = 0;
 
 	if (mode == CONSOLE_REPLAY_ALL) {
+		struct console *c;
 		unsigned long flags;
+		u64 seq;
 
 		printk_safe_enter_irqsave(flags);
-		console_seq = prb_first_valid_seq(prb);
+		seq = prb_first_valid_seq(prb);
 		printk_safe_exit_irqrestore(flags);
+
+		for_each_console(c)
+			c->seq = seq;
 	}
 	console_unlock();
 }
@@ -2776,6 +2861,7 @@ void console_start(struct console *console)
 	console_lock();
 	console->flags |= CON_ENABLED;
 	console_unlock();
+	wake_up_klogd();
 }
 EXPORT_SYMBOL(console_start);
 
@@ -2848,6 +2934,73 @@ static int try_enable_new_console(struct console *newcon, bool user_specified)
 	return -ENOENT;
 }
 
+static bool printer_should_wake(struct console *con)
+{
+	if (kthread_should_stop())
+		return true;
+
+	/*
+	 * The caller of console_unlock() is printing to all consoles,
+	 * the printers are woken again by the next printk().
+	 */
+	if (printk_direct_required())
+		return false;
+
+	/* Only wake up for work the loop below can do, or it would spin. */
+	if (console_suspended || !console_is_usable(con))
+		return false;
+
+	return prb_read_valid(prb, READ_ONCE(con->seq), NULL);
+}
+
+/*
+ * Per-console printer kthread. Records are written one at a time and the
+ * console_lock is dropped in between, so neither other consoles nor tty
+ * users of the console_lock are held off for more than one record.
+ */
+static int printk_kthread_func(void *data)
+{
+	struct console *con = data;
+
+	for (;;) {
+		wait_event_interruptible(printk_printer_wait,
+					 printer_should_wake(con));
+
+		if (kthread_should_stop())
+			break;
+
+		console_lock();
+		if (!console_suspended && console_is_usable(con))
+			console_emit_next_record(con, NULL);
+		console_unlock();
+
+		cond_resched();
+	}
+
+	return 0;
+}
+
+/*
+ * Start the printer kthread of @con. If that fails, fall back to printing
+ * directly to all consoles. Requires the console_lock.
+ */
+static void printk_start_kthread(struct console *con)
+{
+	struct task_struct *tsk;
+
+	tsk = kthread_run(printk_kthread_func, con, "pr/%s%d",
+			  con->name, con->index);
+	if (IS_ERR(tsk)) {
+		pr_err("%sconsole [%s%d]: unable to start printing thread\n",
+		       (con->flags & CON_BOOT) ? "boot" : "",
+		       con->name, con->index);
+		printk_kthreads_available = false;
+		return;
+	}
+
+	con->thread = tsk;
+}
+
 /*
  * The console driver calls this routine during kernel initialization
  * to register the console printing procedure with printk() and to
@@ -2954,30 +3107,26 @@ void register_console(struct console *newcon)
 		console_drivers->next = newcon;
 	}
 
-	if (newcon->flags & CON_EXTENDED)
-		nr_ext_console_drivers++;
-
+	newcon->dropped = 0;
+	newcon->max_lag = 0;
+	newcon->thread = NULL;
 	if (newcon->flags & CON_PRINTBUFFER) {
 		/*
-		 * console_unlock(); will print out the buffered messages
-		 * for us.
-		 *
-		 * We're about to replay the log buffer.  Only do this to the
-		 * just-registered console to avoid excessive message spam to
-		 * the already-registered consoles.
-		 *
-		 * Set exclusive_console with disabled interrupts to reduce
-		 * race window with eventual console_flush_on_panic() that
-		 * ignores console_lock.
+		 * The printer kthread or console_unlock(); will replay the
+		 * buffered messages to the just-registered console only;
+		 * the already-registered consoles keep their own position.
 		 */
-		exclusive_console = newcon;
-		exclusive_console_stop_seq = console_seq;
-
 		/* Get a consistent copy of @syslog_seq. */
 		raw_spin_lock_irqsave(&syslog_lock, flags);
-		console_seq = syslog_seq;
+		newcon->seq = syslog_seq;
 		raw_spin_unlock_irqrestore(&syslog_lock, flags);
+	} else {
+		/* Begin with next message. */
+		newcon->seq = prb_next_seq(prb);
 	}
+
+	if (printk_kthreads_available)
+		printk_start_kthread(newcon);
 	console_unlock();
 	console_sysfs_notify();
 
@@ -3019,6 +3168,15 @@ int unregister_console(struct console *console)
 	if (res > 0)
 		return 0;
 
+	/*
+	 * The printer kthread may be waiting for console_lock, so it must
+	 * be stopped before the lock is taken here.
+	 */
+	if (console->thread) {
+		kthread_stop(console->thread);
+		console->thread = NULL;
+	}
+
 	res = -ENODEV;
 	console_lock();
 	if (console_drivers == console) {
@@ -3037,9 +3195,6 @@ int unregister_console(struct console *console)
 	if (res)
 		goto out_disable_unlock;
 
-	if (console->flags & CON_EXTENDED)
-		nr_ext_console_drivers--;
-
 	/*
 	 * If this isn't the last console and it has CON_CONSDEV set, we
 	 * need to set it on the next preferred console.
@@ -3133,6 +3288,15 @@ static int __init printk_late_init(void)
 			unregister_console(con);
 		}
 	}
+
+	if (IS_ENABLED(CONFIG_PRINTK)) {
+		console_lock();
+		printk_kthreads_available = true;
+		for_each_console(con)
+			printk_start_kthread(con);
+		console_unlock();
+	}
+
 	ret = cpuhp_setup_state_nocalls(CPUHP_PRINTK_DEAD, "printk:dead", NULL,
 					console_cpu_notify);
 	WARN_ON(ret < 0);
@@ -3149,6 +3313,7 @@ late_initcall(printk_late_init);
  */
 #define PRINTK_PENDING_WAKEUP	0x01
 #define PRINTK_PENDING_OUTPUT	0x02
+#define PRINTK_PENDING_PRINTERS	0x04
 
 static DEFINE_PER_CPU(int, printk_pending);
 
@@ -3164,6 +3329,9 @@ static void wake_up_klogd_work_func(struct irq_work *irq_work)
 
 	if (pending & PRINTK_PENDING_WAKEUP)
 		wake_up_interruptible(&log_wait);
+
+	if (pending & PRINTK_PENDING_PRINTERS)
+		wake_up_interruptible_all(&printk_printer_wait);
 }
 
 static DEFINE_PER_CPU(struct irq_work, wake_up_klogd_work) =
@@ -3175,10 +3343,17 @@ void wake_up_klogd(void)
 		return;
 
 	preempt_disable();
-	if (waitqueue_active(&log_wait)) {
+	if (waitqueue_active(&log_wait))
 		this_cpu_or(printk_pending, PRINTK_PENDING_WAKEUP);
+	/*
+	 * Pairs with the barrier in set_current_state() of a printer
+	 * preparing to wait, so that it either sees the new record or
+	 * gets woken up.
+	 */
+	if (wq_has_sleeper(&printk_printer_wait))
+		this_cpu_or(printk_pending, PRINTK_PENDING_PRINTERS);
+	if (this_cpu_read(printk_pending))
 		irq_work_queue(this_cpu_ptr(&wake_up_klogd_work));
-	}
 	preempt_enable();
 }
 
@@ -3215,6 +3390,46 @@ int printk_deferred(const char *fmt, ...)
 	return r;
 }
 
+#ifdef CONFIG_DEBUG_FS
+/*
+ * Report, per console, how many records it is behind the newest stored
+ * record, the highest such backlog seen so far and any records that were
+ * overwritten before they could be printed.
+ */
+static int console_lag_show(struct seq_file *m, void *v)
+{
+	long next = atomic_long_read(&printk_next_stored_seq);
+	struct console *con;
+	char name[24];
+	long lag;
+
+	seq_printf(m, "%-16s %-6s %12s %8s %8s %8s\n",
+		   "console", "mode", "seq", "lag", "max_lag", "dropped");
+
+	console_lock();
+	for_each_console(con) {
+		snprintf(name, sizeof(name), "%s%d", con->name, con->index);
+		lag = next - (unsigned long)con->seq;
+		seq_printf(m, "%-16s %-6s %12llu %8ld %8lu %8lu\n", name,
+			   con->thread && !printk_direct_required() ?
+			   "thread" : "direct",
+			   con->seq, max(lag, 0L), con->max_lag, con->dropped);
+	}
+	console_unlock();
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(console_lag);
+
+static int __init printk_debugfs_init(void)
+{
+	debugfs_create_file("printk_console_lag", 0444, NULL, NULL,
+			    &console_lag_fops);
+	return 0;
+}
+late_initcall(printk_debugfs_init);
+#endif /* CONFIG_DEBUG_FS */
+
 /*
  * printk rate limiting, lifted from the networking subsystem.
  *
@@ -692,6 +692,35 @@ static struct rcu_torture_ops srcud_ops = {
 	.name		= "srcud"
 };
 
+static int srcu_torture_read_lock_lite(void) __acquires(srcu_ctlp)
+{
+	return srcu_read_lock_lite(srcu_ctlp);
+}
+
+static void srcu_torture_read_unlock_lite(int idx) __releases(srcu_ctlp)
+{
+	srcu_read_unlock_lite(srcu_ctlp, idx);
+}
+
+/* As above, but with memory-barrier-free readers. */
+static struct rcu_torture_ops srcul_ops = {
+	.ttype		= SRCU_FLAVOR,
+	.init		= srcu_torture_init,
+	.cleanup	= srcu_torture_cleanup,
+	.readlock	= srcu_torture_read_lock_lite,
+	.read_delay	= srcu_read_delay,
+	.readunlock	= srcu_torture_read_unlock_lite,
+	.get_gp_seq	= srcu_torture_completed,
+	.deferred_free	= srcu_torture_deferred_free,
+	.sync		= srcu_torture_synchronize,
+	.exp_sync	= srcu_torture_synchronize_expedited,
+	.call		= srcu_torture_call,
+	.cb_barrier	= srcu_torture_barrier,
+	.stats		= srcu_torture_stats,
+	.irq_capable	= 1,
+	.name		= "srcul"
+};
+
 /* As above, but broken due to inappropriate reader extension. */
 static struct rcu_torture_ops busted_srcud_ops = {
 	.ttype		= SRCU_FLAVOR,
@@ -2936,7 +2965,7 @@ rcu_torture_init(void)
 	unsigned long gp_seq = 0;
 	static struct rcu_torture_ops *torture_ops[] = {
 		&rcu_ops, &rcu_busted_ops, &srcu_ops, &srcud_ops,
-		&busted_srcud_ops, &tasks_ops, &tasks_rude_ops,
+		&srcul_ops, &busted_srcud_ops, &tasks_ops, &tasks_rude_ops,
 		&tasks_tracing_ops, &trivial_ops,
 	};
 
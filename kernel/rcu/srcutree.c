@@ -46,6 +46,7 @@ static void srcu_invoke_callbacks(struct work_struct *work);
 static void srcu_reschedule(struct srcu_struct *ssp, unsigned long delay);
 static void process_srcu(struct work_struct *work);
 static void srcu_delay_timer(struct timer_list *t);
+static unsigned long srcu_get_delay(struct srcu_struct *ssp);
 
 /* Wrappers for lock acquisition and release, see raw_spin_lock_rcu_node(). */
 #define spin_lock_rcu_node(p)					\
@@ -244,47 +245,95 @@ static void check_init_srcu_struct(struct srcu_struct *ssp)
 
 /*
  * Returns approximate total of the readers' ->srcu_lock_count[] values
- * for the rank of per-CPU counters specified by idx.
+ * for the rank of per-CPU counters specified by idx, and the union of
+ * the reader flavors seen along the way in *rdm.
  */
-static unsigned long srcu_readers_lock_idx(struct srcu_struct *ssp, int idx)
+static unsigned long srcu_readers_lock_idx(struct srcu_struct *ssp, int idx,
+					   int *rdm)
 {
 	int cpu;
+	int mask = 0;
 	unsigned long sum = 0;
 
 	for_each_possible_cpu(cpu) {
 		struct srcu_data *cpuc = per_cpu_ptr(ssp->sda, cpu);
 
 		sum += READ_ONCE(cpuc->srcu_lock_count[idx]);
+		mask |= READ_ONCE(cpuc->srcu_reader_flavor);
 	}
+	*rdm = mask;
 	return sum;
 }
 
 /*
  * Returns approximate total of the readers' ->srcu_unlock_count[] values
- * for the rank of per-CPU counters specified by idx.
+ * for the rank of per-CPU counters specified by idx, and the union of
+ * the reader flavors seen along the way in *rdm.
  */
-static unsigned long srcu_readers_unlock_idx(struct srcu_struct *ssp, int idx)
+static unsigned long srcu_readers_unlock_idx(struct srcu_struct *ssp, int idx,
+					     int *rdm)
 {
 	int cpu;
+	int mask = 0;
 	unsigned long sum = 0;
 
 	for_each_possible_cpu(cpu) {
 		struct srcu_data *cpuc = per_cpu_ptr(ssp->sda, cpu);
 
 		sum += READ_ONCE(cpuc->srcu_unlock_count[idx]);
+		mask |= READ_ONCE(cpuc->srcu_reader_flavor);
 	}
+	*rdm = mask;
 	return sum;
 }
 
+/*
+ * Note that this CPU has used the specified reader flavor on this
+ * srcu_struct.  The full barrier orders the flavor update before the
+ * reader's counter increment and critical section, so that an updater
+ * that misses the flavor also misses neither of those.
+ */
+void __srcu_check_read_flavor(struct srcu_struct *ssp, int read_flavor)
+{
+	struct srcu_data *sdp = raw_cpu_ptr(ssp->sda);
+	int old_read_flavor;
+
+	do {
+		old_read_flavor = READ_ONCE(sdp->srcu_reader_flavor);
+		if (old_read_flavor & read_flavor)
+			return;
+	} while (cmpxchg(&sdp->srcu_reader_flavor, old_read_flavor,
+			 old_read_flavor | read_flavor) != old_read_flavor);
+}
+EXPORT_SYMBOL_GPL(__srcu_check_read_flavor);
+
+/*
+ * Stand-in for the memory barriers omitted by srcu_read_lock_lite()
+ * readers: an RCU grace period forces a full barrier on every CPU that
+ * might be in such a reader.  Use the IPI-based expedited flavor when
+ * this SRCU grace period is itself expedited.
+ */
+static void srcu_lite_sync(struct srcu_struct *ssp)
+{
+	if (!srcu_get_delay(ssp))
+		synchronize_rcu_expedited();
+	else
+		synchronize_rcu();
+}
+
 /*
  * Return true if the number of pre-existing readers is determined to
  * be zero.
  */
 static bool srcu_readers_active_idx_check(struct srcu_struct *ssp, int idx)
 {
+	bool did_gp;
+	int rdm;
+	unsigned long locks;
 	unsigned long unlocks;
 
-	unlocks = srcu_readers_unlock_idx(ssp, idx);
+	unlocks = srcu_readers_unlock_idx(ssp, idx, &rdm);
+	did_gp = !!(rdm & SRCU_READ_FLAVOR_LITE);
 
 	/*
 	 * Make sure that a lock is always counted if the corresponding
@@ -296,8 +345,16 @@ static bool srcu_readers_active_idx_check(struct srcu_struct *ssp, int idx)
 	 * This smp_mb() also pairs with smp_mb() C to prevent accesses
 	 * after the synchronize_srcu() from being executed before the
 	 * grace period ends.
+	 *
+	 * If srcu_read_lock_lite() is in use, an RCU grace period X
+	 * takes the place of A, and supplies full barriers on the reader
+	 * CPUs in place of the omitted B and C, ordered against the
+	 * reader-side increments Y and Z.
 	 */
-	smp_mb(); /* A */
+	if (!did_gp)
+		smp_mb(); /* A */
+	else
+		srcu_lite_sync(ssp); /* X */
 
 	/*
 	 * If the locks are the same as the unlocks, then there must have
@@ -320,7 +377,16 @@ static bool srcu_readers_active_idx_check(struct srcu_struct *ssp, int idx)
 	 * of floor(ULONG_MAX/NR_CPUS/2), which should be sufficient,
 	 * especially on 64-bit systems.
 	 */
-	return srcu_readers_lock_idx(ssp, idx) == unlocks;
+	locks = srcu_readers_lock_idx(ssp, idx, &rdm);
+
+	/*
+	 * A CPU might have started using srcu_read_lock_lite() after
+	 * the unlock scan, in which case X was not executed.  Its
+	 * counts cannot be trusted, so report readers and retry.
+	 */
+	if (!did_gp && (rdm & SRCU_READ_FLAVOR_LITE))
+		return false;
+	return locks == unlocks;
 }
 
 /**
@@ -722,6 +788,9 @@ static void srcu_flip(struct srcu_struct *ssp)
 	 * new value of ->srcu_idx, this updater's earlier scans cannot
 	 * have seen that reader's increments (which is OK, because this
 	 * grace period need not wait on that reader).
+	 *
+	 * For srcu_read_lock_lite() readers, the X in the preceding
+	 * srcu_readers_active_idx_check() provides these guarantees.
 	 */
 	smp_mb(); /* E */  /* Pairs with B and C. */
 
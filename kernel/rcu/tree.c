@@ -60,6 +60,8 @@
 #include <linux/vmalloc.h>
 #include <linux/mm.h>
 #include <linux/kasan.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 #include "../time/tick-internal.h"
 
 #include "tree.h"
@@ -186,6 +188,14 @@ module_param(rcu_unlock_delay, int, 0444);
 static int rcu_min_cached_objs = 5;
 module_param(rcu_min_cached_objs, int, 0444);
 
+/*
+ * Upper bound on the per-CPU page cache.  The cache grows towards this
+ * when kvfree_rcu() callers keep finding it empty, and decays back to
+ * rcu_min_cached_objs once they stop doing so.
+ */
+static int rcu_max_cached_objs = 64;
+module_param(rcu_max_cached_objs, int, 0444);
+
 /* Retrieve RCU kthreads priority for rcutorture */
 int rcu_get_gp_kthreads_prio(void)
 {
@@ -3007,9 +3017,209 @@ static void check_cb_ovld(struct rcu_data *rdp)
 	raw_spin_unlock_rcu_node(rnp);
 }
 
+#ifdef CONFIG_RCU_LAZY
+
+/*
+ * Lazy callbacks wait on their CPU's ->lazy_cblist for up to lazy_jiffies,
+ * or until lazy_qhimark of them are pending, before being handed to
+ * ->cblist where they then wait for a grace period like any other
+ * callback.  An idle CPU thus neither requests a grace period nor keeps
+ * its scheduling-clock tick for a trickle of memory-freeing callbacks.
+ */
+static ulong lazy_jiffies = 10 * HZ;
+module_param(lazy_jiffies, ulong, 0644);
+static long lazy_qhimark = DEFAULT_RCU_QHIMARK;
+module_param(lazy_qhimark, long, 0644);
+
+/*
+ * Hand this CPU's lazy callbacks over to ->cblist and make sure that
+ * a grace period gets requested for them.  Invoked on the CPU owning
+ * rdp, or on behalf of that CPU once it is offline.
+ */
+static void rcu_lazy_flush(struct rcu_data *rdp)
+{
+	bool was_alldone;
+	unsigned long flags;
+	struct rcu_cblist rcl;
+
+	local_irq_save(flags);
+	if (!rcu_cblist_n_cbs(&rdp->lazy_cblist)) {
+		local_irq_restore(flags);
+		return;
+	}
+	rcu_cblist_flush_enqueue(&rcl, &rdp->lazy_cblist, NULL);
+	WRITE_ONCE(rdp->n_lazy_flushes, rdp->n_lazy_flushes + 1);
+	del_timer(&rdp->lazy_timer);
+
+	rcu_nocb_lock(rdp);
+	was_alldone = !rcu_segcblist_pend_cbs(&rdp->cblist);
+	WARN_ON_ONCE(!rcu_nocb_flush_bypass(rdp, NULL, jiffies));
+	rcu_segcblist_add_len(&rdp->cblist, rcl.len); /* Must precede insert. */
+	rcu_segcblist_insert_pend_cbs(&rdp->cblist, &rcl);
+	trace_rcu_segcb_stats(&rdp->cblist, TPS("SegCBLazyFlush"));
+	if (rcu_rdp_is_offloaded(rdp)) {
+		__call_rcu_nocb_wake(rdp, was_alldone, flags); /* unlocks */
+	} else {
+		rcu_nocb_unlock_irqrestore(rdp, flags);
+		invoke_rcu_core();
+	}
+}
+
+/* Lazy callbacks have waited long enough. */
+static void rcu_lazy_timer(struct timer_list *t)
+{
+	struct rcu_data *rdp = from_timer(rdp, t, lazy_timer);
+
+	/* Migrated from an offline CPU, whose lazy CBs were handed over. */
+	if (rdp->cpu != smp_processor_id())
+		return;
+	rcu_lazy_flush(rdp);
+}
+
+/*
+ * Queue a lazy callback, returning false if it must instead go directly
+ * to ->cblist.  Interrupts must be disabled.
+ */
+static bool rcu_lazy_enqueue(struct rcu_data *rdp, struct rcu_head *head)
+{
+	long ncbs = rcu_cblist_n_cbs(&rdp->lazy_cblist);
+	unsigned long j = jiffies;
+
+	// No timers during early boot, and no laziness while a
+	// CPU is coming up or going down.
+	if (rcu_scheduler_active != RCU_SCHEDULER_RUNNING ||
+	    !rcu_segcblist_is_enabled(&rdp->cblist) ||
+	    !READ_ONCE(lazy_jiffies))
+		return false;
+
+	rcu_cblist_enqueue(&rdp->lazy_cblist, head);
+	WRITE_ONCE(rdp->n_lazy_cbs, rdp->n_lazy_cbs + 1);
+	trace_rcu_callback(rcu_state.name, head,
+			   rcu_segcblist_n_cbs(&rdp->cblist) + ncbs + 1);
+	if (!ncbs) {
+		rdp->lazy_first = j;
+		mod_timer(&rdp->lazy_timer, j + READ_ONCE(lazy_jiffies));
+	} else if (ncbs + 1 >= READ_ONCE(lazy_qhimark)) {
+		rcu_lazy_flush(rdp);
+	}
+	return true;
+}
+
+/* Number of lazy callbacks on the specified CPU. */
+static long rcu_lazy_n_cbs(struct rcu_data *rdp)
+{
+	return rcu_cblist_n_cbs(&rdp->lazy_cblist);
+}
+
+static bool rcu_lazy_pending(int cpu, void *unused)
+{
+	return rcu_lazy_n_cbs(per_cpu_ptr(&rcu_data, cpu));
+}
+
+static void rcu_lazy_flush_func(void *unused)
+{
+	rcu_lazy_flush(this_cpu_ptr(&rcu_data));
+}
+
+static unsigned long
+rcu_lazy_shrink_count(struct shrinker *shrink, struct shrink_control *sc)
+{
+	int cpu;
+	unsigned long count = 0;
+
+	for_each_possible_cpu(cpu)
+		count += rcu_lazy_n_cbs(per_cpu_ptr(&rcu_data, cpu));
+
+	return count ? count : SHRINK_EMPTY;
+}
+
+/*
+ * Memory is tight, so stop being lazy: hand every CPU's lazy callbacks
+ * over for immediate grace-period processing.  Nothing is freed until
+ * that grace period ends, so report the flushed callbacks as scanned.
+ */
+static unsigned long
+rcu_lazy_shrink_scan(struct shrinker *shrink, struct shrink_control *sc)
+{
+	unsigned long count = rcu_lazy_shrink_count(shrink, sc);
+
+	if (count == SHRINK_EMPTY)
+		return SHRINK_STOP;
+	on_each_cpu_cond(rcu_lazy_pending, rcu_lazy_flush_func, NULL, true);
+	return count;
+}
+
+static struct shrinker rcu_lazy_shrinker = {
+	.count_objects = rcu_lazy_shrink_count,
+	.scan_objects = rcu_lazy_shrink_scan,
+	.batch = 0,
+	.seeks = DEFAULT_SEEKS,
+};
+
+/* Dump lazy-callback statistics for show_rcu_gp_kthreads(). */
+static void show_rcu_lazy_state(void)
+{
+	int cpu;
+	long qlen = 0;
+	unsigned long cbs = 0;
+	unsigned long flushes = 0;
+	struct rcu_data *rdp;
+
+	for_each_possible_cpu(cpu) {
+		rdp = per_cpu_ptr(&rcu_data, cpu);
+		qlen += rcu_lazy_n_cbs(rdp);
+		cbs += data_race(rdp->n_lazy_cbs);
+		flushes += data_race(rdp->n_lazy_flushes);
+	}
+	pr_info("RCU lazy callbacks since boot: %lu in %lu flushes, %ld pending\n",
+		cbs, flushes, qlen);
+}
+
+static void __init rcu_boot_init_lazy_percpu_data(struct rcu_data *rdp)
+{
+	rcu_cblist_init(&rdp->lazy_cblist);
+	timer_setup(&rdp->lazy_timer, rcu_lazy_timer, TIMER_PINNED);
+}
+
+static void __init rcu_lazy_init(void)
+{
+	if (register_shrinker(&rcu_lazy_shrinker))
+		pr_err("Failed to register call_rcu_lazy() shrinker!\n");
+}
+
+#else /* #ifdef CONFIG_RCU_LAZY */
+
+static void rcu_lazy_flush(struct rcu_data *rdp)
+{
+}
+
+static bool rcu_lazy_enqueue(struct rcu_data *rdp, struct rcu_head *head)
+{
+	return false;
+}
+
+static long rcu_lazy_n_cbs(struct rcu_data *rdp)
+{
+	return 0;
+}
+
+static void show_rcu_lazy_state(void)
+{
+}
+
+static void __init rcu_boot_init_lazy_percpu_data(struct rcu_data *rdp)
+{
+}
+
+static void __init rcu_lazy_init(void)
+{
+}
+
+#endif /* #else #ifdef CONFIG_RCU_LAZY */
+
 /* Helper function for call_rcu() and friends.  */
 static void
-__call_rcu(struct rcu_head *head, rcu_callback_t func)
+__call_rcu(struct rcu_head *head, rcu_callback_t func, bool lazy)
 {
 	static atomic_t doublefrees;
 	unsigned long flags;
@@ -3049,6 +3259,17 @@ __call_rcu(struct rcu_head *head, rcu_callback_t func)
 			rcu_segcblist_init(&rdp->cblist);
 	}
 
+	if (lazy) {
+		if (rcu_lazy_enqueue(rdp, head)) {
+			local_irq_restore(flags);
+			return;
+		}
+	} else {
+		// A grace period is about to be requested anyway, so let
+		// any lazy callbacks ride along.
+		rcu_lazy_flush(rdp);
+	}
+
 	check_cb_ovld(rdp);
 	if (rcu_nocb_try_bypass(rdp, head, &was_alldone, flags))
 		return; // Enqueued onto ->nocb_bypass, so just leave.
@@ -3110,10 +3331,30 @@ __call_rcu(struct rcu_head *head, rcu_callback_t func)
  */
 void call_rcu(struct rcu_head *head, rcu_callback_t func)
 {
-	__call_rcu(head, func);
+	__call_rcu(head, func, false);
 }
 EXPORT_SYMBOL_GPL(call_rcu);
 
+#ifdef CONFIG_RCU_LAZY
+/**
+ * call_rcu_lazy() - Queue an RCU callback that may wait a while.
+ * @head: structure to be used for queueing the RCU updates.
+ * @func: actual callback function to be invoked after the grace period
+ *
+ * Like call_rcu(), but the callback may sit on its CPU for up to
+ * rcutree.lazy_jiffies before a grace period is even requested for it,
+ * so that an idle system can batch many such callbacks into a single
+ * grace period.  Use this only for callbacks whose only job is to free
+ * memory, and whose delay nobody waits for other than via rcu_barrier().
+ * The memory-ordering guarantees are those of call_rcu().
+ */
+void call_rcu_lazy(struct rcu_head *head, rcu_callback_t func)
+{
+	__call_rcu(head, func, true);
+}
+EXPORT_SYMBOL_GPL(call_rcu_lazy);
+#endif /* #ifdef CONFIG_RCU_LAZY */
+
 
 /* Maximum number of jiffies to wait before draining a batch. */
 #define KFREE_DRAIN_JIFFIES (HZ / 50)
@@ -3174,6 +3415,12 @@ struct kfree_rcu_cpu_work {
  * @work_in_progress: Indicates that page_cache_work is running
  * @hrtimer: A hrtimer for scheduling a page_cache_work
  * @nr_bkv_objs: number of allocated objects at @bkvcache.
+ * @nr_bkv_target: number of objects @page_cache_work tries to keep cached
+ * @nr_bkv_pages: number of pages attached to @bkvhead and @krw_arr
+ * @bytes: Size of the slab objects counted in @count
+ * @nr_cache_miss: Times a block was needed but @bkvcache was empty
+ * @nr_cache_miss_snap: @nr_cache_miss at the last @nr_bkv_target decay
+ * @nr_fallback: Times the emergency @head path or an inline free was used
  *
  * This is a per-CPU structure.  The reason that it is not included in
  * the rcu_data structure is to permit this code to be extracted from
@@ -3196,6 +3443,13 @@ struct kfree_rcu_cpu {
 
 	struct llist_head bkvcache;
 	int nr_bkv_objs;
+	int nr_bkv_target;
+	int nr_bkv_pages;
+
+	unsigned long bytes;
+	unsigned long nr_cache_miss;
+	unsigned long nr_cache_miss_snap;
+	unsigned long nr_fallback;
 };
 
 static DEFINE_PER_CPU(struct kfree_rcu_cpu, krc) = {
@@ -3234,8 +3488,14 @@ krc_this_cpu_unlock(struct kfree_rcu_cpu *krcp, unsigned long flags)
 static inline struct kvfree_rcu_bulk_data *
 get_cached_bnode(struct kfree_rcu_cpu *krcp)
 {
-	if (!krcp->nr_bkv_objs)
+	if (!krcp->nr_bkv_objs) {
+		// Running dry, so cache more pages from now on.
+		WRITE_ONCE(krcp->nr_cache_miss, krcp->nr_cache_miss + 1);
+		WRITE_ONCE(krcp->nr_bkv_target,
+			   min(max(2 * krcp->nr_bkv_target, 1),
+			       max(rcu_max_cached_objs, rcu_min_cached_objs)));
 		return NULL;
+	}
 
 	krcp->nr_bkv_objs--;
 	return (struct kvfree_rcu_bulk_data *)
@@ -3247,7 +3507,7 @@ put_cached_bnode(struct kfree_rcu_cpu *krcp,
 	struct kvfree_rcu_bulk_data *bnode)
 {
 	// Check the limit.
-	if (krcp->nr_bkv_objs >= rcu_min_cached_objs)
+	if (krcp->nr_bkv_objs >= krcp->nr_bkv_target)
 		return false;
 
 	llist_add((struct llist_node *) bnode, &krcp->bkvcache);
@@ -3256,6 +3516,34 @@ put_cached_bnode(struct kfree_rcu_cpu *krcp,
 
 }
 
+/*
+ * Free all but @keep of the pages cached on @krcp, returning the number
+ * of pages freed.
+ */
+static int
+drain_page_cache(struct kfree_rcu_cpu *krcp, int keep)
+{
+	struct llist_node *page_list = NULL, *pos, *n;
+	unsigned long flags;
+	int freed = 0;
+
+	raw_spin_lock_irqsave(&krcp->lock, flags);
+	while (krcp->nr_bkv_objs > keep) {
+		pos = llist_del_first(&krcp->bkvcache);
+		krcp->nr_bkv_objs--;
+		pos->next = page_list;
+		page_list = pos;
+	}
+	raw_spin_unlock_irqrestore(&krcp->lock, flags);
+
+	llist_for_each_safe(pos, n, page_list) {
+		free_page((unsigned long) pos);
+		freed++;
+	}
+
+	return freed;
+}
+
 /*
  * This function is invoked in workqueue context after a grace period.
  * It frees all the objects queued on ->bhead_free or ->head_free.
@@ -3311,6 +3599,7 @@ static void kfree_rcu_work(struct work_struct *work)
 			rcu_lock_release(&rcu_callback_map);
 
 			raw_spin_lock_irqsave(&krcp->lock, flags);
+			WRITE_ONCE(krcp->nr_bkv_pages, krcp->nr_bkv_pages - 1);
 			if (put_cached_bnode(krcp, bkvhead[i]))
 				bkvhead[i] = NULL;
 			raw_spin_unlock_irqrestore(&krcp->lock, flags);
@@ -3387,6 +3676,7 @@ static inline bool queue_kfree_rcu_work(struct kfree_rcu_cpu *krcp)
 			}
 
 			WRITE_ONCE(krcp->count, 0);
+			WRITE_ONCE(krcp->bytes, 0);
 
 			/*
 			 * One work is per one batch, so there are three
@@ -3423,6 +3713,27 @@ static inline void kfree_rcu_drain_unlock(struct kfree_rcu_cpu *krcp,
 	raw_spin_unlock_irqrestore(&krcp->lock, flags);
 }
 
+/*
+ * Shrink the page-cache target by one page if no kvfree_rcu() caller
+ * has found the cache empty since the last call, and give the pages
+ * above the target back to the page allocator.
+ */
+static void decay_page_cache(struct kfree_rcu_cpu *krcp)
+{
+	unsigned long flags;
+	int target;
+
+	raw_spin_lock_irqsave(&krcp->lock, flags);
+	if (krcp->nr_cache_miss == krcp->nr_cache_miss_snap &&
+	    krcp->nr_bkv_target > rcu_min_cached_objs)
+		WRITE_ONCE(krcp->nr_bkv_target, krcp->nr_bkv_target - 1);
+	krcp->nr_cache_miss_snap = krcp->nr_cache_miss;
+	target = krcp->nr_bkv_target;
+	raw_spin_unlock_irqrestore(&krcp->lock, flags);
+
+	drain_page_cache(krcp, target);
+}
+
 /*
  * This function is invoked after the KFREE_DRAIN_JIFFIES timeout.
  * It invokes kfree_rcu_drain_unlock() to attempt to start another batch.
@@ -3433,6 +3744,8 @@ static void kfree_rcu_monitor(struct work_struct *work)
 	struct kfree_rcu_cpu *krcp = container_of(work, struct kfree_rcu_cpu,
 						 monitor_work.work);
 
+	decay_page_cache(krcp);
+
 	raw_spin_lock_irqsave(&krcp->lock, flags);
 	if (krcp->monitor_todo)
 		kfree_rcu_drain_unlock(krcp, flags);
@@ -3460,7 +3773,7 @@ static void fill_page_cache_func(struct work_struct *work)
 	bool pushed;
 	int i;
 
-	for (i = 0; i < rcu_min_cached_objs; i++) {
+	for (i = 0; i < READ_ONCE(krcp->nr_bkv_target); i++) {
 		bnode = (struct kvfree_rcu_bulk_data *)
 			__get_free_page(GFP_KERNEL | __GFP_NORETRY | __GFP_NOMEMALLOC | __GFP_NOWARN);
 
@@ -3514,6 +3827,11 @@ add_ptr_to_bulk_krc_lock(struct kfree_rcu_cpu **krcp,
 	if (!(*krcp)->bkvhead[idx] ||
 			(*krcp)->bkvhead[idx]->nr_records == KVFREE_BULK_MAX_ENTR) {
 		bnode = get_cached_bnode(*krcp);
+
+		// Refill before atomic callers find the cache empty.
+		if ((*krcp)->nr_bkv_objs < (*krcp)->nr_bkv_target / 2)
+			run_page_cache_worker(*krcp);
+
 		if (!bnode && can_alloc) {
 			krc_this_cpu_unlock(*krcp, *flags);
 
@@ -3542,6 +3860,7 @@ add_ptr_to_bulk_krc_lock(struct kfree_rcu_cpu **krcp,
 
 		/* Attach it to the head. */
 		(*krcp)->bkvhead[idx] = bnode;
+		WRITE_ONCE((*krcp)->nr_bkv_pages, (*krcp)->nr_bkv_pages + 1);
 	}
 
 	/* Finally insert. */
@@ -3598,6 +3917,7 @@ void kvfree_call_rcu(struct rcu_head *head, rcu_callback_t func)
 	success = add_ptr_to_bulk_krc_lock(&krcp, &flags, ptr, !head);
 	if (!success) {
 		run_page_cache_worker(krcp);
+		WRITE_ONCE(krcp->nr_fallback, krcp->nr_fallback + 1);
 
 		if (head == NULL)
 			// Inline if kvfree_rcu(one_arg) call.
@@ -3610,6 +3930,8 @@ void kvfree_call_rcu(struct rcu_head *head, rcu_callback_t func)
 	}
 
 	WRITE_ONCE(krcp->count, krcp->count + 1);
+	if (!is_vmalloc_addr(ptr))
+		WRITE_ONCE(krcp->bytes, krcp->bytes + __ksize(ptr));
 
 	// Set timer to drain after KFREE_DRAIN_JIFFIES.
 	if (rcu_scheduler_active == RCU_SCHEDULER_RUNNING &&
@@ -3645,6 +3967,7 @@ kfree_rcu_shrink_count(struct shrinker *shrink, struct shrink_control *sc)
 		struct kfree_rcu_cpu *krcp = per_cpu_ptr(&krc, cpu);
 
 		count += READ_ONCE(krcp->count);
+		count += READ_ONCE(krcp->nr_bkv_objs);
 	}
 
 	return count;
@@ -3660,7 +3983,14 @@ kfree_rcu_shrink_scan(struct shrinker *shrink, struct shrink_control *sc)
 		int count;
 		struct kfree_rcu_cpu *krcp = per_cpu_ptr(&krc, cpu);
 
-		count = krcp->count;
+		// Cached pages are the only memory we can hand back now,
+		// and the cache will regrow on demand.
+		raw_spin_lock_irqsave(&krcp->lock, flags);
+		WRITE_ONCE(krcp->nr_bkv_target, rcu_min_cached_objs);
+		raw_spin_unlock_irqrestore(&krcp->lock, flags);
+		count = drain_page_cache(krcp, 0);
+
+		count += krcp->count;
 		raw_spin_lock_irqsave(&krcp->lock, flags);
 		if (krcp->monitor_todo)
 			kfree_rcu_drain_unlock(krcp, flags);
@@ -3684,6 +4014,46 @@ static struct shrinker kfree_rcu_shrinker = {
 	.seeks = DEFAULT_SEEKS,
 };
 
+#ifdef CONFIG_DEBUG_FS
+/*
+ * Memory held back by kvfree_rcu(), per CPU: objects and slab bytes not
+ * yet waiting for a grace period, pages of pointer arrays in use, and
+ * cached pages with the current cache target.
+ */
+static int kvfree_rcu_stats_show(struct seq_file *m, void *v)
+{
+	unsigned long bytes = 0, pages = 0;
+	int cpu;
+
+	seq_puts(m, "cpu     objs      bytes  pages cached target     misses  fallbacks\n");
+	for_each_possible_cpu(cpu) {
+		struct kfree_rcu_cpu *krcp = per_cpu_ptr(&krc, cpu);
+		int nr_pages = READ_ONCE(krcp->nr_bkv_pages);
+		int nr_cached = READ_ONCE(krcp->nr_bkv_objs);
+
+		seq_printf(m, "%3d %8d %10lu %6d %6d %6d %10lu %10lu\n", cpu,
+			   READ_ONCE(krcp->count), READ_ONCE(krcp->bytes),
+			   nr_pages, nr_cached, READ_ONCE(krcp->nr_bkv_target),
+			   READ_ONCE(krcp->nr_cache_miss),
+			   READ_ONCE(krcp->nr_fallback));
+		bytes += READ_ONCE(krcp->bytes);
+		pages += nr_pages + nr_cached;
+	}
+	seq_printf(m, "pending: %lu bytes in objects, %lu bytes in pages\n",
+		   bytes, pages * PAGE_SIZE);
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(kvfree_rcu_stats);
+
+static int __init kvfree_rcu_debugfs_init(void)
+{
+	debugfs_create_file("kvfree_rcu", 0444, NULL, NULL,
+			    &kvfree_rcu_stats_fops);
+	return 0;
+}
+late_initcall(kvfree_rcu_debugfs_init);
+#endif /* #ifdef CONFIG_DEBUG_FS */
+
 void __init kfree_rcu_scheduler_running(void)
 {
 	int cpu;
@@ -3984,6 +4354,7 @@ static void rcu_barrier_func(void *cpu_in)
 	struct rcu_data *rdp = per_cpu_ptr(&rcu_data, cpu);
 
 	rcu_barrier_trace(TPS("IRQ"), -1, rcu_state.barrier_sequence);
+	rcu_lazy_flush(rdp);
 	rdp->barrier_head.func = rcu_barrier_callback;
 	debug_rcu_head_queue(&rdp->barrier_head);
 	rcu_nocb_lock(rdp);
@@ -4051,7 +4422,8 @@ void rcu_barrier(void)
 		if (cpu_is_offline(cpu) &&
 		    !rcu_rdp_is_offloaded(rdp))
 			continue;
-		if (rcu_segcblist_n_cbs(&rdp->cblist) && cpu_online(cpu)) {
+		if ((rcu_segcblist_n_cbs(&rdp->cblist) || rcu_lazy_n_cbs(rdp)) &&
+		    cpu_online(cpu)) {
 			rcu_barrier_trace(TPS("OnlineQ"), cpu,
 					  rcu_state.barrier_sequence);
 			smp_call_function_single(cpu, rcu_barrier_func, (void *)cpu, 1);
@@ -4137,6 +4509,7 @@ rcu_boot_init_percpu_data(int cpu)
 	rdp->rcu_onl_gp_seq = rcu_state.gp_seq;
 	rdp->rcu_onl_gp_flags = RCU_GP_CLEANED;
 	rdp->cpu = cpu;
+	rcu_boot_init_lazy_percpu_data(rdp);
 	rcu_boot_init_nocb_percpu_data(rdp);
 }
 
@@ -4370,6 +4743,7 @@ void rcutree_migrate_callbacks(int cpu)
 	struct rcu_data *rdp = per_cpu_ptr(&rcu_data, cpu);
 	bool needwake;
 
+	rcu_lazy_flush(rdp); /* Outgoing CPU can no longer touch them. */
 	if (rcu_rdp_is_offloaded(rdp) ||
 	    rcu_segcblist_empty(&rdp->cblist))
 		return;  /* No callbacks to migrate. */
@@ -4697,6 +5071,7 @@ static void __init kfree_rcu_batch_init(void)
 
 		INIT_DELAYED_WORK(&krcp->monitor_work, kfree_rcu_monitor);
 		INIT_WORK(&krcp->page_cache_work, fill_page_cache_func);
+		krcp->nr_bkv_target = rcu_min_cached_objs;
 		krcp->initialized = true;
 	}
 	if (register_shrinker(&kfree_rcu_shrinker))
@@ -4710,6 +5085,7 @@ void __init rcu_init(void)
 	rcu_early_boot_tests();
 
 	kfree_rcu_batch_init();
+	rcu_lazy_init();
 	rcu_bootup_announce();
 	rcu_init_geometry();
 	rcu_init_one();
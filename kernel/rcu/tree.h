@@ -178,6 +178,14 @@ struct rcu_data {
 	unsigned long	n_force_qs_snap;
 					/* did other CPU force QS recently? */
 	long		blimit;		/* Upper limit on a processed batch */
+#ifdef CONFIG_RCU_LAZY
+	struct rcu_cblist lazy_cblist;	/* call_rcu_lazy() CBs, not yet */
+					/*  handed to ->cblist. */
+	unsigned long	lazy_first;	/* Time (jiffies) of first lazy CB. */
+	struct timer_list lazy_timer;	/* Enforce finite laziness. */
+	unsigned long	n_lazy_cbs;	/* # lazy callbacks since boot. */
+	unsigned long	n_lazy_flushes;	/* # hand-overs to ->cblist. */
+#endif /* #ifdef CONFIG_RCU_LAZY */
 
 	/* 3) dynticks interface. */
 	int dynticks_snap;		/* Per-GP tracking for dynticks. */
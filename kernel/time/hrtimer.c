@@ -1073,6 +1073,53 @@ static inline ktime_t hrtimer_update_lowres(struct hrtimer *timer, ktime_t tim,
 	return tim;
 }
 
+/*
+ * Move the hard expiry of a timer started with HRTIMER_MODE_ALIGN within
+ * its slack range to the shared deadline of the CPU, so it is expired in
+ * the same interrupt as the other timers aligned to it. If the deadline
+ * is out of range a new one is opened.
+ */
+static inline void hrtimer_align_slack(struct hrtimer *timer,
+				       struct hrtimer_clock_base *base,
+				       const enum hrtimer_mode mode)
+{
+#ifdef CONFIG_HIGH_RES_TIMERS
+	struct hrtimer_cpu_base *cpu_base = base->cpu_base;
+	ktime_t soft, hard, deadline;
+	u64 gran;
+
+	if (!(mode & HRTIMER_MODE_ALIGN) || !cpu_base->hres_active)
+		return;
+
+	/*
+	 * A remote CPU is not reprogrammed, so the timer must not move
+	 * before its next event. See hrtimer_check_target().
+	 */
+	if (cpu_base != this_cpu_ptr(&hrtimer_bases))
+		return;
+
+	/* Timers of all clocks share the deadline in CLOCK_MONOTONIC */
+	soft = ktime_sub(hrtimer_get_softexpires(timer), base->offset);
+	hard = ktime_sub(hrtimer_get_expires(timer), base->offset);
+	if (hard <= soft)
+		return;
+
+	deadline = cpu_base->slack_deadline;
+	if (deadline < soft || deadline > hard) {
+		/*
+		 * Open the new deadline at the latest point of the range which
+		 * is a multiple of the largest power of two not above the
+		 * slack. Timers with a similar slack, also on other CPUs,
+		 * then pick the same deadlines.
+		 */
+		gran = 1ULL << ilog2((u64)(hard - soft));
+		deadline = hard - (hard & (gran - 1));
+		cpu_base->slack_deadline = deadline;
+	}
+	timer->node.expires = ktime_add(deadline, base->offset);
+#endif
+}
+
 static void
 hrtimer_update_softirq_timer(struct hrtimer_cpu_base *cpu_base, bool reprogram)
 {
@@ -1117,7 +1164,10 @@ static int __hrtimer_start_range_ns(struct hrtimer *timer, ktime_t tim,
 	/* Switch the timer base, if necessary: */
 	new_base = switch_hrtimer_base(timer, base, mode & HRTIMER_MODE_PINNED);
 
-	return enqueue_hrtimer(timer, new_base, mode);
+	hrtimer_align_slack(timer, new_base, mode);
+
+	/* The alignment is done, keep it out of the hrtimer_start event */
+	return enqueue_hrtimer(timer, new_base, mode & ~HRTIMER_MODE_ALIGN);
 }
 
 /**
@@ -1566,11 +1616,16 @@ static void __run_hrtimer(struct hrtimer_cpu_base *cpu_base,
 	base->running = NULL;
 }
 
-static void __hrtimer_run_queues(struct hrtimer_cpu_base *cpu_base, ktime_t now,
-				 unsigned long flags, unsigned int active_mask)
+/*
+ * Returns the number of expired timers.
+ */
+static unsigned int __hrtimer_run_queues(struct hrtimer_cpu_base *cpu_base,
+					 ktime_t now, unsigned long flags,
+					 unsigned int active_mask)
 {
 	struct hrtimer_clock_base *base;
 	unsigned int active = cpu_base->active_bases & active_mask;
+	unsigned int expired = 0;
 
 	for_each_active_base(base, cpu_base, active) {
 		struct timerqueue_node *node;
@@ -1601,8 +1656,10 @@ static void __hrtimer_run_queues(struct hrtimer_cpu_base *cpu_base, ktime_t now,
 			__run_hrtimer(cpu_base, base, timer, &basenow, flags);
 			if (active_mask == HRTIMER_ACTIVE_SOFT)
 				hrtimer_sync_wait_running(cpu_base, flags);
+			expired++;
 		}
 	}
+	return expired;
 }
 
 static __latent_entropy void hrtimer_run_softirq(struct softirq_action *h)
@@ -1634,6 +1691,7 @@ void hrtimer_interrupt(struct clock_event_device *dev)
 {
 	struct hrtimer_cpu_base *cpu_base = this_cpu_ptr(&hrtimer_bases);
 	ktime_t expires_next, now, entry_time, delta;
+	unsigned int expired;
 	unsigned long flags;
 	int retries = 0;
 
@@ -1660,7 +1718,10 @@ void hrtimer_interrupt(struct clock_event_device *dev)
 		raise_softirq_irqoff(HRTIMER_SOFTIRQ);
 	}
 
-	__hrtimer_run_queues(cpu_base, now, flags, HRTIMER_ACTIVE_HARD);
+	expired = __hrtimer_run_queues(cpu_base, now, flags, HRTIMER_ACTIVE_HARD);
+	/* Every timer beyond the first would have needed its own interrupt */
+	if (expired > 1)
+		cpu_base->nr_irqs_saved += expired - 1;
 
 	/* Reevaluate the clock bases for the [soft] next expiry */
 	expires_next = hrtimer_update_next_event(cpu_base);
@@ -1946,7 +2007,7 @@ long hrtimer_nanosleep(ktime_t rqtp, const enum hrtimer_mode mode,
 
 	hrtimer_init_sleeper_on_stack(&t, clockid, mode);
 	hrtimer_set_expires_range_ns(&t.timer, rqtp, slack);
-	ret = do_nanosleep(&t, mode);
+	ret = do_nanosleep(&t, mode | HRTIMER_MODE_ALIGN);
 	if (ret != -ERESTART_RESTARTBLOCK)
 		goto out;
 
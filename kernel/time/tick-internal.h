@@ -164,3 +164,5 @@ DECLARE_PER_CPU(struct hrtimer_cpu_base, hrtimer_bases);
 
 extern u64 get_next_timer_interrupt(unsigned long basej, u64 basem);
 void timer_clear_idle(void);
+u64 get_jiffies_update(unsigned long *basej);
+u64 timer_expire_remote(unsigned int cpu, unsigned long basej, u64 basem);
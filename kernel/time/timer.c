@@ -52,6 +52,7 @@
 #include <asm/io.h>
 
 #include "tick-internal.h"
+#include "timer_migration.h"
 
 #define CREATE_TRACE_POINTS
 #include <trace/events/timer.h>
@@ -180,18 +181,23 @@ EXPORT_SYMBOL(jiffies_64);
 #define WHEEL_TIMEOUT_MAX	(WHEEL_TIMEOUT_CUTOFF - LVL_GRAN(LVL_DEPTH - 1))
 
 /*
- * The resulting wheel size. If NOHZ is configured we allocate two
- * wheels so we have a separate storage for the deferrable timers.
+ * The resulting wheel size. If NOHZ is configured we allocate three
+ * wheels: pinned timers go to the local wheel, which always wakes the
+ * CPU, non pinned timers go to the global wheel, which can be expired
+ * by another CPU while this one is idle, and deferrable timers get a
+ * separate storage.
  */
 #define WHEEL_SIZE	(LVL_SIZE * LVL_DEPTH)
 
 #ifdef CONFIG_NO_HZ_COMMON
-# define NR_BASES	2
-# define BASE_STD	0
-# define BASE_DEF	1
+# define NR_BASES	3
+# define BASE_LOCAL	0
+# define BASE_GLOBAL	1
+# define BASE_DEF	2
 #else
 # define NR_BASES	1
-# define BASE_STD	0
+# define BASE_LOCAL	0
+# define BASE_GLOBAL	0
 # define BASE_DEF	0
 #endif
 
@@ -207,6 +213,7 @@ struct timer_base {
 	unsigned int		cpu;
 	bool			next_expiry_recalc;
 	bool			is_idle;
+	bool			expiry_active;
 	DECLARE_BITMAP(pending_map, WHEEL_SIZE);
 	struct hlist_head	vectors[WHEEL_SIZE];
 } ____cacheline_aligned;
@@ -232,11 +239,27 @@ static void timers_update_migration(void)
 		static_branch_enable(&timers_migration_enabled);
 	else
 		static_branch_disable(&timers_migration_enabled);
+
+	/*
+	 * Idle CPUs have handed their global timers to the pull model or
+	 * not according to the old state. Make them reevaluate.
+	 */
+	if (IS_ENABLED(CONFIG_TIMER_PULL))
+		wake_up_all_idle_cpus();
 }
 #else
 static inline void timers_update_migration(void) { }
 #endif /* !CONFIG_SMP */
 
+#ifdef CONFIG_TIMER_PULL
+static inline bool timers_pull_active(void)
+{
+	return static_branch_likely(&timers_migration_enabled);
+}
+#else
+static inline bool timers_pull_active(void) { return false; }
+#endif
+
 static void timer_update_keys(struct work_struct *work)
 {
 	mutex_lock(&timer_keys_mutex);
@@ -847,28 +870,30 @@ static int detach_if_pending(struct timer_list *timer, struct timer_base *base,
 
 static inline struct timer_base *get_timer_cpu_base(u32 tflags, u32 cpu)
 {
-	struct timer_base *base = per_cpu_ptr(&timer_bases[BASE_STD], cpu);
+	int index = tflags & TIMER_PINNED ? BASE_LOCAL : BASE_GLOBAL;
 
 	/*
 	 * If the timer is deferrable and NO_HZ_COMMON is set then we need
 	 * to use the deferrable base.
 	 */
 	if (IS_ENABLED(CONFIG_NO_HZ_COMMON) && (tflags & TIMER_DEFERRABLE))
-		base = per_cpu_ptr(&timer_bases[BASE_DEF], cpu);
-	return base;
+		index = BASE_DEF;
+
+	return per_cpu_ptr(&timer_bases[index], cpu);
 }
 
 static inline struct timer_base *get_timer_this_cpu_base(u32 tflags)
 {
-	struct timer_base *base = this_cpu_ptr(&timer_bases[BASE_STD]);
+	int index = tflags & TIMER_PINNED ? BASE_LOCAL : BASE_GLOBAL;
 
 	/*
 	 * If the timer is deferrable and NO_HZ_COMMON is set then we need
 	 * to use the deferrable base.
 	 */
 	if (IS_ENABLED(CONFIG_NO_HZ_COMMON) && (tflags & TIMER_DEFERRABLE))
-		base = this_cpu_ptr(&timer_bases[BASE_DEF]);
-	return base;
+		index = BASE_DEF;
+
+	return this_cpu_ptr(&timer_bases[index]);
 }
 
 static inline struct timer_base *get_timer_base(u32 tflags)
@@ -880,8 +905,14 @@ static inline struct timer_base *
 get_target_base(struct timer_base *base, unsigned tflags)
 {
 #if defined(CONFIG_SMP) && defined(CONFIG_NO_HZ_COMMON)
+	/*
+	 * With the timer pull model the global timers of an idle CPU are
+	 * expired by the active CPUs of its group, so there is no need to
+	 * push the timer to a busy CPU at enqueue time.
+	 */
 	if (static_branch_likely(&timers_migration_enabled) &&
-	    !(tflags & TIMER_PINNED))
+	    !(tflags & TIMER_PINNED) &&
+	    !tmigr_cpu_enabled(smp_processor_id()))
 		return get_timer_cpu_base(tflags, get_nohz_timer_target());
 #endif
 	return get_timer_this_cpu_base(tflags);
@@ -1157,6 +1188,13 @@ void add_timer_on(struct timer_list *timer, int cpu)
 
 	BUG_ON(timer_pending(timer) || !timer->function);
 
+	/*
+	 * The timer must expire on @cpu. Make sure it is queued in the local
+	 * base, so it is not expired by another CPU while @cpu is idle.
+	 */
+	if (!(timer->flags & TIMER_PINNED))
+		timer->flags |= TIMER_PINNED;
+
 	new_base = get_timer_cpu_base(timer->flags, cpu);
 
 	/*
@@ -1634,29 +1672,16 @@ static u64 cmp_next_hrtimer_event(u64 basem, u64 expires)
 	return DIV_ROUND_UP_ULL(nextevt, TICK_NSEC) * TICK_NSEC;
 }
 
-/**
- * get_next_timer_interrupt - return the time (clock mono) of the next timer
- * @basej:	base time jiffies
- * @basem:	base time clock monotonic
- *
- * Returns the tick aligned clock monotonic time of the next pending
- * timer or KTIME_MAX if no timer is pending.
+/*
+ * Return the next event of @base in clock monotonic, forwarding the base
+ * clock on the way. Called with @base->lock held.
  */
-u64 get_next_timer_interrupt(unsigned long basej, u64 basem)
+static u64 next_base_event(struct timer_base *base, unsigned long basej,
+			   u64 basem)
 {
-	struct timer_base *base = this_cpu_ptr(&timer_bases[BASE_STD]);
-	u64 expires = KTIME_MAX;
 	unsigned long nextevt;
 	bool is_max_delta;
 
-	/*
-	 * Pretend that there is no timer pending if the cpu is offline.
-	 * Possible pending timers will be migrated later to an active cpu.
-	 */
-	if (cpu_is_offline(smp_processor_id()))
-		return expires;
-
-	raw_spin_lock(&base->lock);
 	if (base->next_expiry_recalc)
 		base->next_expiry = __next_timer_interrupt(base);
 	nextevt = base->next_expiry;
@@ -1674,23 +1699,78 @@ u64 get_next_timer_interrupt(unsigned long basej, u64 basem)
 			base->clk = nextevt;
 	}
 
-	if (time_before_eq(nextevt, basej)) {
-		expires = basem;
-		base->is_idle = false;
-	} else {
-		if (!is_max_delta)
-			expires = basem + (u64)(nextevt - basej) * TICK_NSEC;
+	if (time_before_eq(nextevt, basej))
+		return basem;
+	if (is_max_delta)
+		return KTIME_MAX;
+	return basem + (u64)(nextevt - basej) * TICK_NSEC;
+}
+
+/**
+ * get_next_timer_interrupt - return the time (clock mono) of the next timer
+ * @basej:	base time jiffies
+ * @basem:	base time clock monotonic
+ *
+ * Returns the tick aligned clock monotonic time of the next pending
+ * timer or KTIME_MAX if no timer is pending.
+ *
+ * With the timer pull model, the global timers are only taken into
+ * account when this CPU is the last active CPU of its migration group
+ * going idle. Then it has to wake up for the first global timer of all
+ * idle CPUs of the group.
+ */
+u64 get_next_timer_interrupt(unsigned long basej, u64 basem)
+{
+	struct timer_base *base_local, *base_global;
+	u64 expires, local, global;
+	bool idle = false;
+
+	/*
+	 * Pretend that there is no timer pending if the cpu is offline.
+	 * Possible pending timers will be migrated later to an active cpu.
+	 */
+	if (cpu_is_offline(smp_processor_id()))
+		return KTIME_MAX;
+
+	base_local = this_cpu_ptr(&timer_bases[BASE_LOCAL]);
+	base_global = this_cpu_ptr(&timer_bases[BASE_GLOBAL]);
+
+	raw_spin_lock(&base_local->lock);
+	raw_spin_lock_nested(&base_global->lock, SINGLE_DEPTH_NESTING);
+
+	local = next_base_event(base_local, basej, basem);
+	global = next_base_event(base_global, basej, basem);
+	expires = min(local, global);
+
+	if (expires == basem) {
+		base_local->is_idle = false;
+		base_global->is_idle = false;
+	} else if ((expires - basem) > TICK_NSEC) {
+		/*
+		 * If we expect to sleep more than a tick, mark the bases
+		 * idle. Also the tick is stopped so any added timer must
+		 * forward the base clk itself to keep granularity small.
+		 * This idle logic is not maintained for the BASE_DEF base,
+		 * deferrable timers may still see large granularity skew
+		 * (by design).
+		 */
+		base_local->is_idle = true;
+		base_global->is_idle = true;
+		idle = true;
+	}
+
+	raw_spin_unlock(&base_global->lock);
+	raw_spin_unlock(&base_local->lock);
+
+	if (idle && timers_pull_active()) {
 		/*
-		 * If we expect to sleep more than a tick, mark the base idle.
-		 * Also the tick is stopped so any added timer must forward
-		 * the base clk itself to keep granularity small. This idle
-		 * logic is only maintained for the BASE_STD base, deferrable
-		 * timers may still see large granularity skew (by design).
+		 * Hand the global timers over to the group. If other CPUs of
+		 * the group are still active, they take care of them and
+		 * KTIME_MAX is returned.
 		 */
-		if ((expires - basem) > TICK_NSEC)
-			base->is_idle = true;
+		global = tmigr_cpu_deactivate(global);
+		expires = min(local, global);
 	}
-	raw_spin_unlock(&base->lock);
 
 	return cmp_next_hrtimer_event(basem, expires);
 }
@@ -1702,15 +1782,17 @@ u64 get_next_timer_interrupt(unsigned long basej, u64 basem)
  */
 void timer_clear_idle(void)
 {
-	struct timer_base *base = this_cpu_ptr(&timer_bases[BASE_STD]);
-
 	/*
 	 * We do this unlocked. The worst outcome is a remote enqueue sending
 	 * a pointless IPI, but taking the lock would just make the window for
 	 * sending the IPI a few instructions smaller for the cost of taking
 	 * the lock in the exit from idle path.
 	 */
-	base->is_idle = false;
+	__this_cpu_write(timer_bases[BASE_LOCAL].is_idle, false);
+	__this_cpu_write(timer_bases[BASE_GLOBAL].is_idle, false);
+
+	/* Take back the responsibility for the own global timers */
+	tmigr_cpu_activate();
 }
 #endif
 
@@ -1729,6 +1811,19 @@ static inline void __run_timers(struct timer_base *base)
 	timer_base_lock_expiry(base);
 	raw_spin_lock_irq(&base->lock);
 
+	/*
+	 * With the timer pull model the global base of an idle CPU is
+	 * expired by another CPU. When the CPU comes out of idle while that
+	 * is in progress, leave the expiry to the other CPU, running the
+	 * callbacks of one base concurrently would break del_timer_sync().
+	 */
+	if (base->expiry_active) {
+		raw_spin_unlock_irq(&base->lock);
+		timer_base_unlock_expiry(base);
+		return;
+	}
+	base->expiry_active = true;
+
 	while (time_after_eq(jiffies, base->clk) &&
 	       time_after_eq(jiffies, base->next_expiry)) {
 		levels = collect_expired_timers(base, heads);
@@ -1744,6 +1839,7 @@ static inline void __run_timers(struct timer_base *base)
 		while (levels--)
 			expire_timers(base, heads + levels);
 	}
+	base->expiry_active = false;
 	raw_spin_unlock_irq(&base->lock);
 	timer_base_unlock_expiry(base);
 }
@@ -1753,29 +1849,63 @@ static inline void __run_timers(struct timer_base *base)
  */
 static __latent_entropy void run_timer_softirq(struct softirq_action *h)
 {
-	struct timer_base *base = this_cpu_ptr(&timer_bases[BASE_STD]);
+	__run_timers(this_cpu_ptr(&timer_bases[BASE_LOCAL]));
+	if (IS_ENABLED(CONFIG_NO_HZ_COMMON)) {
+		__run_timers(this_cpu_ptr(&timer_bases[BASE_GLOBAL]));
+		__run_timers(this_cpu_ptr(&timer_bases[BASE_DEF]));
+
+		/* Expire the timers of idle CPUs in the migration group */
+		tmigr_handle_remote();
+	}
+}
+
+#ifdef CONFIG_TIMER_PULL
+/**
+ * timer_expire_remote - expire the global timers of an idle CPU
+ * @cpu:	the idle CPU
+ * @basej:	base time jiffies
+ * @basem:	base time clock monotonic
+ *
+ * Called from the timer softirq of an active CPU on behalf of the timer
+ * pull model. The local and deferrable bases of @cpu are left alone,
+ * they may contain pinned timers.
+ *
+ * Returns the next global event of @cpu.
+ */
+u64 timer_expire_remote(unsigned int cpu, unsigned long basej, u64 basem)
+{
+	struct timer_base *base = per_cpu_ptr(&timer_bases[BASE_GLOBAL], cpu);
+	u64 next;
 
 	__run_timers(base);
-	if (IS_ENABLED(CONFIG_NO_HZ_COMMON))
-		__run_timers(this_cpu_ptr(&timer_bases[BASE_DEF]));
+	raw_spin_lock_irq(&base->lock);
+	next = next_base_event(base, basej, basem);
+	raw_spin_unlock_irq(&base->lock);
+
+	return next;
 }
+#endif
 
 /*
  * Called by the local, per-CPU timer interrupt on SMP.
  */
 static void run_local_timers(void)
 {
-	struct timer_base *base = this_cpu_ptr(&timer_bases[BASE_STD]);
+	struct timer_base *base = this_cpu_ptr(&timer_bases[BASE_LOCAL]);
 
 	hrtimer_run_queues();
 	/* Raise the softirq only if required. */
 	if (time_before(jiffies, base->next_expiry)) {
 		if (!IS_ENABLED(CONFIG_NO_HZ_COMMON))
 			return;
-		/* CPU is awake, so check the deferrable base. */
+		/* CPU is awake, so check the global and deferrable bases. */
 		base++;
-		if (time_before(jiffies, base->next_expiry))
-			return;
+		if (time_before(jiffies, base->next_expiry)) {
+			base++;
+			if (time_before(jiffies, base->next_expiry) &&
+			    !tmigr_requires_handle_remote())
+				return;
+		}
 	}
 	raise_softirq(TIMER_SOFTIRQ);
 }
@@ -0,0 +1,384 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Timer pull model for idle CPUs
+ *
+ * Non pinned timers are queued in the global base of the CPU which
+ * queued them, but they are not required to expire on that CPU. When a
+ * CPU goes idle, it hands its first global event over to its group
+ * instead of programming its clock event device for it. The CPUs of the
+ * group which are still active check the events of the idle CPUs from
+ * their tick and expire their global timers remotely.
+ *
+ * Only the last active CPU of a group going idle has to wake up for the
+ * first global event of the group. Pinned timers stay in the local base
+ * and wake up their CPU as before. Deferrable timers, which never wake
+ * up an idle CPU anyway, are left alone.
+ *
+ * Groups span the CPUs of a NUMA node, so timers are not expired on a
+ * remote node. CPUs excluded from timer housekeeping (nohz_full) do not
+ * take part and push their timers to a housekeeping CPU at enqueue time.
+ *
+ * Locking: the group lock protects the group and the tmigr_cpu state of
+ * its members. It is taken with interrupts disabled on idle entry, in
+ * timer_clear_idle() and by the remote expiry in the timer softirq.
+ */
+
+#include <linux/cpuhotplug.h>
+#include <linux/debugfs.h>
+#include <linux/init.h>
+#include <linux/ktime.h>
+#include <linux/mutex.h>
+#include <linux/sched/isolation.h>
+#include <linux/sched/nohz.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/topology.h>
+
+#include "tick-internal.h"
+#include "timer_migration.h"
+
+static DEFINE_MUTEX(tmigr_mutex);
+static struct tmigr_group *tmigr_groups[MAX_NUMNODES];
+
+static DEFINE_PER_CPU(struct tmigr_cpu, tmigr_cpu);
+
+static inline bool tmigr_enabled(void)
+{
+	return static_branch_likely(&timers_migration_enabled);
+}
+
+/* Recalculate the first global event of the idle CPUs of @grp */
+static void tmigr_update_group(struct tmigr_group *grp)
+{
+	u64 next = KTIME_MAX;
+	int cpu;
+
+	lockdep_assert_held(&grp->lock);
+
+	for_each_cpu(cpu, grp->cpus) {
+		struct tmigr_cpu *tmc = per_cpu_ptr(&tmigr_cpu, cpu);
+
+		if (tmc->idle)
+			next = min(next, tmc->wakeup);
+	}
+	grp->next_expiry = next;
+	grp->stale = false;
+}
+
+/* Does @tmc provide the first event of @grp? */
+static bool tmigr_is_first(struct tmigr_group *grp, struct tmigr_cpu *tmc)
+{
+	return tmc->wakeup != KTIME_MAX && tmc->wakeup == grp->next_expiry;
+}
+
+/**
+ * tmigr_cpu_activate - take back the global timers of this CPU
+ *
+ * Called from timer_clear_idle() with interrupts disabled.
+ *
+ * If this CPU provided the first event of the group, the group event is
+ * only marked stale instead of scanning the group on every idle exit.
+ * An early group event costs at most a spurious check for remote expiry.
+ */
+void tmigr_cpu_activate(void)
+{
+	struct tmigr_cpu *tmc = this_cpu_ptr(&tmigr_cpu);
+	struct tmigr_group *grp = tmc->grp;
+
+	if (!tmc->online || !tmc->idle)
+		return;
+
+	raw_spin_lock(&grp->lock);
+	tmc->idle = false;
+	grp->nr_active++;
+	if (tmigr_is_first(grp, tmc))
+		grp->stale = true;
+	tmc->wakeup = KTIME_MAX;
+	raw_spin_unlock(&grp->lock);
+}
+
+/**
+ * tmigr_cpu_deactivate - hand the global timers of this CPU to its group
+ * @nextexp:	first global event of this CPU
+ *
+ * Called from get_next_timer_interrupt() with interrupts disabled, when
+ * the CPU is about to stop its tick.
+ *
+ * Returns the first global event this CPU has to wake up for: KTIME_MAX
+ * if other CPUs of the group are still active, the first global event of
+ * the group if this CPU is the last one going idle, or @nextexp if the
+ * CPU does not take part in the pull model.
+ */
+u64 tmigr_cpu_deactivate(u64 nextexp)
+{
+	struct tmigr_cpu *tmc = this_cpu_ptr(&tmigr_cpu);
+	struct tmigr_group *grp = tmc->grp;
+	u64 ret = KTIME_MAX;
+	bool first = false;
+
+	if (!tmc->online || !tmigr_enabled())
+		return nextexp;
+
+	raw_spin_lock(&grp->lock);
+	if (tmc->idle) {
+		first = tmigr_is_first(grp, tmc);
+	} else {
+		tmc->idle = true;
+		tmc->nr_idle++;
+		grp->nr_active--;
+	}
+
+	tmc->wakeup = nextexp;
+	if (first)
+		tmigr_update_group(grp);
+	else
+		grp->next_expiry = min(grp->next_expiry, nextexp);
+
+	if (!grp->nr_active) {
+		if (grp->stale)
+			tmigr_update_group(grp);
+		tmc->nr_last_idle++;
+		ret = grp->next_expiry;
+	}
+	raw_spin_unlock(&grp->lock);
+
+	return ret;
+}
+
+/**
+ * tmigr_requires_handle_remote - check for expired events of idle CPUs
+ *
+ * Called from the tick of this CPU to decide whether the timer softirq
+ * has to be raised on behalf of the idle CPUs of the group.
+ */
+bool tmigr_requires_handle_remote(void)
+{
+	struct tmigr_cpu *tmc = this_cpu_ptr(&tmigr_cpu);
+	struct tmigr_group *grp = tmc->grp;
+	unsigned long basej;
+	u64 now;
+
+	if (!tmc->online || !tmigr_enabled())
+		return false;
+
+	now = get_jiffies_update(&basej);
+	return READ_ONCE(grp->next_expiry) <= now;
+}
+
+/**
+ * tmigr_handle_remote - expire the global timers of idle CPUs
+ *
+ * Called from the timer softirq.
+ */
+void tmigr_handle_remote(void)
+{
+	struct tmigr_cpu *tmc = this_cpu_ptr(&tmigr_cpu);
+	struct tmigr_group *grp = tmc->grp;
+	int cpu, this_cpu = smp_processor_id();
+	unsigned long basej;
+	u64 now, next;
+
+	if (!tmigr_requires_handle_remote())
+		return;
+
+	now = get_jiffies_update(&basej);
+
+	/* The group event might be a stale one, left behind by activation */
+	raw_spin_lock_irq(&grp->lock);
+	if (grp->stale)
+		tmigr_update_group(grp);
+	next = grp->next_expiry;
+	raw_spin_unlock_irq(&grp->lock);
+	if (next > now)
+		return;
+
+	for_each_cpu(cpu, grp->cpus) {
+		struct tmigr_cpu *rtmc = per_cpu_ptr(&tmigr_cpu, cpu);
+
+		if (cpu == this_cpu)
+			continue;
+
+		raw_spin_lock_irq(&grp->lock);
+		if (!rtmc->idle || rtmc->remote || rtmc->wakeup > now) {
+			raw_spin_unlock_irq(&grp->lock);
+			continue;
+		}
+		/*
+		 * Claim the CPU, so it is expired only once. Its event is
+		 * reset, a deactivation while the expiry is in progress
+		 * installs a fresh one.
+		 */
+		rtmc->remote = true;
+		rtmc->wakeup = KTIME_MAX;
+		raw_spin_unlock_irq(&grp->lock);
+
+		next = timer_expire_remote(cpu, basej, now);
+
+		raw_spin_lock_irq(&grp->lock);
+		rtmc->remote = false;
+		rtmc->nr_expired_remote++;
+		tmc->nr_remote++;
+		if (rtmc->idle)
+			rtmc->wakeup = min(rtmc->wakeup, next);
+		tmigr_update_group(grp);
+		raw_spin_unlock_irq(&grp->lock);
+	}
+}
+
+/**
+ * tmigr_cpu_enabled - check whether a CPU takes part in the pull model
+ * @cpu:	the CPU to check
+ */
+bool tmigr_cpu_enabled(int cpu)
+{
+	return per_cpu(tmigr_cpu, cpu).online;
+}
+
+static struct tmigr_group *tmigr_get_group(int node)
+{
+	struct tmigr_group *grp;
+
+	mutex_lock(&tmigr_mutex);
+	grp = tmigr_groups[node];
+	if (grp)
+		goto out;
+
+	grp = kzalloc_node(sizeof(*grp), GFP_KERNEL, node);
+	if (!grp)
+		goto out;
+	if (!zalloc_cpumask_var_node(&grp->cpus, GFP_KERNEL, node)) {
+		kfree(grp);
+		grp = NULL;
+		goto out;
+	}
+	raw_spin_lock_init(&grp->lock);
+	grp->next_expiry = KTIME_MAX;
+	grp->node = node;
+	tmigr_groups[node] = grp;
+out:
+	mutex_unlock(&tmigr_mutex);
+	return grp;
+}
+
+static int tmigr_cpu_online(unsigned int cpu)
+{
+	struct tmigr_cpu *tmc = per_cpu_ptr(&tmigr_cpu, cpu);
+	int node = cpu_to_node(cpu);
+	struct tmigr_group *grp;
+
+	/* CPUs isolated from timer housekeeping keep pushing their timers */
+	if (!housekeeping_cpu(cpu, HK_FLAG_TIMER))
+		return 0;
+
+	grp = tmigr_get_group(node == NUMA_NO_NODE ? 0 : node);
+	if (!grp)
+		return -ENOMEM;
+
+	raw_spin_lock_irq(&grp->lock);
+	tmc->grp = grp;
+	tmc->idle = false;
+	tmc->wakeup = KTIME_MAX;
+	cpumask_set_cpu(cpu, grp->cpus);
+	grp->nr_active++;
+	tmc->online = true;
+	raw_spin_unlock_irq(&grp->lock);
+
+	return 0;
+}
+
+static int tmigr_cpu_offline(unsigned int cpu)
+{
+	struct tmigr_cpu *tmc = per_cpu_ptr(&tmigr_cpu, cpu);
+	struct tmigr_group *grp = tmc->grp;
+	unsigned int kick = nr_cpu_ids;
+
+	if (!tmc->online)
+		return 0;
+
+	raw_spin_lock_irq(&grp->lock);
+	/*
+	 * Wait for a remote expiry which claimed this CPU while it was
+	 * idle, timers_dead_cpu() must not find it running. No new claim
+	 * can be made, this CPU is active and leaves the group below.
+	 */
+	while (tmc->remote) {
+		raw_spin_unlock_irq(&grp->lock);
+		cpu_relax();
+		raw_spin_lock_irq(&grp->lock);
+	}
+	tmc->online = false;
+	cpumask_clear_cpu(cpu, grp->cpus);
+	if (!tmc->idle)
+		grp->nr_active--;
+	tmc->idle = false;
+	tmigr_update_group(grp);
+	/*
+	 * When the last active CPU of the group goes away, an idle CPU has
+	 * to take over the wakeup for the global timers of the group. Kick
+	 * it, so it reevaluates its next event.
+	 */
+	if (!grp->nr_active && grp->next_expiry != KTIME_MAX)
+		kick = cpumask_first(grp->cpus);
+	raw_spin_unlock_irq(&grp->lock);
+
+	if (kick < nr_cpu_ids)
+		wake_up_nohz_cpu(kick);
+
+	return 0;
+}
+
+static int __init tmigr_init(void)
+{
+	int ret;
+
+	ret = cpuhp_setup_state(CPUHP_AP_ONLINE_DYN, "timers/migration:online",
+				tmigr_cpu_online, tmigr_cpu_offline);
+	return ret < 0 ? ret : 0;
+}
+early_initcall(tmigr_init);
+
+#ifdef CONFIG_DEBUG_FS
+static int tmigr_show(struct seq_file *m, void *v)
+{
+	int cpu, node;
+
+	seq_puts(m, "# cpu node idle nr_idle nr_last_idle nr_remote nr_expired_remote\n");
+	for_each_possible_cpu(cpu) {
+		struct tmigr_cpu *tmc = per_cpu_ptr(&tmigr_cpu, cpu);
+
+		if (!tmc->grp)
+			continue;
+		seq_printf(m, "%d %d %d %lu %lu %lu %lu\n", cpu,
+			   tmc->grp->node, tmc->online ? tmc->idle : -1,
+			   tmc->nr_idle, tmc->nr_last_idle, tmc->nr_remote,
+			   tmc->nr_expired_remote);
+	}
+
+	mutex_lock(&tmigr_mutex);
+	for_each_node(node) {
+		struct tmigr_group *grp = tmigr_groups[node];
+
+		if (!grp)
+			continue;
+		raw_spin_lock_irq(&grp->lock);
+		seq_printf(m, "group %d: cpus %*pbl active %u next_expiry %llu\n",
+			   node, cpumask_pr_args(grp->cpus), grp->nr_active,
+			   grp->next_expiry);
+		raw_spin_unlock_irq(&grp->lock);
+	}
+	mutex_unlock(&tmigr_mutex);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(tmigr);
+
+static int __init tmigr_debugfs_init(void)
+{
+	struct dentry *dir = debugfs_create_dir("timers", NULL);
+
+	debugfs_create_file("migration", 0444, dir, NULL, &tmigr_fops);
+	return 0;
+}
+late_initcall(tmigr_debugfs_init);
+#endif
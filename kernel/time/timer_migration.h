@@ -0,0 +1,68 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _KERNEL_TIME_MIGRATION_H
+#define _KERNEL_TIME_MIGRATION_H
+
+/**
+ * struct tmigr_group - a group of CPUs sharing the expiry of global timers
+ * @lock:		Protects the group and the tmigr_cpu of its members
+ * @cpus:		Online CPUs taking part in the group
+ * @nr_active:		Number of active (not idle) CPUs in @cpus
+ * @next_expiry:	First global event of the idle CPUs, a lower bound of
+ *			it while @stale is set
+ * @stale:		@next_expiry has to be recalculated
+ * @node:		NUMA node the group covers
+ */
+struct tmigr_group {
+	raw_spinlock_t		lock;
+	cpumask_var_t		cpus;
+	unsigned int		nr_active;
+	u64			next_expiry;
+	bool			stale;
+	int			node;
+};
+
+/**
+ * struct tmigr_cpu - per CPU timer pull state
+ * @grp:		The group the CPU belongs to
+ * @online:		The CPU takes part in the pull model
+ * @idle:		The CPU went idle and its global timers are handled
+ *			by the group
+ * @remote:		Another CPU is expiring the timers of this CPU
+ * @wakeup:		First global event while idle
+ * @nr_idle:		Number of transitions into idle
+ * @nr_last_idle:	Number of times the CPU was the last active CPU of
+ *			its group going idle and had to arm for the group
+ * @nr_remote:		Number of times timers of other CPUs were expired
+ * @nr_expired_remote:	Number of times the timers of this CPU were expired
+ *			by another CPU
+ */
+struct tmigr_cpu {
+	struct tmigr_group	*grp;
+	bool			online;
+	bool			idle;
+	bool			remote;
+	u64			wakeup;
+	unsigned long		nr_idle;
+	unsigned long		nr_last_idle;
+	unsigned long		nr_remote;
+	unsigned long		nr_expired_remote;
+};
+
+#ifdef CONFIG_TIMER_PULL
+extern void tmigr_handle_remote(void);
+extern bool tmigr_requires_handle_remote(void);
+extern void tmigr_cpu_activate(void);
+extern u64 tmigr_cpu_deactivate(u64 nextexp);
+extern bool tmigr_cpu_enabled(int cpu);
+#else
+static inline void tmigr_handle_remote(void) { }
+static inline bool tmigr_requires_handle_remote(void) { return false; }
+static inline void tmigr_cpu_activate(void) { }
+static inline u64 tmigr_cpu_deactivate(u64 nextexp)
+{
+	return nextexp;
+}
+static inline bool tmigr_cpu_enabled(int cpu) { return false; }
+#endif
+
+#endif /* _KERNEL_TIME_MIGRATION_H */
@@ -17,6 +17,9 @@
 #include <linux/error-injection.h>
 #include <linux/btf_ids.h>
 #include <linux/bpf_lsm.h>
+#include <linux/fprobe.h>
+#include <linux/bsearch.h>
+#include <linux/sort.h>
 
 #include <net/bpf_sk_storage.h>
 
@@ -1659,6 +1662,11 @@ int perf_event_attach_bpf_prog(struct perf_event *event,
 	     !trace_kprobe_error_injectable(event->tp_event)))
 		return -EINVAL;
 
+	/* kprobe_multi programs only run from their link */
+	if (prog->type == BPF_PROG_TYPE_KPROBE &&
+	    prog->expected_attach_type == BPF_TRACE_KPROBE_MULTI)
+		return -EINVAL;
+
 	mutex_lock(&bpf_event_mutex);
 
 	if (event->prog)
@@ -1975,3 +1983,245 @@ static int __init bpf_event_init(void)
 
 fs_initcall(bpf_event_init);
 #endif /* CONFIG_MODULES */
+
+#ifdef CONFIG_FPROBE
+/* Bounds the memory held for the symbol names of one link. */
+#define MAX_KPROBE_MULTI_CNT (1U << 20)
+
+struct bpf_kprobe_multi_link {
+	struct bpf_link link;
+	struct fprobe fp;
+	unsigned long *addrs;
+	u32 cnt;
+};
+
+static void bpf_kprobe_multi_link_release(struct bpf_link *link)
+{
+	struct bpf_kprobe_multi_link *kmulti_link;
+
+	kmulti_link = container_of(link, struct bpf_kprobe_multi_link, link);
+	unregister_fprobe(&kmulti_link->fp);
+}
+
+static void bpf_kprobe_multi_link_dealloc(struct bpf_link *link)
+{
+	struct bpf_kprobe_multi_link *kmulti_link;
+
+	kmulti_link = container_of(link, struct bpf_kprobe_multi_link, link);
+	kvfree(kmulti_link->addrs);
+	kfree(kmulti_link);
+}
+
+static void bpf_kprobe_multi_link_show_fdinfo(const struct bpf_link *link,
+					      struct seq_file *seq)
+{
+	struct bpf_kprobe_multi_link *kmulti_link;
+
+	kmulti_link = container_of(link, struct bpf_kprobe_multi_link, link);
+	seq_printf(seq, "func_cnt:\t%u\n", kmulti_link->cnt);
+	seq_printf(seq, "nmissed:\t%lu\n", kmulti_link->fp.nmissed);
+}
+
+static const struct bpf_link_ops bpf_kprobe_multi_link_lops = {
+	.release = bpf_kprobe_multi_link_release,
+	.dealloc = bpf_kprobe_multi_link_dealloc,
+	.show_fdinfo = bpf_kprobe_multi_link_show_fdinfo,
+};
+
+static void kprobe_multi_link_handler(struct fprobe *fp, unsigned long entry_ip,
+				      struct pt_regs *regs)
+{
+	struct bpf_kprobe_multi_link *link;
+
+	link = container_of(fp, struct bpf_kprobe_multi_link, fp);
+
+	if (unlikely(__this_cpu_inc_return(bpf_prog_active) != 1)) {
+		fp->nmissed++;
+		goto out;
+	}
+
+	rcu_read_lock();
+	BPF_PROG_RUN(link->link.prog, regs);
+	rcu_read_unlock();
+
+ out:
+	__this_cpu_dec(bpf_prog_active);
+}
+
+struct kprobe_multi_syms {
+	const char **syms;
+	unsigned long *addrs;
+	u32 cnt;
+	u32 found;
+};
+
+static int symbols_cmp(const void *a, const void *b)
+{
+	const char **str_a = (const char **)a;
+	const char **str_b = (const char **)b;
+
+	return strcmp(*str_a, *str_b);
+}
+
+static int kprobe_multi_syms_cb(void *data, const char *name,
+				struct module *mod, unsigned long addr)
+{
+	struct kprobe_multi_syms *args = data;
+	const char **sym;
+	u32 idx;
+
+	sym = bsearch(&name, args->syms, args->cnt, sizeof(*args->syms),
+		      symbols_cmp);
+	if (!sym)
+		return 0;
+
+	idx = sym - args->syms;
+	if (args->addrs[idx])
+		return 0;
+
+	addr = ftrace_location(addr);
+	if (!addr)
+		return 0;
+
+	args->addrs[idx] = addr;
+	return ++args->found == args->cnt;
+}
+
+/*
+ * Resolve all symbol names with a single pass over kallsyms rather than
+ * one kallsyms_lookup_name() walk per name.
+ */
+static int kprobe_multi_resolve_syms(const void __user *usyms, u32 cnt,
+				     unsigned long *addrs)
+{
+	unsigned long __user *uptrs = (unsigned long __user *)usyms;
+	struct kprobe_multi_syms args = {
+		.addrs	= addrs,
+		.cnt	= cnt,
+	};
+	unsigned long uptr;
+	char *buf, *p;
+	long len;
+	int err = -ENOMEM;
+	u32 i;
+
+	args.syms = kvmalloc_array(cnt, sizeof(*args.syms), GFP_KERNEL);
+	buf = kvmalloc_array(cnt, KSYM_NAME_LEN, GFP_KERNEL);
+	if (!args.syms || !buf)
+		goto out;
+
+	for (p = buf, i = 0; i < cnt; i++, p += len + 1) {
+		if (get_user(uptr, uptrs + i)) {
+			err = -EFAULT;
+			goto out;
+		}
+		len = strncpy_from_user(p, (const char __user *)uptr,
+					KSYM_NAME_LEN);
+		if (len < 0) {
+			err = len;
+			goto out;
+		}
+		if (len == KSYM_NAME_LEN) {
+			err = -E2BIG;
+			goto out;
+		}
+		args.syms[i] = p;
+	}
+
+	sort(args.syms, cnt, sizeof(*args.syms), symbols_cmp, NULL);
+	kallsyms_on_each_symbol(kprobe_multi_syms_cb, &args);
+
+	/* missing or duplicated names */
+	err = args.found == cnt ? 0 : -ENOENT;
+out:
+	kvfree(buf);
+	kvfree(args.syms);
+	return err;
+}
+
+int bpf_kprobe_multi_link_attach(const union bpf_attr *attr, struct bpf_prog *prog)
+{
+	struct bpf_kprobe_multi_link *link = NULL;
+	struct bpf_link_primer link_primer;
+	void __user *uaddrs, *usyms;
+	unsigned long *addrs;
+	u32 cnt;
+	int err;
+
+	/* no support for 32bit archs yet */
+	if (sizeof(u64) != sizeof(void *))
+		return -EOPNOTSUPP;
+
+	if (prog->expected_attach_type != BPF_TRACE_KPROBE_MULTI)
+		return -EINVAL;
+
+	/* bpf_override_return() only works on individual kprobes */
+	if (prog->kprobe_override)
+		return -EINVAL;
+
+	if (attr->link_create.kprobe_multi.flags)
+		return -EINVAL;
+
+	uaddrs = u64_to_user_ptr(attr->link_create.kprobe_multi.addrs);
+	usyms = u64_to_user_ptr(attr->link_create.kprobe_multi.syms);
+	if (!!uaddrs == !!usyms)
+		return -EINVAL;
+
+	cnt = attr->link_create.kprobe_multi.cnt;
+	if (!cnt)
+		return -EINVAL;
+	if (cnt > MAX_KPROBE_MULTI_CNT)
+		return -E2BIG;
+
+	addrs = kvcalloc(cnt, sizeof(*addrs), GFP_KERNEL);
+	if (!addrs)
+		return -ENOMEM;
+
+	if (uaddrs) {
+		if (copy_from_user(addrs, uaddrs, cnt * sizeof(*addrs))) {
+			err = -EFAULT;
+			goto error;
+		}
+	} else {
+		err = kprobe_multi_resolve_syms(usyms, cnt, addrs);
+		if (err)
+			goto error;
+	}
+
+	link = kzalloc(sizeof(*link), GFP_KERNEL);
+	if (!link) {
+		err = -ENOMEM;
+		goto error;
+	}
+
+	bpf_link_init(&link->link, BPF_LINK_TYPE_KPROBE_MULTI,
+		      &bpf_kprobe_multi_link_lops, prog);
+
+	err = bpf_link_prime(&link->link, &link_primer);
+	if (err)
+		goto error;
+
+	link->fp.entry_handler = kprobe_multi_link_handler;
+	link->addrs = addrs;
+	link->cnt = cnt;
+
+	/* one filter update and one code update for all functions */
+	err = register_fprobe_ips(&link->fp, addrs, cnt);
+	if (err) {
+		bpf_link_cleanup(&link_primer);
+		return err;
+	}
+
+	return bpf_link_settle(&link_primer);
+
+error:
+	kfree(link);
+	kvfree(addrs);
+	return err;
+}
+#else /* !CONFIG_FPROBE */
+int bpf_kprobe_multi_link_attach(const union bpf_attr *attr, struct bpf_prog *prog)
+{
+	return -EOPNOTSUPP;
+}
+#endif
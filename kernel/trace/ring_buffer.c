@@ -323,6 +323,7 @@ struct buffer_page {
 	unsigned	 read;		/* index for next read */
 	local_t		 entries;	/* entries on this page */
 	unsigned long	 real_end;	/* real end of data */
+	unsigned	 order;		/* order of the data page */
 	struct buffer_data_page *page;	/* Actual data page */
 };
 
@@ -352,10 +353,33 @@ static void rb_init_page(struct buffer_data_page *bpage)
  */
 static void free_buffer_page(struct buffer_page *bpage)
 {
-	free_page((unsigned long)bpage->page);
+	free_pages((unsigned long)bpage->page, bpage->order);
 	kfree(bpage);
 }
 
+/*
+ * Sub buffers are allocated as compound pages, so that the order of a
+ * page handed out by ring_buffer_alloc_read_page() can be recovered
+ * even after the sub buffer size of the ring buffer has changed.
+ */
+static struct buffer_data_page *rb_alloc_subbuf(int node, gfp_t gfp,
+						unsigned int order)
+{
+	struct page *page;
+
+	if (order)
+		gfp |= __GFP_COMP;
+	page = alloc_pages_node(node, gfp, order);
+	if (!page)
+		return NULL;
+	return page_address(page);
+}
+
+static unsigned int rb_subbuf_order(void *data)
+{
+	return compound_order(virt_to_head_page(data));
+}
+
 /*
  * We need to fit the time_stamp delta into 27 bits.
  */
@@ -366,40 +390,21 @@ static inline int test_time_stamp(u64 delta)
 	return 0;
 }
 
-#define BUF_PAGE_SIZE (PAGE_SIZE - BUF_PAGE_HDR_SIZE)
-
-/* Max payload is BUF_PAGE_SIZE - header (8bytes) */
-#define BUF_MAX_DATA_SIZE (BUF_PAGE_SIZE - (sizeof(u32) * 2))
-
-int ring_buffer_print_page_header(struct trace_seq *s)
-{
-	struct buffer_data_page field;
-
-	trace_seq_printf(s, "\tfield: u64 timestamp;\t"
-			 "offset:0;\tsize:%u;\tsigned:%u;\n",
-			 (unsigned int)sizeof(field.time_stamp),
-			 (unsigned int)is_signed_type(u64));
-
-	trace_seq_printf(s, "\tfield: local_t commit;\t"
-			 "offset:%u;\tsize:%u;\tsigned:%u;\n",
-			 (unsigned int)offsetof(typeof(field), commit),
-			 (unsigned int)sizeof(field.commit),
-			 (unsigned int)is_signed_type(long));
+/* Size of the data area of a sub buffer of the given order */
+#define BUF_SUBBUF_SIZE(order) ((PAGE_SIZE << (order)) - BUF_PAGE_HDR_SIZE)
 
-	trace_seq_printf(s, "\tfield: int overwrite;\t"
-			 "offset:%u;\tsize:%u;\tsigned:%u;\n",
-			 (unsigned int)offsetof(typeof(field), commit),
-			 1,
-			 (unsigned int)is_signed_type(long));
-
-	trace_seq_printf(s, "\tfield: char data;\t"
-			 "offset:%u;\tsize:%u;\tsigned:%u;\n",
-			 (unsigned int)offsetof(typeof(field), data),
-			 (unsigned int)BUF_PAGE_SIZE,
-			 (unsigned int)is_signed_type(char));
+/*
+ * The write index of a sub buffer is only 20 bits wide, and nested writers
+ * may each push it past the end of the sub buffer before noticing. Keep the
+ * sub buffer to half of the index range and cap the payload so that even
+ * fully nested reservations cannot wrap it.
+ */
+#define RB_SUBBUF_ORDER_MAX	(ilog2((RB_WRITE_MASK + 1) / 2 / PAGE_SIZE))
+#define RB_MAX_DATA_LIMIT	((RB_WRITE_MASK + 1) / 16)
 
-	return !trace_seq_has_overflowed(s);
-}
+/* Max payload is the sub buffer data size - header (8bytes) */
+#define BUF_MAX_DATA_SIZE(size)						\
+	min_t(unsigned int, (size) - (sizeof(u32) * 2), RB_MAX_DATA_LIMIT)
 
 struct rb_irq_work {
 	struct irq_work			work;
@@ -544,6 +549,10 @@ struct trace_buffer {
 
 	struct rb_irq_work		irq_work;
 	bool				time_stamp_abs;
+
+	unsigned int			subbuf_order;	/* protected by @mutex */
+	unsigned int			subbuf_size;	/* data bytes per sub buffer */
+	unsigned int			max_data_size;	/* largest event payload */
 };
 
 struct ring_buffer_iter {
@@ -559,6 +568,37 @@ struct ring_buffer_iter {
 	int				missed_events;
 };
 
+int ring_buffer_print_page_header(struct trace_buffer *buffer,
+				  struct trace_seq *s)
+{
+	struct buffer_data_page field;
+
+	trace_seq_printf(s, "\tfield: u64 timestamp;\t"
+			 "offset:0;\tsize:%u;\tsigned:%u;\n",
+			 (unsigned int)sizeof(field.time_stamp),
+			 (unsigned int)is_signed_type(u64));
+
+	trace_seq_printf(s, "\tfield: local_t commit;\t"
+			 "offset:%u;\tsize:%u;\tsigned:%u;\n",
+			 (unsigned int)offsetof(typeof(field), commit),
+			 (unsigned int)sizeof(field.commit),
+			 (unsigned int)is_signed_type(long));
+
+	trace_seq_printf(s, "\tfield: int overwrite;\t"
+			 "offset:%u;\tsize:%u;\tsigned:%u;\n",
+			 (unsigned int)offsetof(typeof(field), commit),
+			 1,
+			 (unsigned int)is_signed_type(long));
+
+	trace_seq_printf(s, "\tfield: char data;\t"
+			 "offset:%u;\tsize:%u;\tsigned:%u;\n",
+			 (unsigned int)offsetof(typeof(field), data),
+			 (unsigned int)buffer->subbuf_size,
+			 (unsigned int)is_signed_type(char));
+
+	return !trace_seq_has_overflowed(s);
+}
+
 #ifdef RB_TIME_32
 
 /*
@@ -1516,7 +1556,7 @@ static int rb_check_pages(struct ring_buffer_per_cpu *cpu_buffer)
 }
 
 static int __rb_allocate_pages(struct ring_buffer_per_cpu *cpu_buffer,
-		long nr_pages, struct list_head *pages)
+		long nr_pages, unsigned int order, struct list_head *pages)
 {
 	struct buffer_page *bpage, *tmp;
 	bool user_thread = current->mm != NULL;
@@ -1531,7 +1571,7 @@ static int __rb_allocate_pages(struct ring_buffer_per_cpu *cpu_buffer,
 	 * not going to succeed.
 	 */
 	i = si_mem_available();
-	if (i < nr_pages)
+	if (i < (nr_pages << order))
 		return -ENOMEM;
 
 	/*
@@ -1553,8 +1593,6 @@ static int __rb_allocate_pages(struct ring_buffer_per_cpu *cpu_buffer,
 	if (user_thread)
 		set_current_oom_origin();
 	for (i = 0; i < nr_pages; i++) {
-		struct page *page;
-
 		bpage = kzalloc_node(ALIGN(sizeof(*bpage), cache_line_size()),
 				    mflags, cpu_to_node(cpu_buffer->cpu));
 		if (!bpage)
@@ -1564,10 +1602,11 @@ static int __rb_allocate_pages(struct ring_buffer_per_cpu *cpu_buffer,
 
 		list_add(&bpage->list, pages);
 
-		page = alloc_pages_node(cpu_to_node(cpu_buffer->cpu), mflags, 0);
-		if (!page)
+		bpage->order = order;
+		bpage->page = rb_alloc_subbuf(cpu_to_node(cpu_buffer->cpu),
+					      mflags, order);
+		if (!bpage->page)
 			goto free_pages;
-		bpage->page = page_address(page);
 		rb_init_page(bpage->page);
 
 		if (user_thread && fatal_signal_pending(current))
@@ -1596,7 +1635,8 @@ static int rb_allocate_pages(struct ring_buffer_per_cpu *cpu_buffer,
 
 	WARN_ON(!nr_pages);
 
-	if (__rb_allocate_pages(cpu_buffer, nr_pages, &pages))
+	if (__rb_allocate_pages(cpu_buffer, nr_pages,
+				cpu_buffer->buffer->subbuf_order, &pages))
 		return -ENOMEM;
 
 	/*
@@ -1619,7 +1659,6 @@ rb_allocate_cpu_buffer(struct trace_buffer *buffer, long nr_pages, int cpu)
 {
 	struct ring_buffer_per_cpu *cpu_buffer;
 	struct buffer_page *bpage;
-	struct page *page;
 	int ret;
 
 	cpu_buffer = kzalloc_node(ALIGN(sizeof(*cpu_buffer), cache_line_size()),
@@ -1646,10 +1685,10 @@ rb_allocate_cpu_buffer(struct trace_buffer *buffer, long nr_pages, int cpu)
 	rb_check_bpage(cpu_buffer, bpage);
 
 	cpu_buffer->reader_page = bpage;
-	page = alloc_pages_node(cpu_to_node(cpu), GFP_KERNEL, 0);
-	if (!page)
+	bpage->order = buffer->subbuf_order;
+	bpage->page = rb_alloc_subbuf(cpu_to_node(cpu), GFP_KERNEL, bpage->order);
+	if (!bpage->page)
 		goto fail_free_reader;
-	bpage->page = page_address(page);
 	rb_init_page(bpage->page);
 
 	INIT_LIST_HEAD(&cpu_buffer->reader_page->list);
@@ -1725,7 +1764,11 @@ struct trace_buffer *__ring_buffer_alloc(unsigned long size, unsigned flags,
 	if (!zalloc_cpumask_var(&buffer->cpumask, GFP_KERNEL))
 		goto fail_free_buffer;
 
-	nr_pages = DIV_ROUND_UP(size, BUF_PAGE_SIZE);
+	buffer->subbuf_order = 0;
+	buffer->subbuf_size = BUF_SUBBUF_SIZE(0);
+	buffer->max_data_size = BUF_MAX_DATA_SIZE(buffer->subbuf_size);
+
+	nr_pages = DIV_ROUND_UP(size, buffer->subbuf_size);
 	buffer->flags = flags;
 	buffer->clock = trace_clock_local;
 	buffer->reader_lock_key = key;
@@ -1919,7 +1962,8 @@ rb_remove_pages(struct ring_buffer_per_cpu *cpu_buffer, unsigned long nr_pages)
 			 * Increment overrun to account for the lost events.
 			 */
 			local_add(page_entries, &cpu_buffer->overrun);
-			local_sub(BUF_PAGE_SIZE, &cpu_buffer->entries_bytes);
+			local_sub(cpu_buffer->buffer->subbuf_size,
+				  &cpu_buffer->entries_bytes);
 		}
 
 		/*
@@ -2041,7 +2085,7 @@ static void update_pages_handler(struct work_struct *work)
  * @size: the new size.
  * @cpu_id: the cpu buffer to resize
  *
- * Minimum size is 2 * BUF_PAGE_SIZE.
+ * Minimum size is 2 sub buffers.
  *
  * Returns 0 on success and < 0 on failure.
  */
@@ -2063,7 +2107,7 @@ int ring_buffer_resize(struct trace_buffer *buffer, unsigned long size,
 	    !cpumask_test_cpu(cpu_id, buffer->cpumask))
 		return 0;
 
-	nr_pages = DIV_ROUND_UP(size, BUF_PAGE_SIZE);
+	nr_pages = DIV_ROUND_UP(size, buffer->subbuf_size);
 
 	/* we need a minimum of two pages */
 	if (nr_pages < 2)
@@ -2104,6 +2148,7 @@ int ring_buffer_resize(struct trace_buffer *buffer, unsigned long size,
 			 */
 			INIT_LIST_HEAD(&cpu_buffer->new_pages);
 			if (__rb_allocate_pages(cpu_buffer, cpu_buffer->nr_pages_to_update,
+						buffer->subbuf_order,
 						&cpu_buffer->new_pages)) {
 				/* not enough memory for new pages */
 				err = -ENOMEM;
@@ -2166,6 +2211,7 @@ int ring_buffer_resize(struct trace_buffer *buffer, unsigned long size,
 		INIT_LIST_HEAD(&cpu_buffer->new_pages);
 		if (cpu_buffer->nr_pages_to_update > 0 &&
 			__rb_allocate_pages(cpu_buffer, cpu_buffer->nr_pages_to_update,
+					    buffer->subbuf_order,
 					    &cpu_buffer->new_pages)) {
 			err = -ENOMEM;
 			goto out_err;
@@ -2290,7 +2336,8 @@ rb_iter_head_event(struct ring_buffer_iter *iter)
 	 */
 	barrier();
 
-	if ((iter->head + length) > commit || length > BUF_MAX_DATA_SIZE)
+	if ((iter->head + length) > commit ||
+	    length > iter->cpu_buffer->buffer->max_data_size)
 		/* Writer corrupted the read? */
 		goto reset;
 
@@ -2330,11 +2377,15 @@ rb_commit_index(struct ring_buffer_per_cpu *cpu_buffer)
 }
 
 static __always_inline unsigned
-rb_event_index(struct ring_buffer_event *event)
+rb_event_index(struct ring_buffer_per_cpu *cpu_buffer,
+	       struct ring_buffer_event *event)
 {
 	unsigned long addr = (unsigned long)event;
 
-	return (addr & ~PAGE_MASK) - BUF_PAGE_HDR_SIZE;
+	/* Sub buffers are naturally aligned to their size */
+	addr &= (PAGE_SIZE << cpu_buffer->buffer->subbuf_order) - 1;
+
+	return addr - BUF_PAGE_HDR_SIZE;
 }
 
 static void rb_inc_iter(struct ring_buffer_iter *iter)
@@ -2403,7 +2454,8 @@ rb_handle_head_page(struct ring_buffer_per_cpu *cpu_buffer,
 		 * the counters.
 		 */
 		local_add(entries, &cpu_buffer->overrun);
-		local_sub(BUF_PAGE_SIZE, &cpu_buffer->entries_bytes);
+		local_sub(cpu_buffer->buffer->subbuf_size,
+			  &cpu_buffer->entries_bytes);
 
 		/*
 		 * The entries will be zeroed out when we move the
@@ -2522,6 +2574,7 @@ static inline void
 rb_reset_tail(struct ring_buffer_per_cpu *cpu_buffer,
 	      unsigned long tail, struct rb_event_info *info)
 {
+	unsigned long subbuf_size = cpu_buffer->buffer->subbuf_size;
 	struct buffer_page *tail_page = info->tail_page;
 	struct ring_buffer_event *event;
 	unsigned long length = info->length;
@@ -2530,13 +2583,13 @@ rb_reset_tail(struct ring_buffer_per_cpu *cpu_buffer,
 	 * Only the event that crossed the page boundary
 	 * must fill the old tail_page with padding.
 	 */
-	if (tail >= BUF_PAGE_SIZE) {
+	if (tail >= subbuf_size) {
 		/*
 		 * If the page was filled, then we still need
 		 * to update the real_end. Reset it to zero
 		 * and the reader will ignore it.
 		 */
-		if (tail == BUF_PAGE_SIZE)
+		if (tail == subbuf_size)
 			tail_page->real_end = 0;
 
 		local_sub(length, &tail_page->write);
@@ -2546,7 +2599,7 @@ rb_reset_tail(struct ring_buffer_per_cpu *cpu_buffer,
 	event = __rb_page_index(tail_page, tail);
 
 	/* account for padding bytes */
-	local_add(BUF_PAGE_SIZE - tail, &cpu_buffer->entries_bytes);
+	local_add(subbuf_size - tail, &cpu_buffer->entries_bytes);
 
 	/*
 	 * Save the original length to the meta data.
@@ -2566,7 +2619,7 @@ rb_reset_tail(struct ring_buffer_per_cpu *cpu_buffer,
 	 * If we are less than the minimum size, we don't need to
 	 * worry about it.
 	 */
-	if (tail > (BUF_PAGE_SIZE - RB_EVNT_MIN_SIZE)) {
+	if (tail > (subbuf_size - RB_EVNT_MIN_SIZE)) {
 		/* No room for any events */
 
 		/* Mark the rest of the page with padding */
@@ -2578,13 +2631,13 @@ rb_reset_tail(struct ring_buffer_per_cpu *cpu_buffer,
 	}
 
 	/* Put in a discarded event */
-	event->array[0] = (BUF_PAGE_SIZE - tail) - RB_EVNT_HDR_SIZE;
+	event->array[0] = (subbuf_size - tail) - RB_EVNT_HDR_SIZE;
 	event->type_len = RINGBUF_TYPE_PADDING;
 	/* time delta must be non zero */
 	event->time_delta = 1;
 
 	/* Set write to end of buffer */
-	length = (tail + length) - BUF_PAGE_SIZE;
+	length = (tail + length) - subbuf_size;
 	local_sub(length, &tail_page->write);
 }
 
@@ -2698,7 +2751,8 @@ rb_move_tail(struct ring_buffer_per_cpu *cpu_buffer,
 
 /* Slow path */
 static struct ring_buffer_event *
-rb_add_time_stamp(struct ring_buffer_event *event, u64 delta, bool abs)
+rb_add_time_stamp(struct ring_buffer_per_cpu *cpu_buffer,
+		  struct ring_buffer_event *event, u64 delta, bool abs)
 {
 	if (abs)
 		event->type_len = RINGBUF_TYPE_TIME_STAMP;
@@ -2706,7 +2760,7 @@ rb_add_time_stamp(struct ring_buffer_event *event, u64 delta, bool abs)
 		event->type_len = RINGBUF_TYPE_TIME_EXTEND;
 
 	/* Not the first event on the page, or not delta? */
-	if (abs || rb_event_index(event)) {
+	if (abs || rb_event_index(cpu_buffer, event)) {
 		event->time_delta = delta & TS_MASK;
 		event->array[0] = delta >> TS_SHIFT;
 	} else {
@@ -2773,7 +2827,7 @@ static void rb_add_timestamp(struct ring_buffer_per_cpu *cpu_buffer,
 		if (!abs)
 			info->delta = 0;
 	}
-	*event = rb_add_time_stamp(*event, info->delta, abs);
+	*event = rb_add_time_stamp(cpu_buffer, *event, info->delta, abs);
 	*length -= RB_LEN_TIME_EXTEND;
 	*delta = 0;
 }
@@ -2879,10 +2933,10 @@ rb_try_to_discard(struct ring_buffer_per_cpu *cpu_buffer,
 	u64 write_stamp;
 	u64 delta;
 
-	new_index = rb_event_index(event);
+	new_index = rb_event_index(cpu_buffer, event);
 	old_index = new_index + rb_event_ts_length(event);
 	addr = (unsigned long)event;
-	addr &= PAGE_MASK;
+	addr &= ~((PAGE_SIZE << cpu_buffer->buffer->subbuf_order) - 1);
 
 	bpage = READ_ONCE(cpu_buffer->tail_page);
 
@@ -3481,7 +3535,7 @@ __rb_reserve_next(struct ring_buffer_per_cpu *cpu_buffer,
 	tail = write - info->length;
 
 	/* See if we shot pass the end of this buffer page */
-	if (unlikely(write > BUF_PAGE_SIZE)) {
+	if (unlikely(write > cpu_buffer->buffer->subbuf_size)) {
 		/* before and after may now different, fix it up*/
 		b_ok = rb_time_read(&cpu_buffer->before_stamp, &info->before);
 		a_ok = rb_time_read(&cpu_buffer->write_stamp, &info->after);
@@ -3690,7 +3744,7 @@ ring_buffer_lock_reserve(struct trace_buffer *buffer, unsigned long length)
 	if (unlikely(atomic_read(&cpu_buffer->record_disabled)))
 		goto out;
 
-	if (unlikely(length > BUF_MAX_DATA_SIZE))
+	if (unlikely(length > buffer->max_data_size))
 		goto out;
 
 	if (unlikely(trace_recursive_lock(cpu_buffer)))
@@ -3724,7 +3778,7 @@ rb_decrement_entry(struct ring_buffer_per_cpu *cpu_buffer,
 	struct buffer_page *bpage = cpu_buffer->commit_page;
 	struct buffer_page *start;
 
-	addr &= PAGE_MASK;
+	addr &= ~((PAGE_SIZE << cpu_buffer->buffer->subbuf_order) - 1);
 
 	/* Do the likely case first */
 	if (likely(bpage->page == (void *)addr)) {
@@ -3840,7 +3894,7 @@ int ring_buffer_write(struct trace_buffer *buffer,
 	if (atomic_read(&cpu_buffer->record_disabled))
 		goto out;
 
-	if (length > BUF_MAX_DATA_SIZE)
+	if (length > buffer->max_data_size)
 		goto out;
 
 	if (unlikely(trace_recursive_lock(cpu_buffer)))
@@ -4942,7 +4996,7 @@ ring_buffer_read_prepare(struct trace_buffer *buffer, int cpu, gfp_t flags)
 	if (!iter)
 		return NULL;
 
-	iter->event = kmalloc(BUF_MAX_DATA_SIZE, flags);
+	iter->event = kmalloc(buffer->max_data_size, flags);
 	if (!iter->event) {
 		kfree(iter);
 		return NULL;
@@ -5060,14 +5114,14 @@ unsigned long ring_buffer_size(struct trace_buffer *buffer, int cpu)
 {
 	/*
 	 * Earlier, this method returned
-	 *	BUF_PAGE_SIZE * buffer->nr_pages
+	 *	sub buffer size * buffer->nr_pages
 	 * Since the nr_pages field is now removed, we have converted this to
 	 * return the per cpu buffer value.
 	 */
 	if (!cpumask_test_cpu(cpu, buffer->cpumask))
 		return 0;
 
-	return BUF_PAGE_SIZE * buffer->buffers[cpu]->nr_pages;
+	return buffer->subbuf_size * buffer->buffers[cpu]->nr_pages;
 }
 EXPORT_SYMBOL_GPL(ring_buffer_size);
 
@@ -5319,6 +5373,9 @@ int ring_buffer_swap_cpu(struct trace_buffer *buffer_a,
 	if (cpu_buffer_a->nr_pages != cpu_buffer_b->nr_pages)
 		goto out;
 
+	if (buffer_a->subbuf_order != buffer_b->subbuf_order)
+		goto out;
+
 	ret = -EAGAIN;
 
 	if (atomic_read(&buffer_a->record_disabled))
@@ -5386,7 +5443,6 @@ void *ring_buffer_alloc_read_page(struct trace_buffer *buffer, int cpu)
 	struct ring_buffer_per_cpu *cpu_buffer;
 	struct buffer_data_page *bpage = NULL;
 	unsigned long flags;
-	struct page *page;
 
 	if (!cpumask_test_cpu(cpu, buffer->cpumask))
 		return ERR_PTR(-ENODEV);
@@ -5406,13 +5462,11 @@ void *ring_buffer_alloc_read_page(struct trace_buffer *buffer, int cpu)
 	if (bpage)
 		goto out;
 
-	page = alloc_pages_node(cpu_to_node(cpu),
-				GFP_KERNEL | __GFP_NORETRY, 0);
-	if (!page)
+	bpage = rb_alloc_subbuf(cpu_to_node(cpu), GFP_KERNEL | __GFP_NORETRY,
+				READ_ONCE(buffer->subbuf_order));
+	if (!bpage)
 		return ERR_PTR(-ENOMEM);
 
-	bpage = page_address(page);
-
  out:
 	rb_init_page(bpage);
 
@@ -5433,6 +5487,7 @@ void ring_buffer_free_read_page(struct trace_buffer *buffer, int cpu, void *data
 	struct ring_buffer_per_cpu *cpu_buffer = buffer->buffers[cpu];
 	struct buffer_data_page *bpage = data;
 	struct page *page = virt_to_page(bpage);
+	unsigned int order = rb_subbuf_order(bpage);
 	unsigned long flags;
 
 	/* If the page is still in use someplace else, we can't reuse it */
@@ -5442,7 +5497,8 @@ void ring_buffer_free_read_page(struct trace_buffer *buffer, int cpu, void *data
 	local_irq_save(flags);
 	arch_spin_lock(&cpu_buffer->lock);
 
-	if (!cpu_buffer->free_page) {
+	/* Only cache sub buffers that still match the buffer's size */
+	if (!cpu_buffer->free_page && order == buffer->subbuf_order) {
 		cpu_buffer->free_page = bpage;
 		bpage = NULL;
 	}
@@ -5451,7 +5507,8 @@ void ring_buffer_free_read_page(struct trace_buffer *buffer, int cpu, void *data
 	local_irq_restore(flags);
 
  out:
-	free_page((unsigned long)bpage);
+	if (bpage)
+		__free_pages(page, order);
 }
 EXPORT_SYMBOL_GPL(ring_buffer_free_read_page);
 
@@ -5459,7 +5516,7 @@ EXPORT_SYMBOL_GPL(ring_buffer_free_read_page);
  * ring_buffer_read_page - extract a page from the ring buffer
  * @buffer: buffer to extract from
  * @data_page: the page to use allocated from ring_buffer_alloc_read_page
- * @len: amount to extract
+ * @len: amount to extract, at most ring_buffer_subbuf_size_get()
  * @cpu: the cpu of the buffer to extract
  * @full: should the extraction only happen when the page is full.
  *
@@ -5486,6 +5543,7 @@ EXPORT_SYMBOL_GPL(ring_buffer_free_read_page);
  *
  * Returns:
  *  >=0 if data has been transferred, returns the offset of consumed data.
+ *  -EINVAL if @data_page was allocated for a different sub buffer size.
  *  <0 if no data has been transferred.
  */
 int ring_buffer_read_page(struct trace_buffer *buffer,
@@ -5496,6 +5554,7 @@ int ring_buffer_read_page(struct trace_buffer *buffer,
 	struct buffer_data_page *bpage;
 	struct buffer_page *reader;
 	unsigned long missed_events;
+	unsigned int subbuf_size;
 	unsigned long flags;
 	unsigned int commit;
 	unsigned int read;
@@ -5523,6 +5582,19 @@ int ring_buffer_read_page(struct trace_buffer *buffer,
 
 	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
 
+	/*
+	 * The sub buffer size may have changed since @data_page was
+	 * allocated; it can neither be swapped in nor hold a full page.
+	 */
+	if (rb_subbuf_order(bpage) != buffer->subbuf_order) {
+		ret = -EINVAL;
+		goto out_unlock;
+	}
+
+	subbuf_size = buffer->subbuf_size;
+	if (len > subbuf_size)
+		len = subbuf_size;
+
 	reader = rb_get_reader_page(cpu_buffer);
 	if (!reader)
 		goto out_unlock;
@@ -5598,7 +5670,7 @@ int ring_buffer_read_page(struct trace_buffer *buffer,
 	} else {
 		/* update the entry counter */
 		cpu_buffer->read += rb_page_entries(reader);
-		cpu_buffer->read_bytes += BUF_PAGE_SIZE;
+		cpu_buffer->read_bytes += subbuf_size;
 
 		/* swap the pages */
 		rb_init_page(bpage);
@@ -5629,7 +5701,7 @@ int ring_buffer_read_page(struct trace_buffer *buffer,
 		/* If there is room at the end of the page to save the
 		 * missed events, then record it there.
 		 */
-		if (BUF_PAGE_SIZE - commit >= sizeof(missed_events)) {
+		if (subbuf_size - commit >= sizeof(missed_events)) {
 			memcpy(&bpage->data[commit], &missed_events,
 			       sizeof(missed_events));
 			local_add(RB_MISSED_STORED, &bpage->commit);
@@ -5641,8 +5713,8 @@ int ring_buffer_read_page(struct trace_buffer *buffer,
 	/*
 	 * This page may be off to user land. Zero it out here.
 	 */
-	if (commit < BUF_PAGE_SIZE)
-		memset(&bpage->data[commit], 0, BUF_PAGE_SIZE - commit);
+	if (commit < subbuf_size)
+		memset(&bpage->data[commit], 0, subbuf_size - commit);
 
  out_unlock:
 	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
@@ -5652,6 +5724,169 @@ int ring_buffer_read_page(struct trace_buffer *buffer,
 }
 EXPORT_SYMBOL_GPL(ring_buffer_read_page);
 
+/**
+ * ring_buffer_subbuf_size_get - get the size of a sub buffer
+ * @buffer: The ring buffer to query
+ *
+ * Returns the size in bytes of a sub buffer including its header, which is
+ * the amount of data ring_buffer_read_page() can return at once.
+ */
+int ring_buffer_subbuf_size_get(struct trace_buffer *buffer)
+{
+	return PAGE_SIZE << READ_ONCE(buffer->subbuf_order);
+}
+EXPORT_SYMBOL_GPL(ring_buffer_subbuf_size_get);
+
+/**
+ * ring_buffer_subbuf_order_get - get the page order of the sub buffers
+ * @buffer: The ring buffer to query
+ */
+int ring_buffer_subbuf_order_get(struct trace_buffer *buffer)
+{
+	if (!buffer)
+		return -EINVAL;
+
+	return READ_ONCE(buffer->subbuf_order);
+}
+EXPORT_SYMBOL_GPL(ring_buffer_subbuf_order_get);
+
+/**
+ * ring_buffer_subbuf_order_set - set the page order of the sub buffers
+ * @buffer: The ring buffer to change
+ * @order: The page order of a sub buffer
+ *
+ * Larger sub buffers hold larger events and mean fewer page swaps and
+ * reader wake ups at high event rates. The total size of each per CPU
+ * buffer is kept (rounded up to whole sub buffers), but all data in the
+ * ring buffer is discarded.
+ *
+ * Returns 0 on success, -EBUSY if the buffer is being read through an
+ * iterator or being resized, and -ENOMEM if the new sub buffers could not
+ * be allocated, in which case the buffer is left untouched.
+ */
+int ring_buffer_subbuf_order_set(struct trace_buffer *buffer, int order)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+	struct buffer_page *bpage, *tmp;
+	unsigned int old_order, new_size;
+	unsigned long nr_pages;
+	int cpu, err = 0;
+
+	if (!buffer || order < 0 || order > RB_SUBBUF_ORDER_MAX)
+		return -EINVAL;
+
+	/* prevent another thread from changing buffer sizes */
+	mutex_lock(&buffer->mutex);
+
+	if (buffer->subbuf_order == order)
+		goto out_unlock;
+
+	for_each_buffer_cpu(buffer, cpu) {
+		cpu_buffer = buffer->buffers[cpu];
+		if (atomic_read(&cpu_buffer->resize_disabled)) {
+			err = -EBUSY;
+			goto out_unlock;
+		}
+	}
+
+	old_order = buffer->subbuf_order;
+	new_size = BUF_SUBBUF_SIZE(order);
+
+	/* Allocate everything before touching any of the CPU buffers */
+	for_each_buffer_cpu(buffer, cpu) {
+		cpu_buffer = buffer->buffers[cpu];
+
+		nr_pages = DIV_ROUND_UP((unsigned long)buffer->subbuf_size *
+					cpu_buffer->nr_pages, new_size);
+		/* we need a minimum of two pages */
+		if (nr_pages < 2)
+			nr_pages = 2;
+		cpu_buffer->nr_pages_to_update = nr_pages;
+
+		/* One more for the reader page */
+		INIT_LIST_HEAD(&cpu_buffer->new_pages);
+		if (__rb_allocate_pages(cpu_buffer, nr_pages + 1, order,
+					&cpu_buffer->new_pages)) {
+			err = -ENOMEM;
+			goto out_err;
+		}
+	}
+
+	atomic_inc(&buffer->record_disabled);
+
+	/* Make sure all commits have finished */
+	synchronize_rcu();
+
+	buffer->subbuf_order = order;
+	buffer->subbuf_size = new_size;
+	buffer->max_data_size = BUF_MAX_DATA_SIZE(new_size);
+
+	for_each_buffer_cpu(buffer, cpu) {
+		struct buffer_data_page *old_free_page;
+		unsigned long flags;
+		LIST_HEAD(old_pages);
+
+		cpu_buffer = buffer->buffers[cpu];
+
+		raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+		arch_spin_lock(&cpu_buffer->lock);
+
+		/* Collect the old sub buffers, including the reader page */
+		rb_head_page_deactivate(cpu_buffer);
+		list_add(&old_pages, cpu_buffer->pages);
+		list_add(&cpu_buffer->reader_page->list, &old_pages);
+
+		cpu_buffer->reader_page = list_first_entry(&cpu_buffer->new_pages,
+							   struct buffer_page, list);
+		list_del_init(&cpu_buffer->reader_page->list);
+
+		cpu_buffer->pages = cpu_buffer->new_pages.next;
+		list_del_init(&cpu_buffer->new_pages);
+
+		cpu_buffer->nr_pages = cpu_buffer->nr_pages_to_update;
+		cpu_buffer->nr_pages_to_update = 0;
+
+		old_free_page = cpu_buffer->free_page;
+		cpu_buffer->free_page = NULL;
+
+		/* Start over on the new pages; this also reactivates the head */
+		rb_reset_cpu(cpu_buffer);
+
+		arch_spin_unlock(&cpu_buffer->lock);
+		raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+
+		list_for_each_entry_safe(bpage, tmp, &old_pages, list) {
+			list_del_init(&bpage->list);
+			free_buffer_page(bpage);
+		}
+		if (old_free_page)
+			free_pages((unsigned long)old_free_page, old_order);
+
+		rb_check_pages(cpu_buffer);
+	}
+
+	atomic_dec(&buffer->record_disabled);
+	mutex_unlock(&buffer->mutex);
+	return 0;
+
+ out_err:
+	for_each_buffer_cpu(buffer, cpu) {
+		cpu_buffer = buffer->buffers[cpu];
+		if (!cpu_buffer->nr_pages_to_update)
+			continue;
+		cpu_buffer->nr_pages_to_update = 0;
+		list_for_each_entry_safe(bpage, tmp, &cpu_buffer->new_pages,
+					 list) {
+			list_del_init(&bpage->list);
+			free_buffer_page(bpage);
+		}
+	}
+ out_unlock:
+	mutex_unlock(&buffer->mutex);
+	return err;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_subbuf_order_set);
+
 /*
  * We only allocate new buffers, never free them if the CPU goes down.
  * If we were to free the buffer, then the user would lose any trace that was in
@@ -5853,6 +6088,61 @@ static __init int rb_hammer_test(void *arg)
 	return 0;
 }
 
+/*
+ * Discard every other event of a sub buffer larger than a page. Events
+ * past the first page of the sub buffer must be found on their buffer
+ * page, otherwise the discard warns and disables the buffer.
+ */
+static __init int rb_test_discard(void)
+{
+	struct ring_buffer_event *event;
+	struct trace_buffer *buffer;
+	unsigned long lost;
+	int committed = 0;
+	int read = 0;
+	int cpu, i;
+	int ret = 0;
+
+	buffer = ring_buffer_alloc(RB_TEST_BUFFER_SIZE, RB_FL_OVERWRITE);
+	if (WARN_ON(!buffer))
+		return -ENOMEM;
+
+	if (WARN_ON(ring_buffer_subbuf_order_set(buffer, 2))) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	cpu = get_cpu();
+	for (i = 0; i < 64; i++) {
+		event = ring_buffer_lock_reserve(buffer, 200);
+		if (!event)
+			break;
+		*(int *)ring_buffer_event_data(event) = i;
+		if (i & 1) {
+			ring_buffer_discard_commit(buffer, event);
+		} else {
+			ring_buffer_unlock_commit(buffer, event);
+			committed++;
+		}
+	}
+	put_cpu();
+
+	while ((event = ring_buffer_consume(buffer, cpu, NULL, &lost))) {
+		if (RB_WARN_ON(buffer, *(int *)ring_buffer_event_data(event) & 1))
+			break;
+		read++;
+	}
+
+	if (!ring_buffer_record_is_on(buffer) || i != 64 || read != committed) {
+		pr_info("Ring buffer discard test FAILED (%d events, %d of %d read)\n",
+			i, read, committed);
+		ret = -1;
+	}
+ out:
+	ring_buffer_free(buffer);
+	return ret;
+}
+
 static __init int test_ringbuffer(void)
 {
 	struct task_struct *rb_hammer;
@@ -5867,6 +6157,9 @@ static __init int test_ringbuffer(void)
 
 	pr_info("Running ring buffer tests...\n");
 
+	if (rb_test_discard())
+		return 0;
+
 	buffer = ring_buffer_alloc(RB_TEST_BUFFER_SIZE, RB_FL_OVERWRITE);
 	if (WARN_ON(!buffer))
 		return 0;
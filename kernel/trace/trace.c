@@ -1207,10 +1207,17 @@ static void set_buffer_entries(struct array_buffer *buf, unsigned long val);
 
 int tracing_alloc_snapshot_instance(struct trace_array *tr)
 {
+	int order;
 	int ret;
 
 	if (!tr->allocated_snapshot) {
 
+		/* The snapshot must use the same sub buffer size to be swapped */
+		order = ring_buffer_subbuf_order_get(tr->array_buffer.buffer);
+		ret = ring_buffer_subbuf_order_set(tr->max_buffer.buffer, order);
+		if (ret < 0)
+			return ret;
+
 		/* allocate spare buffer */
 		ret = resize_buffer_duplicate_size(&tr->max_buffer,
 				   &tr->array_buffer, RING_BUFFER_ALL_CPUS);
@@ -4808,7 +4815,7 @@ static int tracing_release(struct inode *inode, struct file *file)
 	return 0;
 }
 
-static int tracing_release_generic_tr(struct inode *inode, struct file *file)
+int tracing_release_generic_tr(struct inode *inode, struct file *file)
 {
 	struct trace_array *tr = inode->i_private;
 
@@ -5536,7 +5543,7 @@ static const char readme_msg[] =
 	"\t    Format: hist:keys=<field1[,field2,...]>\n"
 	"\t            [:values=<field1[,field2,...]>]\n"
 	"\t            [:sort=<field1[,field2,...]>]\n"
-	"\t            [:size=#entries]\n"
+	"\t            [:size=#entries][:percpu]\n"
 	"\t            [:pause][:continue][:clear]\n"
 	"\t            [:name=histname1]\n"
 	"\t            [:<handler>.<action>]\n"
@@ -5555,7 +5562,10 @@ static const char readme_msg[] =
 	"\t    or fewer than the default 2048 entries for the hashtable size.\n"
 	"\t    If a hist trigger is given a name using the 'name' parameter,\n"
 	"\t    its histogram data will be shared with other triggers of the\n"
-	"\t    same name, and trigger hits will update this common data.\n\n"
+	"\t    same name, and trigger hits will update this common data.\n"
+	"\t    With 'percpu', each CPU updates a private table of 'size'\n"
+	"\t    entries, and the tables are merged when 'hist' is read.\n"
+	"\t    Such triggers can't define variables or actions.\n\n"
 	"\t    Reading the 'hist' file for the event will dump the hash\n"
 	"\t    table in its entirety to stdout.  If there are multiple hist\n"
 	"\t    triggers attached to an event, there will be a table for each\n"
@@ -7259,6 +7269,7 @@ struct ftrace_buffer_info {
 	struct trace_iterator	iter;
 	void			*spare;
 	unsigned int		spare_cpu;
+	unsigned int		spare_size;
 	unsigned int		read;
 };
 
@@ -7849,7 +7860,21 @@ tracing_buffers_read(struct file *filp, char __user *ubuf,
 		return -EBUSY;
 #endif
 
+	/* Do we have previous read data to read? */
+	if (info->spare && info->read < info->spare_size)
+		goto read;
+
+ alloc:
+	/* The sub buffer size may have changed since the spare was allocated */
+	if (info->spare &&
+	    info->spare_size != ring_buffer_subbuf_size_get(iter->array_buffer->buffer)) {
+		ring_buffer_free_read_page(iter->array_buffer->buffer,
+					   info->spare_cpu, info->spare);
+		info->spare = NULL;
+	}
+
 	if (!info->spare) {
+		info->spare_size = ring_buffer_subbuf_size_get(iter->array_buffer->buffer);
 		info->spare = ring_buffer_alloc_read_page(iter->array_buffer->buffer,
 							  iter->cpu_file);
 		if (IS_ERR(info->spare)) {
@@ -7862,10 +7887,6 @@ tracing_buffers_read(struct file *filp, char __user *ubuf,
 	if (!info->spare)
 		return ret;
 
-	/* Do we have previous read data to read? */
-	if (info->read < PAGE_SIZE)
-		goto read;
-
  again:
 	trace_access_lock(iter->cpu_file);
 	ret = ring_buffer_read_page(iter->array_buffer->buffer,
@@ -7874,6 +7895,14 @@ tracing_buffers_read(struct file *filp, char __user *ubuf,
 				    iter->cpu_file, 0);
 	trace_access_unlock(iter->cpu_file);
 
+	/* Raced with a sub buffer size change, retry with a new spare */
+	if (ret == -EINVAL) {
+		ring_buffer_free_read_page(iter->array_buffer->buffer,
+					   info->spare_cpu, info->spare);
+		info->spare = NULL;
+		goto alloc;
+	}
+
 	if (ret < 0) {
 		if (trace_empty(iter)) {
 			if ((filp->f_flags & O_NONBLOCK))
@@ -7890,7 +7919,7 @@ tracing_buffers_read(struct file *filp, char __user *ubuf,
 
 	info->read = 0;
  read:
-	size = PAGE_SIZE - info->read;
+	size = info->spare_size - info->read;
 	if (size > count)
 		size = count;
 
@@ -8001,19 +8030,26 @@ tracing_buffers_splice_read(struct file *file, loff_t *ppos,
 	struct buffer_ref *ref;
 	int entries, i;
 	ssize_t ret = 0;
+	int page_size;
 
 #ifdef CONFIG_TRACER_MAX_TRACE
 	if (iter->snapshot && iter->tr->current_trace->use_max_tr)
 		return -EBUSY;
 #endif
 
-	if (*ppos & (PAGE_SIZE - 1))
+	/*
+	 * Full sub buffers are handed to the pipe as they are, so reads
+	 * must be done in multiples of the sub buffer size.
+	 */
+	page_size = ring_buffer_subbuf_size_get(iter->array_buffer->buffer);
+
+	if (*ppos & (page_size - 1))
 		return -EINVAL;
 
-	if (len & (PAGE_SIZE - 1)) {
-		if (len < PAGE_SIZE)
+	if (len & (page_size - 1)) {
+		if (len < page_size)
 			return -EINVAL;
-		len &= PAGE_MASK;
+		len &= ~((size_t)page_size - 1);
 	}
 
 	if (splice_grow_spd(pipe, &spd))
@@ -8023,7 +8059,7 @@ tracing_buffers_splice_read(struct file *file, loff_t *ppos,
 	trace_access_lock(iter->cpu_file);
 	entries = ring_buffer_entries_cpu(iter->array_buffer->buffer, iter->cpu_file);
 
-	for (i = 0; i < spd.nr_pages_max && len && entries; i++, len -= PAGE_SIZE) {
+	for (i = 0; i < spd.nr_pages_max && len && entries; i++, len -= page_size) {
 		struct page *page;
 		int r;
 
@@ -8045,7 +8081,7 @@ tracing_buffers_splice_read(struct file *file, loff_t *ppos,
 		ref->cpu = iter->cpu_file;
 
 		r = ring_buffer_read_page(ref->buffer, &ref->page,
-					  len, iter->cpu_file, 1);
+					  page_size, iter->cpu_file, 1);
 		if (r < 0) {
 			ring_buffer_free_read_page(ref->buffer, ref->cpu,
 						   ref->page);
@@ -8056,11 +8092,11 @@ tracing_buffers_splice_read(struct file *file, loff_t *ppos,
 		page = virt_to_page(ref->page);
 
 		spd.pages[i] = page;
-		spd.partial[i].len = PAGE_SIZE;
+		spd.partial[i].len = page_size;
 		spd.partial[i].offset = 0;
 		spd.partial[i].private = (unsigned long)ref;
 		spd.nr_pages++;
-		*ppos += PAGE_SIZE;
+		*ppos += page_size;
 
 		entries = ring_buffer_entries_cpu(iter->array_buffer->buffer, iter->cpu_file);
 	}
@@ -8849,6 +8885,81 @@ static const struct file_operations buffer_percent_fops = {
 	.llseek		= default_llseek,
 };
 
+static ssize_t
+buffer_subbuf_size_read(struct file *filp, char __user *ubuf,
+			size_t cnt, loff_t *ppos)
+{
+	struct trace_array *tr = filp->private_data;
+	size_t size;
+	char buf[64];
+	int r;
+
+	size = ring_buffer_subbuf_size_get(tr->array_buffer.buffer);
+	r = sprintf(buf, "%zu\n", size / 1024);
+
+	return simple_read_from_buffer(ubuf, cnt, ppos, buf, r);
+}
+
+static ssize_t
+buffer_subbuf_size_write(struct file *filp, const char __user *ubuf,
+			 size_t cnt, loff_t *ppos)
+{
+	struct trace_array *tr = filp->private_data;
+	unsigned long val;
+	int old_order;
+	int order;
+	int ret;
+
+	ret = kstrtoul_from_user(ubuf, cnt, 10, &val);
+	if (ret)
+		return ret;
+
+	if (!val || val > ULONG_MAX / 1024)
+		return -EINVAL;
+
+	/* Sub buffers are a power of two pages, round up */
+	order = get_order(val * 1024);
+
+	mutex_lock(&trace_types_lock);
+
+	old_order = ring_buffer_subbuf_order_get(tr->array_buffer.buffer);
+	if (old_order == order)
+		goto out;
+
+	ret = ring_buffer_subbuf_order_set(tr->array_buffer.buffer, order);
+	if (ret)
+		goto out;
+
+#ifdef CONFIG_TRACER_MAX_TRACE
+	if (tr->allocated_snapshot) {
+		ret = ring_buffer_subbuf_order_set(tr->max_buffer.buffer, order);
+		if (ret) {
+			/* Keep both buffers swappable */
+			WARN_ON_ONCE(ring_buffer_subbuf_order_set(tr->array_buffer.buffer,
+								  old_order));
+			goto out;
+		}
+	}
+#endif
+ out:
+	mutex_unlock(&trace_types_lock);
+
+	if (ret)
+		return ret;
+
+	(*ppos)++;
+
+	return cnt;
+}
+
+static const struct file_operations buffer_subbuf_size_fops = {
+	.open		= tracing_open_generic_tr,
+	.read		= buffer_subbuf_size_read,
+	.write		= buffer_subbuf_size_write,
+	.release	= tracing_release_generic_tr,
+	.llseek		= default_llseek,
+};
+
 static struct dentry *trace_instance_dir;
 
 static void
@@ -9300,6 +9411,9 @@ init_tracer_tracefs(struct trace_array *tr, struct dentry *d_tracer)
 	trace_create_file("buffer_percent", 0444, d_tracer,
 			tr, &buffer_percent_fops);
 
+	trace_create_file("buffer_subbuf_size_kb", 0644, d_tracer,
+			  tr, &buffer_subbuf_size_fops);
+
 	create_trace_options_dir(tr);
 
 #if defined(CONFIG_TRACER_MAX_TRACE) || defined(CONFIG_HWLAT_TRACER)
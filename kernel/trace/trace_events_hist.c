@@ -65,7 +65,8 @@
 	C(INVALID_SORT_MODIFIER,"Invalid sort modifier"),		\
 	C(EMPTY_SORT_FIELD,	"Empty sort field"),			\
 	C(TOO_MANY_SORT_FIELDS,	"Too many sort fields (Max = 2)"),	\
-	C(INVALID_SORT_FIELD,	"Sort field must be a key or a val"),
+	C(INVALID_SORT_FIELD,	"Sort field must be a key or a val"),	\
+	C(PERCPU_NOT_SHARED,	"Per-CPU hist can't have variables or actions"),
 
 #undef C
 #define C(a, b)		HIST_ERR_##a
@@ -334,6 +335,7 @@ struct hist_trigger_attrs {
 	bool		pause;
 	bool		cont;
 	bool		clear;
+	bool		percpu;
 	bool		ts_in_usecs;
 	unsigned int	map_bits;
 
@@ -1330,6 +1332,8 @@ parse_hist_trigger_attrs(struct trace_array *tr, char *trigger_str)
 			attrs->cont = true;
 		else if (strcmp(str, "clear") == 0)
 			attrs->clear = true;
+		else if (strcmp(str, "percpu") == 0)
+			attrs->percpu = true;
 		else {
 			ret = parse_action(str, attrs);
 			if (ret)
@@ -1447,10 +1451,22 @@ static void hist_trigger_elt_data_init(struct tracing_map_elt *elt)
 		save_comm(elt_data->comm, current);
 }
 
+static void hist_trigger_elt_data_copy(struct tracing_map_elt *to,
+				       struct tracing_map_elt *from)
+{
+	struct hist_elt_data *to_data = to->private_data;
+	struct hist_elt_data *from_data = from->private_data;
+
+	/* Per-CPU hists have no variables, only the comm needs copying */
+	if (to_data->comm && from_data->comm)
+		memcpy(to_data->comm, from_data->comm, TASK_COMM_LEN);
+}
+
 static const struct tracing_map_ops hist_trigger_elt_data_ops = {
 	.elt_alloc	= hist_trigger_elt_data_alloc,
 	.elt_free	= hist_trigger_elt_data_free,
 	.elt_init	= hist_trigger_elt_data_init,
+	.elt_copy	= hist_trigger_elt_data_copy,
 };
 
 static const char *get_hist_field_flags(struct hist_field *hist_field)
@@ -4399,6 +4415,17 @@ create_hist_data(unsigned int map_bits,
 	if (ret)
 		goto free;
 
+	/*
+	 * Elements of a per-CPU hist are private to a CPU, so there is
+	 * nothing variables or actions on other events could refer to.
+	 */
+	if (attrs->percpu &&
+	    (hist_data->n_vars || hist_data->n_var_refs || attrs->n_actions)) {
+		hist_err(file->tr, HIST_ERR_PERCPU_NOT_SHARED, 0);
+		ret = -EINVAL;
+		goto free;
+	}
+
 	map_ops = &hist_trigger_elt_data_ops;
 
 	hist_data->map = tracing_map_create(map_bits, hist_data->key_size,
@@ -4409,6 +4436,12 @@ create_hist_data(unsigned int map_bits,
 		goto free;
 	}
 
+	if (attrs->percpu) {
+		ret = tracing_map_set_percpu(hist_data->map);
+		if (ret)
+			goto free;
+	}
+
 	ret = create_tracing_map_fields(hist_data);
 	if (ret)
 		goto free;
@@ -4750,8 +4783,8 @@ static void hist_trigger_show(struct seq_file *m,
 	track_data_snapshot_print(m, hist_data);
 
 	seq_printf(m, "\nTotals:\n    Hits: %llu\n    Entries: %u\n    Dropped: %llu\n",
-		   (u64)atomic64_read(&hist_data->map->hits),
-		   n_entries, (u64)atomic64_read(&hist_data->map->drops));
+		   tracing_map_read_hits(hist_data->map),
+		   n_entries, tracing_map_read_drops(hist_data->map));
 }
 
 static int hist_show(struct seq_file *m, void *v)
@@ -5189,6 +5222,8 @@ static int event_hist_trigger_print(struct seq_file *m,
 			seq_puts(m, ".descending");
 	}
 	seq_printf(m, ":size=%u", (1 << hist_data->map->map_bits));
+	if (hist_data->attrs->percpu)
+		seq_puts(m, ":percpu");
 	if (hist_data->enable_timestamps)
 		seq_printf(m, ":clock=%s", hist_data->attrs->clock);
 
@@ -5361,7 +5396,8 @@ static bool hist_trigger_match(struct event_trigger_data *data,
 
 	if (hist_data->n_vals != hist_data_test->n_vals ||
 	    hist_data->n_fields != hist_data_test->n_fields ||
-	    hist_data->n_sort_keys != hist_data_test->n_sort_keys)
+	    hist_data->n_sort_keys != hist_data_test->n_sort_keys ||
+	    hist_data->attrs->percpu != hist_data_test->attrs->percpu)
 		return false;
 
 	if (!ignore_filter) {
@@ -591,6 +591,18 @@ __tracing_map_insert(struct tracing_map *map, void *key, bool lookup_only)
 	return NULL;
 }
 
+static inline struct tracing_map *tracing_map_this_cpu(struct tracing_map *map)
+{
+	/*
+	 * Inserting into another CPU's map after migrating is harmless,
+	 * the insertion algorithm copes with concurrent writers.
+	 */
+	if (map->cpu_maps)
+		return map->cpu_maps[raw_smp_processor_id()];
+
+	return map;
+}
+
 /**
  * tracing_map_insert - Insert key and/or retrieve val from a tracing_map
  * @map: The tracing_map to insert into
@@ -612,6 +624,9 @@ __tracing_map_insert(struct tracing_map *map, void *key, bool lookup_only)
  * the 'hits' value is incremented.  Every time an element insertion
  * fails, the 'drops' value is incremented.
  *
+ * For a per-CPU map, the key is inserted into the map of the current
+ * CPU, and hits and drops are accounted there.
+ *
  * This is a lock-free tracing map insertion function implementing a
  * modified form of Cliff Click's basic insertion algorithm.  It
  * requires the table size be a power of two.  To prevent any
@@ -630,7 +645,7 @@ __tracing_map_insert(struct tracing_map *map, void *key, bool lookup_only)
  */
 struct tracing_map_elt *tracing_map_insert(struct tracing_map *map, void *key)
 {
-	return __tracing_map_insert(map, key, false);
+	return __tracing_map_insert(tracing_map_this_cpu(map), key, false);
 }
 
 /**
@@ -647,12 +662,28 @@ struct tracing_map_elt *tracing_map_insert(struct tracing_map *map, void *key)
  * is successfully retrieved, the 'hits' value is incremented.  The
  * 'drops' value is never updated by this function.
  *
+ * For a per-CPU map, only the current CPU's map is searched.
+ *
  * Return: the tracing_map_elt pointer val associated with the key.
  * If the key wasn't found, NULL is returned.
  */
 struct tracing_map_elt *tracing_map_lookup(struct tracing_map *map, void *key)
 {
-	return __tracing_map_insert(map, key, true);
+	return __tracing_map_insert(tracing_map_this_cpu(map), key, true);
+}
+
+static void tracing_map_free_cpu_maps(struct tracing_map *map)
+{
+	int cpu;
+
+	if (!map->cpu_maps)
+		return;
+
+	for_each_possible_cpu(cpu)
+		tracing_map_destroy(map->cpu_maps[cpu]);
+
+	kfree(map->cpu_maps);
+	map->cpu_maps = NULL;
 }
 
 /**
@@ -670,6 +701,7 @@ void tracing_map_destroy(struct tracing_map *map)
 	if (!map)
 		return;
 
+	tracing_map_free_cpu_maps(map);
 	tracing_map_free_elts(map);
 
 	tracing_map_array_free(map->map);
@@ -690,6 +722,13 @@ void tracing_map_destroy(struct tracing_map *map)
 void tracing_map_clear(struct tracing_map *map)
 {
 	unsigned int i;
+	int cpu;
+
+	if (map->cpu_maps) {
+		for_each_possible_cpu(cpu)
+			tracing_map_clear(map->cpu_maps[cpu]);
+		return;
+	}
 
 	atomic_set(&map->next_elt, -1);
 	atomic64_set(&map->hits, 0);
@@ -701,6 +740,46 @@ void tracing_map_clear(struct tracing_map *map)
 		tracing_map_elt_clear(*(TRACING_MAP_ELT(map->elts, i)));
 }
 
+/**
+ * tracing_map_read_hits - Return the number of hits of a tracing_map
+ * @map: The tracing_map
+ *
+ * Return: the number of times an element was inserted or retrieved,
+ * summed over all CPUs for a per-CPU map.
+ */
+u64 tracing_map_read_hits(struct tracing_map *map)
+{
+	u64 hits = atomic64_read(&map->hits);
+	int cpu;
+
+	if (map->cpu_maps) {
+		for_each_possible_cpu(cpu)
+			hits += atomic64_read(&map->cpu_maps[cpu]->hits);
+	}
+
+	return hits;
+}
+
+/**
+ * tracing_map_read_drops - Return the number of drops of a tracing_map
+ * @map: The tracing_map
+ *
+ * Return: the number of failed insertions, summed over all CPUs for a
+ * per-CPU map.
+ */
+u64 tracing_map_read_drops(struct tracing_map *map)
+{
+	u64 drops = atomic64_read(&map->drops);
+	int cpu;
+
+	if (map->cpu_maps) {
+		for_each_possible_cpu(cpu)
+			drops += atomic64_read(&map->cpu_maps[cpu]->drops);
+	}
+
+	return drops;
+}
+
 static void set_sort_key(struct tracing_map *map,
 			 struct tracing_map_sort_key *sort_key)
 {
@@ -799,6 +878,67 @@ struct tracing_map *tracing_map_create(unsigned int map_bits,
 	goto out;
 }
 
+static int tracing_map_init_cpu_maps(struct tracing_map *map)
+{
+	struct tracing_map *cpu_map;
+	int cpu, err;
+
+	map->cpu_maps = kcalloc(nr_cpu_ids, sizeof(*map->cpu_maps),
+				GFP_KERNEL);
+	if (!map->cpu_maps)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		cpu_map = tracing_map_create(map->map_bits, map->key_size,
+					     map->ops, map->private_data);
+		if (IS_ERR(cpu_map)) {
+			err = PTR_ERR(cpu_map);
+			goto free;
+		}
+		map->cpu_maps[cpu] = cpu_map;
+
+		memcpy(cpu_map->fields, map->fields, sizeof(map->fields));
+		cpu_map->n_fields = map->n_fields;
+		memcpy(cpu_map->key_idx, map->key_idx, sizeof(map->key_idx));
+		cpu_map->n_keys = map->n_keys;
+		cpu_map->n_vars = map->n_vars;
+
+		err = tracing_map_init(cpu_map);
+		if (err)
+			goto free;
+	}
+
+	/* All insertions go to the per-CPU maps */
+	tracing_map_array_free(map->map);
+	map->map = NULL;
+
+	return 0;
+ free:
+	tracing_map_free_cpu_maps(map);
+
+	return err;
+}
+
+/**
+ * tracing_map_set_percpu - Make a tracing_map use per-CPU maps
+ * @map: The tracing_map
+ *
+ * Switch the map to per-CPU mode; see tracing_map.h.  Must be called
+ * before tracing_map_init().  The size of the map then applies to each
+ * CPU separately.
+ *
+ * Return: 0 if successful, -EBUSY if the map was already initialized.
+ */
+int tracing_map_set_percpu(struct tracing_map *map)
+{
+	if (map->elts || map->cpu_maps)
+		return -EBUSY;
+
+	map->percpu = true;
+
+	return 0;
+}
+
 /**
  * tracing_map_init - Allocate and clear a map's tracing_map_elts
  * @map: The tracing_map to initialize
@@ -825,6 +965,9 @@ int tracing_map_init(struct tracing_map *map)
 	if (map->n_fields < 2)
 		return -EINVAL; /* need at least 1 key and 1 val */
 
+	if (map->percpu)
+		return tracing_map_init_cpu_maps(map);
+
 	err = tracing_map_alloc_elts(map);
 	if (err)
 		return err;
@@ -1032,6 +1175,108 @@ static void sort_secondary(struct tracing_map *map,
 	}
 }
 
+static int cmp_elts_key(const void *a, const void *b)
+{
+	const struct tracing_map_elt *elt_a = *(const struct tracing_map_elt **)a;
+	const struct tracing_map_elt *elt_b = *(const struct tracing_map_elt **)b;
+
+	return memcmp(elt_a->key, elt_b->key, elt_a->map->key_size);
+}
+
+static void tracing_map_elt_merge(struct tracing_map_elt *to,
+				  struct tracing_map_elt *from)
+{
+	unsigned int i;
+
+	for (i = 0; i < to->map->n_fields; i++)
+		if (to->fields[i].cmp_fn == tracing_map_cmp_atomic64)
+			atomic64_add(atomic64_read(&from->fields[i].sum),
+				     &to->fields[i].sum);
+}
+
+/*
+ * Fold the elements of all per-CPU maps into one sort entry per key.
+ * The merged elements are allocated here and freed along with the
+ * sort entries.
+ */
+static int merge_cpu_maps(struct tracing_map *map,
+			  struct tracing_map_sort_entry ***merged)
+{
+	struct tracing_map_sort_entry **entries;
+	struct tracing_map_elt **elts, *elt;
+	unsigned int i, j, n_elts = 0;
+	int cpu, n_entries = 0, ret;
+
+	elts = vmalloc(array3_size(sizeof(*elts), num_possible_cpus(),
+				   map->max_elts));
+	if (!elts)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		struct tracing_map *cpu_map = map->cpu_maps[cpu];
+
+		for (i = 0; i < cpu_map->map_size; i++) {
+			struct tracing_map_entry *entry;
+
+			entry = TRACING_MAP_ENTRY(cpu_map->map, i);
+			elt = READ_ONCE(entry->val);
+			if (!entry->key || !elt)
+				continue;
+
+			elts[n_elts++] = elt;
+		}
+	}
+
+	if (!n_elts) {
+		vfree(elts);
+		return 0;
+	}
+
+	entries = vmalloc(array_size(sizeof(*entries), n_elts));
+	if (!entries) {
+		vfree(elts);
+		return -ENOMEM;
+	}
+
+	sort(elts, n_elts, sizeof(*elts), cmp_elts_key, NULL);
+
+	for (i = 0; i < n_elts; i = j) {
+		elt = tracing_map_elt_alloc(map);
+		if (IS_ERR(elt)) {
+			ret = PTR_ERR(elt);
+			goto free;
+		}
+
+		memcpy(elt->key, elts[i]->key, map->key_size);
+		if (map->ops && map->ops->elt_copy)
+			map->ops->elt_copy(elt, elts[i]);
+
+		for (j = i; j < n_elts; j++) {
+			if (memcmp(elts[j]->key, elt->key, map->key_size))
+				break;
+			tracing_map_elt_merge(elt, elts[j]);
+		}
+
+		entries[n_entries] = create_sort_entry(elt->key, elt);
+		if (!entries[n_entries]) {
+			tracing_map_elt_free(elt);
+			ret = -ENOMEM;
+			goto free;
+		}
+		entries[n_entries++]->elt_copied = true;
+	}
+
+	vfree(elts);
+	*merged = entries;
+
+	return n_entries;
+ free:
+	vfree(elts);
+	tracing_map_destroy_sort_entries(entries, n_entries);
+
+	return ret;
+}
+
 /**
  * tracing_map_sort_entries - Sort the current set of tracing_map_elts in a map
  * @map: The tracing_map
@@ -1066,6 +1311,13 @@ int tracing_map_sort_entries(struct tracing_map *map,
 	struct tracing_map_sort_entry *sort_entry, **entries;
 	int i, n_entries, ret;
 
+	if (map->cpu_maps) {
+		n_entries = merge_cpu_maps(map, &entries);
+		if (n_entries <= 0)
+			return n_entries;
+		goto sort;
+	}
+
 	entries = vmalloc(array_size(sizeof(sort_entry), map->max_elts));
 	if (!entries)
 		return -ENOMEM;
@@ -1090,7 +1342,7 @@ int tracing_map_sort_entries(struct tracing_map *map,
 		ret = 0;
 		goto free;
 	}
-
+ sort:
 	if (n_entries == 1) {
 		*sort_entries = entries;
 		return 1;
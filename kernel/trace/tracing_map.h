@@ -125,6 +125,16 @@ typedef int (*tracing_map_cmp_fn_t) (void *val_a, void *val_b);
  * user, tracing_map_sort_entry objects contain a number of additional
  * fields which are used for caching and internal purposes and can
  * safely be ignored.
+ *
+ * A map can be switched to per-CPU mode with tracing_map_set_percpu()
+ * before tracing_map_init().  Each possible CPU then gets a private
+ * tracing_map with its own tracing_map_entry array and element pool
+ * of max_elts entries, so that insertions from different CPUs never
+ * write to the same cachelines.  The per-CPU maps are only merged
+ * when tracing_map_sort_entries() is called: elements with the same
+ * key are folded into newly allocated elements whose sums are the
+ * totals over all CPUs.  Since elements are not shared between CPUs,
+ * per-CPU maps are not suitable for clients that use variables.
 */
 
 struct tracing_map_field {
@@ -198,6 +208,8 @@ struct tracing_map {
 	unsigned int			n_vars;
 	atomic64_t			hits;
 	atomic64_t			drops;
+	bool				percpu;
+	struct tracing_map		**cpu_maps;
 };
 
 /**
@@ -229,12 +241,18 @@ struct tracing_map {
  *	be initialized when used i.e. when the element is actually
  *	claimed by tracing_map_insert() in the context of the map
  *	insertion.
+ *
+ * @elt_copy: For per-CPU maps, this callback allows per-element
+ *	client-defined data to be copied from a per-CPU element into
+ *	the merged element handed out by tracing_map_sort_entries().
  */
 struct tracing_map_ops {
 	int			(*elt_alloc)(struct tracing_map_elt *elt);
 	void			(*elt_free)(struct tracing_map_elt *elt);
 	void			(*elt_clear)(struct tracing_map_elt *elt);
 	void			(*elt_init)(struct tracing_map_elt *elt);
+	void			(*elt_copy)(struct tracing_map_elt *to,
+					    struct tracing_map_elt *from);
 };
 
 extern struct tracing_map *
@@ -243,6 +261,7 @@ tracing_map_create(unsigned int map_bits,
 		   const struct tracing_map_ops *ops,
 		   void *private_data);
 extern int tracing_map_init(struct tracing_map *map);
+extern int tracing_map_set_percpu(struct tracing_map *map);
 
 extern int tracing_map_add_sum_field(struct tracing_map *map);
 extern int tracing_map_add_var(struct tracing_map *map);
@@ -252,6 +271,8 @@ extern int tracing_map_add_key_field(struct tracing_map *map,
 
 extern void tracing_map_destroy(struct tracing_map *map);
 extern void tracing_map_clear(struct tracing_map *map);
+extern u64 tracing_map_read_hits(struct tracing_map *map);
+extern u64 tracing_map_read_drops(struct tracing_map *map);
 
 extern struct tracing_map_elt *
 tracing_map_insert(struct tracing_map *map, void *key);
@@ -2,9 +2,91 @@
 
 #include <linux/buildid.h>
 #include <linux/elf.h>
+#include <linux/fs.h>
+#include <linux/hash.h>
 #include <linux/pagemap.h>
 
 #define BUILD_ID 3
+
+/*
+ * Small direct-mapped cache of build ids, indexed by inode. Profilers look
+ * up the same few binaries at a high rate, often from NMI, so entries are
+ * neither allocated nor locked: each one is guarded by a sequence count,
+ * and writers that find it odd simply skip caching. An entry is only used
+ * while the inode's identity and mtime still match.
+ */
+#define BUILD_ID_CACHE_BITS 8
+
+struct build_id_cache_entry {
+	unsigned int seq;
+	const struct inode *inode;
+	unsigned long ino;
+	u32 generation;
+	struct timespec64 mtime;
+	__u32 size;
+	unsigned char build_id[BUILD_ID_SIZE_MAX];
+};
+
+static struct build_id_cache_entry build_id_cache[1 << BUILD_ID_CACHE_BITS];
+
+static struct build_id_cache_entry *build_id_cache_entry(struct inode *inode)
+{
+	return &build_id_cache[hash_ptr(inode, BUILD_ID_CACHE_BITS)];
+}
+
+static bool build_id_cache_match(const struct build_id_cache_entry *e,
+				 struct inode *inode)
+{
+	return e->inode == inode && e->ino == inode->i_ino &&
+	       e->generation == inode->i_generation &&
+	       timespec64_equal(&e->mtime, &inode->i_mtime);
+}
+
+static bool build_id_cache_lookup(struct inode *inode, unsigned char *build_id,
+				  __u32 *size)
+{
+	struct build_id_cache_entry *e = build_id_cache_entry(inode);
+	unsigned int seq;
+	__u32 id_size;
+
+	seq = READ_ONCE(e->seq);
+	if (seq & 1)
+		return false;
+	smp_rmb();
+
+	if (!build_id_cache_match(e, inode))
+		return false;
+	memcpy(build_id, e->build_id, BUILD_ID_SIZE_MAX);
+	id_size = e->size;
+
+	smp_rmb();
+	if (READ_ONCE(e->seq) != seq)
+		return false;
+
+	if (size)
+		*size = id_size;
+	return true;
+}
+
+static void build_id_cache_store(struct inode *inode,
+				 const unsigned char *build_id, __u32 size)
+{
+	struct build_id_cache_entry *e = build_id_cache_entry(inode);
+	unsigned int seq;
+
+	seq = READ_ONCE(e->seq);
+	if (seq & 1 || cmpxchg(&e->seq, seq, seq + 1) != seq)
+		return;
+
+	e->inode = inode;
+	e->ino = inode->i_ino;
+	e->generation = inode->i_generation;
+	e->mtime = inode->i_mtime;
+	e->size = size;
+	memcpy(e->build_id, build_id, BUILD_ID_SIZE_MAX);
+
+	smp_store_release(&e->seq, seq + 2);
+}
 /*
  * Parse build id from the note segment. This logic can be shared between
  * 32-bit and 64-bit system, because Elf32_Nhdr and Elf64_Nhdr are
@@ -113,15 +195,21 @@ static int get_build_id_64(void *page_addr, unsigned char *build_id,
 int build_id_parse(struct vm_area_struct *vma, unsigned char *build_id,
 		   __u32 *size)
 {
+	struct inode *inode;
 	Elf32_Ehdr *ehdr;
 	struct page *page;
 	void *page_addr;
+	__u32 id_size;
 	int ret;
 
 	/* only works for page backed storage  */
 	if (!vma->vm_file)
 		return -EINVAL;
 
+	inode = file_inode(vma->vm_file);
+	if (build_id_cache_lookup(inode, build_id, size))
+		return 0;
+
 	page = find_get_page(vma->vm_file->f_mapping, 0);
 	if (!page)
 		return -EFAULT;	/* page not mapped */
@@ -139,11 +227,17 @@ int build_id_parse(struct vm_area_struct *vma, unsigned char *build_id,
 		goto out;
 
 	if (ehdr->e_ident[EI_CLASS] == ELFCLASS32)
-		ret = get_build_id_32(page_addr, build_id, size);
+		ret = get_build_id_32(page_addr, build_id, &id_size);
 	else if (ehdr->e_ident[EI_CLASS] == ELFCLASS64)
-		ret = get_build_id_64(page_addr, build_id, size);
+		ret = get_build_id_64(page_addr, build_id, &id_size);
 out:
 	kunmap_atomic(page_addr);
 	put_page(page);
+
+	if (!ret) {
+		build_id_cache_store(inode, build_id, id_size);
+		if (size)
+			*size = id_size;
+	}
 	return ret;
 }
@@ -0,0 +1,97 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Kernel module for testing uprobe_register_batch() and
+ * uprobe_unregister_batch().
+ *
+ * The probes at @offsets in the file at @path are registered as one batch
+ * when the module is loaded and unregistered as one batch when it is
+ * removed. Their hits are counted in the @hits parameter, which is used
+ * by tools/testing/selftests/uprobes/uprobe_batch.c.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/atomic.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/namei.h>
+#include <linux/uprobes.h>
+
+#define MAX_PROBES	64
+
+static char *path;
+module_param(path, charp, 0444);
+MODULE_PARM_DESC(path, "file to place the probes in");
+
+static unsigned long offsets[MAX_PROBES];
+static int nr_probes;
+module_param_array(offsets, ulong, &nr_probes, 0444);
+MODULE_PARM_DESC(offsets, "file offsets of the probes");
+
+static atomic_long_t hits = ATOMIC_LONG_INIT(0);
+
+static int hits_get(char *buffer, const struct kernel_param *kp)
+{
+	return sprintf(buffer, "%ld\n", atomic_long_read(&hits));
+}
+
+static const struct kernel_param_ops hits_ops = {
+	.get	= hits_get,
+};
+module_param_cb(hits, &hits_ops, NULL, 0444);
+MODULE_PARM_DESC(hits, "number of hits of all probes");
+
+static struct path probe_path;
+static struct uprobe_consumer consumers[MAX_PROBES];
+static struct uprobe_batch_entry entries[MAX_PROBES];
+
+static int test_uprobe_handler(struct uprobe_consumer *self,
+			       struct pt_regs *regs)
+{
+	atomic_long_inc(&hits);
+	return 0;
+}
+
+static int __init test_uprobe_batch_init(void)
+{
+	int i, ret;
+
+	if (!path || !nr_probes)
+		return -EINVAL;
+
+	ret = kern_path(path, LOOKUP_FOLLOW, &probe_path);
+	if (ret)
+		return ret;
+
+	for (i = 0; i < nr_probes; i++) {
+		consumers[i].handler = test_uprobe_handler;
+		entries[i].offset = offsets[i];
+		entries[i].uc = &consumers[i];
+	}
+
+	ret = uprobe_register_batch(d_real_inode(probe_path.dentry), entries,
+				    nr_probes);
+	if (ret) {
+		pr_err("registering %d probes in %s failed: %d\n", nr_probes,
+		       path, ret);
+		path_put(&probe_path);
+		return ret;
+	}
+
+	pr_info("registered %d probes in %s\n", nr_probes, path);
+	return 0;
+}
+module_init(test_uprobe_batch_init);
+
+static void __exit test_uprobe_batch_exit(void)
+{
+	uprobe_unregister_batch(d_real_inode(probe_path.dentry), entries,
+				nr_probes);
+	path_put(&probe_path);
+	pr_info("unregistered %d probes, %ld hits\n", nr_probes,
+		atomic_long_read(&hits));
+}
+module_exit(test_uprobe_batch_exit);
+
+MODULE_DESCRIPTION("Test module for batched uprobe registration");
+MODULE_LICENSE("GPL");
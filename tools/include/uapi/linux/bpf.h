@@ -895,6 +895,8 @@ enum bpf_map_type {
 	BPF_MAP_TYPE_RINGBUF,
 	BPF_MAP_TYPE_INODE_STORAGE,
 	BPF_MAP_TYPE_TASK_STORAGE,
+	BPF_MAP_TYPE_RHASH,
+	BPF_MAP_TYPE_STACK_TRIE,
 };
 
 /* Note that tracing related programs such as
@@ -979,6 +981,7 @@ enum bpf_attach_type {
 	BPF_SK_LOOKUP,
 	BPF_XDP,
 	BPF_SK_SKB_VERDICT,
+	BPF_TRACE_KPROBE_MULTI,
 	__MAX_BPF_ATTACH_TYPE
 };
 
@@ -992,6 +995,7 @@ enum bpf_link_type {
 	BPF_LINK_TYPE_ITER = 4,
 	BPF_LINK_TYPE_NETNS = 5,
 	BPF_LINK_TYPE_XDP = 6,
+	BPF_LINK_TYPE_KPROBE_MULTI = 7,
 
 	MAX_BPF_LINK_TYPE,
 };
@@ -1190,6 +1194,19 @@ enum {
 
 /* Create a map that is suitable to be an inner map with dynamic max entries */
 	BPF_F_INNER_MAP		= (1U << 12),
+
+/* Instead of maintaining active and inactive lists in the
+ * BPF_MAP_TYPE_LRU_[PERCPU_]HASH map, approximate LRU with a CLOCK
+ * sweep over the elements, driven by the reference bit set on lookup.
+ * Cannot be combined with BPF_F_NO_COMMON_LRU.
+ */
+	BPF_F_LRU_CLOCK		= (1U << 13),
+
+/* Let the kernel batch BPF_MAP_TYPE_RINGBUF consumer wakeups: notify once
+ * the unconsumed data crosses a watermark, or after a short timeout,
+ * instead of whenever the consumer has caught up.
+ */
+	BPF_F_RB_ADAPTIVE_WAKEUP	= (1U << 14),
 };
 
 /* Flags for BPF_PROG_QUERY. */
@@ -1426,6 +1443,12 @@ union bpf_attr {
 				__aligned_u64	iter_info;	/* extra bpf_iter_link_info */
 				__u32		iter_info_len;	/* iter_info length */
 			};
+			struct {
+				__u32		flags;
+				__u32		cnt;	/* number of functions */
+				__aligned_u64	syms;	/* array of function names */
+				__aligned_u64	addrs;	/* or of their addresses */
+			} kprobe_multi;
 		};
 	} link_create;
 
@@ -4089,6 +4112,9 @@ union bpf_attr {
  * 		process has caught up and consumed all available payloads. In case the user-space
  * 		process is still processing a previous payload, then no notification is needed
  * 		as it will process the newly added payload automatically.
+ * 		For ring buffers created with **BPF_F_RB_ADAPTIVE_WAKEUP**, the
+ * 		notification is instead sent once the unconsumed data crosses
+ * 		a watermark, or after a short timeout.
  * 	Return
  * 		0 on success, or a negative error in case of failure.
  *
@@ -4137,6 +4163,9 @@ union bpf_attr {
  *		* **BPF_RB_RING_SIZE**: The size of ring buffer.
  *		* **BPF_RB_CONS_POS**: Consumer position (can wrap around).
  *		* **BPF_RB_PROD_POS**: Producer(s) position (can wrap around).
+ *		* **BPF_RB_DROPPED**: Number of reservations that failed.
+ *		* **BPF_RB_CONTENDED**: Number of reservations that raced
+ *		  with another producer.
  *
  *		Data returned is just a momentary snapshot of actual values
  *		and could be inaccurate, so this facility should be used to
@@ -5041,6 +5070,8 @@ enum {
 	BPF_RB_RING_SIZE = 1,
 	BPF_RB_CONS_POS = 2,
 	BPF_RB_PROD_POS = 3,
+	BPF_RB_DROPPED = 4,
+	BPF_RB_CONTENDED = 5,
 };
 
 /* BPF ring buffer constants */
@@ -5422,6 +5453,8 @@ struct bpf_map_info {
 	__u32 btf_id;
 	__u32 btf_key_type_id;
 	__u32 btf_value_type_id;
+	__u32 :32;	/* alignment pad */
+	__u64 lru_evictions;
 } __attribute__((aligned(8)));
 
 struct bpf_btf_info {
@@ -409,7 +409,8 @@ struct perf_event_attr {
 				inherit_thread :  1, /* children only inherit if cloned with CLONE_THREAD */
 				remove_on_exec :  1, /* event is removed from task on exec */
 				sigtrap        :  1, /* send synchronous SIGTRAP on event */
-				__reserved_1   : 26;
+				compact_callchain :  1, /* dedup callchains, see PERF_RECORD_CALLCHAIN */
+				__reserved_1   : 25;
 
 	union {
 		__u32		wakeup_events;	  /* wakeup every n events */
@@ -1141,6 +1142,24 @@ enum perf_event_type {
 	 */
 	PERF_RECORD_TEXT_POKE			= 20,
 
+	/*
+	 * Defines a callchain for events with attr.compact_callchain set.
+	 * Samples of such events whose callchain matches a recently emitted
+	 * definition carry the callchain { 2, PERF_CONTEXT_CALLCHAIN_ID,
+	 * chain_id } instead of the full list of ips. The definition is
+	 * always written to the buffer before the first sample referring
+	 * to it and carries the sample_id of that sample.
+	 *
+	 * struct {
+	 *	struct perf_event_header	header;
+	 *	u64				chain_id;
+	 *	u64				nr;
+	 *	u64				ips[nr];
+	 *	struct sample_id		sample_id;
+	 * };
+	 */
+	PERF_RECORD_CALLCHAIN			= 21,
+
 	PERF_RECORD_MAX,			/* non-ABI */
 };
 
@@ -1176,6 +1195,8 @@ enum perf_callchain_context {
 	PERF_CONTEXT_GUEST_KERNEL	= (__u64)-2176,
 	PERF_CONTEXT_GUEST_USER		= (__u64)-2560,
 
+	PERF_CONTEXT_CALLCHAIN_ID	= (__u64)-3072,
+
 	PERF_CONTEXT_MAX		= (__u64)-4095,
 };
 
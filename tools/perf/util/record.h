@@ -43,6 +43,7 @@ struct record_opts {
 	bool	      all_user;
 	bool	      kernel_callchains;
 	bool	      user_callchains;
+	bool	      compact_callchains;
 	bool	      tail_synthesize;
 	bool	      overwrite;
 	bool	      ignore_missing_thread;
@@ -3,6 +3,7 @@
 #include <inttypes.h>
 #include <linux/err.h>
 #include <linux/kernel.h>
+#include <linux/string.h>
 #include <linux/zalloc.h>
 #include <api/fs/fs.h>
 
@@ -17,6 +18,7 @@
 #include "debug.h"
 #include "evlist.h"
 #include "evsel.h"
+#include "hashmap.h"
 #include "memswap.h"
 #include "map.h"
 #include "symbol.h"
@@ -290,6 +292,91 @@ static void perf_session__release_decomp_events(struct perf_session *session)
 	} while (1);
 }
 
+/*
+ * Callchains defined by PERF_RECORD_CALLCHAIN, referenced by samples of
+ * events with attr.compact_callchain set.
+ */
+struct callchain_id {
+	u64			id;
+	struct ip_callchain	chain;
+};
+
+static size_t callchain_id__hash(const void *key, void *ctx __maybe_unused)
+{
+	return *(const u64 *)key;
+}
+
+static bool callchain_id__equal(const void *key1, const void *key2,
+				void *ctx __maybe_unused)
+{
+	return *(const u64 *)key1 == *(const u64 *)key2;
+}
+
+static void perf_session__delete_callchain_ids(struct perf_session *session)
+{
+	struct hashmap_entry *cur;
+	size_t bkt;
+
+	if (!session->callchain_ids)
+		return;
+
+	hashmap__for_each_entry(session->callchain_ids, cur, bkt)
+		free(cur->value);
+	hashmap__free(session->callchain_ids);
+	session->callchain_ids = NULL;
+}
+
+/*
+ * Definitions are stored as soon as they are read, before any reordering,
+ * so that they are known by the time the samples using them are delivered.
+ */
+static int perf_session__add_callchain_id(struct perf_session *session,
+					  union perf_event *event)
+{
+	struct callchain_id *def = (void *)(&event->header + 1);
+	struct callchain_id *cid;
+	size_t size;
+
+	if (event->header.size < sizeof(event->header) + sizeof(*def) ||
+	    def->chain.nr > (event->header.size - sizeof(event->header) -
+			     sizeof(*def)) / sizeof(u64))
+		return -EINVAL;
+
+	if (!session->callchain_ids) {
+		session->callchain_ids = hashmap__new(callchain_id__hash,
+						      callchain_id__equal, NULL);
+		if (IS_ERR(session->callchain_ids)) {
+			session->callchain_ids = NULL;
+			return -ENOMEM;
+		}
+	}
+
+	size = sizeof(*def) + def->chain.nr * sizeof(u64);
+	cid = memdup(def, size);
+	if (!cid)
+		return -ENOMEM;
+
+	if (hashmap__add(session->callchain_ids, &cid->id, cid))
+		free(cid);
+
+	return 0;
+}
+
+static void perf_session__resolve_callchain_id(struct perf_session *session,
+					       struct perf_sample *sample)
+{
+	struct callchain_id *cid;
+	u64 id = sample->callchain->ips[1];
+
+	if (!session->callchain_ids ||
+	    !hashmap__find(session->callchain_ids, &id, (void **)&cid)) {
+		session->evlist->stats.nr_unresolved_chains++;
+		return;
+	}
+
+	sample->callchain = &cid->chain;
+}
+
 void perf_session__delete(struct perf_session *session)
 {
 	if (session == NULL)
@@ -299,6 +386,7 @@ void perf_session__delete(struct perf_session *session)
 	perf_session__destroy_kernel_maps(session);
 	perf_session__delete_threads(session);
 	perf_session__release_decomp_events(session);
+	perf_session__delete_callchain_ids(session);
 	perf_env__exit(&session->header.env);
 	machines__exit(&session->machines);
 	if (session->data)
@@ -995,6 +1083,7 @@ static perf_event__swap_op perf_event__swap_ops[] = {
 	[PERF_RECORD_NAMESPACES]	  = perf_event__namespaces_swap,
 	[PERF_RECORD_CGROUP]		  = perf_event__cgroup_swap,
 	[PERF_RECORD_TEXT_POKE]		  = perf_event__text_poke_swap,
+	[PERF_RECORD_CALLCHAIN]		  = perf_event__all64_swap,
 	[PERF_RECORD_HEADER_ATTR]	  = perf_event__hdr_attr_swap,
 	[PERF_RECORD_HEADER_EVENT_TYPE]	  = perf_event__event_type_swap,
 	[PERF_RECORD_HEADER_TRACING_DATA] = perf_event__tracing_data_swap,
@@ -1549,6 +1638,9 @@ static int machines__deliver_event(struct machines *machines,
 		return tool->bpf(tool, event, sample, machine);
 	case PERF_RECORD_TEXT_POKE:
 		return tool->text_poke(tool, event, sample, machine);
+	case PERF_RECORD_CALLCHAIN:
+		/* already stored by perf_session__process_event() */
+		return 0;
 	default:
 		++evlist->stats.nr_unknown_events;
 		return -1;
@@ -1568,6 +1660,10 @@ static int perf_session__deliver_event(struct perf_session *session,
 		return ret;
 	}
 
+	if (sample.callchain && sample.callchain->nr == 2 &&
+	    sample.callchain->ips[0] == PERF_CONTEXT_CALLCHAIN_ID)
+		perf_session__resolve_callchain_id(session, &sample);
+
 	ret = auxtrace__process_event(session, event, &sample, tool);
 	if (ret < 0)
 		return ret;
@@ -1788,6 +1884,12 @@ static s64 perf_session__process_event(struct perf_session *session,
 	if (event->header.type >= PERF_RECORD_USER_TYPE_START)
 		return perf_session__process_user_event(session, event, file_offset);
 
+	if (event->header.type == PERF_RECORD_CALLCHAIN) {
+		ret = perf_session__add_callchain_id(session, event);
+		if (ret)
+			return ret;
+	}
+
 	if (tool->ordered_events) {
 		u64 timestamp = -1ULL;
 
@@ -1912,6 +2014,13 @@ static void perf_session__warn_about_errors(const struct perf_session *session)
 			    stats->nr_events[PERF_RECORD_SAMPLE]);
 	}
 
+	if (stats->nr_unresolved_chains != 0) {
+		ui__warning("%u samples refer to callchains whose definition was not recorded.\n"
+			    "They keep a placeholder callchain holding only the id, this is\n"
+			    "expected for the oldest samples of an overwritten ring buffer.\n",
+			    stats->nr_unresolved_chains);
+	}
+
 	if (stats->nr_unprocessable_samples != 0) {
 		ui__warning("%u unprocessable samples recorded.\n"
 			    "Do you have a KVM guest running and not using 'perf kvm'?\n",
@@ -41,6 +41,7 @@ struct perf_session {
 	struct zstd_data	zstd_data;
 	struct decomp		*decomp;
 	struct decomp		*decomp_last;
+	struct hashmap		*callchain_ids;
 };
 
 struct decomp {
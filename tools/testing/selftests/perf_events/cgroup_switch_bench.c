@@ -0,0 +1,302 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Measure the context switch overhead of counting events per cgroup.
+ *
+ * Two tasks in different cgroups ping-pong a byte over a pair of pipes on
+ * one cpu, so every round trip is two cgroup switches. The round trip time
+ * is reported with no events, with one cgroup event per monitored cgroup
+ * and with one shared event attached to all of them through
+ * PERF_EVENT_IOC_ATTACH_CGROUP.
+ *
+ * Needs cgroup v2 with the perf_event controller mounted at CGROUP_ROOT
+ * and the permission to create cgroups there.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#define CGROUP_ROOT	"/sys/fs/cgroup"
+#define CGROUP_PREFIX	"perf_bench"
+
+static int nr_cgroups = 16;
+static int nr_loops = 100000;
+static int cpu;
+
+static int sys_perf_event_open(struct perf_event_attr *attr, pid_t pid,
+			       int cpu, int group_fd, unsigned long flags)
+{
+	return syscall(__NR_perf_event_open, attr, pid, cpu, group_fd, flags);
+}
+
+static void cgroup_path(char *buf, size_t size, int i)
+{
+	snprintf(buf, size, "%s/%s%d", CGROUP_ROOT, CGROUP_PREFIX, i);
+}
+
+static int cgroup_create(int i, unsigned long long *id)
+{
+	char path[256];
+	struct stat st;
+
+	cgroup_path(path, sizeof(path), i);
+	if (mkdir(path, 0755) && errno != EEXIST)
+		return -1;
+	if (stat(path, &st))
+		return -1;
+
+	/* The cgroup id is the inode number of its cgroupfs directory. */
+	*id = st.st_ino;
+	return 0;
+}
+
+static void cgroup_destroy(int i)
+{
+	char path[256];
+
+	cgroup_path(path, sizeof(path), i);
+	rmdir(path);
+}
+
+static int cgroup_enter(int i)
+{
+	char path[256];
+	int fd, ret;
+
+	cgroup_path(path, sizeof(path), i);
+	strcat(path, "/cgroup.procs");
+	fd = open(path, O_WRONLY);
+	if (fd < 0)
+		return -1;
+	ret = write(fd, "0", 1) == 1 ? 0 : -1;
+	close(fd);
+	return ret;
+}
+
+static void pin_cpu(void)
+{
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (sched_setaffinity(0, sizeof(set), &set)) {
+		perror("sched_setaffinity");
+		exit(1);
+	}
+}
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Returns the average round trip between cgroups 0 and 1, in ns. */
+static double ping_pong(void)
+{
+	int p2c[2], c2p[2];
+	unsigned long long start;
+	pid_t pid;
+	char c = 0;
+	int i;
+
+	if (pipe(p2c) || pipe(c2p)) {
+		perror("pipe");
+		exit(1);
+	}
+
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		exit(1);
+	}
+	if (!pid) {
+		if (cgroup_enter(1))
+			_exit(1);
+		for (i = 0; i < nr_loops; i++) {
+			if (read(p2c[0], &c, 1) != 1 ||
+			    write(c2p[1], &c, 1) != 1)
+				_exit(1);
+		}
+		_exit(0);
+	}
+
+	start = now_ns();
+	for (i = 0; i < nr_loops; i++) {
+		if (write(p2c[1], &c, 1) != 1 ||
+		    read(c2p[0], &c, 1) != 1) {
+			fprintf(stderr, "ping-pong failed\n");
+			exit(1);
+		}
+	}
+	start = now_ns() - start;
+
+	waitpid(pid, NULL, 0);
+	close(p2c[0]);
+	close(p2c[1]);
+	close(c2p[0]);
+	close(c2p[1]);
+
+	return (double)start / nr_loops;
+}
+
+static void event_attr(struct perf_event_attr *attr)
+{
+	memset(attr, 0, sizeof(*attr));
+	attr->size = sizeof(*attr);
+	attr->type = PERF_TYPE_HARDWARE;
+	attr->config = PERF_COUNT_HW_INSTRUCTIONS;
+}
+
+static int bench_cgroup_events(int *fds)
+{
+	struct perf_event_attr attr;
+	char path[256];
+	int i, cgfd;
+
+	event_attr(&attr);
+	for (i = 0; i < nr_cgroups; i++) {
+		cgroup_path(path, sizeof(path), i);
+		cgfd = open(path, O_RDONLY);
+		if (cgfd < 0)
+			return -1;
+		fds[i] = sys_perf_event_open(&attr, cgfd, cpu, -1,
+					     PERF_FLAG_PID_CGROUP);
+		close(cgfd);
+		if (fds[i] < 0)
+			return -1;
+	}
+	return 0;
+}
+
+static int bench_shared_event(int *fd, unsigned long long *ids)
+{
+	struct perf_event_attach_cgroup *attach;
+	struct perf_event_attr attr;
+	int i, ret;
+
+	event_attr(&attr);
+	*fd = sys_perf_event_open(&attr, -1, cpu, -1, 0);
+	if (*fd < 0)
+		return -1;
+
+	attach = calloc(1, sizeof(*attach) + nr_cgroups * sizeof(__u64));
+	if (!attach)
+		return -1;
+	attach->nr = nr_cgroups;
+	for (i = 0; i < nr_cgroups; i++)
+		attach->ids[i] = ids[i];
+
+	ret = ioctl(*fd, PERF_EVENT_IOC_ATTACH_CGROUP, attach);
+	free(attach);
+	return ret;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-n cgroups] [-l loops] [-c cpu]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	struct perf_event_cgroup_read cread;
+	unsigned long long *ids;
+	double base, cgrp, shared;
+	int *fds, fd, i, opt;
+
+	while ((opt = getopt(argc, argv, "n:l:c:")) != -1) {
+		switch (opt) {
+		case 'n':
+			nr_cgroups = atoi(optarg);
+			break;
+		case 'l':
+			nr_loops = atoi(optarg);
+			break;
+		case 'c':
+			cpu = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (nr_cgroups < 2 || nr_loops < 1)
+		usage(argv[0]);
+
+	ids = calloc(nr_cgroups, sizeof(*ids));
+	fds = calloc(nr_cgroups, sizeof(*fds));
+	if (!ids || !fds)
+		return 1;
+
+	for (i = 0; i < nr_cgroups; i++) {
+		if (cgroup_create(i, &ids[i])) {
+			perror("cgroup_create");
+			goto out;
+		}
+	}
+
+	pin_cpu();
+	if (cgroup_enter(0)) {
+		perror("cgroup_enter");
+		goto out;
+	}
+
+	base = ping_pong();
+
+	if (bench_cgroup_events(fds)) {
+		perror("cgroup events");
+		goto out;
+	}
+	cgrp = ping_pong();
+	for (i = 0; i < nr_cgroups; i++)
+		close(fds[i]);
+
+	if (bench_shared_event(&fd, ids)) {
+		perror("shared event");
+		goto out;
+	}
+	shared = ping_pong();
+
+	printf("%d cgroups, %d round trips on cpu %d\n",
+	       nr_cgroups, nr_loops, cpu);
+	printf("  no events:     %10.1f ns/round trip\n", base);
+	printf("  cgroup events: %10.1f ns/round trip (+%.1f)\n",
+	       cgrp, cgrp - base);
+	printf("  shared event:  %10.1f ns/round trip (+%.1f)\n",
+	       shared, shared - base);
+
+	for (i = 0; i < 2; i++) {
+		cread.id = ids[i];
+		if (ioctl(fd, PERF_EVENT_IOC_READ_CGROUP, &cread))
+			continue;
+		printf("  %s%d: %llu instructions in %llu ns\n", CGROUP_PREFIX,
+		       i, (unsigned long long)cread.count,
+		       (unsigned long long)cread.time);
+	}
+	close(fd);
+
+out:
+	/* Move back to the root so that the cgroups can be removed. */
+	fd = open(CGROUP_ROOT "/cgroup.procs", O_WRONLY);
+	if (fd >= 0) {
+		if (write(fd, "0", 1) != 1)
+			perror("cgroup.procs");
+		close(fd);
+	}
+	for (i = 0; i < nr_cgroups; i++)
+		cgroup_destroy(i);
+
+	return 0;
+}
@@ -0,0 +1,211 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Timer slack stress test
+ *
+ * Runs a sleeping thread per CPU (twice as many by default) with a large
+ * timer slack, each one sleeping random intervals with clock_nanosleep().
+ * The sleepers are aligned to shared deadlines by the kernel, so this
+ * verifies that no sleep returns before the requested time nor later than
+ * the requested time plus the slack and a latency allowance.
+ *
+ * The sleepers run twice: once with a 1ns slack, which leaves the kernel
+ * no room to align them, then with the large slack. If /proc/timer_list
+ * is readable, the number of hrtimer interrupts which were saved by
+ * expiring several timers in one interrupt is reported for both runs.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <time.h>
+#include <unistd.h>
+#include "../kselftest.h"
+
+#define NSEC_PER_SEC		1000000000ULL
+#define NSEC_PER_USEC		1000ULL
+
+#define TIMER_SLACK		(200 * NSEC_PER_USEC)
+#define NO_ALIGN_SLACK		1
+#define MIN_SLEEP		(100 * NSEC_PER_USEC)
+#define MAX_SLEEP		(5000 * NSEC_PER_USEC)
+/* Allow for scheduling latency on a loaded machine */
+#define UNREASONABLE_LAT	(40 * 1000 * NSEC_PER_USEC)
+#define TEST_SECONDS		5
+
+static volatile int done;
+
+struct sleeper {
+	pthread_t		thread;
+	unsigned int		seed;
+	unsigned long		loops;
+	unsigned long		early;
+	unsigned long		late;
+	unsigned long long	max_lat;
+};
+
+static unsigned long long timespec_ns(struct timespec *ts)
+{
+	return ts->tv_sec * NSEC_PER_SEC + ts->tv_nsec;
+}
+
+static void *sleeper_fn(void *arg)
+{
+	struct sleeper *s = arg;
+
+	while (!done) {
+		unsigned long long req, start, end, lat;
+		struct timespec ts;
+
+		req = MIN_SLEEP + rand_r(&s->seed) % (MAX_SLEEP - MIN_SLEEP);
+
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		start = timespec_ns(&ts);
+		ts.tv_sec = req / NSEC_PER_SEC;
+		ts.tv_nsec = req % NSEC_PER_SEC;
+		while (clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, &ts) == EINTR)
+			;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		end = timespec_ns(&ts);
+
+		s->loops++;
+		if (end - start < req) {
+			s->early++;
+			continue;
+		}
+		lat = end - start - req;
+		if (lat > s->max_lat)
+			s->max_lat = lat;
+		if (lat > TIMER_SLACK + UNREASONABLE_LAT)
+			s->late++;
+	}
+	return NULL;
+}
+
+/* Sum of the nr_irqs_saved counters of all CPUs, or -1 if unavailable */
+static long long irqs_saved(void)
+{
+	long long sum = -1;
+	char line[256];
+	FILE *f;
+
+	f = fopen("/proc/timer_list", "r");
+	if (!f)
+		return -1;
+	while (fgets(line, sizeof(line), f)) {
+		unsigned long long val;
+
+		if (sscanf(line, " .nr_irqs_saved : %llu", &val) == 1)
+			sum = (sum < 0 ? 0 : sum) + val;
+	}
+	fclose(f);
+	return sum;
+}
+
+struct result {
+	unsigned long		loops;
+	unsigned long		early;
+	unsigned long		late;
+	unsigned long long	max_lat;
+	long long		saved;
+};
+
+/* Run @nr_threads sleepers with @slack for TEST_SECONDS */
+static int run_sleepers(int nr_threads, unsigned long slack,
+			struct result *res)
+{
+	long long saved_start, saved_end;
+	struct sleeper *sleepers;
+	int i, ret = 0;
+
+	memset(res, 0, sizeof(*res));
+
+	/* Inherited by the sleeper threads */
+	if (prctl(PR_SET_TIMERSLACK, slack, 0, 0, 0)) {
+		ksft_print_msg("PR_SET_TIMERSLACK failed: %s\n", strerror(errno));
+		return -1;
+	}
+
+	sleepers = calloc(nr_threads, sizeof(*sleepers));
+	if (!sleepers)
+		return -1;
+
+	done = 0;
+	saved_start = irqs_saved();
+
+	for (i = 0; i < nr_threads; i++) {
+		sleepers[i].seed = i + 1;
+		if (pthread_create(&sleepers[i].thread, NULL, sleeper_fn,
+				   &sleepers[i])) {
+			ksft_print_msg("pthread_create failed\n");
+			done = 1;
+			nr_threads = i;
+			ret = -1;
+			break;
+		}
+	}
+
+	if (!done)
+		sleep(TEST_SECONDS);
+	done = 1;
+
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(sleepers[i].thread, NULL);
+		res->loops += sleepers[i].loops;
+		res->early += sleepers[i].early;
+		res->late += sleepers[i].late;
+		if (sleepers[i].max_lat > res->max_lat)
+			res->max_lat = sleepers[i].max_lat;
+	}
+	free(sleepers);
+
+	saved_end = irqs_saved();
+	res->saved = -1;
+	if (saved_start >= 0 && saved_end >= 0)
+		res->saved = saved_end - saved_start;
+
+	return ret;
+}
+
+static void print_result(const char *name, int nr_threads,
+			 struct result *res)
+{
+	printf("%s: %d sleepers, %lu sleeps, max latency %llu us\n", name,
+	       nr_threads, res->loops, res->max_lat / NSEC_PER_USEC);
+	if (res->saved >= 0)
+		printf("%s: hrtimer interrupts saved: %lld (%lld/s)\n", name,
+		       res->saved, res->saved / TEST_SECONDS);
+}
+
+int main(int argc, char **argv)
+{
+	struct result unaligned, aligned;
+	int nr_threads;
+
+	nr_threads = 2 * sysconf(_SC_NPROCESSORS_ONLN);
+	if (argc > 1)
+		nr_threads = atoi(argv[1]);
+	if (nr_threads <= 0)
+		nr_threads = 1;
+
+	if (run_sleepers(nr_threads, NO_ALIGN_SLACK, &unaligned) ||
+	    run_sleepers(nr_threads, TIMER_SLACK, &aligned))
+		return ksft_exit_fail();
+
+	print_result("unaligned", nr_threads, &unaligned);
+	print_result("aligned", nr_threads, &aligned);
+
+	if (!unaligned.loops || !aligned.loops ||
+	    unaligned.early || aligned.early ||
+	    unaligned.late || aligned.late) {
+		printf("%lu sleeps returned early, %lu too late\n",
+		       unaligned.early + aligned.early,
+		       unaligned.late + aligned.late);
+		printf("[FAILED]\n");
+		return ksft_exit_fail();
+	}
+	printf("[OK]\n");
+	return ksft_exit_pass();
+}
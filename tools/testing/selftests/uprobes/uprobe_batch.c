@@ -0,0 +1,128 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Batched uprobe registration test
+ *
+ * Loads the test_uprobe_batch module with probes on a few functions of
+ * this program, while it is running, so the breakpoints are installed in
+ * its mm by a single batch. Each function is then called a known number
+ * of times and the hits counted by the module are checked. After the
+ * module is removed, the functions are called again: a breakpoint left
+ * behind by the batch unregistration would kill the test with SIGTRAP.
+ */
+#define _GNU_SOURCE
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../kselftest.h"
+
+#define NR_CALLS	1000
+#define HITS_FILE	"/sys/module/test_uprobe_batch/parameters/hits"
+
+static volatile int sink;
+
+static __attribute__((noinline)) void probed_a(int i) { sink += i; }
+static __attribute__((noinline)) void probed_b(int i) { sink ^= i; }
+static __attribute__((noinline)) void probed_c(int i) { sink -= i; }
+
+static void (*const probed[])(int) = { probed_a, probed_b, probed_c };
+#define NR_PROBES	(sizeof(probed) / sizeof(probed[0]))
+
+/* File offset of @addr in the executable mapping it, or -1 */
+static long file_offset(void *addr)
+{
+	unsigned long start, end, off, a = (unsigned long)addr;
+	char line[512];
+	long ret = -1;
+	FILE *f;
+
+	f = fopen("/proc/self/maps", "r");
+	if (!f)
+		return -1;
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "%lx-%lx %*s %lx", &start, &end, &off) != 3)
+			continue;
+		if (a >= start && a < end) {
+			ret = a - start + off;
+			break;
+		}
+	}
+	fclose(f);
+	return ret;
+}
+
+static long read_hits(void)
+{
+	long hits = -1;
+	FILE *f;
+
+	f = fopen(HITS_FILE, "r");
+	if (!f)
+		return -1;
+	if (fscanf(f, "%ld", &hits) != 1)
+		hits = -1;
+	fclose(f);
+	return hits;
+}
+
+static void call_probed(void)
+{
+	unsigned int i, j;
+
+	for (i = 0; i < NR_PROBES; i++)
+		for (j = 0; j < NR_CALLS; j++)
+			probed[i](j);
+}
+
+int main(void)
+{
+	char exe[PATH_MAX], cmd[PATH_MAX + 256];
+	int len, n;
+	unsigned int i;
+	long hits;
+	ssize_t ret;
+
+	if (geteuid())
+		ksft_exit_skip("needs root to load test_uprobe_batch\n");
+
+	ret = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+	if (ret < 0)
+		return ksft_exit_fail();
+	exe[ret] = '\0';
+
+	len = snprintf(cmd, sizeof(cmd),
+		       "modprobe test_uprobe_batch path=%s offsets=", exe);
+	for (i = 0; i < NR_PROBES; i++) {
+		long off = file_offset(probed[i]);
+
+		if (off < 0) {
+			ksft_print_msg("no mapping for probed function %u\n", i);
+			return ksft_exit_fail();
+		}
+		n = snprintf(cmd + len, sizeof(cmd) - len, "%s%ld",
+			     i ? "," : "", off);
+		len += n;
+	}
+
+	if (system(cmd))
+		ksft_exit_skip("test_uprobe_batch module not available\n");
+
+	call_probed();
+	hits = read_hits();
+
+	if (system("modprobe -r test_uprobe_batch"))
+		ksft_print_msg("removing test_uprobe_batch failed\n");
+
+	/* The breakpoints must be gone now */
+	call_probed();
+
+	printf("%u probes, %ld hits\n", (unsigned int)NR_PROBES, hits);
+	if (hits != NR_PROBES * NR_CALLS) {
+		printf("expected %u hits\n", (unsigned int)(NR_PROBES * NR_CALLS));
+		printf("[FAILED]\n");
+		return ksft_exit_fail();
+	}
+	printf("[OK]\n");
+	return ksft_exit_pass();
+}
@@ -0,0 +1,133 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: GPL-2.0
+"""Monitor workqueue statistics
+
+Periodically reads /sys/kernel/debug/workqueue/stats and prints, for each
+workqueue, the counters accumulated during the last interval:
+
+  queued         work items queued
+  started        work items started execution
+  completed      work items completed execution
+  cpu_intensive  work items which hogged a per-cpu pool for longer than
+                 workqueue.cpu_intensive_thresh_us and were taken out of
+                 concurrency management
+  cm_wakeup      workers woken up by concurrency management
+  mayday         maydays sent to the rescuer
+  rescued        work items executed by the rescuer
+
+With --hist, the execution time histograms, and queue-to-start latency
+histograms if the kernel was built with CONFIG_WQ_QUEUE_LATENCY, are
+printed as well.
+"""
+
+import argparse
+import re
+import sys
+import time
+
+DEBUGFS = '/sys/kernel/debug/workqueue'
+
+
+def read_table(name):
+    """Return (columns, {key: [values]}) from a debugfs workqueue file."""
+    cols, rows = [], {}
+    with open(f'{DEBUGFS}/{name}') as f:
+        for line in f:
+            fields = line.split()
+            if not fields:
+                continue
+            if fields[0] == '#':
+                cols = fields[1:]
+                continue
+            # stats lines are "name vals...", histogram lines "name hist vals..."
+            nkeys = 2 if name == 'histograms' else 1
+            key = tuple(fields[:nkeys])
+            rows[key] = [int(v) for v in fields[nkeys:]]
+    return cols, rows
+
+
+def delta(cur, prev):
+    return {k: [c - p for c, p in zip(v, prev.get(k, [0] * len(v)))]
+            for k, v in cur.items()}
+
+
+def print_stats(cols, rows, pattern, show_idle):
+    width = max([len(k[0]) for k in rows] + [len(cols[0])])
+    print(f'{cols[0]:<{width}}' + ''.join(f' {c:>13}' for c in cols[1:]))
+    for key in sorted(rows):
+        vals = rows[key]
+        if pattern and not pattern.search(key[0]):
+            continue
+        if not show_idle and not any(vals):
+            continue
+        print(f'{key[0]:<{width}}' + ''.join(f' {v:>13}' for v in vals))
+
+
+def print_hists(cols, rows, pattern, show_idle):
+    width = max([len(k[0]) for k in rows] + [len(cols[0])])
+    print(f'{cols[0]:<{width}} {cols[1]:<9}' +
+          ''.join(f' {c:>8}' for c in cols[2:]))
+    for key in sorted(rows):
+        vals = rows[key]
+        if pattern and not pattern.search(key[0]):
+            continue
+        if not show_idle and not any(vals):
+            continue
+        print(f'{key[0]:<{width}} {key[1]:<9}' +
+              ''.join(f' {v:>8}' for v in vals))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                        formatter_class=argparse.RawTextHelpFormatter)
+    parser.add_argument('workqueue', metavar='REGEX', nargs='?',
+                        help='only show workqueues matching REGEX')
+    parser.add_argument('-i', '--interval', type=float, default=1,
+                        help='monitoring interval in seconds (default: 1)')
+    parser.add_argument('-c', '--cumulative', action='store_true',
+                        help='show totals since boot instead of deltas')
+    parser.add_argument('-a', '--all', action='store_true',
+                        help='also show workqueues without activity')
+    parser.add_argument('--hist', action='store_true',
+                        help='also show the latency histograms')
+    parser.add_argument('--once', action='store_true',
+                        help='print once and exit')
+    args = parser.parse_args()
+
+    pattern = re.compile(args.workqueue) if args.workqueue else None
+
+    try:
+        prev_stats = read_table('stats')[1]
+        prev_hists = read_table('histograms')[1]
+    except OSError as e:
+        sys.exit(f'{e}\nIs debugfs mounted and are you root?')
+
+    if args.once or args.cumulative:
+        prev_stats, prev_hists = {}, {}
+        if args.once:
+            args.interval = 0
+
+    while True:
+        time.sleep(args.interval)
+
+        cols, stats = read_table('stats')
+        hcols, hists = read_table('histograms')
+
+        print(time.strftime('%H:%M:%S'))
+        print_stats(cols, delta(stats, prev_stats), pattern, args.all)
+        if args.hist:
+            print()
+            print_hists(hcols, delta(hists, prev_hists), pattern, args.all)
+        print()
+
+        if args.once:
+            break
+        if not args.cumulative:
+            prev_stats, prev_hists = stats, hists
+
+
+if __name__ == '__main__':
+    try:
+        main()
+    except KeyboardInterrupt:
+        pass